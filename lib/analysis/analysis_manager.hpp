@@ -0,0 +1,112 @@
+#ifndef __LLPM_ANALYSIS_ANALYSIS_MANAGER_HPP__
+#define __LLPM_ANALYSIS_ANALYSIS_MANAGER_HPP__
+
+#include <util/macros.hpp>
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+
+namespace llpm {
+
+// fwd defs
+class Module;
+
+/**
+ * The set of analyses a pass promises it has kept valid, even though it
+ * changed the module. Analyses are identified by the address of their
+ * static ID member, as in LLVM.
+ */
+class PreservedAnalyses {
+    std::set<const void*> _ids;
+
+public:
+    template<typename A>
+    void preserve() {
+        _ids.insert(&A::ID);
+    }
+
+    bool preserved(const void* id) const {
+        return _ids.count(id) > 0;
+    }
+
+    bool empty() const {
+        return _ids.empty();
+    }
+};
+
+/**
+ * Per-module cache of analysis results. A result is valid for as long
+ * as the module's change counter hasn't moved, unless the pass which
+ * moved it declared that the analysis was preserved.
+ *
+ * An analysis is a class with a 'static char ID', a 'Result' type and
+ * a 'static std::shared_ptr<Result> run(Module*)'.
+ */
+class AnalysisManager {
+    struct Entry {
+        uint64_t age;
+        std::shared_ptr<void> result;
+    };
+
+    const uint64_t* _counter;
+    std::map<const void*, Entry> _results;
+    std::mutex _lock;
+    uint64_t _hits;
+    uint64_t _misses;
+
+public:
+    AnalysisManager(const uint64_t* counter) :
+        _counter(counter),
+        _hits(0),
+        _misses(0)
+    { }
+
+    DEF_GET_NP(hits);
+    DEF_GET_NP(misses);
+
+    template<typename A>
+    std::shared_ptr<typename A::Result> get(Module* mod) {
+        {
+            std::lock_guard<std::mutex> l(_lock);
+            auto f = _results.find(&A::ID);
+            if (f != _results.end() && f->second.age == *_counter) {
+                _hits++;
+                return std::static_pointer_cast<typename A::Result>(
+                            f->second.result);
+            }
+            _misses++;
+        }
+
+        // Don't hold the lock while computing. Analyses may ask for
+        // other analyses.
+        uint64_t age = *_counter;
+        std::shared_ptr<typename A::Result> r = A::run(mod);
+        std::lock_guard<std::mutex> l(_lock);
+        _results[&A::ID] = Entry{age, r};
+        return r;
+    }
+
+    /**
+     * Called after a pass has run. Results which were valid at
+     * 'before' and which the pass preserved become valid again.
+     */
+    void update(uint64_t before, const PreservedAnalyses& pa) {
+        std::lock_guard<std::mutex> l(_lock);
+        for (auto& pr: _results) {
+            if (pr.second.age == before && pa.preserved(pr.first))
+                pr.second.age = *_counter;
+        }
+    }
+
+    void invalidate() {
+        std::lock_guard<std::mutex> l(_lock);
+        _results.clear();
+    }
+};
+
+} // namespace llpm
+
+#endif // __LLPM_ANALYSIS_ANALYSIS_MANAGER_HPP__
@@ -0,0 +1,23 @@
+#include "graph.hpp"
+
+#include <atomic>
+
+namespace llpm {
+
+static std::atomic<uint64_t> TotalVisits(0);
+static thread_local uint64_t ThreadVisits = 0;
+
+void SearchStats::add(uint64_t visits) {
+    TotalVisits += visits;
+    ThreadVisits += visits;
+}
+
+uint64_t SearchStats::total() {
+    return TotalVisits;
+}
+
+uint64_t SearchStats::thread() {
+    return ThreadVisits;
+}
+
+} // namespace llpm
@@ -13,6 +13,8 @@
 #include <llpm/connection.hpp>
 
 #include <vector>
+#include <deque>
+#include <unordered_map>
 
 namespace llpm {
 
@@ -189,11 +191,178 @@ typedef Path<OutputPort, InputPort> SourceSinkPath;
 typedef Path<InputPort, OutputPort> SinkSourcePath;
 typedef Path<Port, Port>            GenericPath;
 
+// Fwd def
+template<typename SrcPort, typename DstPort>
+class SharedPath;
+
+/**
+ * Owns the nodes of SharedPaths. Nodes are hash-consed: extending a
+ * given node with a given edge always returns the same node, so two
+ * paths from the same arena are equal iff their nodes are.
+ */
+template<typename SrcPort, typename DstPort>
+class PathArena {
+public:
+    struct Node {
+        const Node* parent;
+        const SrcPort* src;
+        const DstPort* dst;
+        // Sequence number within the arena. Deterministic, unlike
+        // the node's address.
+        uint64_t id;
+        unsigned length;
+        // One bit per edge hash, OR'd along the path. Lets us skip
+        // the ancestor walk when checking for a repeated edge.
+        uint64_t signature;
+        bool cyclic;
+    };
+
+private:
+    struct Key {
+        const Node* parent;
+        const SrcPort* src;
+        const DstPort* dst;
+
+        bool operator==(const Key& k) const {
+            return parent == k.parent && src == k.src && dst == k.dst;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            size_t h = std::hash<const void*>()(k.parent);
+            h = h * 31 + std::hash<const void*>()(k.src);
+            h = h * 31 + std::hash<const void*>()(k.dst);
+            return h;
+        }
+    };
+
+    // Deque so that node addresses are stable
+    std::deque<Node> _nodes;
+    std::unordered_map<Key, const Node*, KeyHash> _intern;
+
+public:
+    PathArena() { }
+    PathArena(const PathArena&) = delete;
+    PathArena& operator=(const PathArena&) = delete;
+
+    const Node* get(const Node* parent,
+                    const SrcPort* src, const DstPort* dst);
+
+    size_t size() const {
+        return _nodes.size();
+    }
+
+    SharedPath<SrcPort, DstPort> root(const SrcPort* src, const DstPort* dst) {
+        return SharedPath<SrcPort, DstPort>(this, get(NULL, src, dst));
+    }
+};
+
+/**
+ * Drop-in replacement for Path which shares its prefix with the path
+ * it was extended from. push() is O(1) and copies are two pointers.
+ * Paths are only valid as long as their arena (usually the
+ * GraphSearch which created them) is alive.
+ */
+template<typename SrcPort, typename DstPort>
+class SharedPath {
+public:
+    typedef const SrcPort SrcPortTy;
+    typedef const DstPort DstPortTy;
+    typedef PathArena<SrcPort, DstPort> ArenaTy;
+    typedef typename ArenaTy::Node Node;
+
+private:
+    ArenaTy* _arena;
+    const Node* _node;
+
+public:
+    SharedPath() :
+        _arena(NULL),
+        _node(NULL) { }
+
+    SharedPath(ArenaTy* arena, const Node* node) :
+        _arena(arena),
+        _node(node) { }
+
+    SharedPath push(const SrcPort* sp, const DstPort* dp) const {
+        return SharedPath(_arena, _arena->get(_node, sp, dp));
+    }
+
+    std::pair<const SrcPort*, const DstPort*> end() const {
+        return std::make_pair(_node->src, _node->dst);
+    }
+    const DstPort* endPort() const {
+        return _node->dst;
+    }
+
+    /// Last node on the path. Walk 'parent' to get to the start.
+    const Node* node() const {
+        return _node;
+    }
+
+    unsigned length() const {
+        return _node ? _node->length : 0;
+    }
+
+    /// Materialize the path, first edge first
+    std::vector< std::pair<const SrcPort*, const DstPort*> > raw() const;
+
+    bool hasCycle() const {
+        return _node->cyclic;
+    }
+    bool contains(Block* b) const;
+
+    std::vector< std::pair<const SrcPort*, const DstPort*> > extractCycle() const;
+
+    bool operator==(const SharedPath& p) const {
+        return _node == p._node;
+    }
+
+    bool operator<(const SharedPath& p) const {
+        if (_node == NULL || p._node == NULL)
+            return _node == NULL && p._node != NULL;
+        return _node->id < p._node->id;
+    }
+
+    void print() const;
+};
+
+typedef SharedPath<OutputPort, InputPort> SharedSourceSinkPath;
+typedef SharedPath<InputPort, OutputPort> SharedSinkSourcePath;
+
+/**
+ * Creates the initial paths for a GraphSearch. Plain path types are
+ * self-contained; SharedPaths are rooted in the search's arena.
+ */
+template<typename PathTy>
+struct PathContext {
+    PathTy root(typename PathTy::SrcPortTy* src,
+                typename PathTy::DstPortTy* dst) {
+        return PathTy(src, dst);
+    }
+};
+
+template<typename SrcPort, typename DstPort>
+struct PathContext< SharedPath<SrcPort, DstPort> > :
+    public PathArena<SrcPort, DstPort>
+{ };
+
 enum SearchAlgo {
     DFS,
     BFS
 };
 
+/**
+ * Counts the vertices visited by all GraphSearches, both process-wide
+ * and on the calling thread. Searches report once, when they finish.
+ */
+struct SearchStats {
+    static void add(uint64_t visits);
+    static uint64_t total();
+    static uint64_t thread();
+};
+
 template<typename Visitor,
          const SearchAlgo Algo>
 class GraphSearch {
@@ -206,6 +375,7 @@ public:
 protected:
     const ConnectionDB* _conns;
     VisitorTy& _visitor;
+    PathContext<PathTy> _paths;
 
 public:
     GraphSearch(const ConnectionDB* conns, VisitorTy& visitor) :
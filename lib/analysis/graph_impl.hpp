@@ -5,6 +5,7 @@
 
 #include <set>
 #include <deque>
+#include <algorithm>
 
 namespace llpm {
 
@@ -97,6 +98,103 @@ void Path<SrcPort, DstPort>::print() const {
     }
 }
 
+template<typename SrcPort,
+         typename DstPort>
+const typename PathArena<SrcPort, DstPort>::Node*
+PathArena<SrcPort, DstPort>::get(const Node* parent,
+                                 const SrcPort* src, const DstPort* dst) {
+    Key k = {parent, src, dst};
+    auto f = _intern.find(k);
+    if (f != _intern.end())
+        return f->second;
+
+    uint64_t bit = 1ull << ((std::hash<const void*>()(src) ^
+                             std::hash<const void*>()(dst) * 31) % 64);
+    Node n;
+    n.parent = parent;
+    n.src = src;
+    n.dst = dst;
+    n.id = _nodes.size();
+    n.length = parent ? parent->length + 1 : 1;
+    n.signature = parent ? parent->signature | bit : bit;
+    n.cyclic = false;
+    if (parent) {
+        n.cyclic = parent->cyclic;
+        if (!n.cyclic && (parent->signature & bit)) {
+            // Possible repeat. Walk the ancestors to be sure.
+            for (const Node* a = parent; a != NULL; a = a->parent) {
+                if (a->src == src && a->dst == dst) {
+                    n.cyclic = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    _nodes.push_back(n);
+    const Node* np = &_nodes.back();
+    _intern.emplace(k, np);
+    return np;
+}
+
+template<typename SrcPort,
+         typename DstPort>
+std::vector< std::pair<const SrcPort*, const DstPort*> >
+SharedPath<SrcPort, DstPort>::raw() const {
+    std::vector< std::pair<const SrcPort*, const DstPort*> > ret(length());
+    unsigned i = ret.size();
+    for (const Node* n = _node; n != NULL; n = n->parent)
+        ret[--i] = std::make_pair(n->src, n->dst);
+    return ret;
+}
+
+template<typename SrcPort,
+         typename DstPort>
+bool SharedPath<SrcPort, DstPort>::contains(Block* b) const {
+    for (const Node* n = _node; n != NULL; n = n->parent) {
+        if (n->src->owner() == b ||
+            n->dst->owner() == b)
+            return true;
+    }
+    return false;
+}
+
+template<typename SrcPort,
+         typename DstPort>
+std::vector< std::pair<const SrcPort*, const DstPort*> >
+SharedPath<SrcPort, DstPort>::extractCycle() const {
+    std::vector< std::pair<const SrcPort*, const DstPort*> > cycle;
+    if (!hasCycle())
+        return cycle;
+
+    // Find the first node at which the path became cyclic. Its edge is
+    // the crux; the cycle runs from its earlier occurrence to it.
+    const Node* first = _node;
+    while (first->parent != NULL && first->parent->cyclic)
+        first = first->parent;
+
+    for (const Node* n = first; n != NULL; n = n->parent) {
+        cycle.push_back(std::make_pair(n->src, n->dst));
+        if (n != first && n->src == first->src && n->dst == first->dst)
+            break;
+    }
+    cycle.pop_back();
+    std::reverse(cycle.begin(), cycle.end());
+    return cycle;
+}
+
+template<typename SrcPort,
+         typename DstPort>
+void SharedPath<SrcPort, DstPort>::print() const {
+    for (const auto& pp: raw()) {
+        printf("%p owner: %p %s -- %p owner %p %s\n",
+               pp.first, pp.first->owner(),
+               pp.first->owner()->name().c_str(),
+               pp.second, pp.second->owner(),
+               pp.second->owner()->name().c_str());
+    }
+}
+
 template<typename PathTy>
 struct Next {
     PathTy path;
@@ -124,11 +222,12 @@ void GraphSearch<Visitor, Algo>::go(const Container& init) {
         _conns->find(src, dsts);
 
         for (DstPortTy* dst: dsts) {
-            PathTy p(src, dst);
+            PathTy p = _paths.root(src, dst);
             queue.push_back(Next<PathTy>::newPath(p));
         }
     }
 
+    uint64_t visits = 0;
     Terminate terminate = Continue;
     while (terminate == Continue &&
            !queue.empty()) {
@@ -141,6 +240,7 @@ void GraphSearch<Visitor, Algo>::go(const Container& init) {
             t = _visitor.pop(_conns);
         } else {
             t = _visitor.visit(_conns, current.path);
+            visits++;
             if (Algo == DFS) {
                 queue.push_front(Next<PathTy>::newPop());
             }
@@ -183,6 +283,7 @@ void GraphSearch<Visitor, Algo>::go(const Container& init) {
             terminate = TerminateSearch;
         }
     }
+    SearchStats::add(visits);
 }
 
 } // namespace llpm
@@ -5,10 +5,10 @@
 #include <util/misc.hpp>
 #include <libraries/core/interface.hpp>
 #include <libraries/core/logic_intr.hpp>
+#include <libraries/synthesis/pipeline.hpp>
 #include <analysis/graph.hpp>
 #include <analysis/graph_impl.hpp>
 
-#include <boost/range/adaptor/reversed.hpp>
 
 using namespace std;
 
@@ -45,7 +45,7 @@ void FindDominators(const ConnectionDB* conns,
 }
 
 
-typedef Path<InputPort, OutputPort> IOPath;
+typedef SharedPath<InputPort, OutputPort> IOPath;
 struct TokenAnalysisVisitor : public Visitor<IOPath> {
     const Port* source;
     bool foundSource;
@@ -66,12 +66,13 @@ struct TokenAnalysisVisitor : public Visitor<IOPath> {
     // Write some Thorough unit tests!
     void addSource(const IOPath& path) {
         bool requires = false;
-        for (const auto& edge: boost::adaptors::reverse(path.raw())) {
-            if (edge.first == source || edge.second == source) {
-                requiresSource[edge.first] = true;
+        // Walking parents visits the path back to front
+        for (auto edge = path.node(); edge != NULL; edge = edge->parent) {
+            if (edge->src == source || edge->dst == source) {
+                requiresSource[edge->src] = true;
                 requires = true;
             } else {
-                const OutputPort* op = edge.second;
+                const OutputPort* op = edge->dst;
                 auto dr = op->deps();
                 // Assumption: requiresSource[x] defaults to 'false' when key
                 // x is not an entry
@@ -313,10 +314,8 @@ void FindConstants(Module* mod,
     GraphSearch<ConstFindingVisitor, BFS> search(conns, visitor);
     vector<OutputPort*> init;
 
-    set<Block*> blocks;
-    conns->findAllBlocks(blocks);
-    for (Block* b: blocks) {
-        Constant* c = dynamic_cast<Constant*>(b);
+    for (Block* b: conns->blocks()) {
+        Constant* c = b->as<Constant>();
         if (c != NULL) {
             visitor.addBlock(c);
             for (auto op: c->outputs())
@@ -581,5 +580,39 @@ llvm::Constant* FindConstant(const Module* mod, Port* port) {
     return nullptr;
 }
 
+static bool isPipelineReg(Block* b) {
+    return b->is<PipelineRegister>();
+}
+
+char ConstantsAnalysis::ID = 0;
+char CombCycleAnalysis::ID = 0;
+char ConsumersAnalysis::ID = 0;
+
+shared_ptr<ConstantsAnalysis::Result> ConstantsAnalysis::run(Module* mod) {
+    auto r = make_shared<Result>();
+    FindConstants(mod, r->ports, r->blocks);
+    return r;
+}
+
+shared_ptr<CombCycleAnalysis::Result> CombCycleAnalysis::run(Module* mod) {
+    auto r = make_shared<Result>();
+    r->found = FindCycle(mod, &isPipelineReg, r->cycle);
+    return r;
+}
+
+shared_ptr<ConsumersAnalysis::Result> ConsumersAnalysis::run(Module* mod) {
+    return make_shared<Result>(mod);
+}
+
+const set<const InputPort*>&
+ConsumersAnalysis::Result::consumers(OutputPort* op) {
+    auto f = _consumers.find(op);
+    if (f != _consumers.end())
+        return f->second;
+    auto& c = _consumers[op];
+    FindConsumers(_mod, op, c, &isPipelineReg);
+    return c;
+}
+
 } // namespace queries
 } // namespace llpm
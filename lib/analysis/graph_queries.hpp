@@ -3,6 +3,9 @@
 
 #include <llpm/connection.hpp>
 #include <llpm/module.hpp>
+#include <analysis/analysis_manager.hpp>
+
+#include <memory>
 
 namespace llpm {
 namespace queries {
@@ -65,6 +68,58 @@ OutputPort* FindSubfieldDriver(const Module*,
 
 // If a port is driven by a constant, find & return that constant
 llvm::Constant* FindConstant(const Module*, Port*);
+
+/***
+ * Cached versions of the above, for use with a module's
+ * AnalysisManager. Get them with Analyze<>().
+ */
+
+// FindConstants
+struct ConstantsAnalysis {
+    static char ID;
+    struct Result {
+        std::set<const Port*> ports;
+        std::set<Block*> blocks;
+    };
+    static std::shared_ptr<Result> run(Module*);
+};
+
+// FindCycle, ignoring paths broken by pipeline registers
+struct CombCycleAnalysis {
+    static char ID;
+    struct Result {
+        bool found;
+        std::vector< std::pair<const OutputPort*, const InputPort*> > cycle;
+    };
+    static std::shared_ptr<Result> run(Module*);
+};
+
+// FindConsumers, ignoring paths broken by pipeline registers. Each
+// port's consumers are found the first time they are asked for.
+struct ConsumersAnalysis {
+    static char ID;
+    class Result {
+        const Module* _mod;
+        std::map<OutputPort*, std::set<const InputPort*> > _consumers;
+
+    public:
+        Result(const Module* mod) :
+            _mod(mod)
+        { }
+
+        const std::set<const InputPort*>& consumers(OutputPort*);
+    };
+    static std::shared_ptr<Result> run(Module*);
+};
+
+template<typename A>
+std::shared_ptr<typename A::Result> Analyze(Module* mod) {
+    AnalysisManager* am = mod->analyses();
+    if (am == NULL)
+        return A::run(mod);
+    return am->get<A>(mod);
+}
+
 };
 };
 
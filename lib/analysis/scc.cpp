@@ -0,0 +1,193 @@
+#include "scc.hpp"
+
+#include <llpm/block.hpp>
+#include <util/llvm_type.hpp>
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace llpm {
+namespace queries {
+
+PortGraph::PortGraph(const ConnectionDB* conns,
+                     boost::function<bool(Block*)> ignoreBlock) :
+    _generation(0)
+{
+    set<const OutputPort*> deps;
+    for (const Connection& c: *conns) {
+        if (ignoreBlock(c.source()->owner()) ||
+            ignoreBlock(c.sink()->owner()))
+            continue;
+
+        NodeId src = node(c.source());
+        deps.clear();
+        c.sink()->owner()->deps(c.sink(), deps);
+        for (auto dep: deps) {
+            NodeId dst = node(dep);
+            _succ[src].push_back(dst);
+            if (src == dst)
+                _selfLoop[src] = true;
+        }
+    }
+
+    _stamp.resize(size(), 0);
+    _order.resize(size());
+    _low.resize(size());
+    _onStack.resize(size(), false);
+}
+
+PortGraph::NodeId PortGraph::node(const OutputPort* op) {
+    auto f = _index.find(op);
+    if (f != _index.end())
+        return f->second;
+    NodeId n = _ports.size();
+    _ports.push_back(op);
+    _succ.emplace_back();
+    _selfLoop.push_back(false);
+    _removed.push_back(false);
+    _index[op] = n;
+    return n;
+}
+
+void PortGraph::cyclicSCCs(const vector<NodeId>& within,
+                           vector< vector<NodeId> >& sccs) {
+    // Stamps mark the subgraph: 'gen' is in but unvisited, 'gen+1' is
+    // visited. Bumping the generation invalidates all old marks.
+    _generation += 2;
+    const unsigned inSub = _generation;
+    const unsigned visited = _generation + 1;
+    for (auto n: within)
+        if (!_removed[n])
+            _stamp[n] = inSub;
+
+    struct Frame {
+        NodeId n;
+        unsigned pos;
+    };
+    vector<Frame> calls;
+    vector<NodeId> stack;
+    unsigned counter = 0;
+
+    for (auto root: within) {
+        if (_stamp[root] != inSub)
+            continue;
+
+        _stamp[root] = visited;
+        _order[root] = _low[root] = counter++;
+        stack.push_back(root);
+        _onStack[root] = true;
+        calls.push_back(Frame{root, 0});
+
+        while (!calls.empty()) {
+            Frame& f = calls.back();
+            NodeId v = f.n;
+            if (f.pos < _succ[v].size()) {
+                NodeId w = _succ[v][f.pos++];
+                if (_stamp[w] == inSub) {
+                    _stamp[w] = visited;
+                    _order[w] = _low[w] = counter++;
+                    stack.push_back(w);
+                    _onStack[w] = true;
+                    // Invalidates 'f'
+                    calls.push_back(Frame{w, 0});
+                } else if (_stamp[w] == visited && _onStack[w]) {
+                    _low[v] = std::min(_low[v], _order[w]);
+                }
+                continue;
+            }
+
+            if (_low[v] == _order[v]) {
+                vector<NodeId> scc;
+                NodeId w;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    _onStack[w] = false;
+                    scc.push_back(w);
+                } while (w != v);
+                if (scc.size() > 1 || _selfLoop[v])
+                    sccs.push_back(std::move(scc));
+            }
+
+            calls.pop_back();
+            if (!calls.empty()) {
+                NodeId p = calls.back().n;
+                _low[p] = std::min(_low[p], _low[v]);
+            }
+        }
+    }
+}
+
+void PortGraph::cyclicSCCs(vector< vector<NodeId> >& sccs) {
+    vector<NodeId> all(size());
+    for (NodeId n=0; n<size(); n++)
+        all[n] = n;
+    cyclicSCCs(all, sccs);
+}
+
+void FindFeedbackPorts(Module* mod,
+                       boost::function<bool(Block*)> ignoreBlock,
+                       vector<const OutputPort*>& cut) {
+    ConnectionDB* conns = mod->conns();
+    if (conns == NULL)
+        throw InvalidArgument("Cannot analyze opaque module!");
+
+    PortGraph g(conns, ignoreBlock);
+    vector< vector<PortGraph::NodeId> > work;
+    g.cyclicSCCs(work);
+
+    // Minimum weight feedback vertex set is NP-hard, so greedily cut
+    // the vertex which looks like it sits on the most cycles per bit.
+    // Removing a vertex can only split its SCC, so we need only
+    // re-examine that one SCC afterwards.
+    vector<unsigned> inDeg(g.size());
+    vector<unsigned> inScc(g.size(), ~0u);
+    unsigned sccNum = 0;
+    while (!work.empty()) {
+        vector<PortGraph::NodeId> scc = std::move(work.back());
+        work.pop_back();
+
+        sccNum++;
+        for (auto n: scc) {
+            inScc[n] = sccNum;
+            inDeg[n] = 0;
+        }
+        for (auto n: scc)
+            for (auto s: g.succ(n))
+                if (inScc[s] == sccNum)
+                    inDeg[s]++;
+
+        PortGraph::NodeId best = scc.front();
+        float bestScore = -1.0;
+        for (auto n: scc) {
+            float score;
+            if (g.selfLoop(n)) {
+                // Nothing else can break this one
+                score = std::numeric_limits<float>::infinity();
+            } else {
+                unsigned outDeg = 0;
+                for (auto s: g.succ(n))
+                    if (inScc[s] == sccNum)
+                        outDeg++;
+                // Every register carries a valid bit in addition to
+                // its data
+                unsigned cost = bitwidth(g.port(n)->type()) + 1;
+                score = (float)(inDeg[n] * outDeg) / cost;
+            }
+            if (score > bestScore ||
+                (score == bestScore && n < best)) {
+                bestScore = score;
+                best = n;
+            }
+        }
+
+        g.remove(best);
+        cut.push_back(g.port(best));
+        g.cyclicSCCs(scc, work);
+    }
+}
+
+} // namespace queries
+} // namespace llpm
@@ -0,0 +1,96 @@
+#ifndef __LLPM_ANALYSIS_SCC_HPP__
+#define __LLPM_ANALYSIS_SCC_HPP__
+
+#include <llpm/connection.hpp>
+#include <llpm/module.hpp>
+
+#include <boost/function.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+namespace llpm {
+namespace queries {
+
+/**
+ * A snapshot of a module's dataflow graph with output ports as
+ * vertices. There is an edge from A to B when A drives an input which
+ * B depends upon. Connections into or out of ignored blocks are left
+ * out. Vertices can be removed to model cutting all of a port's
+ * connections (e.g. by registering it).
+ */
+class PortGraph {
+public:
+    typedef unsigned NodeId;
+
+private:
+    std::vector<const OutputPort*> _ports;
+    std::unordered_map<const OutputPort*, NodeId> _index;
+    std::vector< std::vector<NodeId> > _succ;
+    std::vector<bool> _selfLoop;
+    std::vector<bool> _removed;
+
+    // Tarjan scratch space, reused across calls
+    std::vector<unsigned> _stamp;
+    std::vector<unsigned> _order;
+    std::vector<unsigned> _low;
+    std::vector<bool> _onStack;
+    unsigned _generation;
+
+    NodeId node(const OutputPort*);
+
+public:
+    PortGraph(const ConnectionDB* conns,
+              boost::function<bool(Block*)> ignoreBlock);
+
+    size_t size() const {
+        return _ports.size();
+    }
+
+    const OutputPort* port(NodeId n) const {
+        return _ports[n];
+    }
+
+    const std::vector<NodeId>& succ(NodeId n) const {
+        return _succ[n];
+    }
+
+    bool selfLoop(NodeId n) const {
+        return _selfLoop[n];
+    }
+
+    bool removed(NodeId n) const {
+        return _removed[n];
+    }
+
+    void remove(NodeId n) {
+        _removed[n] = true;
+    }
+
+    /**
+     * Find the strongly connected components which contain a cycle,
+     * considering only the live vertices in 'within'. Runs in time
+     * linear in the size of that subgraph, so re-splitting a component
+     * after removing a vertex from it does not touch the rest of the
+     * graph.
+     */
+    void cyclicSCCs(const std::vector<NodeId>& within,
+                    std::vector< std::vector<NodeId> >& sccs);
+
+    /// Cyclic SCCs of the whole (live) graph
+    void cyclicSCCs(std::vector< std::vector<NodeId> >& sccs);
+};
+
+/**
+ * Find a set of output ports which, once registered, leave the module
+ * without combinatorial cycles. Tries to keep the total number of
+ * registered bits low. Ports are returned in selection order.
+ */
+void FindFeedbackPorts(Module*,
+                       boost::function<bool(Block*)> ignoreBlock,
+                       std::vector<const OutputPort*>& cut);
+
+} // namespace queries
+} // namespace llpm
+
+#endif // __LLPM_ANALYSIS_SCC_HPP__
@@ -0,0 +1,352 @@
+#include "timing.hpp"
+
+#include <backends/backend.hpp>
+#include <llpm/module.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <deque>
+#include <functional>
+
+using namespace std;
+
+namespace llpm {
+
+const StaticTiming::NodeId StaticTiming::NoNode;
+
+static const Time Never = Time::s(numeric_limits<double>::infinity());
+
+StaticTiming::StaticTiming(const ConnectionDB* conns,
+                           Backend* backend,
+                           Time period) :
+    _conns(conns),
+    _backend(backend),
+    _period(period),
+    _loopBreaks(0),
+    _built(false)
+{ }
+
+StaticTiming::NodeId StaticTiming::node(const Port* p) {
+    auto f = _index.find(p);
+    if (f != _index.end())
+        return f->second;
+    NodeId n = _ports.size();
+    _ports.push_back(p);
+    _fanin.emplace_back();
+    _fanout.emplace_back();
+    _index[p] = n;
+    return n;
+}
+
+void StaticTiming::setStart(const OutputPort* op, Time arrival) {
+    _starts[node(op)] = arrival;
+}
+
+void StaticTiming::setLatency(const OutputPort* op, Time t) {
+    assert(!_built);
+    _fixedLatency[op] = t;
+}
+
+void StaticTiming::connectInput(const InputPort* ip) {
+    NodeId in = node(ip);
+    OutputPort* src = _conns->findSource(ip);
+    if (src == NULL)
+        return;
+    NodeId sn = node(src);
+    Time d = _backend->latency(Connection(src, (InputPort*)ip));
+    _fanin[in].push_back(Arc{sn, d});
+    _fanout[sn].push_back(Arc{in, d});
+}
+
+void StaticTiming::build() {
+    set<const InputPort*> deps;
+    for (Block* b: _conns->blocks()) {
+        for (InputPort* ip: b->inputs())
+            connectInput(ip);
+
+        // Registers are where paths begin and end, as are multi-cycle
+        // blocks since they register their inputs and outputs
+        if (b->is<PipelineRegister>() || _backend->cycles(b) > 0)
+            continue;
+
+        for (OutputPort* op: b->outputs()) {
+            NodeId on = node(op);
+            auto fixed = _fixedLatency.find(op);
+            deps.clear();
+            b->deps(op, deps);
+            for (auto ip: deps) {
+                NodeId in = node(ip);
+                Time d = fixed != _fixedLatency.end() ?
+                            fixed->second : _backend->latency(ip, op);
+                _fanin[on].push_back(Arc{in, d});
+                _fanout[in].push_back(Arc{on, d});
+            }
+        }
+    }
+
+    // The internal sinks of the module's outputs belong to blacklisted
+    // dummy blocks, so blocks() skips them. Paths leaving the module end
+    // there.
+    Module* mod = _conns->module();
+    if (mod != NULL) {
+        for (OutputPort* modOp: mod->outputs()) {
+            InputPort* ip = mod->getSink(modOp);
+            if (ip != NULL)
+                connectInput(ip);
+        }
+    }
+
+    _cut.resize(_ports.size(), false);
+    levelize();
+    _built = true;
+}
+
+void StaticTiming::levelize() {
+    // Kahn's algorithm. Start points don't depend on their fanin.
+    size_t N = _ports.size();
+    vector<unsigned> pending(N);
+    vector<bool> done(N, false);
+    deque<NodeId> ready;
+    for (NodeId n=0; n<N; n++) {
+        pending[n] = _starts.count(n) ? 0 : _fanin[n].size();
+        if (pending[n] == 0)
+            ready.push_back(n);
+    }
+
+    _topo.clear();
+    NodeId nextBreak = 0;
+    while (_topo.size() < N) {
+        if (ready.empty()) {
+            // Everything left is on or downstream of a combinatorial
+            // loop. Arbitrarily start a path on one of the loops' output
+            // ports so that we can carry on.
+            while (done[nextBreak] || pending[nextBreak] == 0 ||
+                   _ports[nextBreak]->asOutput() == NULL)
+                nextBreak++;
+            _starts[nextBreak] = Time();
+            pending[nextBreak] = 0;
+            ready.push_back(nextBreak);
+            _loopBreaks++;
+        }
+
+        NodeId n = ready.front();
+        ready.pop_front();
+        if (done[n])
+            continue;
+        done[n] = true;
+        _topo.push_back(n);
+        for (const Arc& a: _fanout[n]) {
+            if (done[a.node] || pending[a.node] == 0)
+                continue;
+            if (--pending[a.node] == 0)
+                ready.push_back(a.node);
+        }
+    }
+
+    _level.resize(N);
+    for (unsigned i=0; i<N; i++)
+        _level[_topo[i]] = i;
+}
+
+bool StaticTiming::evalArrival(NodeId n) {
+    Time a;
+    NodeId pred = NoNode;
+    auto s = _starts.find(n);
+    if (s != _starts.end()) {
+        a = s->second;
+    } else {
+        for (const Arc& arc: _fanin[n]) {
+            // Past a register, we start over
+            Time base = _cut[arc.node] ? Time() : _arrival[arc.node];
+            Time t = base + arc.delay;
+            if (pred == NoNode || t > a) {
+                a = t;
+                pred = arc.node;
+            }
+        }
+    }
+
+    bool changed = !(a == _arrival[n]) || pred != _critPred[n];
+    _arrival[n] = a;
+    _critPred[n] = pred;
+    return changed;
+}
+
+void StaticTiming::propagateRequired() {
+    for (auto iter = _topo.rbegin(); iter != _topo.rend(); iter++) {
+        NodeId n = *iter;
+        Time r = isEndpoint(n) ? _period : Never;
+        if (!_cut[n]) {
+            for (const Arc& arc: _fanout[n]) {
+                if (_starts.count(arc.node))
+                    continue;
+                Time t = _required[arc.node] - arc.delay;
+                if (t < r)
+                    r = t;
+            }
+        }
+        _required[n] = r;
+    }
+}
+
+void StaticTiming::analyze() {
+    if (!_built)
+        build();
+
+    size_t N = _ports.size();
+    _arrival.assign(N, Time());
+    _required.assign(N, Never);
+    _critPred.assign(N, NoNode);
+    for (auto n: _topo)
+        evalArrival(n);
+
+    _endpoints.clear();
+    _listed.assign(N, false);
+    _endHeap = priority_queue<HeapEntry>();
+    for (NodeId n=0; n<N; n++) {
+        if (isEndpoint(n)) {
+            _endpoints.push_back(n);
+            _listed[n] = true;
+            _endHeap.push(make_pair(_arrival[n].sec(), n));
+        }
+    }
+
+    propagateRequired();
+}
+
+void StaticTiming::cut(const OutputPort* op) {
+    assert(_built);
+    NodeId n = find(op);
+    assert(n != NoNode);
+    if (_cut[n])
+        return;
+    _cut[n] = true;
+    // Sinks are already endpoints
+    if (!_listed[n]) {
+        _endpoints.push_back(n);
+        _listed[n] = true;
+        _endHeap.push(make_pair(_arrival[n].sec(), n));
+    }
+
+    // Re-evaluate the fanout cone in topological order
+    typedef pair<unsigned, NodeId> Item;
+    priority_queue<Item, vector<Item>, greater<Item> > work;
+    set<NodeId> queued;
+    for (const Arc& arc: _fanout[n])
+        if (queued.insert(arc.node).second)
+            work.push(make_pair(_level[arc.node], arc.node));
+
+    while (!work.empty()) {
+        NodeId m = work.top().second;
+        work.pop();
+        queued.erase(m);
+        if (!evalArrival(m) || _cut[m])
+            continue;
+        for (const Arc& arc: _fanout[m])
+            if (queued.insert(arc.node).second)
+                work.push(make_pair(_level[arc.node], arc.node));
+    }
+}
+
+Time StaticTiming::arrival(const Port* p) const {
+    NodeId n = find(p);
+    if (n == NoNode)
+        throw InvalidArgument("Port is not part of this timing graph");
+    return _arrival[n];
+}
+
+Time StaticTiming::required(const Port* p) const {
+    NodeId n = find(p);
+    if (n == NoNode)
+        throw InvalidArgument("Port is not part of this timing graph");
+    return _required[n];
+}
+
+Time StaticTiming::slack(const Port* p) const {
+    return required(p) - arrival(p);
+}
+
+Time StaticTiming::wns() const {
+    Time worst;
+    for (auto n: _endpoints) {
+        Time s = _required[n] - _arrival[n];
+        if (s < worst)
+            worst = s;
+    }
+    return worst;
+}
+
+Time StaticTiming::tns() const {
+    Time total;
+    for (auto n: _endpoints) {
+        Time s = _required[n] - _arrival[n];
+        if (s < Time())
+            total += s;
+    }
+    return total;
+}
+
+const Port* StaticTiming::worstViolation(const std::set<const Port*>& ignore) {
+    while (!_endHeap.empty()) {
+        HeapEntry top = _endHeap.top();
+        NodeId n = top.second;
+        double current = _arrival[n].sec();
+        if (current != top.first) {
+            // Stale entry. Arrival times only ever decrease, so the
+            // real value belongs somewhere further down.
+            _endHeap.pop();
+            _endHeap.push(make_pair(current, n));
+            continue;
+        }
+        if (current <= _period.sec())
+            return NULL;
+        if (ignore.count(_ports[n])) {
+            _endHeap.pop();
+            continue;
+        }
+        return _ports[n];
+    }
+    return NULL;
+}
+
+void StaticTiming::path(NodeId n, TimingPath& path) const {
+    path.clear();
+    while (n != NoNode) {
+        path.push_back(PathPoint{_ports[n], _arrival[n]});
+        NodeId pred = _critPred[n];
+        if (pred != NoNode && _cut[pred]) {
+            // The path really starts at the register after 'pred'
+            path.push_back(PathPoint{_ports[pred], Time()});
+            break;
+        }
+        n = pred;
+    }
+    std::reverse(path.begin(), path.end());
+}
+
+void StaticTiming::criticalPath(const Port* endpoint, TimingPath& p) const {
+    NodeId n = find(endpoint);
+    if (n == NoNode)
+        throw InvalidArgument("Port is not part of this timing graph");
+    path(n, p);
+}
+
+void StaticTiming::worstPaths(unsigned k, std::vector<TimingPath>& paths) const {
+    vector<NodeId> eps = _endpoints;
+    std::sort(eps.begin(), eps.end(), [this](NodeId a, NodeId b) {
+        Time sa = _required[a] - _arrival[a];
+        Time sb = _required[b] - _arrival[b];
+        if (sa == sb)
+            return a < b;
+        return sa < sb;
+    });
+    eps.erase(std::unique(eps.begin(), eps.end()), eps.end());
+
+    for (unsigned i=0; i<k && i<eps.size(); i++) {
+        paths.emplace_back();
+        path(eps[i], paths.back());
+    }
+}
+
+} // namespace llpm
@@ -0,0 +1,149 @@
+#ifndef __LLPM_ANALYSIS_TIMING_HPP__
+#define __LLPM_ANALYSIS_TIMING_HPP__
+
+#include <llpm/connection.hpp>
+#include <util/time.hpp>
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+
+namespace llpm {
+
+// Fwd defs. Time waits for no one.
+class Backend;
+
+/**
+ * Static timing analysis over a module's (register-cut) dataflow
+ * graph. Every port is a timing node: connections contribute routing
+ * delay and blocks contribute input-to-output delay, both taken from
+ * the Backend. Paths start at pipeline register outputs (and those
+ * of other blocks which take clock cycles), at ports with no
+ * dependencies and at explicitly seeded ports. They end at inputs
+ * which nothing depends upon, including pipeline register inputs and
+ * the internal sinks of the module's outputs.
+ *
+ * Arrival times are propagated in topological order, so each node is
+ * evaluated exactly once per analysis. cut() models inserting a
+ * register after an output port and updates arrival times
+ * incrementally, only within that port's fanout cone.
+ */
+class StaticTiming {
+public:
+    typedef unsigned NodeId;
+    static const NodeId NoNode = ~0u;
+
+    struct PathPoint {
+        const Port* port;
+        Time arrival;
+    };
+    typedef std::vector<PathPoint> TimingPath;
+
+private:
+    struct Arc {
+        NodeId node;
+        Time delay;
+    };
+
+    const ConnectionDB* _conns;
+    Backend* _backend;
+    Time _period;
+
+    std::vector<const Port*> _ports;
+    std::unordered_map<const Port*, NodeId> _index;
+    std::vector< std::vector<Arc> > _fanin;
+    std::vector< std::vector<Arc> > _fanout;
+
+    // Ports with a fixed arrival time (path start points)
+    std::unordered_map<NodeId, Time> _starts;
+    // Fixed input-to-output latencies, e.g. for submodules
+    std::unordered_map<const OutputPort*, Time> _fixedLatency;
+    // Output ports with a (virtual) register after them
+    std::vector<bool> _cut;
+
+    std::vector<NodeId> _topo;
+    std::vector<unsigned> _level;
+    std::vector<Time> _arrival;
+    std::vector<Time> _required;
+    std::vector<NodeId> _critPred;
+    std::vector<NodeId> _endpoints;
+    // Is the node already in _endpoints?
+    std::vector<bool> _listed;
+    unsigned _loopBreaks;
+    bool _built;
+
+    // Lazily updated max-heap of endpoint arrivals
+    typedef std::pair<double, NodeId> HeapEntry;
+    std::priority_queue<HeapEntry> _endHeap;
+
+    NodeId node(const Port*);
+    void connectInput(const InputPort*);
+    void build();
+    void levelize();
+    bool evalArrival(NodeId);
+    void propagateRequired();
+    void path(NodeId endpoint, TimingPath& path) const;
+
+    NodeId find(const Port* p) const {
+        auto f = _index.find(p);
+        if (f == _index.end())
+            return NoNode;
+        return f->second;
+    }
+
+    bool isEndpoint(NodeId n) const {
+        return _fanout[n].size() == 0 || _cut[n];
+    }
+
+public:
+    StaticTiming(const ConnectionDB* conns, Backend* backend, Time period);
+
+    DEF_GET_NP(period);
+
+    /// Paths through this port start at 'arrival'
+    void setStart(const OutputPort*, Time arrival);
+    /// Every input-to-output path through this port takes 't'
+    void setLatency(const OutputPort*, Time t);
+
+    /// (Re)compute all arrival and required times
+    void analyze();
+
+    /**
+     * Pretend that there's a register after this port, and update
+     * the arrival times downstream of it. Required times (and thus
+     * slack) are stale until the next analyze().
+     */
+    void cut(const OutputPort*);
+    bool isCut(const OutputPort* op) const {
+        NodeId n = find(op);
+        return n != NoNode && _cut[n];
+    }
+
+    Time arrival(const Port*) const;
+    Time required(const Port*) const;
+    Time slack(const Port*) const;
+
+    /// Worst negative slack over all endpoints (zero if timing is met)
+    Time wns() const;
+    /// Total negative slack over all endpoints
+    Time tns() const;
+    unsigned loopBreaks() const {
+        return _loopBreaks;
+    }
+
+    /**
+     * The endpoint with the latest arrival time which is later than
+     * the period, or NULL if timing is met. Skips ports in 'ignore'.
+     */
+    const Port* worstViolation(const std::set<const Port*>& ignore);
+
+    /// The critical path ending at this port, start point first
+    void criticalPath(const Port* endpoint, TimingPath& path) const;
+
+    /// Critical paths to the k endpoints with the least slack
+    void worstPaths(unsigned k, std::vector<TimingPath>& paths) const;
+};
+
+} // namespace llpm
+
+#endif // __LLPM_ANALYSIS_TIMING_HPP__
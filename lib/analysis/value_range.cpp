@@ -0,0 +1,654 @@
+#include "value_range.hpp"
+
+#include <llpm/module.hpp>
+#include <libraries/core/std_library.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+#include <util/llvm_type.hpp>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+
+#include <algorithm>
+#include <deque>
+#include <set>
+
+using namespace std;
+
+namespace llpm {
+
+// Updates a port may take before its range is widened
+static const unsigned WidenAfter = 3;
+// Plain sweeps to win back precision lost by widening
+static const unsigned NarrowSweeps = 3;
+
+static uint64_t MaxValue(unsigned width) {
+    if (width >= 64)
+        return ~(uint64_t)0;
+    return ((uint64_t)1 << width) - 1;
+}
+
+// Bits needed to hold x
+static unsigned BitsOf(uint64_t x) {
+    unsigned b = 0;
+    while (b < 64 && (x >> b) != 0)
+        b++;
+    return b;
+}
+
+static unsigned TrackedWidth(llvm::Type* t) {
+    if (!t->isIntegerTy())
+        return 0;
+    unsigned w = t->getIntegerBitWidth();
+    return w <= 64 ? w : 0;
+}
+
+ValueRange ValueRange::Interval(unsigned width, uint64_t lo, uint64_t hi,
+                                const OutputPort* origin) {
+    ValueRange v;
+    v.width = width;
+    v.lo = lo;
+    v.hi = hi;
+    v.origin = origin;
+    v.empty = lo > hi;
+    return v;
+}
+
+ValueRange ValueRange::Full(llvm::Type* t, const OutputPort* origin) {
+    ValueRange v;
+    v.origin = origin;
+    v.width = TrackedWidth(t);
+    v.hi = MaxValue(v.width);
+    if (t->isStructTy()) {
+        for (unsigned i=0; i<t->getStructNumElements(); i++)
+            v.fields.push_back(Full(t->getStructElementType(i), nullptr));
+    }
+    return v;
+}
+
+// No tokens at all, in any field
+static void MarkEmpty(ValueRange& v) {
+    v.empty = true;
+    for (auto& f: v.fields)
+        MarkEmpty(f);
+}
+
+ValueRange ValueRange::Empty(llvm::Type* t) {
+    ValueRange v = Full(t, nullptr);
+    MarkEmpty(v);
+    return v;
+}
+
+ValueRange ValueRange::Of(llvm::Constant* c, const OutputPort* origin) {
+    llvm::Type* t = c->getType();
+    auto ci = llvm::dyn_cast<llvm::ConstantInt>(c);
+    if (ci != nullptr && TrackedWidth(t) > 0) {
+        uint64_t x = ci->getZExtValue();
+        return Interval(TrackedWidth(t), x, x, origin);
+    }
+
+    ValueRange v = Full(t, origin);
+    if (t->isStructTy() && !llvm::isa<llvm::UndefValue>(c)) {
+        for (unsigned i=0; i<v.fields.size(); i++) {
+            auto e = c->getAggregateElement(i);
+            if (e != nullptr)
+                v.fields[i] = Of(e, nullptr);
+        }
+    }
+    return v;
+}
+
+bool ValueRange::full() const {
+    if (!fields.empty()) {
+        for (const auto& f: fields)
+            if (!f.full())
+                return false;
+        return true;
+    }
+    return !tracked() || (!empty && lo == 0 && hi == MaxValue(width));
+}
+
+unsigned ValueRange::bits() const {
+    return BitsOf(hi);
+}
+
+bool ValueRange::narrowable() const {
+    for (const auto& f: fields)
+        if (f.narrowable())
+            return true;
+    return tracked() && !empty && max(bits(), 1u) < width;
+}
+
+void ValueRange::unite(const ValueRange& v) {
+    if (origin != v.origin)
+        origin = nullptr;
+    if (fields.size() == v.fields.size()) {
+        for (unsigned i=0; i<fields.size(); i++)
+            fields[i].unite(v.fields[i]);
+    }
+    if (v.empty)
+        return;
+    if (empty) {
+        lo = v.lo;
+        hi = v.hi;
+        empty = false;
+        return;
+    }
+    lo = min(lo, v.lo);
+    hi = max(hi, v.hi);
+}
+
+void ValueRange::intersect(const ValueRange& v) {
+    if (fields.size() == v.fields.size()) {
+        for (unsigned i=0; i<fields.size(); i++)
+            fields[i].intersect(v.fields[i]);
+    }
+    if (empty || v.empty) {
+        empty = true;
+        return;
+    }
+    if (!tracked() || !v.tracked())
+        return;
+    lo = max(lo, v.lo);
+    hi = min(hi, v.hi);
+    if (lo > hi)
+        empty = true;
+}
+
+void ValueRange::widen(const ValueRange& prev,
+                       const set<uint64_t>& thresholds) {
+    if (fields.size() == prev.fields.size()) {
+        for (unsigned i=0; i<fields.size(); i++)
+            fields[i].widen(prev.fields[i], thresholds);
+    }
+    if (!tracked() || empty)
+        return;
+    bool grewDown = prev.empty || lo < prev.lo;
+    bool grewUp = prev.empty || hi > prev.hi;
+    if (grewUp) {
+        auto t = thresholds.lower_bound(hi);
+        hi = t != thresholds.end() && *t <= MaxValue(width) ?
+                *t : MaxValue(width);
+    }
+    if (grewDown) {
+        auto t = thresholds.upper_bound(lo);
+        lo = t != thresholds.begin() ? *--t : 0;
+    }
+}
+
+bool ValueRange::operator==(const ValueRange& v) const {
+    if (width != v.width || empty != v.empty || origin != v.origin ||
+        fields != v.fields)
+        return false;
+    return empty || (lo == v.lo && hi == v.hi);
+}
+
+ValueRange RangeAnalysis::Result::range(const OutputPort* op) const {
+    auto f = _ranges.find(op);
+    if (f == _ranges.end())
+        return ValueRange::Full(op->type(), op);
+    return f->second;
+}
+
+char RangeAnalysis::ID = 0;
+
+class RangeSolver {
+    ConnectionDB* _conns;
+    RangeAnalysis::Result& _r;
+    const map<const OutputPort*, ValueRange>& _seeds;
+    set<Block*> _blocks;
+    map<const OutputPort*, unsigned> _rounds;
+    // Where widening stops
+    set<uint64_t> _thresholds;
+
+    void findThresholds();
+
+    ValueRange input(const InputPort* ip) const;
+    ValueRange guard(ValueRange data, const ValueRange& idx,
+                     unsigned k) const;
+    void eval(Block* b, vector<ValueRange>& outs) const;
+    bool update(const OutputPort* op, ValueRange v);
+
+public:
+    RangeSolver(ConnectionDB* conns, RangeAnalysis::Result& r,
+                const map<const OutputPort*, ValueRange>& seeds) :
+        _conns(conns),
+        _r(r),
+        _seeds(seeds)
+    { }
+
+    void solve();
+};
+
+ValueRange RangeSolver::input(const InputPort* ip) const {
+    OutputPort* src = _conns->findSource(ip);
+    if (src == nullptr)
+        return ValueRange::Full(ip->type(), nullptr);
+    auto f = _r._ranges.find(src);
+    if (f != _r._ranges.end())
+        return f->second;
+    if (_blocks.count(src->owner()) == 0) {
+        // Module I/O
+        auto s = _seeds.find(src);
+        if (s != _seeds.end())
+            return s->second;
+        return ValueRange::Full(src->type(), src);
+    }
+    // Not computed yet
+    return ValueRange::Empty(src->type());
+}
+
+// Apply 'c' to every field of 'v' holding a copy of the same value
+static void Restrict(ValueRange& v, const ValueRange& c) {
+    for (auto& f: v.fields)
+        Restrict(f, c);
+    if (v.tracked() && v.origin != nullptr && v.origin == c.origin)
+        v.intersect(c);
+}
+
+// Flipping the sign bit maps signed order onto unsigned order. A range
+// holding both negative and non-negative values becomes two pieces, so
+// it maps to the whole range. Mapping twice gives back the original,
+// or something wider.
+static ValueRange SignFlipped(const ValueRange& v) {
+    if (!v.tracked() || v.empty)
+        return v;
+    uint64_t sign = (uint64_t)1 << (v.width - 1);
+    if ((v.lo & sign) != (v.hi & sign))
+        return ValueRange::Interval(v.width, 0, MaxValue(v.width), v.origin);
+    return ValueRange::Interval(v.width, v.lo ^ sign, v.hi ^ sign, v.origin);
+}
+
+// Take 'c' out of v if it's one of v's ends, 'c' being a single value
+static void Exclude(ValueRange& v, const ValueRange& c) {
+    if (c.empty || c.lo != c.hi || v.empty)
+        return;
+    if (v.lo == c.lo && v.hi == c.lo)
+        v.empty = true;
+    else if (v.lo == c.lo)
+        v.lo++;
+    else if (v.hi == c.lo)
+        v.hi--;
+}
+
+// Narrow a and b to the values for which "a op b" is 'taken'
+static bool Constrain(IntCompare::Cmp op, bool isSigned, bool taken,
+                      ValueRange& a, ValueRange& b) {
+    if (!a.tracked() || !b.tracked() || a.empty || b.empty)
+        return false;
+
+    if (op == IntCompare::EQ || op == IntCompare::NEQ) {
+        if (taken == (op == IntCompare::EQ)) {
+            a.intersect(b);
+            b.intersect(a);
+        } else {
+            Exclude(a, b);
+            Exclude(b, a);
+        }
+        return true;
+    }
+
+    if (isSigned) {
+        ValueRange sa = SignFlipped(a);
+        ValueRange sb = SignFlipped(b);
+        if (!Constrain(op, false, taken, sa, sb))
+            return false;
+        a.intersect(SignFlipped(sa));
+        b.intersect(SignFlipped(sb));
+        return true;
+    }
+
+    auto atLeast = [](ValueRange& v, uint64_t lo) {
+        v.intersect(ValueRange::Interval(v.width, lo, v.hi, v.origin));
+    };
+    auto atMost = [](ValueRange& v, uint64_t hi) {
+        v.intersect(ValueRange::Interval(v.width, v.lo, hi, v.origin));
+    };
+    // a > b, or a >= b when 'strict' is false
+    auto greater = [&](ValueRange& a, ValueRange& b, bool strict) {
+        unsigned s = strict ? 1 : 0;
+        if (b.lo + s < b.lo || a.hi < s) {
+            a.empty = b.empty = true;
+            return;
+        }
+        uint64_t bLo = b.lo, aHi = a.hi;
+        atLeast(a, bLo + s);
+        atMost(b, aHi - s);
+    };
+
+    switch (op) {
+    case IntCompare::GT:
+        if (taken)
+            greater(a, b, true);
+        else
+            greater(b, a, false);
+        return true;
+    case IntCompare::GTE:
+        if (taken)
+            greater(a, b, false);
+        else
+            greater(b, a, true);
+        return true;
+    default:
+        return false;
+    }
+}
+
+ValueRange RangeSolver::guard(ValueRange data, const ValueRange& idx,
+                              unsigned k) const {
+    if (idx.tracked() && !idx.empty && (k < idx.lo || k > idx.hi)) {
+        // Nothing is ever routed this way
+        MarkEmpty(data);
+        return data;
+    }
+
+    const OutputPort* cond = idx.origin;
+    if (cond == nullptr || !cond->owner()->is<IntCompare>())
+        return data;
+    IntCompare* ic = cond->owner()->as<IntCompare>();
+    ValueRange args = input(ic->din());
+    if (args.fields.size() != 2)
+        return data;
+    ValueRange a = args.fields[0];
+    ValueRange b = args.fields[1];
+    if (Constrain(ic->op(), ic->isSigned(), k == 1, a, b)) {
+        Restrict(data, a);
+        Restrict(data, b);
+    }
+    return data;
+}
+
+// Blocks whose output is their input, unmodified
+static const InputPort* PassThrough(Block* b) {
+    if (b->is<Identity>())
+        return b->as<Identity>()->din();
+    if (b->is<PipelineRegister>())
+        return b->as<PipelineRegister>()->din();
+    if (b->is<Latch>())
+        return b->as<Latch>()->din();
+    if (b->is<Wait>())
+        return b->as<Wait>()->din();
+    return nullptr;
+}
+
+// Ranges from LLVM !range metadata on the instruction 'op' computes.
+// Only the block's own instruction counts: an ancestor's metadata
+// describes a value this block may have been rewritten away from.
+static void RangeMetadata(Block* b, const OutputPort* op, ValueRange& v) {
+    const llvm::MDNode* md = b->history().range();
+    if (md == nullptr || md->getNumOperands() < 2 || !v.tracked())
+        return;
+    // Describes some other output of the block
+    if (llvm::mdconst::extract<llvm::ConstantInt>(md->getOperand(0))
+            ->getType() != op->type())
+        return;
+
+    ValueRange r = ValueRange::Empty(op->type());
+    for (unsigned i=0; i+1<md->getNumOperands(); i+=2) {
+        auto lo = llvm::mdconst::extract<llvm::ConstantInt>(
+                    md->getOperand(i))->getZExtValue();
+        auto hi = llvm::mdconst::extract<llvm::ConstantInt>(
+                    md->getOperand(i+1))->getZExtValue();
+        if (lo >= hi)
+            // Wraps around
+            return;
+        r.unite(ValueRange::Interval(v.width, lo, hi - 1, v.origin));
+    }
+    v.intersect(r);
+}
+
+void RangeSolver::eval(Block* b, vector<ValueRange>& outs) const {
+    outs.clear();
+    for (auto op: b->outputs())
+        outs.push_back(ValueRange::Full(op->type(), op));
+    if (outs.empty())
+        return;
+    ValueRange& out = outs[0];
+    const OutputPort* op0 = b->outputs()[0];
+    unsigned w = out.width;
+
+    if (const InputPort* din = PassThrough(b)) {
+        out = input(din);
+    } else if (b->is<Constant>()) {
+        auto c = b->as<Constant>();
+        if (c->value() != nullptr)
+            out = ValueRange::Of(c->value(), op0);
+    } else if (b->is<Join>()) {
+        auto j = b->as<Join>();
+        for (unsigned i=0; i<j->din_size(); i++)
+            out.fields[i] = input(j->din(i));
+    } else if (b->is<Split>()) {
+        auto s = b->as<Split>();
+        ValueRange in = input(s->din());
+        if (in.fields.size() == outs.size())
+            outs.swap(in.fields);
+    } else if (b->is<Extract>()) {
+        auto e = b->as<Extract>();
+        ValueRange in = input(e->din());
+        const ValueRange* v = &in;
+        for (unsigned i: e->path()) {
+            if (i >= v->fields.size()) {
+                v = nullptr;
+                break;
+            }
+            v = &v->fields[i];
+        }
+        if (v != nullptr)
+            out = *v;
+    } else if (b->is<Select>() || b->is<IdxSelect>()) {
+        bool first = true;
+        for (auto ip: b->inputs()) {
+            if (b->is<IdxSelect>() && ip == b->as<IdxSelect>()->idx())
+                continue;
+            if (first)
+                out = input(ip);
+            else
+                out.unite(input(ip));
+            first = false;
+        }
+    } else if (b->is<Router>()) {
+        auto r = b->as<Router>();
+        ValueRange in = input(r->din());
+        if (in.fields.size() == 2) {
+            for (unsigned k=0; k<outs.size(); k++)
+                outs[k] = guard(in.fields[1], in.fields[0], k);
+        }
+    } else if (w > 0 && b->is<Function>()) {
+        // Integer operators
+        Function* f = b->as<Function>();
+        ValueRange in = input(f->din());
+        vector<ValueRange> args = in.fields;
+        if (args.empty())
+            args.push_back(in);
+        for (const auto& a: args) {
+            if (a.empty)
+                out = ValueRange::Empty(op0->type());
+        }
+        bool tracked = all_of(args.begin(), args.end(),
+                              [](const ValueRange& a) {
+                                  return a.tracked();
+                              });
+        bool nonNeg = all_of(args.begin(), args.end(),
+                             [](const ValueRange& a) {
+                                 return a.hi <= MaxValue(a.width - 1);
+                             });
+        const ValueRange& a = args[0];
+        const ValueRange& c = args.size() > 1 ? args[1] : args[0];
+
+        if (out.empty || !tracked) {
+            // Nothing to go on
+        } else if (b->is<IntTruncate>()) {
+            if (a.hi <= MaxValue(w))
+                out = ValueRange::Interval(w, a.lo, a.hi, op0);
+        } else if (b->is<IntExtend>()) {
+            if (!b->as<IntExtend>()->signExtend() || nonNeg)
+                out = ValueRange::Interval(w, a.lo, a.hi, op0);
+        } else if (b->is<IntAddition>()) {
+            uint64_t lo = 0, hi = 0;
+            bool overflow = false;
+            for (const auto& x: args) {
+                overflow |= hi + x.hi < hi;
+                lo += x.lo;
+                hi += x.hi;
+            }
+            if (!overflow && hi <= MaxValue(w))
+                out = ValueRange::Interval(w, lo, hi, op0);
+        } else if (b->is<IntSubtraction>()) {
+            if (a.lo >= c.hi)
+                out = ValueRange::Interval(w, a.lo - c.hi, a.hi - c.lo, op0);
+        } else if (b->is<IntMultiply>()) {
+            uint64_t lo = 1, hi = 1;
+            bool overflow = false;
+            for (const auto& x: args) {
+                overflow |= x.hi != 0 && hi > MaxValue(64) / x.hi;
+                lo *= x.lo;
+                hi *= x.hi;
+            }
+            if (!overflow && hi <= MaxValue(w))
+                out = ValueRange::Interval(w, lo, hi, op0);
+        } else if (b->is<IntDivide>()) {
+            if (!b->as<IntDivide>()->isSigned() || nonNeg)
+                out = ValueRange::Interval(w, c.hi == 0 ? 0 : a.lo / c.hi,
+                                           a.hi / max(c.lo, (uint64_t)1),
+                                           op0);
+        } else if (b->is<IntRemainder>()) {
+            if ((!b->as<IntRemainder>()->isSigned() || nonNeg) && c.hi > 0)
+                out = ValueRange::Interval(w, 0, min(a.hi, c.hi - 1), op0);
+        } else if (b->is<Bitwise>()) {
+            uint64_t hi = 0;
+            for (const auto& x: args)
+                hi = max(hi, x.hi);
+            if (b->as<Bitwise>()->op() == Bitwise::AND) {
+                for (const auto& x: args)
+                    hi = min(hi, x.hi);
+            } else {
+                hi = MaxValue(BitsOf(hi));
+            }
+            out = ValueRange::Interval(w, 0, min(hi, MaxValue(w)), op0);
+        }
+    }
+
+    if (outs.size() == 1)
+        RangeMetadata(b, op0, out);
+}
+
+bool RangeSolver::update(const OutputPort* op, ValueRange v) {
+    auto s = _seeds.find(op);
+    if (s != _seeds.end())
+        v.intersect(s->second);
+
+    auto f = _r._ranges.find(op);
+    if (f == _r._ranges.end()) {
+        if (v.fields.empty() && v.origin == nullptr)
+            v.origin = op;
+        _r._ranges.emplace(op, v);
+        return true;
+    }
+
+    ValueRange nv = f->second;
+    nv.unite(v);
+    if (nv.fields.empty() && nv.origin == nullptr)
+        // Merges several values, so is a new one
+        nv.origin = op;
+    if (nv == f->second)
+        return false;
+    if (++_rounds[op] > WidenAfter)
+        nv.widen(f->second, _thresholds);
+    f->second = nv;
+    return true;
+}
+
+// The constants compared against, and their neighbours, in both
+// signed and unsigned order. Loop bounds are among them.
+void RangeSolver::findThresholds() {
+    for (Block* b: _blocks) {
+        if (!b->is<IntCompare>())
+            continue;
+        OutputPort* src = _conns->findSource(b->as<IntCompare>()->din());
+        if (src == nullptr || !src->owner()->is<Join>())
+            continue;
+        Join* j = src->owner()->as<Join>();
+        for (unsigned i=0; i<j->din_size(); i++) {
+            OutputPort* arg = _conns->findSource(j->din(i));
+            if (arg == nullptr || !arg->owner()->is<Constant>())
+                continue;
+            llvm::Constant* value = arg->owner()->as<Constant>()->value();
+            if (value == nullptr)
+                continue;
+            ValueRange c = ValueRange::Of(value, nullptr);
+            if (!c.tracked() || c.empty)
+                continue;
+            uint64_t max = MaxValue(c.width);
+            uint64_t sign = (uint64_t)1 << (c.width - 1);
+            for (uint64_t t: {c.lo, sign - 1}) {
+                _thresholds.insert(t);
+                if (t > 0)
+                    _thresholds.insert(t - 1);
+                if (t < max)
+                    _thresholds.insert(t + 1);
+            }
+        }
+    }
+}
+
+void RangeSolver::solve() {
+    vector<Block*> blocks;
+    _conns->findAllBlocks(blocks);
+    _blocks.insert(blocks.begin(), blocks.end());
+    findThresholds();
+
+    deque<Block*> work(blocks.begin(), blocks.end());
+    set<Block*> queued(blocks.begin(), blocks.end());
+    vector<ValueRange> outs;
+    while (!work.empty()) {
+        Block* b = work.front();
+        work.pop_front();
+        queued.erase(b);
+
+        eval(b, outs);
+        for (unsigned i=0; i<outs.size(); i++) {
+            OutputPort* op = b->outputs()[i];
+            if (!update(op, outs[i]))
+                continue;
+            vector<InputPort*> sinks;
+            _conns->findSinks(op, sinks);
+            for (auto ip: sinks) {
+                Block* sink = ip->owner();
+                if (_blocks.count(sink) && queued.insert(sink).second)
+                    work.push_back(sink);
+            }
+        }
+    }
+
+    // Widening overshot on loops. Evaluating again from the fixed point
+    // can only tighten, and stays sound.
+    for (unsigned sweep=0; sweep<NarrowSweeps; sweep++) {
+        for (Block* b: blocks) {
+            eval(b, outs);
+            for (unsigned i=0; i<outs.size(); i++) {
+                auto& r = _r._ranges[b->outputs()[i]];
+                const OutputPort* origin = r.origin;
+                r.intersect(outs[i]);
+                r.origin = origin;
+            }
+        }
+    }
+}
+
+shared_ptr<RangeAnalysis::Result> AnalyzeRanges(
+        Module* mod, const map<const OutputPort*, ValueRange>& seeds) {
+    auto r = make_shared<RangeAnalysis::Result>();
+    ConnectionDB* conns = mod->conns();
+    if (conns != nullptr) {
+        RangeSolver solver(conns, *r, seeds);
+        solver.solve();
+    }
+    return r;
+}
+
+shared_ptr<RangeAnalysis::Result> RangeAnalysis::run(Module* mod) {
+    return AnalyzeRanges(mod, map<const OutputPort*, ValueRange>());
+}
+
+} // namespace llpm
@@ -0,0 +1,113 @@
+#ifndef __LLPM_ANALYSIS_VALUE_RANGE_HPP__
+#define __LLPM_ANALYSIS_VALUE_RANGE_HPP__
+
+#include <llpm/ports.hpp>
+
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace llvm {
+    class Constant;
+    class Type;
+}
+
+namespace llpm {
+
+// fwd defs
+class Module;
+
+/**
+ * The unsigned interval [lo, hi] of values an integer port may carry,
+ * or the ranges of each field of a struct. Ints wider than 64 bits and
+ * other types aren't tracked.
+ *
+ * 'origin' is the port this value is an unmodified copy of. It lets a
+ * Router steered by an IntCompare narrow the compared values as they
+ * pass through in its data.
+ */
+struct ValueRange {
+    // Width of a tracked int. Zero for structs and untracked values.
+    unsigned width;
+    // No token has been seen yet
+    bool empty;
+    uint64_t lo;
+    uint64_t hi;
+    const OutputPort* origin;
+    std::vector<ValueRange> fields;
+
+    ValueRange() :
+        width(0),
+        empty(false),
+        lo(0),
+        hi(0),
+        origin(nullptr)
+    { }
+
+    static ValueRange Interval(unsigned width, uint64_t lo, uint64_t hi,
+                               const OutputPort* origin);
+    static ValueRange Full(llvm::Type*, const OutputPort* origin);
+    static ValueRange Empty(llvm::Type*);
+    static ValueRange Of(llvm::Constant*, const OutputPort* origin);
+
+    bool tracked() const {
+        return width > 0;
+    }
+    bool full() const;
+
+    // Bits needed for the largest value
+    unsigned bits() const;
+    // Can this value be carried in fewer bits than its type has?
+    bool narrowable() const;
+
+    // Grow to cover 'v' too
+    void unite(const ValueRange& v);
+    // Shrink to what's also in 'v'
+    void intersect(const ValueRange& v);
+    // Give up on precision while keeping the shape: bounds which moved
+    // out from 'prev' go on to the next threshold, or the end of the
+    // range if there is none
+    void widen(const ValueRange& prev, const std::set<uint64_t>& thresholds);
+
+    bool operator==(const ValueRange& v) const;
+    bool operator!=(const ValueRange& v) const {
+        return !(*this == v);
+    }
+};
+
+/**
+ * Interval analysis over a module's blocks. Ranges are seeded from
+ * Constants and LLVM !range metadata, propagated through integer
+ * operators and communication intrinsics, and narrowed on Router
+ * outputs steered by an IntCompare, signed or not. Loops are solved by
+ * widening after a few rounds, to the constants the module compares
+ * against (so a loop counter stops at its bound) or else to the full
+ * range, and then narrowing again with a few plain sweeps.
+ */
+struct RangeAnalysis {
+    static char ID;
+
+    class Result {
+        std::map<const OutputPort*, ValueRange> _ranges;
+        friend class RangeSolver;
+
+    public:
+        // Range of values on a port. Full if the port is unknown.
+        ValueRange range(const OutputPort*) const;
+    };
+
+    static std::shared_ptr<Result> run(Module*);
+};
+
+/**
+ * As RangeAnalysis, starting from known ranges on some ports (usually
+ * the drivers of the module's inputs)
+ */
+std::shared_ptr<RangeAnalysis::Result> AnalyzeRanges(
+    Module*, const std::map<const OutputPort*, ValueRange>& seeds);
+
+} // namespace llpm
+
+#endif // __LLPM_ANALYSIS_VALUE_RANGE_HPP__
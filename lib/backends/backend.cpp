@@ -1,6 +1,7 @@
 #include "backend.hpp"
 
 #include <llpm/control_region.hpp>
+#include <libraries/synthesis/arith.hpp>
 
 using namespace std;
 
@@ -24,6 +25,20 @@ Time Backend::maxLatency(const OutputPort* op) const {
     return maxT;
 }
 
+unsigned Backend::cycles(const Block* b) const {
+    auto sa = dynamic_cast<const SequentialArith*>(b);
+    if (sa != nullptr)
+        return sa->latency();
+    return 0;
+}
+
+unsigned Backend::interval(const Block* b) const {
+    auto sa = dynamic_cast<const SequentialArith*>(b);
+    if (sa != nullptr)
+        return sa->interval();
+    return 1;
+}
+
 Time Backend::latency(Connection c) const {
     auto source = c.source()->owner();
     auto sink = c.sink()->owner();
@@ -36,6 +36,16 @@ public:
      */
     Time maxLatency(const OutputPort*) const;
 
+    /**
+     * How many clock cycles does a block take from accepting an input
+     * to presenting its output, and how many cycles apart can it
+     * accept inputs? Combinational blocks take 0 cycles; timing paths
+     * end at the inputs of blocks which take more. Pipeline registers
+     * and control regions are accounted for separately.
+     */
+    virtual unsigned cycles(const Block*) const;
+    virtual unsigned interval(const Block*) const;
+
     /**
      * What is the maximum latency for a signal to propagate a connection?
      * Again, this is ideally based on layout or at least floor planning, but
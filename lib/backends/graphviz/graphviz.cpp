@@ -65,7 +65,7 @@ static std::string label(ObjectNamer& namer, Block* b) {
 static std::string attrs(ObjectNamer& namer, Block* b,
                          std::map<std::string, std::string> o) {
     std::map<std::string, std::string> a;
-    if (dynamic_cast<PipelineRegister*>(b)) {
+    if (b->is<PipelineRegister>()) {
         a["shape"] = "rectangle";
         a["label"] = "\"reg " + namer.getName(b, b->module()) + "\"";
     } else if (b->is<DummyBlock>()) {
@@ -101,7 +101,7 @@ static std::string attrs(ObjectNamer&, OutputPort* op, InputPort* ip,
 }
 
 bool is_hidden(Block* b, Module* topMod) {
-    return dynamic_cast<DummyBlock*>(b) != NULL &&
+    return b->is<DummyBlock>() &&
            b->module() != topMod;
 }
 
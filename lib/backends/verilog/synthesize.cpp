@@ -1,16 +1,19 @@
 #include "synthesize.hpp"
 
 #include <cmath>
+#include <sstream>
 
 #include <libraries/synthesis/pipeline.hpp>
 #include <util/llvm_type.hpp>
 #include <util/misc.hpp>
+#include <util/thread_pool.hpp>
 #include <refinery/refinery.hpp>
 
 #include <libraries/core/comm_intr.hpp>
 #include <libraries/core/std_library.hpp>
 #include <libraries/synthesis/memory.hpp>
 #include <libraries/synthesis/fork.hpp>
+#include <libraries/synthesis/arith.hpp>
 #include <libraries/legacy/rtl_wrappers.hpp>
 
 #include <llvm/IR/Constants.h>
@@ -28,6 +31,7 @@ static const vector<string> externalFiles {
     "/support/backends/verilog/pipeline.sv",
     "/support/backends/verilog/memory.sv",
     "/support/backends/verilog/fork.sv",
+    "/support/backends/verilog/arith.sv",
 };
 
 static const vector<string> svKeywords {
@@ -271,6 +275,7 @@ void VerilogSynthesizer::addStops() {
     _stops.addClass<BlockRAM>();
     _stops.addClass<RTLReg>();
     _stops.addClass<Latch>();
+    _stops.addClass<SequentialArith>();
 }
 
 #if 0
@@ -310,15 +315,40 @@ void VerilogSynthesizer::writeModule(FileSet::File* f, Module* mod) {
 }
 #endif
 
+// Control regions get their own Verilog modules
+static void findRegions(Module* mod, vector<Module*>& mods) {
+    mods.push_back(mod);
+    vector<Module*> submodules;
+    mod->submodules(submodules);
+    for (Module* sm: submodules) {
+        if (sm->is<ControlRegion>())
+            findRegions(sm, mods);
+    }
+}
+
+// The order in which a module's blocks are written (and so named).
+// Connection DB order rather than pointer order, so that the output is
+// the same from run to run.
+static void blockOrder(Module* mod, vector<Block*>& blocks) {
+    ConnectionDB* conns = mod->conns();
+    conns->findAllBlocks(blocks);
+    set<Block*> io;
+    auto addIO = [&](Block* b) {
+        if (conns->liveOrder(b) == (size_t)-1 && io.insert(b).second)
+            blocks.push_back(b);
+    };
+    for (auto ip: mod->inputs()) {
+        addIO(mod->getDriver(ip)->owner());
+    }
+    for (auto op: mod->outputs()) {
+        addIO(mod->getSink(op)->owner());
+    }
+}
+
 void VerilogSynthesizer::writeModule(FileSet& dir,
                                      Module* mod,
                                      std::set<FileSet::File*>& files) 
 {
-    if (mod->is<ControlRegion>()) {
-        // Force a schedule if not yet done.
-        mod->as<ControlRegion>()->clocks();
-    }
-
     for (auto f: externalFiles) {
         auto cpy = dir.copy(Directories::llpmLibraryPath() + f);
         files.insert(cpy);
@@ -329,12 +359,61 @@ void VerilogSynthesizer::writeModule(FileSet& dir,
         return;
     }
 
-    auto vf = dir.create(mod->name() + ".sv");
-    files.insert(vf);
-    std::ostream& os = vf->openStream();
+    // Modules share nothing but the namer and printers, so render them
+    // concurrently into memory. Files are written afterwards, in order.
+    vector<Module*> mods;
+    findRegions(mod, mods);
+    vector<string> text(mods.size());
+    vector< function<void()> > tasks;
+    for (unsigned i=0; i<mods.size(); i++) {
+        tasks.push_back([this, &mods, &text, i]() {
+            text[i] = render(mods[i]);
+        });
+    }
+
+    // Scheduling a control region adds blocks, so do it before anything
+    // is named rather than from the render tasks.
+    for (auto m: mods) {
+        if (m->is<ControlRegion>())
+            m->as<ControlRegion>()->clocks();
+    }
+
+    // Blocks are first named as they're written. Do that up front, in
+    // one order -- I/O first, as writeIO goes before writeBlocks -- so
+    // that anonymous blocks get the same numbers however many threads
+    // render the modules.
+    for (auto m: mods) {
+        for (auto ip: m->inputs())
+            _design.namer().primBlockName(m->getDriver(ip)->owner(), m);
+        for (auto op: m->outputs())
+            _design.namer().primBlockName(m->getSink(op)->owner(), m);
+        vector<Block*> blocks;
+        blockOrder(m, blocks);
+        for (auto b: blocks)
+            _design.namer().primBlockName(b, m);
+    }
+
+    ThreadPool* pool = _design.passPool();
+    if (pool != NULL && tasks.size() > 1) {
+        pool->run(tasks);
+    } else {
+        for (auto& t: tasks)
+            t();
+    }
 
-    Context ctxt(os, mod);
+    for (unsigned i=0; i<mods.size(); i++) {
+        auto vf = dir.create(mods[i]->name() + ".sv");
+        files.insert(vf);
+        std::ostream& os = vf->openStream();
+        os.write(text[i].data(), text[i].size());
+        vf->close();
+    }
+}
 
+std::string VerilogSynthesizer::render(Module* mod) {
+    // writeModule has already scheduled control regions
+    std::ostringstream os;
+    Context ctxt(os, mod);
 
     ctxt << header;
     ctxt << "\n\n";
@@ -357,18 +436,16 @@ void VerilogSynthesizer::writeModule(FileSet& dir,
     ctxt << "endmodule\n";
     ctxt << "`default_nettype wire\n";
 
-
+    // Control regions used to be written out from here, each preceded
+    // by a blank line in this file. Keep the output the same.
     vector<Module*> submodules;
     mod->submodules(submodules);
     for (Module* sm: submodules) {
-        ControlRegion* cr = dynamic_cast<ControlRegion*>(sm);
-        if (cr != NULL) {
+        if (sm->is<ControlRegion>())
             ctxt << "\n";
-            writeModule(dir, cr, files);
-        }
     }
 
-    vf->close();
+    return os.str();
 }
 
 void VerilogSynthesizer::writeIO(Context& ctxt) {
@@ -458,7 +535,7 @@ void VerilogSynthesizer::writeCRControl(Context& ctxt) {
 
     for (auto&& ip: mod->inputs()) {
         OutputPort* dummyOP = mod->getDriver(ip);
-        ctxt.namer().assignName(dummyOP, mod, ctxt.name(ip, true));
+        ctxt.assignName(dummyOP, ctxt.name(ip, true));
         if (inControl) {
             ctxt << boost::format("    assign %1%_bp = %2%_bp;\n")
                             % ctxt.name(ip, true)
@@ -477,7 +554,7 @@ void VerilogSynthesizer::writeCRControl(Context& ctxt) {
     for (auto&& op: mod->outputs()) {
         InputPort* dummyIP = mod->getSink(op);
         OutputPort* source = conns->findSource(dummyIP);
-        ctxt.namer().assignName(dummyIP, mod, ctxt.name(op, true));
+        ctxt.assignName(dummyIP, ctxt.name(op, true));
         if (bitwidth(op->type()) > 0)
             ctxt << boost::format("    assign %1% = %2%;\n")
                         % ctxt.name(op, true)
@@ -508,7 +585,7 @@ void VerilogSynthesizer::writeLocalIOControl(Context& ctxt) {
     for (auto&& ip: mod->inputs()) {
         OutputPort* dummyOP = mod->getDriver(ip);
 
-        ctxt.namer().assignName(dummyOP, mod, ctxt.name(ip, true));
+        ctxt.assignName(dummyOP, ctxt.name(ip, true));
 
         InputPort* sink = findSink(conns, dummyOP);
         if (sink) {
@@ -523,7 +600,7 @@ void VerilogSynthesizer::writeLocalIOControl(Context& ctxt) {
 
     for (auto&& op: mod->outputs()) {
         InputPort* dummyIP = mod->getSink(op);
-        ctxt.namer().assignName(dummyIP, mod, ctxt.name(op, true));
+        ctxt.assignName(dummyIP, ctxt.name(op, true));
         OutputPort* source = conns->findSource(dummyIP);
         if (source != nullptr) {
             if (bitwidth(op->type()) > 0)
@@ -541,17 +618,8 @@ void VerilogSynthesizer::writeLocalIOControl(Context& ctxt) {
 
 void VerilogSynthesizer::writeBlocks(Context& ctxt) {
     ConnectionDB* conns = ctxt.module()->conns();
-    Module* mod = ctxt.module();
-    
-    set<Block*> blocks;
-    conns->findAllBlocks(blocks);
-
-    for (auto ip: mod->inputs()) {
-        blocks.insert(mod->getDriver(ip)->owner());
-    }
-    for (auto op: mod->outputs()) {
-        blocks.insert(mod->getSink(op)->owner());
-    }
+    vector<Block*> blocks;
+    blockOrder(ctxt.module(), blocks);
 
     // Track block names for sanity checking
     std::map<std::string, Block*> blockNames;
@@ -583,35 +651,31 @@ void VerilogSynthesizer::writeBlocks(Context& ctxt) {
         ctxt << "    // Signal fwd defs \"" << ctxt.primBlockName(b) << "\" type "
              << cpp_demangle(typeid(*b).name()) << "\n";
         for (InputPort* ip: b->inputs()) {
-            if (bitwidth(ip->type()) > 0) {
-                ctxt << boost::format("    wire [%1%-1:0] %2%;\n")
-                            % bitwidth(ip->type())
-                            % ctxt.name(ip);
+            const string& name = ctxt.name(ip);
+            auto width = bitwidth(ip->type());
+            if (width > 0) {
+                ctxt << "    wire [" << width << "-1:0] " << name << ";\n";
             }
             if (writeControlBits || printer->alwaysWriteValid(ip)) {
-                ctxt << boost::format("    wire %1%_valid;\n")
-                            % ctxt.name(ip);
+                ctxt << "    wire " << name << "_valid;\n";
             }
             if (writeControlBits || printer->alwaysWriteBP(ip)) {
-                ctxt << boost::format("    wire %1%_bp;\n")
-                            % ctxt.name(ip);
+                ctxt << "    wire " << name << "_bp;\n";
             } 
         }
 
         for (OutputPort* op: b->outputs()) {
-            if (bitwidth(op->type()) > 0) {
-                ctxt << boost::format("    wire [%1%-1:0] %2%;\n")
-                            % bitwidth(op->type())
-                            % ctxt.name(op);
+            const string& name = ctxt.name(op);
+            auto width = bitwidth(op->type());
+            if (width > 0) {
+                ctxt << "    wire [" << width << "-1:0] " << name << ";\n";
             }
 
             if (writeControlBits || printer->alwaysWriteValid(op)) {
-                ctxt << boost::format("    wire %1%_valid;\n")
-                                      % ctxt.name(op);
+                ctxt << "    wire " << name << "_valid;\n";
             }
             if (writeControlBits || printer->alwaysWriteBP(op)) {
-                ctxt << boost::format("    wire %1%_bp;\n")
-                            % ctxt.name(op);
+                ctxt << "    wire " << name << "_bp;\n";
             }
         }
 
@@ -636,7 +700,7 @@ void VerilogSynthesizer::writeBlocks(Context& ctxt) {
          << "\n";
 
     for (Block* b: blocks) {
-        if (dynamic_cast<DummyBlock*>(b) != NULL)
+        if (b->is<DummyBlock>())
             continue;
 
         const vector<Printer*>& possible_printers = _printers(b);
@@ -658,9 +722,9 @@ void VerilogSynthesizer::writeBlocks(Context& ctxt) {
             auto inpFound = conns->find(ip, c);
             std::string opName;
             if (!inpFound) {
-                fprintf(stderr, "Warning: no driver found for input %s!\n",
-                        ctxt.name(ip).c_str());
-                fprintf(stderr, "         input %u of %lu of block %s type %s\n",
+                tfprintf(stderr, "Warning: no driver found for input %s!\n",
+                         ctxt.name(ip).c_str());
+                tfprintf(stderr, "         input %u of %lu of block %s type %s\n",
                                 b->inputNum(ip)+1, b->inputs().size(),
                                 ctxt.name(b).c_str(),
                                 cpp_demangle(typeid(*b).name()).c_str());
@@ -670,21 +734,18 @@ void VerilogSynthesizer::writeBlocks(Context& ctxt) {
             }
 
             if (bitwidth(ip->type()) > 0) {
-                ctxt << boost::format("    assign %1% = %2%;\n")
-                            % ctxt.name(ip)
-                            % opName;
+                ctxt << "    assign " << ctxt.name(ip)
+                     << " = " << opName << ";\n";
             }
             if (writeControlBits || printer->alwaysWriteValid(ip)) {
-                ctxt << boost::format("    assign %1%_valid = %2%_valid;\n")
-                            % ctxt.name(ip)
-                            % opName;
+                ctxt << "    assign " << ctxt.name(ip)
+                     << "_valid = " << opName << "_valid;\n";
             }
         }
 
         for (OutputPort* op: b->outputs()) {
             if (writeControlBits || printer->alwaysWriteBP(op)) {
-                ctxt << boost::format("    assign %1%_bp = ")
-                            % ctxt.name(op);
+                ctxt << "    assign " << ctxt.name(op) << "_bp = ";
                 InputPort* sink = findSink(conns, op);
                 if (sink) {
                     ctxt << ctxt.name(sink) << "_bp;\n";
@@ -762,7 +823,7 @@ void print_function(VerilogSynthesizer::Context& ctxt, Block* c,
     ctxt << "    assign " << ctxt.name(b->dout()) << " = ";
     auto dinType = b->din()->type();
     assert(dinType->isStructTy());
-    auto dinName = ctxt.name(b->din());
+    const std::string& dinName = ctxt.name(b->din());
     bool first = true;
     for (unsigned i = 0; i < numContainedTypes(dinType); i++) {
         unsigned offset = bitoffset(dinType, i);
@@ -774,15 +835,10 @@ void print_function(VerilogSynthesizer::Context& ctxt, Block* c,
         else
             ctxt << " " << op << " ";
         if (signedWrap)
-            ctxt << boost::format("$signed(%1%[%2%:%3%])") 
-                            % dinName
-                            % (offset+width-1)
-                            % offset;
+            ctxt << "$signed(" << dinName << "["
+                 << (offset+width-1) << ":" << offset << "])";
         else 
-            ctxt << boost::format("%1%[%2%:%3%]") 
-                            % dinName
-                            % (offset+width-1)
-                            % offset;
+            ctxt << dinName << "[" << (offset+width-1) << ":" << offset << "]";
     }
     ctxt << ";\n";
 }
@@ -1028,11 +1084,11 @@ public:
     }
 
     bool handles(Block* b) const {
-        return dynamic_cast<NullSink*>(b) != NULL;
+        return b->is<NullSink>();
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* c) const {
-        NullSink* f = dynamic_cast<NullSink*>(c);
+        NullSink* f = c->as<NullSink>();
         ctxt << boost::format(
                     "    assign %1%_bp = 1'b0;\n")
                         % ctxt.name(f->din());
@@ -1042,7 +1098,7 @@ public:
 class ConstantPrinter: public VerilogSynthesizer::Printer {
 public:
     bool handles(Block* b) const {
-        return dynamic_cast<Constant*>(b) != NULL;
+        return b->is<Constant>();
     }
 
     static std::string toString(llvm::Type* ty, llvm::Constant* lc) {
@@ -1132,7 +1188,7 @@ public:
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* c) const {
-        Constant* f = dynamic_cast<Constant*>(c);
+        Constant* f = c->as<Constant>();
         if (bitwidth(f->dout()->type()) > 0)
             ctxt << "    assign " << ctxt.name(f->dout()) << " = "
                  << toString(f) << ";\n";
@@ -1181,11 +1237,11 @@ public:
 class JoinPrinter: public VerilogSynthesizer::Printer {
 public:
     bool handles(Block* b) const {
-        return dynamic_cast<Join*>(b) != NULL;
+        return b->is<Join>();
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* c) const {
-        Join* j = dynamic_cast<Join*>(c);
+        Join* j = c->as<Join>();
         if (bitwidth(j->dout()->type()) == 0)
             return;
         ctxt << "    assign " << ctxt.name(j->dout()) << " = { ";
@@ -1206,11 +1262,11 @@ public:
 class SplitPrinter: public VerilogSynthesizer::Printer {
 public:
     bool handles(Block* b) const {
-        return dynamic_cast<Split*>(b) != NULL;
+        return b->is<Split>();
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* c) const {
-        Split* s = dynamic_cast<Split*>(c);
+        Split* s = c->as<Split>();
         auto dinName = ctxt.name(s->din());
         for (unsigned i=0; i < s->dout_size(); i++) {
             if (bitwidth(s->dout(i)->type()) == 0)
@@ -1229,11 +1285,11 @@ public:
 class ExtractPrinter: public VerilogSynthesizer::Printer {
 public:
     bool handles(Block* b) const {
-        return dynamic_cast<Extract*>(b) != NULL;
+        return b->is<Extract>();
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* c) const {
-        Extract* e = dynamic_cast<Extract*>(c);
+        Extract* e = c->as<Extract>();
         auto dinName = ctxt.name(e->din());
         unsigned offset = 0; 
         llvm::Type* type = e->din()->type();
@@ -1528,7 +1584,7 @@ public:
 class ForkPrinter: public VerilogSynthesizer::Printer {
 public:
     bool handles(Block* b) const {
-        return dynamic_cast<Fork*>(b) != NULL;
+        return b->is<Fork>();
     }
 
     virtual bool customLID() const {
@@ -1536,7 +1592,7 @@ public:
     }
 
     void print(VerilogSynthesizer::Context& ctxt, Block* b) const {
-        Fork* f = dynamic_cast<Fork*>(b);
+        Fork* f = b->as<Fork>();
         std::string style;
         if (f->virt())
             style = "VirtFork";
@@ -1887,6 +1943,28 @@ struct BlockRAMAttr: public AttributePrinter {
     }
 };
 
+struct SequentialArithAttr: public AttributePrinter {
+    std::string name(Block* b) {
+        if (b->is<PipelinedArith>())
+            return "LLPM_PipelinedArith";
+        return "LLPM_IterativeArith";
+    }
+
+    void operator()(VerilogSynthesizer::Context& ctxt,
+                    SequentialArith* sa) {
+        auto dinT = sa->din()->type();
+        bool pipelined = sa->is<PipelinedArith>();
+        print(ctxt, "Name", "\"" + ctxt.name(sa, false) + "\"", false);
+        print(ctxt, "Op", (unsigned)sa->op(), false);
+        print(ctxt, "Signed", sa->isSigned() ? 1 : 0, false);
+        print(ctxt, "AWidth", bitwidth(nthType(dinT, 0)), false);
+        print(ctxt, "BWidth", bitwidth(nthType(dinT, 1)), false);
+        print(ctxt, "Width", bitwidth(sa->dout()->type()), !pipelined);
+        if (pipelined)
+            print(ctxt, "Stages", sa->as<PipelinedArith>()->stages(), true);
+    }
+};
+
 void VerilogSynthesizer::addDefaultPrinters() {
     _printers.appendEntry(make_shared<BinaryOpPrinter<IntAddition>>("+"));
     _printers.appendEntry(make_shared<BinaryOpPrinter<IntSubtraction>>("-"));
@@ -1929,6 +2007,8 @@ void VerilogSynthesizer::addDefaultPrinters() {
     _printers.appendEntry(make_shared<VModulePrinter<BlockRAM,
                                                      BlockRAMAttr>>());
     _printers.appendEntry(make_shared<VModulePrinter<Latch, LatchAttr>>());
+    _printers.appendEntry(make_shared<VModulePrinter<SequentialArith,
+                                                     SequentialArithAttr>>());
     _printers.appendEntry(make_shared<VModulePrinter<Module, ModuleAttr>>());
 }
 
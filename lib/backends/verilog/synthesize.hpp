@@ -30,6 +30,9 @@ public:
         Module* _ctxt;
 
         std::map<OutputPort*, std::string> _mapping;
+        // Names handed out so far, indexed by 'io'. Printers ask for the
+        // same port's net name many times over.
+        std::unordered_map<const void*, std::string> _names[2];
 
     public:
         Context(std::ostream& os, Module* ctxt) :
@@ -61,12 +64,21 @@ public:
 
 
         template<typename C>
-        std::string name(C c, bool io = false) {
-            return _namer.getName(c, _ctxt, io);
+        const std::string& name(C c, bool io = false) {
+            auto& names = _names[io];
+            auto f = names.find(c);
+            if (f != names.end())
+                return f->second;
+            return names[c] = _namer.getName(c, _ctxt, io);
+        }
+
+        void assignName(const Port* p, std::string name) {
+            _namer.assignName(p, _ctxt, name);
+            _names[0].erase(p);
         }
 
         template<typename T>
-        Context& operator<<(T t) {
+        Context& operator<<(const T& t) {
             _os << t;
             return *this;
         }
@@ -124,11 +136,13 @@ private:
 
     static InputPort* findSink(const ConnectionDB*, const OutputPort*);
 
+    std::string render(Module* mod);
+
 public:
     VerilogSynthesizer(Design& design);
     virtual ~VerilogSynthesizer() { }
 
-    DEF_GET_NP(printers);
+    DEF_GET(printers);
 
     virtual void writeModule(FileSet& dir,
                              Module* mod,
@@ -25,6 +25,7 @@ protected:
         _bb(bb)
     {
         this->createName();
+        this->history().setFrontend("", ins);
         // printf("Ins: %s\n", this->name().c_str());
     }
 
@@ -12,10 +12,167 @@
 
 #include <util/llvm_type.hpp>
 
+#include <functional>
+
 using namespace std;
 
 namespace llpm {
 
+/**
+ * Build a block for each of lbb's instructions and connect their
+ * operands. valueMap must already hold lbb's non-PHI inputs, and
+ * phiInput(phi) gives the value of each PHI. Afterwards valueMap also
+ * holds the instructions and constants.
+ */
+static void BuildInstructions(
+        const LLVMBasicBlock* lbb,
+        ConnectionDB& conns,
+        map<llvm::Value*, OutputPort*>& valueMap,
+        map<llvm::Instruction*, LLVMInstruction*>& blockMap,
+        function<OutputPort* (llvm::PHINode*)> phiInput)
+{
+    llvm::BasicBlock* bb = lbb->basicBlock();
+
+    // cout << "Refining BB " << bb->getName().str() << endl;
+    // cout << valuestr(bb) << endl;
+
+    // Construct each block
+    for(llvm::Instruction& ins: bb->getInstList()) {
+        if (llvm::DbgInfoIntrinsic::classof(&ins))
+            // Skip debug info
+            continue;
+
+        auto block = LLVMInstruction::Create(lbb, &ins);
+        blockMap[&ins] = block;
+        valueMap[&ins] = block->output();
+
+        // Connect up memory ports, if any
+        auto reqMem = block->memReqPort();
+        auto ifaceMem = lbb->mem(&ins);
+        if (reqMem) {
+            assert(ifaceMem != NULL);
+            conns.remap(ifaceMem->dout(), reqMem);
+        }
+        auto respMem = block->memRespPort();
+        if (respMem) {
+            assert(ifaceMem != NULL);
+            conns.remap(ifaceMem->din(), respMem);
+        }
+
+        // Connect up call ports, if any
+        auto reqCall = block->callReqPort();
+        auto ifaceCall = lbb->call(&ins);
+        if (reqCall) {
+            assert(ifaceCall != NULL);
+            conns.remap(ifaceCall->dout(), reqCall);
+        }
+        auto respCall = block->callRespPort();
+        if (respCall) {
+            assert(ifaceCall != NULL);
+            conns.remap(ifaceCall->din(), respCall);
+        }
+    }
+
+    // Construct any constants it produces
+    for(llvm::Constant* c: lbb->constants()) {
+        Constant* block = new Constant(c);
+        if (c->hasName())
+            block->name(c->getName());
+        valueMap[c] = block->dout();
+    }
+
+    // Connect the inputs to each block
+    for(llvm::Instruction& ins: bb->getInstList()) {
+        if (llvm::DbgInfoIntrinsic::classof(&ins))
+            // Skip debug info
+            continue;
+
+        LLVMInstruction* li = blockMap[&ins];
+        assert(li != NULL);
+
+        vector<InputPort*> inputPorts;
+        // Create a 'join' node for multiple inputs if necessary
+        if (li->getNumHWOperands() > 1) {
+            vector<llvm::Type*> inTypes;
+            for (unsigned i=0; i<ins.getNumOperands(); i++) {
+                if (!li->hwIgnoresOperand(i))
+                    inTypes.push_back(ins.getOperand(i)->getType());
+            }
+            Join* inJoin = new Join(inTypes);
+            if (ins.hasName())
+                inJoin->name("bb_" + ins.getName().str() + "_input_join");
+            conns.connect(inJoin->dout(), li->input());
+            unsigned hwNum = 0;
+            for (unsigned i=0; i<ins.getNumOperands(); i++) {
+                if (!li->hwIgnoresOperand(i)) {
+                    inputPorts.push_back(inJoin->din(hwNum));
+                    hwNum += 1;
+                }
+            }
+        } else {
+            inputPorts.push_back(li->input());
+        }
+
+        // For each input, find the correct output port and
+        // connect it
+        if (llvm::PHINode* phi = llvm::dyn_cast<llvm::PHINode>(&ins)) {
+            // Once again, PHI nodes are special
+            assert(inputPorts.size() == 1);
+            conns.connect(phiInput(phi), inputPorts[0]);
+        } else {
+            // Every other node performs normally
+            unsigned hwNum = 0;
+            for (unsigned i=0; i<ins.getNumOperands(); i++) {
+                if (li->hwIgnoresOperand(i))
+                    continue;
+                llvm::Value* operand = ins.getOperand(i);
+                auto f = valueMap.find(operand);
+                if (f != valueMap.end()) {
+                    OutputPort* port = f->second;
+                    conns.connect(port, inputPorts[hwNum]);
+                } else {
+                    // If it's not local it better be a
+                    // constant!
+                    Constant* c = new Constant(operand);
+                    if (operand->hasName())
+                        c->name(operand->getName());
+                    conns.connect(c->dout(), inputPorts[hwNum]);
+                }
+                hwNum += 1;
+            }
+        }
+    }
+}
+
+/**
+ * Join all of lbb's output values into its output type
+ */
+static Join* BuildOutput(const LLVMBasicBlock* lbb,
+                         ConnectionDB& conns,
+                         const map<llvm::Value*, OutputPort*>& valueMap) {
+    llvm::BasicBlock* bb = lbb->basicBlock();
+    Join* output = new Join(lbb->output()->type());
+    if (bb->hasName())
+        output->name("bb_" + bb->getName().str() + "output_join");
+    auto outputMap = lbb->outputMap();
+    for(auto p: outputMap) {
+        llvm::Value* v = p.first;
+        unsigned i = p.second;
+        auto f = valueMap.find(v);
+        if (f == valueMap.end()) {
+            printf("Could not find output in value map:\n");
+            v->dump();
+            if (lbb->passthroughs().count(v) > 0)
+                printf("It's a passthrough!\n");
+            printf("While processing this block:\n");
+            bb->dump();
+            assert(f != valueMap.end());
+        }
+        conns.connect(f->second, output->din(i));
+    }
+    return output;
+}
+
 class LLVMBasicBlockRefiner : public LLVMRefiner<LLVMBasicBlock> {
 public:
     virtual bool refine(
@@ -32,58 +189,9 @@ public:
         inputs.push_back(controlWait->newControl(lbb->input()->type()));
         conns.remap(lbb->output(), controlWait->dout());
 
-        llvm::BasicBlock* bb = lbb->basicBlock();
         map<llvm::Instruction*, LLVMInstruction*> blockMap;
         map<llvm::Value*, OutputPort*> valueMap;
 
-        // cout << "Refining BB " << bb->getName().str() << endl;
-        // cout << valuestr(bb) << endl;
-
-        // Construct each block
-        for(llvm::Instruction& ins: bb->getInstList()) {
-            if (llvm::DbgInfoIntrinsic::classof(&ins))
-                // Skip debug info
-                continue;
-
-            auto block = LLVMInstruction::Create(lbb, &ins);
-            blockMap[&ins] = block;
-            valueMap[&ins] = block->output();
-
-            // Connect up memory ports, if any
-            auto reqMem = block->memReqPort();
-            auto ifaceMem = lbb->mem(&ins);
-            if (reqMem) {
-                assert(ifaceMem != NULL);
-                conns.remap(ifaceMem->dout(), reqMem);
-            }
-            auto respMem = block->memRespPort();
-            if (respMem) {
-                assert(ifaceMem != NULL);
-                conns.remap(ifaceMem->din(), respMem);
-            }
-
-            // Connect up call ports, if any
-            auto reqCall = block->callReqPort();
-            auto ifaceCall = lbb->call(&ins);
-            if (reqCall) {
-                assert(ifaceCall != NULL);
-                conns.remap(ifaceCall->dout(), reqCall);
-            }
-            auto respCall = block->callRespPort();
-            if (respCall) {
-                assert(ifaceCall != NULL);
-                conns.remap(ifaceCall->din(), respCall);
-            }
-        }
-
-        // Construct any constants it produces
-        for(llvm::Constant* c: lbb->constants()) {
-            Constant* block = new Constant(c);
-            if (c->hasName())
-                block->name(c->getName());
-            valueMap[c] = block->dout();
-        }
-
         // Add an extractor for each input and add it to the value
         // map
         auto inputMap = lbb->nonPhiInputMap();
@@ -97,95 +205,20 @@ public:
             valueMap[v] = e->dout();
         }
 
-        // Connect the inputs to each block
-        for(llvm::Instruction& ins: bb->getInstList()) {
-            if (llvm::DbgInfoIntrinsic::classof(&ins))
-                // Skip debug info
-                continue;
-
-            LLVMInstruction* li = blockMap[&ins];
-            assert(li != NULL);
-
-            vector<InputPort*> inputPorts;
-            // Create a 'join' node for multiple inputs if necessary
-            if (li->getNumHWOperands() > 1) {
-                vector<llvm::Type*> inTypes;
-                for (unsigned i=0; i<ins.getNumOperands(); i++) {
-                    if (!li->hwIgnoresOperand(i))
-                        inTypes.push_back(ins.getOperand(i)->getType());
-                }
-                Join* inJoin = new Join(inTypes);
-                if (ins.hasName())
-                    inJoin->name("bb_" + ins.getName().str() + "_input_join");
-                conns.connect(inJoin->dout(), li->input());
-                unsigned hwNum = 0;
-                for (unsigned i=0; i<ins.getNumOperands(); i++) {
-                    if (!li->hwIgnoresOperand(i)) {
-                        inputPorts.push_back(inJoin->din(hwNum));
-                        hwNum += 1;
-                    }
-                }
-            } else {
-                inputPorts.push_back(li->input());
-            }
-
-            // For each input, find the correct output port and
-            // connect it
-            if (llvm::PHINode* phi = llvm::dyn_cast<llvm::PHINode>(&ins)) {
-                // Once again, PHI nodes are special
+        BuildInstructions(lbb, conns, valueMap, blockMap,
+            [&](llvm::PHINode* phi) -> OutputPort* {
                 auto fInputNum = lbb->phiInputMap().find(phi);
                 assert(fInputNum != lbb->phiInputMap().end());
                 auto inputNum = fInputNum->second;
                 Extract* e = new Extract(lbb->input()->type(), {inputNum});
-                if (ins.hasName())
-                    e->name(ins.getName().str() + "_extractor");
+                if (phi->hasName())
+                    e->name(phi->getName().str() + "_extractor");
                 inputs.push_back(e->din());
-                assert(inputPorts.size() == 1);
-                conns.connect(e->dout(), inputPorts[0]);
-            } else {
-                // Every other node performs normally
-                unsigned hwNum = 0;
-                for (unsigned i=0; i<ins.getNumOperands(); i++) {
-                    if (li->hwIgnoresOperand(i))
-                        continue;
-                    llvm::Value* operand = ins.getOperand(i);
-                    auto f = valueMap.find(operand);
-                    if (f != valueMap.end()) {
-                        OutputPort* port = f->second;
-                        conns.connect(port, inputPorts[hwNum]);
-                    } else {
-                        // If it's not local it better be a
-                        // constant!
-                        Constant* c = new Constant(operand);
-                        if (operand->hasName())
-                            c->name(operand->getName());
-                        conns.connect(c->dout(), inputPorts[hwNum]);
-                    }
-                    hwNum += 1;
-                }
-            }
-        }
+                return e->dout();
+            });
 
         // Create and connect up a basic block output
-        Join* output = new Join(lbb->output()->type());
-        if (bb->hasName())
-            output->name("bb_" + bb->getName().str() + "output_join");
-        auto outputMap = lbb->outputMap();
-        for(auto p: outputMap) {
-            llvm::Value* v = p.first;
-            unsigned i = p.second;
-            auto f = valueMap.find(v);
-            if (f == valueMap.end()) {
-                printf("Could not find output in value map:\n");
-                v->dump();
-                if (lbb->passthroughs().count(v) > 0)
-                    printf("It's a passthrough!\n");
-                printf("While processing this block:\n");
-                bb->dump();
-                assert(f != valueMap.end());
-            }
-            conns.connect(f->second, output->din(i));
-        }
+        Join* output = BuildOutput(lbb, conns, valueMap);
 
         // Inform the DB about the external connection mapping
         conns.remap(lbb->input(), inputs);
@@ -195,6 +228,202 @@ public:
     }
 };
 
+/**
+ * Builds a pipelined loop. Each loop-carried value (PHIs and values
+ * merely passed through each iteration) gets an IdxSelect which takes
+ * it from the loop entry on the first iteration and from the previous
+ * iteration afterwards, steered by the branch condition. The next
+ * values are routed back by the same condition, or dropped once the
+ * loop exits. The instructions in between see one token per
+ * iteration, so iterations overlap everywhere except on the
+ * recurrences.
+ */
+class LLVMLoopBasicBlockRefiner : public LLVMRefiner<LLVMLoopBasicBlock> {
+    // Route a token back around the loop or drop it, depending on cond
+    static void loopBack(ConnectionDB& conns, OutputPort* cond,
+                         OutputPort* next, IdxSelect* carried,
+                         unsigned contIdx) {
+        llvm::Type* t = next->type();
+        Router* rtr = new Router(2, t);
+        Join* rtrJ = new Join(rtr->din()->type());
+        conns.connect(cond, rtrJ->din(0));
+        conns.connect(next, rtrJ->din(1));
+        conns.connect(rtrJ->dout(), rtr->din());
+        conns.connect(rtr->dout(contIdx), carried->din(contIdx));
+        NullSink* drop = new NullSink(t);
+        conns.connect(rtr->dout(1 - contIdx), drop->din());
+    }
+
+public:
+    virtual bool refine(
+            const Block* block,
+            ConnectionDB& conns) const
+    {
+        const LLVMLoopBasicBlock* lbb =
+            dynamic_cast<const LLVMLoopBasicBlock*>(block);
+        if (lbb == NULL)
+            return false;
+
+        llvm::BasicBlock* bb = lbb->basicBlock();
+        llvm::LLVMContext& ctxt = bb->getContext();
+        llvm::Type* inType = lbb->input()->type();
+        unsigned contIdx = lbb->continueIdx();
+        unsigned exitIdx = 1 - contIdx;
+        vector<InputPort*> entryInputs;
+
+        // Starts out selecting the entry, then follows the branch
+        // condition. The Once fires long before any condition can.
+        llvm::Type* selType = llvm::Type::getInt1Ty(ctxt);
+        Once* first = new Once(llvm::ConstantInt::get(selType, exitIdx));
+        Select* selMerge = new Select(2, selType);
+        selMerge->name(lbb->name() + "_iteration");
+        conns.connect(first->dout(), selMerge->din(0));
+        OutputPort* sel = selMerge->dout();
+
+        // Field number -> the value it carries
+        vector<llvm::Value*> fields(lbb->numInputs());
+        for (auto p: lbb->nonPhiInputMap())
+            fields[p.second] = p.first;
+        for (auto p: lbb->phiInputMap())
+            fields[p.second] = p.first;
+
+        vector<IdxSelect*> carried;
+        for (unsigned i=0; i<fields.size(); i++) {
+            Extract* e = new Extract(inType, {i});
+            entryInputs.push_back(e->din());
+            IdxSelect* s = new IdxSelect(2, e->dout()->type());
+            if (fields[i]->hasName())
+                s->name(fields[i]->getName().str() + "_carried");
+            conns.connect(e->dout(), s->din(exitIdx));
+            conns.connect(sel, s->idx());
+            carried.push_back(s);
+        }
+
+        map<llvm::Instruction*, LLVMInstruction*> blockMap;
+        map<llvm::Value*, OutputPort*> valueMap;
+        for (auto p: lbb->nonPhiInputMap())
+            valueMap[p.first] = carried[p.second]->dout();
+        BuildInstructions(lbb, conns, valueMap, blockMap,
+            [&](llvm::PHINode* phi) -> OutputPort* {
+                auto f = lbb->phiInputMap().find(phi);
+                assert(f != lbb->phiInputMap().end());
+                return carried[f->second]->dout();
+            });
+
+        OutputPort* cond = valueMap[bb->getTerminator()];
+        assert(cond != NULL);
+        conns.connect(cond, selMerge->din(1));
+
+        // Send each value's next iteration around
+        for (unsigned i=0; i<fields.size(); i++) {
+            llvm::Value* next = fields[i];
+            if (auto phi = llvm::dyn_cast<llvm::PHINode>(next))
+                next = phi->getIncomingValueForBlock(bb);
+            OutputPort* nextPort;
+            auto f = valueMap.find(next);
+            if (f != valueMap.end()) {
+                nextPort = f->second;
+            } else {
+                Constant* c = new Constant(next);
+                nextPort = c->dout();
+            }
+            loopBack(conns, cond, nextPort, carried[i], contIdx);
+        }
+
+        IdxSelect* memToken =
+            orderMemory(lbb, conns, blockMap, sel, cond, entryInputs);
+
+        // Every iteration's output, of which only the last leaves
+        Join* output = BuildOutput(lbb, conns, valueMap);
+        llvm::Type* outType = output->dout()->type();
+        Wait* iterWait = new Wait(outType);
+        conns.connect(output->dout(), iterWait->din());
+        iterWait->newControl(&conns, carried.front()->dout());
+
+        Router* exitRtr = new Router(2, outType);
+        exitRtr->name(lbb->name() + "_exit");
+        Join* exitJ = new Join(exitRtr->din()->type());
+        conns.connect(cond, exitJ->din(0));
+        conns.connect(iterWait->dout(), exitJ->din(1));
+        conns.connect(exitJ->dout(), exitRtr->din());
+        NullSink* drop = new NullSink(outType);
+        conns.connect(exitRtr->dout(contIdx), drop->din());
+
+        conns.remap(lbb->output(), exitRtr->dout(exitIdx));
+        conns.remap(lbb->input(), entryInputs);
+
+        if (memToken != NULL)
+            carried.push_back(memToken);
+        lbb->function()->regLoopCarried(lbb->loopName(), carried);
+        return true;
+    }
+
+    /**
+     * Iterations may only overlap in memory operations if doing so
+     * can't reorder them: loads alone, or a single store or call.
+     * Otherwise each iteration's memory operations wait until the
+     * previous iteration's have all completed, via one more
+     * loop-carried (void) token, whose IdxSelect is returned.
+     */
+    static IdxSelect* orderMemory(const LLVMLoopBasicBlock* lbb,
+                            ConnectionDB& conns,
+                            map<llvm::Instruction*, LLVMInstruction*>& blockMap,
+                            OutputPort* sel,
+                            OutputPort* cond,
+                            vector<InputPort*>& entryInputs) {
+        vector<llvm::Instruction*> ops;
+        bool writes = false;
+        for (llvm::Instruction& ins: lbb->basicBlock()->getInstList()) {
+            if (llvm::DbgInfoIntrinsic::classof(&ins))
+                continue;
+            if (lbb->mem(&ins) == NULL && lbb->call(&ins) == NULL)
+                continue;
+            ops.push_back(&ins);
+            if (ins.mayWriteToMemory() ||
+                ins.getOpcode() == llvm::Instruction::Call)
+                writes = true;
+        }
+        if (!writes || ops.size() < 2)
+            return NULL;
+
+        Design& d = lbb->function()->design();
+        llvm::Type* voidTy = llvm::Type::getVoidTy(d.context());
+        unsigned contIdx = lbb->continueIdx();
+
+        IdxSelect* token = new IdxSelect(2, voidTy);
+        token->name(lbb->name() + "_mem_order");
+        conns.connect(sel, token->idx());
+
+        Wait* entryTok = new Wait(voidTy);
+        conns.connect(Constant::getVoid(d)->dout(), entryTok->din());
+        entryInputs.push_back(entryTok->newControl(lbb->input()->type()));
+        conns.connect(entryTok->dout(), token->din(1 - contIdx));
+
+        vector<OutputPort*> results;
+        for (auto ins: ops) {
+            LLVMInstruction* li = blockMap[ins];
+            results.push_back(li->output());
+
+            InputPort* ip = li->input();
+            OutputPort* src = conns.findSource(ip);
+            if (src == NULL)
+                // Nothing to hold back
+                continue;
+            Wait* w = new Wait(ip->type());
+            conns.disconnect(src, ip);
+            conns.connect(src, w->din());
+            w->newControl(&conns, token->dout());
+            conns.connect(w->dout(), ip);
+        }
+
+        Wait* done = new Wait(voidTy);
+        conns.connect(Constant::getVoid(d)->dout(), done->din());
+        done->newControl(&conns, Join::get(conns, results)->dout());
+        loopBack(conns, cond, done->dout(), token, contIdx);
+        return token;
+    }
+};
+
 class LLVMControlRefiner : public LLVMRefiner<LLVMControl>
 {
 public:
@@ -270,6 +499,8 @@ std::vector<std::shared_ptr<Refinery::Refiner>>
 LLVMBaseLibrary::BuildCollection() {
     return {
         make_shared<LLVMControlRefiner>(),
+        // Must come first, since the general refiner handles loops too
+        make_shared<LLVMLoopBasicBlockRefiner>(),
         make_shared<LLVMBasicBlockRefiner>(),
     };
 }
@@ -0,0 +1,149 @@
+#include "loops.hpp"
+
+#include <llpm/control_region.hpp>
+#include <llpm/design.hpp>
+#include <backends/backend.hpp>
+#include <libraries/core/comm_intr.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace std;
+
+namespace llpm {
+
+static unsigned Stages(Backend* backend, Block* b) {
+    if (b->is<PipelineRegister>())
+        return 1;
+    if (b->is<ControlRegion>())
+        return b->cast<ControlRegion>()->clocks();
+    return backend->cycles(b);
+}
+
+/**
+ * Longest path, in clocked stages, from an output port back into the
+ * target block. Paths through other loop-carried values belong to a
+ * later iteration so they are cut there.
+ */
+class RecurrenceLength {
+    Backend* _backend;
+    const ConnectionDB* _conns;
+    Block* _target;
+    const set<Block*>& _barriers;
+    map<const OutputPort*, int> _memo;
+    set<const OutputPort*> _onStack;
+
+public:
+    RecurrenceLength(Backend* backend,
+                     const ConnectionDB* conns,
+                     Block* target,
+                     const set<Block*>& barriers) :
+        _backend(backend),
+        _conns(conns),
+        _target(target),
+        _barriers(barriers)
+    { }
+
+    // -1 if the target can't be reached
+    int from(const OutputPort* op) {
+        auto f = _memo.find(op);
+        if (f != _memo.end())
+            return f->second;
+        if (_onStack.count(op) > 0)
+            return -1;
+        _onStack.insert(op);
+
+        int best = -1;
+        vector<InputPort*> sinks;
+        _conns->findSinks(op, sinks);
+        for (auto ip: sinks) {
+            Block* b = ip->owner();
+            if (b == _target) {
+                best = max(best, 0);
+                continue;
+            }
+            if (_barriers.count(b) > 0)
+                continue;
+            int stages = Stages(_backend, b);
+            for (auto next: b->outputs()) {
+                int len = from(next);
+                if (len >= 0)
+                    best = max(best, len + stages);
+            }
+        }
+
+        _onStack.erase(op);
+        _memo[op] = best;
+        return best;
+    }
+};
+
+unsigned LoopIIReportPass::EstimateII(Module* mod,
+                                      const LLVMFunction::PipelinedLoop& loop,
+                                      std::string& critical) {
+    const ConnectionDB* conns = mod->conns();
+    set<Block*> barriers;
+    for (auto s: loop.carried)
+        barriers.insert(s.get());
+    unsigned ii = 1;
+    critical = "";
+    for (auto s: loop.carried) {
+        RecurrenceLength rl(mod->design().backend(), conns, s.get(),
+                            barriers);
+        int len = rl.from(s->cast<IdxSelect>()->dout());
+        if (len >= (int)ii) {
+            ii = len;
+            critical = s->name();
+        }
+    }
+    return ii;
+}
+
+void LoopIIReportPass::runInternal(Module* mod) {
+    LLVMFunction* func = dynamic_cast<LLVMFunction*>(mod);
+    if (func == NULL) {
+        // Modules loaded from a checkpoint or the elaboration cache keep
+        // their blocks but not the function's list of loops
+        const auto& top = _design.modules();
+        if (find(top.begin(), top.end(), mod) != top.end())
+            printf("Warning: cannot report loop IIs for %s, which was "
+                   "not elaborated in this run\n", mod->name().c_str());
+        return;
+    }
+    if (func->conns() == NULL)
+        return;
+
+    // Some pass may have replaced the merges, so only look at them if
+    // they're still there
+    set<Block*> blocks;
+    func->conns()->findAllBlocks(blocks);
+
+    for (const auto& loop: func->loops()) {
+        bool live = !loop.carried.empty();
+        for (auto s: loop.carried) {
+            if (blocks.count(s.get()) == 0)
+                live = false;
+        }
+        if (!live) {
+            printf("Loop %s: could not find its recurrences\n",
+                   loop.name.c_str());
+            continue;
+        }
+
+        string critical;
+        unsigned ii = EstimateII(func, loop, critical);
+        printf("Loop %s: II %u", loop.name.c_str(), ii);
+        if (critical != "")
+            printf(", limited by %s", critical.c_str());
+        if (loop.targetII > 0)
+            printf(" (target %u)", loop.targetII);
+        printf("\n");
+        if (loop.targetII > 0 && ii > loop.targetII)
+            printf("Warning: loop %s misses its target II of %u\n",
+                   loop.name.c_str(), loop.targetII);
+    }
+}
+
+} // namespace llpm
@@ -0,0 +1,34 @@
+#ifndef __LLPM_LLVM_LOOPS_HPP__
+#define __LLPM_LLVM_LOOPS_HPP__
+
+#include <passes/pass.hpp>
+#include <frontends/llvm/objects.hpp>
+
+namespace llpm {
+
+/**
+ * Reports the initiation interval of each pipelined loop: the number
+ * of clocked stages around its slowest recurrence, as left by the
+ * optimization passes. This is an estimate; memory latency outside of
+ * the module is not counted.
+ */
+class LoopIIReportPass: public ModulePass {
+public:
+    LoopIIReportPass(Design& d) :
+        ModulePass(d)
+    { }
+
+    virtual void runInternal(Module* mod);
+
+    /**
+     * Estimate the II of a refined loop in mod. 'critical' gets the
+     * name of the loop-carried value on the slowest recurrence.
+     */
+    static unsigned EstimateII(Module* mod,
+                               const LLVMFunction::PipelinedLoop& loop,
+                               std::string& critical);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_LLVM_LOOPS_HPP__
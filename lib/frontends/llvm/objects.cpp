@@ -128,6 +128,32 @@ LLVMImpureBasicBlock::LLVMImpureBasicBlock(LLVMFunction* func, llvm::BasicBlock*
     _dout(this, NULL, "dout")
 { }
 
+LLVMLoopBasicBlock::LLVMLoopBasicBlock(LLVMFunction* func,
+                                       llvm::BasicBlock* bb,
+                                       std::string loopName,
+                                       unsigned targetII) :
+    LLVMImpureBasicBlock(func, bb),
+    _loopName(loopName),
+    _targetII(targetII)
+{ }
+
+bool LLVMLoopBasicBlock::Pipelinable(llvm::BasicBlock* bb) {
+    llvm::BranchInst* br =
+        llvm::dyn_cast_or_null<llvm::BranchInst>(bb->getTerminator());
+    if (br == NULL || br->isUnconditional())
+        return false;
+    // Loops which branch back to themselves either way never exit
+    if ((br->getSuccessor(0) == bb) == (br->getSuccessor(1) == bb))
+        return false;
+    return llvm::isa<llvm::PHINode>(bb->front());
+}
+
+unsigned LLVMLoopBasicBlock::continueIdx() const {
+    // The first successor is taken when the condition is true
+    llvm::TerminatorInst* ti = _basicBlock->getTerminator();
+    return ti->getSuccessor(0) == _basicBlock ? 1 : 0;
+}
+
 DependenceRule LLVMImpureBasicBlock::deps(
     const OutputPort* op) const {
     assert(std::find(outputs().begin(), outputs().end(), op)
@@ -361,8 +387,12 @@ void LLVMControl::construct() {
         throw InvalidArgument("A basic block does not appear to have a terminator!");
     }
 
+    bool pipelined = dynamic_cast<LLVMLoopBasicBlock*>(_basicBlock) != NULL;
     for (unsigned i=0; i<ti->getNumSuccessors(); i++) {
         llvm::BasicBlock* successor = ti->getSuccessor(i);
+        if (pipelined && successor == bb)
+            // Pipelined loops iterate internally
+            continue;
         LLVMControl* succControl = _function->getControl(successor);
         assert(succControl != NULL);
         assert(i == _basicBlock->mapSuccessor(successor));
@@ -508,9 +538,28 @@ void LLVMFunction::regBBCallPort(llvm::CallInst* ci, Interface* iface) {
                            iface->name());
 }
 
+void LLVMFunction::regLoopCarried(std::string loopName,
+                                  const std::vector<IdxSelect*>& carried) {
+    for (auto& l: _loops) {
+        if (l.name == loopName)
+            l.carried.assign(carried.begin(), carried.end());
+    }
+}
+
 void LLVMFunction::build(llvm::Function* func) {
     // First, we gotta build the blockMap
     for(auto& bb: func->getBasicBlockList()) {
+        if (design().pipelineLoops() && LLVMLoopBasicBlock::Pipelinable(&bb)) {
+            std::string loopName =
+                func->getName().str() + ":" + getBasicBlockName(&bb);
+            unsigned targetII = design().loopII(loopName);
+            _blockMap[&bb] = new LLVMLoopBasicBlock(this, &bb,
+                                                    loopName, targetII);
+            _loops.push_back(PipelinedLoop {loopName, targetII, {}});
+            printf("Pipelining loop %s\n", loopName.c_str());
+            continue;
+        }
+
         bool impure = false;
         for(auto& ins: bb.getInstList()) {
             if (ins.mayReadOrWriteMemory() &&
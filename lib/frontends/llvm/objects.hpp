@@ -52,6 +52,19 @@ class LLVMFunction: public ContainerModule {
     std::map<llvm::Value*, Interface*> _memInterfaces;
     std::map<llvm::CallInst*, Interface*> _callInterfaces;
 
+public:
+    struct PipelinedLoop {
+        std::string name;
+        unsigned targetII;
+        // Merges (IdxSelects) for each loop-carried value. Set during
+        // refinement. Held so that they outlive being optimized away;
+        // check that they're still in the module before use.
+        std::vector<BlockP> carried;
+    };
+
+private:
+    std::vector<PipelinedLoop> _loops;
+
     LLVMFunction(Design&, LLVMTranslator*, llvm::Function*);
     void build(llvm::Function* func);
 
@@ -91,6 +104,12 @@ public:
 
     void regBBMemPort(llvm::Value*, Interface*);
     void regBBCallPort(llvm::CallInst*, Interface*);
+
+    const std::vector<PipelinedLoop>& loops() const {
+        return _loops;
+    }
+    void regLoopCarried(std::string loopName,
+                        const std::vector<IdxSelect*>& carried);
 };
 
 
@@ -239,6 +258,7 @@ class LLVMImpureBasicBlock: public LLVMBasicBlock {
     // Function call request ports
     std::map<llvm::CallInst*, std::unique_ptr<Interface>> _call;
 
+protected:
     LLVMImpureBasicBlock(LLVMFunction* func, llvm::BasicBlock* bb);
 
 public:
@@ -280,6 +300,37 @@ public:
     virtual DependenceRule deps(const OutputPort* op) const;
 };
 
+// A basic block which branches back to itself -- an innermost loop
+// -- and is pipelined. It takes one token per entry into the loop and
+// produces one when the loop exits; the iterations happen inside.
+// Each loop-carried value circulates on its own, so only the
+// instructions on a recurrence limit how often iterations start. All
+// other instructions are fed forward and iterations overlap in them.
+class LLVMLoopBasicBlock: public LLVMImpureBasicBlock {
+    friend class LLVMFunction;
+
+    std::string _loopName;
+    unsigned _targetII;
+
+    LLVMLoopBasicBlock(LLVMFunction* func, llvm::BasicBlock* bb,
+                       std::string loopName, unsigned targetII);
+
+public:
+    virtual ~LLVMLoopBasicBlock() { }
+
+    /**
+     * Can bb be pipelined? It must end in a conditional branch to
+     * itself and some exit, and carry at least one value around.
+     */
+    static bool Pipelinable(llvm::BasicBlock* bb);
+
+    DEF_GET_NP(loopName);
+    DEF_GET_NP(targetII);
+
+    /// Value of the branch condition which starts another iteration
+    unsigned continueIdx() const;
+};
+
 // LLVMBasicBlocks are connected via LLVMControl blocks. Separating
 // the control part of the basic block from the dataflow part of the
 // basic block allows subsequent passes to refine them in different
@@ -2,6 +2,8 @@
 
 #include <llvm/Pass.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
@@ -19,12 +21,17 @@
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/CallSite.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
 
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/MC/SubtargetFeature.h>
 
 #include <frontends/llvm/library.hpp>
+#include <llpm/elab_cache.hpp>
+
+#include <regex>
 
 using namespace std;
 using namespace llvm; 
@@ -294,5 +301,78 @@ LLVMFunction* LLVMTranslator::get(std::string fnName) {
     return get(func);
 }
 
+std::string LLVMTranslator::Hash(llvm::Function* func) {
+    std::string ir;
+    llvm::raw_string_ostream os(ir);
+    func->print(os);
+    os.flush();
+
+    // Attachments name their nodes by number, which changes whenever
+    // unrelated code moves around (mostly !dbg), and the nodes
+    // themselves aren't printed.
+    static const std::regex attachment(", ![A-Za-z_.][A-Za-z0-9_.]* ![0-9]+");
+    ir = std::regex_replace(ir, attachment, "");
+
+    // Value ranges get narrowed to, so their contents go in the key
+    unsigned n = 0;
+    for (auto& bb: *func) {
+        for (auto& ins: bb) {
+            auto md = ins.getMetadata(llvm::LLVMContext::MD_range);
+            if (md != nullptr) {
+                os << "\n!range " << n << ":";
+                for (const auto& op: md->operands()) {
+                    os << " ";
+                    llvm::mdconst::extract<llvm::ConstantInt>(op)->print(os);
+                }
+            }
+            n++;
+        }
+    }
+    os.flush();
+
+    llvm::MD5 h;
+    h.update(ir);
+    llvm::MD5::MD5Result res;
+    h.final(res);
+    llvm::SmallString<32> str;
+    llvm::MD5::stringifyResult(res, str);
+    return std::string(str.begin(), str.end());
+}
+
+void LLVMTranslator::addModule(llvm::Function* func) {
+    if (func == NULL)
+        throw InvalidArgument("Function cannot be NULL!");
+    ElabCache* cache = _design.elabCache();
+    if (cache == NULL) {
+        _design.addModule(get(func));
+        return;
+    }
+
+    llvm::Function* prepared = _origToPrepared[func];
+    if (prepared == NULL)
+        throw InvalidArgument("Function must have been prepared first!");
+    std::string key = cache->key(Hash(prepared));
+    Module* m = cache->load(key);
+    if (m != NULL) {
+        printf("Loaded '%s' from the elaboration cache\n",
+               m->name().c_str());
+        _design.addModule(m, true);
+        return;
+    }
+
+    m = get(func);
+    _design.addModule(m);
+    cache->storeAfterElaboration(m, key);
+}
+
+void LLVMTranslator::addModule(std::string fnName) {
+    if (this->_llvmModule == NULL)
+        throw InvalidCall("Must load a module into LLVMTranslator before translating");
+    llvm::Function* func = this->_llvmModule->getFunction(fnName);
+    if (func == NULL)
+        throw InvalidArgument("Could not find function: " + fnName);
+    addModule(func);
+}
+
 } // namespace llpm
 
@@ -37,6 +37,22 @@ public:
     LLVMFunction* get(llvm::Function*);
     LLVMFunction* get(std::string fnName);
 
+    /**
+     * Add the module for a (prepared) function to the design. If the
+     * design has an elaboration cache which already holds this
+     * function, the cached module is added and the function is not
+     * translated or elaborated again.
+     */
+    void addModule(llvm::Function*);
+    void addModule(std::string fnName);
+
+    /**
+     * Hash of everything the translation of func depends on: its IR
+     * minus debug metadata, which includes the signatures of its
+     * callees and the globals it uses
+     */
+    static std::string Hash(llvm::Function* func);
+
 private:
     void optimize(llvm::Module* module);
     llvm::Function* elevateArgs(llvm::Function*);
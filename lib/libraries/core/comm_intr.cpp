@@ -16,12 +16,15 @@ using namespace llvm;
 Identity::Identity(llvm::Type* type) :
     Function(type, type)
 {
+    kind<Identity>();
 }
 
 Wait::Wait(llvm::Type* type) :
     _din(this, type, "din"),
     _dout(this, type, "dout")
-{ }
+{
+    kind<Wait>();
+}
 
 InputPort* Wait::newControl(llvm::Type* t) {
     auto name = str(boost::format("control%1%") % _controls.size());
@@ -38,12 +41,14 @@ Cast::Cast(llvm::CastInst* cast) :
     Function(cast->getSrcTy(), cast->getDestTy()),
     _cast(cast)
 {
+    kind<Cast>();
 }
 
 Cast::Cast(llvm::Type* from, llvm::Type* to) :
     Function(from, to),
     _cast(NULL)
 {
+    kind<Cast>();
     if (bitwidth(from) != bitwidth(to))
         throw InvalidArgument("Can only cast to/from types of the same width");
 }
@@ -51,6 +56,7 @@ Cast::Cast(llvm::Type* from, llvm::Type* to) :
 Join::Join(const vector<llvm::Type*>& inputs) :
     _dout(this, StructType::get(inputs[0]->getContext(), inputs))
 {
+    kind<Join>();
     for(auto input: inputs) {
         _din.emplace_back(new InputPort(this, input));
     }
@@ -59,6 +65,7 @@ Join::Join(const vector<llvm::Type*>& inputs) :
 Join::Join(llvm::Type* output) :
     _dout(this, output)
 {
+    kind<Join>();
     llvm::CompositeType* ct = llvm::dyn_cast<llvm::CompositeType>(output);
     if (ct == NULL)
         throw InvalidArgument("When specifying an output type for Join, it must be a CompositeType");
@@ -96,6 +103,7 @@ InputPort* Select::createInput() {
 Split::Split(const vector<llvm::Type*>& outputs) :
     _din(this, StructType::get(outputs[0]->getContext(), outputs))
 {
+    kind<Split>();
     for(auto output: outputs) {
         _dout.emplace_back(new OutputPort(this, output));
     }
@@ -104,6 +112,7 @@ Split::Split(const vector<llvm::Type*>& outputs) :
 Split::Split(llvm::Type* input) :
     _din(this, input)
 {
+    kind<Split>();
     llvm::CompositeType* ct = llvm::dyn_cast<llvm::CompositeType>(input);
     if (ct == NULL)
         throw InvalidArgument("When specifying an output type for Join, it must be a CompositeType");
@@ -141,7 +150,9 @@ llvm::Type* Extract::GetOutput(llvm::Type* t, std::vector<unsigned> path) {
 Extract::Extract(llvm::Type* t, vector<unsigned> path) :
     Function(t, GetOutput(t, path)),
     _path(path)
-{ }
+{
+    kind<Extract>();
+}
 
 std::string Extract::print() const {
     string ret;
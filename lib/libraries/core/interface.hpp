@@ -26,6 +26,8 @@ class Interface {
     InterfaceMultiplexer* _multiplexer;
 
 public:
+    POOL_ALLOCATED
+
     Interface(Block* owner,
               llvm::Type* inpType,
               llvm::Type* outType,
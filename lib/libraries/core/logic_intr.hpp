@@ -29,6 +29,7 @@ public:
         _dout(this, value->getType(),
               "c")
     {
+        kind<Constant>();
         _value = llvm::dyn_cast<llvm::Constant>(value);
         if (_value == NULL) {
             throw InvalidArgument("Value passed to constant must be Constant!");
@@ -38,12 +39,16 @@ public:
     Constant(llvm::Constant* value) :
         _value(value),
         _dout(this, value->getType(), "c")
-    { }
+    {
+        kind<Constant>();
+    }
 
     Constant(llvm::Type* t) :
         _value(NULL),
         _dout(this, t, "c")
-    { }
+    {
+        kind<Constant>();
+    }
 
     virtual bool hasState() const { return false; }
     virtual std::string print() const;
@@ -93,7 +98,9 @@ class NullSink: public virtual Block {
 public:
     NullSink(llvm::Type* t) :
         _din(this, t, "in")
-    { }
+    {
+        kind<NullSink>();
+    }
 
     virtual bool hasState() const { return false; }
 
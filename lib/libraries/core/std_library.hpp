@@ -174,6 +174,11 @@ namespace llpm {
     class IntRemainder : public Function {
         bool _isSigned;
 
+        virtual float logicalEffortFunc() const {
+            // Takes a full divider
+            return 25 * (1.0 + log2((float)bitwidth(dout()->type())));
+        }
+
     public:
         static llvm::Type* InType(llvm::Type* a, llvm::Type* b, bool isSigned);
         static llvm::Type* OutType(llvm::Type* a, llvm::Type* b, bool isSigned);
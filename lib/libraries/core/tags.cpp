@@ -35,7 +35,7 @@ llvm::Type* Tagger::GetServerOutput(
 
 void SynthesizeTagsPass::runInternal(Module* mod) {
     MutableModule* mm = dynamic_cast<MutableModule*>(mod);
-    set<Block*> blocks;
+    vector<Block*> blocks;
     mm->blocks(blocks);
     for (auto block: blocks) {
         Tagger* tagger = dynamic_cast<Tagger*>(block);
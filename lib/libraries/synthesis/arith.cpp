@@ -0,0 +1,247 @@
+#include "arith.hpp"
+
+#include <libraries/core/std_library.hpp>
+#include <refinery/implementations.hpp>
+#include <backends/backend.hpp>
+#include <util/llvm_type.hpp>
+
+#include <boost/format.hpp>
+
+#include <cctype>
+#include <cmath>
+
+using namespace std;
+
+namespace llpm {
+
+static SequentialArith::Op OpOf(Block* b, bool& isSigned) {
+    isSigned = false;
+    if (b->is<IntMultiply>())
+        return SequentialArith::Multiply;
+    if (b->is<IntDivide>()) {
+        isSigned = b->as<IntDivide>()->isSigned();
+        return SequentialArith::Divide;
+    }
+    if (b->is<IntRemainder>()) {
+        isSigned = b->as<IntRemainder>()->isSigned();
+        return SequentialArith::Remainder;
+    }
+    throw InvalidArgument("Sequential units only multiply, divide or "
+                          "take remainders");
+}
+
+bool SequentialArith::Handles(Block* b) {
+    if (b->is<IntDivide>() || b->is<IntRemainder>())
+        return true;
+    // The units only have two operands
+    return b->is<IntMultiply>() &&
+           numContainedTypes(b->as<IntMultiply>()->din()->type()) == 2;
+}
+
+SequentialArith::SequentialArith(Function* comb, unsigned latency) :
+    Function(comb->din()->type(), comb->dout()->type()),
+    _latency(latency)
+{
+    if (!Handles(comb))
+        throw InvalidArgument("Cannot build a sequential unit for this block");
+    if (latency == 0)
+        throw InvalidArgument("Sequential units take at least one cycle");
+    _op = OpOf(comb, _isSigned);
+}
+
+Function* SequentialArith::combinational() const {
+    auto dinT = din()->type();
+    auto a = nthType(dinT, 0);
+    auto b = nthType(dinT, 1);
+    switch (_op) {
+    case Multiply:
+        return new IntMultiply({a, b});
+    case Divide:
+        return new IntDivide(a, b, _isSigned);
+    case Remainder:
+        return new IntRemainder(a, b, _isSigned);
+    }
+    assert(false);
+    return nullptr;
+}
+
+std::string SequentialArith::print() const {
+    static const char* ops[] = {"mul", "div", "rem"};
+    return str(boost::format("%1%%2% latency %3% interval %4%")
+                % (_isSigned ? "s" : "")
+                % ops[_op]
+                % _latency
+                % interval());
+}
+
+static float CombEffort(Function* comb) {
+    return comb->logicalEffort(comb->din(), comb->dout());
+}
+
+PipelinedArith::PipelinedArith(Function* comb, unsigned stages) :
+    // Plus the operand register
+    SequentialArith(comb, stages + 1),
+    // Once retimed, each stage has its share of the operator's logic
+    _effort(CombEffort(comb) / stages)
+{ }
+
+static unsigned IterativeSteps(Function* comb) {
+    auto dinT = comb->din()->type();
+    // Multiplies step through the multiplier, divides through the
+    // dividend
+    if (comb->is<IntMultiply>())
+        return bitwidth(nthType(dinT, 1));
+    return bitwidth(nthType(dinT, 0));
+}
+
+IterativeArith::IterativeArith(Function* comb) :
+    // Load the operands, make them positive, one cycle per bit, then
+    // sign the result
+    SequentialArith(comb, IterativeSteps(comb) + 3)
+{ }
+
+float IterativeArith::logicalEffortFunc() const {
+    // One add or subtract per cycle
+    return 1.0 + log2((float)bitwidth(dout()->type()));
+}
+
+// The combinational operator 'b' stands for, building one if 'b' is a
+// sequential unit. 'keep' holds on to anything built.
+static Function* CombinationalOf(Block* b, BlockP& keep) {
+    if (!b->is<SequentialArith>())
+        return b->as<Function>();
+    Function* comb = b->as<SequentialArith>()->combinational();
+    keep = comb;
+    return comb;
+}
+
+static bool HandlesArith(Block* b) {
+    return b->is<SequentialArith>() || SequentialArith::Handles(b);
+}
+
+static float OutBits(Block* b) {
+    return bitwidth(b->as<Function>()->dout()->type());
+}
+
+static float CombArea(Block* b) {
+    BlockP keep;
+    Function* comb = CombinationalOf(b, keep);
+    return CombEffort(comb) * OutBits(comb);
+}
+
+namespace {
+
+class CombArithImpl: public Implementation {
+public:
+    virtual std::string name() const {
+        return "comb";
+    }
+    virtual bool handles(Block* b) const {
+        return HandlesArith(b);
+    }
+    virtual Block* build(Block* b, Backend*, Time) const {
+        if (!b->is<SequentialArith>())
+            return b;
+        return b->as<SequentialArith>()->combinational();
+    }
+    virtual float area(Block* impl) const {
+        return CombArea(impl);
+    }
+};
+
+// Deepest "pipelined:N" we accept. More stages than operand bits buys
+// nothing.
+static const unsigned MaxStages = 64;
+
+class PipelinedArithImpl: public Implementation {
+    // Fixed depth, or 0 to split the operator over as many clock
+    // periods as it takes
+    unsigned _stages;
+
+public:
+    PipelinedArithImpl(unsigned stages = 0) :
+        _stages(stages)
+    { }
+
+    virtual std::string name() const {
+        return "pipelined";
+    }
+    virtual bool handles(Block* b) const {
+        return HandlesArith(b);
+    }
+    virtual Block* build(Block* b, Backend* backend, Time period) const {
+        BlockP keep;
+        Function* comb = CombinationalOf(b, keep);
+        unsigned stages = _stages;
+        if (stages == 0) {
+            Time delay = backend->latency(comb->din(), comb->dout());
+            stages = 1;
+            if (period.sec() > 0.0)
+                stages = max(1u,
+                             (unsigned)ceil(delay.sec() / period.sec()));
+        }
+        if (b->is<PipelinedArith>() &&
+            b->as<PipelinedArith>()->stages() == stages)
+            return b;
+        return new PipelinedArith(comb, stages);
+    }
+    virtual float area(Block* impl) const {
+        // The operator itself, the operand register and a result and
+        // valid bit per stage
+        auto p = impl->as<PipelinedArith>();
+        float inBits = bitwidth(p->din()->type());
+        return CombArea(impl) + inBits + 1 +
+               p->stages() * (OutBits(impl) + 1);
+    }
+    virtual shared_ptr<Implementation> configure(const string& arg) const {
+        // stoul skips whitespace, negates a leading '-' and stops at
+        // the first non-digit, so only take plain digit strings
+        unsigned long stages = 0;
+        size_t pos = 0;
+        if (!arg.empty() && isdigit((unsigned char)arg[0])) {
+            try {
+                stages = stoul(arg, &pos);
+            } catch (std::exception&) {
+                stages = 0;
+            }
+        }
+        if (pos != arg.size() || stages == 0 || stages > MaxStages)
+            throw InvalidArgument(str(
+                boost::format("Bad pipeline depth '%1%' (expected 1 to %2%)")
+                    % arg % MaxStages));
+        return make_shared<PipelinedArithImpl>((unsigned)stages);
+    }
+};
+
+class IterativeArithImpl: public Implementation {
+public:
+    virtual std::string name() const {
+        return "iterative";
+    }
+    virtual bool handles(Block* b) const {
+        return HandlesArith(b);
+    }
+    virtual Block* build(Block* b, Backend*, Time) const {
+        if (b->is<IterativeArith>())
+            return b;
+        BlockP keep;
+        return new IterativeArith(CombinationalOf(b, keep));
+    }
+    virtual float area(Block* impl) const {
+        // One adder plus the operand, partial result and output
+        // registers
+        auto f = impl->as<Function>();
+        float inBits = bitwidth(f->din()->type());
+        return CombEffort(f) * OutBits(f) + inBits + 2 * OutBits(f);
+    }
+};
+
+}
+
+void RegisterArithImpls(ImplRegistry& reg) {
+    reg.add(make_shared<CombArithImpl>());
+    reg.add(make_shared<PipelinedArithImpl>());
+    reg.add(make_shared<IterativeArithImpl>());
+}
+
+} // namespace llpm
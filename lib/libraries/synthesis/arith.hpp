@@ -0,0 +1,108 @@
+#ifndef __LLPM_LIBRARIES_SYNTHESIS_ARITH_HPP__
+#define __LLPM_LIBRARIES_SYNTHESIS_ARITH_HPP__
+
+#include <llpm/block.hpp>
+
+namespace llpm {
+
+// fwd defs
+class ImplRegistry;
+
+/**
+ * Integer multiply, divide or remainder spread over several clock
+ * cycles. Operands go straight into a register as they are accepted
+ * and results come out of one, so timing paths end at the unit's
+ * input and start at its output instead of running through one huge
+ * operator. Dividing by zero gives zero.
+ *
+ * latency() is the number of cycles from an input being accepted to
+ * its result being presented. interval() is the number of cycles
+ * between accepted inputs. Both are reported to the timing model
+ * through Backend::cycles() and Backend::interval().
+ */
+class SequentialArith : public Function {
+public:
+    enum Op {
+        Multiply,
+        Divide,
+        Remainder
+    };
+
+protected:
+    Op _op;
+    bool _isSigned;
+    unsigned _latency;
+
+    SequentialArith(Function* comb, unsigned latency);
+
+public:
+    /// Can this block be swapped for a sequential unit?
+    static bool Handles(Block* b);
+
+    DEF_GET_NP(op);
+    DEF_GET_NP(isSigned);
+    DEF_GET_NP(latency);
+    virtual unsigned interval() const = 0;
+
+    virtual bool hasState() const {
+        return true;
+    }
+
+    /// A new combinational block computing the same function
+    Function* combinational() const;
+
+    virtual std::string print() const;
+};
+
+/**
+ * Accepts an input every cycle. The operands are registered, then the
+ * combinational operator is followed by 'stages' registers for the
+ * synthesis tools to retime into it, for a latency of stages + 1.
+ */
+class PipelinedArith : public SequentialArith {
+    float _effort;
+
+    virtual float logicalEffortFunc() const {
+        return _effort;
+    }
+
+public:
+    PipelinedArith(Function* comb, unsigned stages);
+
+    unsigned stages() const {
+        return _latency - 1;
+    }
+    virtual unsigned interval() const {
+        return 1;
+    }
+};
+
+/**
+ * Computes one bit per cycle: shift-and-add for multiplies, restoring
+ * division for divides and remainders. Besides those, it takes a cycle
+ * each to register the operands, to make them positive and to sign
+ * the result. Only one operation is in flight at a time, so the next
+ * input waits for the result.
+ */
+class IterativeArith : public SequentialArith {
+    virtual float logicalEffortFunc() const;
+
+public:
+    IterativeArith(Function* comb);
+
+    virtual unsigned interval() const {
+        return _latency;
+    }
+};
+
+/**
+ * Adds the multiply, divide and remainder implementations ("comb",
+ * "pipelined" and "iterative") to an implementation registry.
+ * Pipelined units get just enough stages to fit the clock period, or
+ * as many as "pipelined:N" configures.
+ */
+void RegisterArithImpls(ImplRegistry&);
+
+} // namespace llpm
+
+#endif // __LLPM_LIBRARIES_SYNTHESIS_ARITH_HPP__
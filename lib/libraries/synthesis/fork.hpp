@@ -18,7 +18,9 @@ public:
     Fork(llvm::Type* ty, bool virt) :
         _din(this, ty, "din"),
         _virt(virt)
-    { }
+    {
+        kind<Fork>();
+    }
 
     DEF_GET(din);
     DEF_GET_NP(virt);
@@ -13,7 +13,9 @@ PipelineStageController::PipelineStageController(Design& d) :
     _vin(this, llvm::Type::getVoidTy(d.context()), "vin"),
     _vout(this, llvm::Type::getVoidTy(d.context()), "vout"),
     _ce(this, llvm::Type::getVoidTy(d.context()), "ce")
-{ }
+{
+    kind<PipelineStageController>();
+}
 
 void PipelineStageController::connectVin(ConnectionDB* conns, OutputPort* op) {
     if (op->type()->isVoidTy()) {
@@ -68,10 +68,11 @@ public:
         _enable(nullptr),
         _dout(this, src->type(), "q")
     {
+        kind<PipelineRegister>();
         auto ownerName = _source->owner()->name();
         if (ownerName != "")
             this->name(ownerName + "_reg");
-        this->history().setOptimization(src->ownerP());
+        this->history().setOptimization(src->owner());
     }
 
     virtual bool hasState() const {
@@ -102,10 +103,11 @@ public:
         _din(this, src->type(), "d"),
         _dout(this, src->type(), "q")
     {
+        kind<Latch>();
         auto ownerName = _source->owner()->name();
         if (ownerName != "")
             this->name(ownerName + "_latch");
-        this->history().setOptimization(src->ownerP());
+        this->history().setOptimization(src->owner());
     }
 
     virtual bool hasState() const {
@@ -7,6 +7,7 @@
 #include <llpm/ports.hpp>
 #include <llpm/exceptions.hpp>
 #include <util/macros.hpp>
+#include <util/pool_alloc.hpp>
 
 #include <map>
 #include <set>
@@ -27,6 +28,57 @@ class ConnectionDB;
 class Block;
 typedef boost::intrusive_ptr<Block> BlockP;
 
+// Blocks which get tested for constantly
+class ControlRegion;
+class PipelineRegister;
+class PipelineStageController;
+class Latch;
+class Fork;
+class Constant;
+class NullSink;
+class DummyBlock;
+class Identity;
+class Join;
+class Split;
+class Wait;
+class Extract;
+class Cast;
+
+/**
+ * Classes which is<>() and as<>() look for in inner loops get a kind
+ * bit, set by their constructors with kind<>(). Subclasses inherit
+ * their parents' bits, so testing one is equivalent to (but much
+ * cheaper than) a dynamic_cast. Classes without a bit use dynamic_cast.
+ */
+template<typename T>
+struct BlockKind {
+    static const uint32_t Bit = 0;
+};
+
+#define LLPM_BLOCK_KIND(CLS, N) \
+    template<> \
+    struct BlockKind<CLS> { \
+        static const uint32_t Bit = 1u << (N); \
+    };
+
+LLPM_BLOCK_KIND(Module, 0)
+LLPM_BLOCK_KIND(ControlRegion, 1)
+LLPM_BLOCK_KIND(PipelineRegister, 2)
+LLPM_BLOCK_KIND(PipelineStageController, 3)
+LLPM_BLOCK_KIND(Latch, 4)
+LLPM_BLOCK_KIND(Fork, 5)
+LLPM_BLOCK_KIND(Constant, 6)
+LLPM_BLOCK_KIND(NullSink, 7)
+LLPM_BLOCK_KIND(DummyBlock, 8)
+LLPM_BLOCK_KIND(Identity, 9)
+LLPM_BLOCK_KIND(Join, 10)
+LLPM_BLOCK_KIND(Split, 11)
+LLPM_BLOCK_KIND(Wait, 12)
+LLPM_BLOCK_KIND(Extract, 13)
+LLPM_BLOCK_KIND(Cast, 14)
+
+#undef LLPM_BLOCK_KIND
+
 /**
  * Block is the basic unit in LLPM.
  * It can do computation, store state, read inputs, and write
@@ -38,18 +90,35 @@ typedef boost::intrusive_ptr<Block> BlockP;
  */
 class Block :
     public boost::intrusive_ref_counter<Block,
-                                        boost::thread_unsafe_counter>
+                                        boost::thread_safe_counter>
 {
+public:
+    // Nearly all blocks have a couple of ports. Keep them inline.
+    typedef llvm::SmallVector<InputPort*, 2>  InputList;
+    typedef llvm::SmallVector<OutputPort*, 2> OutputList;
+
 protected:
     Module* _module;
     std::string _name;
-    std::vector<InputPort*>  _inputs;
-    std::vector<OutputPort*> _outputs;
+    InputList  _inputs;
+    OutputList _outputs;
     std::vector<Interface*>  _interfaces;
 
     BlockHistory _history;
 
-    Block(): _module(nullptr) { }
+    // BlockKind bits of this block's class and its ancestors
+    uint32_t _kinds;
+
+    Block():
+        _module(nullptr),
+        _kinds(0)
+    { }
+
+    template<typename T>
+    void kind() {
+        static_assert(BlockKind<T>::Bit != 0, "Class has no kind bit");
+        _kinds |= BlockKind<T>::Bit;
+    }
 
     friend class InputPort;
     friend class OutputPort;
@@ -77,6 +146,8 @@ protected:
 public:
     virtual ~Block() { }
 
+    POOL_ALLOCATED
+
     BlockP getptr() {
         return boost::intrusive_ptr<Block>(this);
     }
@@ -96,21 +167,48 @@ public:
     DEF_GET_NP(name);
     DEF_SET(name);
 
+private:
+    // Downcasts to classes with a kind bit. Static when the class
+    // doesn't inherit Block virtually.
+    template<typename TO>
+    auto downcast(int) -> decltype(static_cast<TO*>((Block*)NULL)) {
+        return static_cast<TO*>(this);
+    }
+    template<typename TO>
+    TO* downcast(long) {
+        return dynamic_cast<TO*>(this);
+    }
+
+public:
     template<typename TEST>
     bool is() const {
+        if (BlockKind<TEST>::Bit != 0)
+            return (_kinds & BlockKind<TEST>::Bit) != 0;
         return dynamic_cast<const TEST*>(this) != NULL;
     }
 
     template<typename TEST>
     bool isnot() const {
-        return dynamic_cast<const TEST*>(this) == NULL;
+        return !is<TEST>();
     }
 
     template<typename TO>
     TO* as() {
+        if (BlockKind<TO>::Bit != 0) {
+            if ((_kinds & BlockKind<TO>::Bit) == 0)
+                return NULL;
+            return downcast<TO>(0);
+        }
         return dynamic_cast<TO*>(this);
     }
 
+    // as<>(), but the block must be a TO
+    template<typename TO>
+    TO* cast() {
+        assert(is<TO>());
+        return as<TO>();
+    }
+
     std::string globalName() const;
 
     /**
@@ -184,10 +282,10 @@ public:
         return _history;
     }
 
-    const std::vector<InputPort*>&  inputs() const {
+    const InputList&  inputs() const {
         return _inputs;
     }
-    const std::vector<OutputPort*>& outputs() const {
+    const OutputList& outputs() const {
         return _outputs;
     }
     const std::vector<Interface*>& interfaces() const {
@@ -210,7 +308,7 @@ public:
     }
 
     int inputNum(const InputPort* ip) const {
-        auto f = find(_inputs.begin(), _inputs.end(), ip);
+        auto f = std::find(_inputs.begin(), _inputs.end(), ip);
         if (f == _inputs.end())
             return -1;
         else
@@ -218,7 +316,7 @@ public:
     }
 
     int outputNum(const OutputPort* op) const {
-        auto f = find(_outputs.begin(), _outputs.end(), op);
+        auto f = std::find(_outputs.begin(), _outputs.end(), op);
         if (f == _outputs.end())
             return -1;
         else
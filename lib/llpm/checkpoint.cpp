@@ -0,0 +1,1310 @@
+#include "checkpoint.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <libraries/core/std_library.hpp>
+#include <libraries/core/tags.hpp>
+#include <libraries/synthesis/fork.hpp>
+#include <libraries/synthesis/memory.hpp>
+#include <util/llvm_type.hpp>
+#include <util/misc.hpp>
+
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace llpm {
+
+/**
+ * File layout: magic, version, module count, then one record per
+ * module. Types are written inline on first use and referred to by
+ * number afterwards. All values are in host byte order, since
+ * checkpoints are only meant to be read back on the same machine.
+ */
+static const char Magic[8] = {'L', 'L', 'P', 'M', 'C', 'K', 'P', 'T'};
+static const uint32_t Version = 4;
+
+// Type reference meaning "a new type follows"
+static const uint32_t NewType = 0xFFFFFFFF;
+
+enum TypeKind : uint8_t {
+    TVoid,
+    TInt,
+    TStruct,
+    TNamedStruct,
+    TPointer,
+    TArray,
+    TVector,
+    THalf,
+    TFloat,
+    TDouble
+};
+
+enum ConstKind : uint8_t {
+    CNone,
+    CInt,
+    CFP,
+    CZero,
+    CUndef,
+    CPointerNull,
+    CAggregate
+};
+
+// Module port declarations
+enum PortDecl : uint8_t {
+    PEnd,
+    PInput,
+    POutput,
+    PInterface
+};
+
+/**
+ * A ContainerModule whose ports and interfaces get declared by the
+ * checkpoint reader
+ */
+class CheckpointModule: public ContainerModule {
+public:
+    CheckpointModule(Design& d, std::string name) :
+        ContainerModule(d, name)
+    { }
+
+    using ContainerModule::createInputPort;
+    using ContainerModule::createOutputPort;
+    using ContainerModule::createInterface;
+
+    /// Restore a software model whose functions all live in 'sw'
+    void software(llvm::Module* sw,
+                  const std::set<llvm::Function*>& tests,
+                  const std::map<std::string, llvm::Function*>& versions,
+                  const std::map<std::string, llvm::Function*>& stubs) {
+        _tests = tests;
+        _swVersion = versions;
+        _interfaceStubs = stubs;
+        swModule(sw);
+    }
+};
+
+static vector<llvm::Type*> elements(llvm::Type* t) {
+    auto sty = llvm::dyn_cast<llvm::StructType>(t);
+    if (sty == NULL)
+        throw InvalidArgument("Expected struct type, got " + typestr(t));
+    return vector<llvm::Type*>(sty->element_begin(), sty->element_end());
+}
+
+class Writer {
+    std::string _buf;
+    std::unordered_map<llvm::Type*, uint32_t> _types;
+
+public:
+    const std::string& buf() const {
+        return _buf;
+    }
+
+    template<typename T>
+    void pod(T v) {
+        _buf.append((const char*)&v, sizeof(T));
+    }
+
+    void str(const std::string& s) {
+        pod<uint32_t>(s.size());
+        _buf.append(s);
+    }
+
+    void apint(const llvm::APInt& v) {
+        pod<uint32_t>(v.getBitWidth());
+        pod<uint32_t>(v.getNumWords());
+        for (unsigned i=0; i<v.getNumWords(); i++)
+            pod<uint64_t>(v.getRawData()[i]);
+    }
+
+    void type(llvm::Type* t);
+    void types(const std::vector<llvm::Type*>& ts) {
+        pod<uint32_t>(ts.size());
+        for (auto t: ts)
+            type(t);
+    }
+    void constant(llvm::Constant* c);
+
+    void history(const BlockHistory& h);
+    void block(Block* b);
+    void module(Module* m);
+    void software(Module* m);
+};
+
+class Reader {
+    Design& _design;
+    const char* _pos;
+    const char* _end;
+    std::vector<llvm::Type*> _types;
+
+    void need(size_t bytes) {
+        if ((size_t)(_end - _pos) < bytes)
+            throw Exception("Truncated checkpoint");
+    }
+
+public:
+    Reader(Design& d, const char* data, size_t size) :
+        _design(d),
+        _pos(data),
+        _end(data + size)
+    { }
+
+    Design& design() const {
+        return _design;
+    }
+
+    llvm::LLVMContext& context() const {
+        return _design.context();
+    }
+
+    template<typename T>
+    T pod() {
+        need(sizeof(T));
+        T v;
+        memcpy(&v, _pos, sizeof(T));
+        _pos += sizeof(T);
+        return v;
+    }
+
+    std::string str() {
+        uint32_t len = pod<uint32_t>();
+        need(len);
+        std::string s(_pos, len);
+        _pos += len;
+        return s;
+    }
+
+    llvm::APInt apint() {
+        uint32_t width = pod<uint32_t>();
+        uint32_t numWords = pod<uint32_t>();
+        std::vector<uint64_t> words;
+        for (unsigned i=0; i<numWords; i++)
+            words.push_back(pod<uint64_t>());
+        return llvm::APInt(width, words);
+    }
+
+    llvm::Type* type();
+    std::vector<llvm::Type*> types() {
+        std::vector<llvm::Type*> ts;
+        uint32_t num = pod<uint32_t>();
+        for (unsigned i=0; i<num; i++)
+            ts.push_back(type());
+        return ts;
+    }
+    llvm::Constant* constant();
+
+    void history(BlockHistory& h);
+    Block* block(std::vector<BlockP>& keep);
+    CheckpointModule* module();
+    void software(CheckpointModule* m);
+    llvm::Function* function(llvm::Module* sw);
+};
+
+/**
+ * How to save and restore the parameters of one block class. Ports
+ * are recreated by the class's constructor (and whatever methods add
+ * ports later), so only constructor arguments get saved.
+ */
+struct Codec {
+    std::string tag;
+    std::function<bool (Block*)> handles;
+    std::function<void (Writer&, Block*)> save;
+    std::function<Block* (Reader&)> load;
+};
+
+class Codecs {
+    std::deque<Codec> _codecs;
+    std::unordered_map<std::type_index, const Codec*> _byType;
+    std::unordered_map<std::string, const Codec*> _byTag;
+    // Subclasses resolved to a base class codec
+    mutable std::mutex _derivedLock;
+    mutable std::unordered_map<std::type_index, const Codec*> _derived;
+
+    template<typename B>
+    void add(std::string tag,
+             std::function<void (Writer&, B*)> save,
+             std::function<Block* (Reader&)> load) {
+        _codecs.push_back(Codec {
+            tag,
+            [](Block* b) { return dynamic_cast<B*>(b) != NULL; },
+            [save](Writer& w, Block* b) { save(w, dynamic_cast<B*>(b)); },
+            load
+        });
+        _byType[typeid(B)] = &_codecs.back();
+        _byTag[tag] = &_codecs.back();
+    }
+
+    Codecs();
+
+public:
+    static const Codecs& get() {
+        static Codecs codecs;
+        return codecs;
+    }
+
+    /**
+     * The codec for a block's class or, failing that, for a base class.
+     * Frontend subclasses (e.g. LLVMExit and LLVMConstant) survive
+     * elaboration but behave just like their library base classes from
+     * then on, so they're saved as those. None of the registered classes
+     * derive from one another, so at most one base class matches.
+     */
+    const Codec* find(Block* b) const {
+        std::type_index idx = typeid(*b);
+        auto f = _byType.find(idx);
+        if (f != _byType.end())
+            return f->second;
+
+        std::lock_guard<std::mutex> l(_derivedLock);
+        auto d = _derived.find(idx);
+        if (d != _derived.end())
+            return d->second;
+        const Codec* codec = NULL;
+        for (const auto& c: _codecs) {
+            if (c.handles(b)) {
+                codec = &c;
+                break;
+            }
+        }
+        _derived[idx] = codec;
+        return codec;
+    }
+
+    const Codec* find(std::string tag) const {
+        auto f = _byTag.find(tag);
+        if (f == _byTag.end())
+            return NULL;
+        return f->second;
+    }
+};
+
+Codecs::Codecs() {
+    /*** Communication intrinsics */
+    add<Identity>("Identity",
+        [](Writer& w, Identity* b) {
+            w.type(b->din()->type());
+        },
+        [](Reader& r) -> Block* {
+            return new Identity(r.type());
+        });
+    add<Wait>("Wait",
+        [](Writer& w, Wait* b) {
+            w.type(b->din()->type());
+            w.pod<uint32_t>(b->controls_size());
+            for (unsigned i=0; i<b->controls_size(); i++)
+                w.type(b->controls(i)->type());
+        },
+        [](Reader& r) -> Block* {
+            auto wait = new Wait(r.type());
+            uint32_t num = r.pod<uint32_t>();
+            for (unsigned i=0; i<num; i++)
+                wait->newControl(r.type());
+            return wait;
+        });
+    add<Cast>("Cast",
+        [](Writer& w, Cast* b) {
+            w.type(b->din()->type());
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            auto from = r.type();
+            return new Cast(from, r.type());
+        });
+    add<Join>("Join",
+        [](Writer& w, Join* b) {
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            return new Join(r.type());
+        });
+    add<Select>("Select",
+        [](Writer& w, Select* b) {
+            w.pod<uint32_t>(b->din_size());
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            uint32_t n = r.pod<uint32_t>();
+            return new Select(n, r.type());
+        });
+    add<Split>("Split",
+        [](Writer& w, Split* b) {
+            w.type(b->din()->type());
+        },
+        [](Reader& r) -> Block* {
+            return new Split(r.type());
+        });
+    add<Extract>("Extract",
+        [](Writer& w, Extract* b) {
+            w.type(b->din()->type());
+            w.pod<uint32_t>(b->path().size());
+            for (auto idx: b->path())
+                w.pod<uint32_t>(idx);
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            vector<unsigned> path(r.pod<uint32_t>());
+            for (auto& idx: path)
+                idx = r.pod<uint32_t>();
+            return new Extract(t, path);
+        });
+    add<Multiplexer>("Multiplexer",
+        [](Writer& w, Multiplexer* b) {
+            w.pod<uint32_t>(numContainedTypes(b->din()->type()) - 1);
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            uint32_t n = r.pod<uint32_t>();
+            return new Multiplexer(n, r.type());
+        });
+    add<IdxSelect>("IdxSelect",
+        [](Writer& w, IdxSelect* b) {
+            w.pod<uint32_t>(b->din_size());
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            uint32_t n = r.pod<uint32_t>();
+            return new IdxSelect(n, r.type());
+        });
+    add<Router>("Router",
+        [](Writer& w, Router* b) {
+            w.pod<uint32_t>(b->dout_size());
+            w.type(b->dout(0)->type());
+        },
+        [](Reader& r) -> Block* {
+            uint32_t n = r.pod<uint32_t>();
+            return new Router(n, r.type());
+        });
+
+    /*** Logic intrinsics */
+    add<BooleanLogic>("BooleanLogic",
+        [](Writer& w, BooleanLogic* b) {
+            w.type(b->din()->type());
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            auto in = r.type();
+            return new BooleanLogic(0, in, r.type());
+        });
+    add<Constant>("Constant",
+        [](Writer& w, Constant* b) {
+            w.type(b->dout()->type());
+            w.constant(b->value());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto v = r.constant();
+            if (v != NULL)
+                return new Constant(v);
+            return new Constant(t);
+        });
+    add<Once>("Once",
+        [](Writer& w, Once* b) {
+            w.type(b->dout()->type());
+            w.constant(b->value());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto v = r.constant();
+            if (v != NULL)
+                return new Once(v);
+            return new Once(t);
+        });
+    add<Never>("Never",
+        [](Writer& w, Never* b) {
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            return new Never(r.type());
+        });
+    add<NullSink>("NullSink",
+        [](Writer& w, NullSink* b) {
+            w.type(b->din()->type());
+        },
+        [](Reader& r) -> Block* {
+            return new NullSink(r.type());
+        });
+
+    /*** Integer operations */
+    add<IntAddition>("IntAddition",
+        [](Writer& w, IntAddition* b) {
+            w.types(elements(b->din()->type()));
+        },
+        [](Reader& r) -> Block* {
+            return new IntAddition(r.types());
+        });
+    add<IntMultiply>("IntMultiply",
+        [](Writer& w, IntMultiply* b) {
+            w.types(elements(b->din()->type()));
+        },
+        [](Reader& r) -> Block* {
+            return new IntMultiply(r.types());
+        });
+    add<IntSubtraction>("IntSubtraction",
+        [](Writer& w, IntSubtraction* b) {
+            w.type(nthType(b->din()->type(), 0));
+            w.type(nthType(b->din()->type(), 1));
+        },
+        [](Reader& r) -> Block* {
+            auto a = r.type();
+            return new IntSubtraction(a, r.type());
+        });
+    add<IntDivide>("IntDivide",
+        [](Writer& w, IntDivide* b) {
+            w.type(nthType(b->din()->type(), 0));
+            w.type(nthType(b->din()->type(), 1));
+            w.pod<uint8_t>(b->isSigned());
+        },
+        [](Reader& r) -> Block* {
+            auto a = r.type();
+            auto b = r.type();
+            return new IntDivide(a, b, r.pod<uint8_t>());
+        });
+    add<IntRemainder>("IntRemainder",
+        [](Writer& w, IntRemainder* b) {
+            w.type(nthType(b->din()->type(), 0));
+            w.type(nthType(b->din()->type(), 1));
+            w.pod<uint8_t>(b->isSigned());
+        },
+        [](Reader& r) -> Block* {
+            auto a = r.type();
+            auto b = r.type();
+            return new IntRemainder(a, b, r.pod<uint8_t>());
+        });
+    add<IntCompare>("IntCompare",
+        [](Writer& w, IntCompare* b) {
+            w.type(nthType(b->din()->type(), 0));
+            w.type(nthType(b->din()->type(), 1));
+            w.pod<uint8_t>(b->op());
+            w.pod<uint8_t>(b->isSigned());
+        },
+        [](Reader& r) -> Block* {
+            auto a = r.type();
+            auto b = r.type();
+            auto op = (IntCompare::Cmp)r.pod<uint8_t>();
+            return new IntCompare(a, b, op, r.pod<uint8_t>());
+        });
+    add<ConstShift>("ConstShift",
+        [](Writer& w, ConstShift* b) {
+            w.type(b->din()->type());
+            w.pod<int32_t>(b->shift());
+            w.pod<uint8_t>(b->style());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto shift = r.pod<int32_t>();
+            return new ConstShift(t, shift,
+                                  (ConstShift::Style)r.pod<uint8_t>());
+        });
+    add<Shift>("Shift",
+        [](Writer& w, Shift* b) {
+            w.type(nthType(b->din()->type(), 0));
+            w.pod<uint8_t>(b->dir());
+            w.pod<uint8_t>(b->style());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto dir = (Shift::Direction)r.pod<uint8_t>();
+            return new Shift(t, dir, (Shift::Style)r.pod<uint8_t>());
+        });
+    add<IntTruncate>("IntTruncate",
+        [](Writer& w, IntTruncate* b) {
+            w.type(b->din()->type());
+            w.type(b->dout()->type());
+        },
+        [](Reader& r) -> Block* {
+            auto a = r.type();
+            return new IntTruncate(a, r.type());
+        });
+    add<IntExtend>("IntExtend",
+        [](Writer& w, IntExtend* b) {
+            w.pod<uint32_t>(bitwidth(b->dout()->type()) -
+                            bitwidth(b->din()->type()));
+            w.pod<uint8_t>(b->signExtend());
+            w.type(b->din()->type());
+        },
+        [](Reader& r) -> Block* {
+            auto n = r.pod<uint32_t>();
+            bool signExtend = r.pod<uint8_t>();
+            return new IntExtend(n, signExtend, r.type());
+        });
+    add<Bitwise>("Bitwise",
+        [](Writer& w, Bitwise* b) {
+            w.pod<uint32_t>(numContainedTypes(b->din()->type()));
+            w.type(b->dout()->type());
+            w.pod<uint8_t>(b->op());
+        },
+        [](Reader& r) -> Block* {
+            auto n = r.pod<uint32_t>();
+            auto t = r.type();
+            return new Bitwise(n, t, (Bitwise::Op)r.pod<uint8_t>());
+        });
+
+    /*** Memories */
+    add<Register>("Register",
+        [](Writer& w, Register* b) {
+            w.type(b->type());
+        },
+        [](Reader& r) -> Block* {
+            return new Register(r.type());
+        });
+    add<FiniteArray>("FiniteArray",
+        [](Writer& w, FiniteArray* b) {
+            w.type(b->type());
+            w.pod<uint32_t>(b->depth());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            return new FiniteArray(t, r.pod<uint32_t>());
+        });
+    add<RTLReg>("RTLReg",
+        [](Writer& w, RTLReg* b) {
+            // Reads and writes interleave in the port lists
+            vector<Interface*> writes;
+            b->write(writes);
+            w.type(b->type());
+            w.pod<uint32_t>(b->interfaces().size());
+            for (auto iface: b->interfaces()) {
+                bool isWrite = std::find(writes.begin(), writes.end(), iface)
+                                != writes.end();
+                w.pod<uint8_t>(isWrite);
+            }
+        },
+        [](Reader& r) -> Block* {
+            auto reg = new RTLReg(r.type());
+            uint32_t num = r.pod<uint32_t>();
+            for (unsigned i=0; i<num; i++) {
+                if (r.pod<uint8_t>())
+                    reg->newWrite();
+                else
+                    reg->newRead();
+            }
+            return reg;
+        });
+    add<BlockRAM>("BlockRAM",
+        [](Writer& w, BlockRAM* b) {
+            w.type(b->type());
+            w.pod<uint32_t>(b->depth());
+            w.pod<uint32_t>(b->ports_size());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto depth = r.pod<uint32_t>();
+            return new BlockRAM(t, depth, r.pod<uint32_t>());
+        });
+
+    /*** Synthesis helpers */
+    add<Fork>("Fork",
+        [](Writer& w, Fork* b) {
+            w.type(b->din()->type());
+            w.pod<uint8_t>(b->virt());
+            w.pod<uint32_t>(b->dout_size());
+        },
+        [](Reader& r) -> Block* {
+            auto t = r.type();
+            auto fork = new Fork(t, r.pod<uint8_t>());
+            uint32_t num = r.pod<uint32_t>();
+            for (unsigned i=0; i<num; i++)
+                fork->createOutput();
+            return fork;
+        });
+    add<Tagger>("Tagger",
+        [](Writer& w, Tagger* b) {
+            w.type(nthType(b->server()->din()->type(), 1));
+            w.type(nthType(b->server()->dout()->type(), 1));
+            w.type(nthType(b->server()->din()->type(), 0));
+        },
+        [](Reader& r) -> Block* {
+            auto req = r.type();
+            auto resp = r.type();
+            return new Tagger(req, resp, r.type());
+        });
+}
+
+/*********
+ * Writer
+ */
+
+void Writer::type(llvm::Type* t) {
+    auto f = _types.find(t);
+    if (f != _types.end()) {
+        pod<uint32_t>(f->second);
+        return;
+    }
+    pod<uint32_t>(NewType);
+
+    auto sty = llvm::dyn_cast<llvm::StructType>(t);
+    if (sty != NULL && !sty->isLiteral()) {
+        // Numbered before the body, which may refer back to it
+        _types.emplace(t, _types.size());
+        pod<uint8_t>(TNamedStruct);
+        str(sty->getName().str());
+        pod<uint8_t>(sty->isOpaque());
+        if (!sty->isOpaque()) {
+            pod<uint8_t>(sty->isPacked());
+            types(elements(sty));
+        }
+        return;
+    }
+
+    switch (t->getTypeID()) {
+    case llvm::Type::VoidTyID:
+        pod<uint8_t>(TVoid);
+        break;
+    case llvm::Type::IntegerTyID:
+        pod<uint8_t>(TInt);
+        pod<uint32_t>(t->getIntegerBitWidth());
+        break;
+    case llvm::Type::StructTyID:
+        pod<uint8_t>(TStruct);
+        pod<uint8_t>(sty->isPacked());
+        types(elements(sty));
+        break;
+    case llvm::Type::PointerTyID:
+        pod<uint8_t>(TPointer);
+        pod<uint32_t>(t->getPointerAddressSpace());
+        type(t->getPointerElementType());
+        break;
+    case llvm::Type::ArrayTyID:
+        pod<uint8_t>(TArray);
+        pod<uint64_t>(t->getArrayNumElements());
+        type(t->getArrayElementType());
+        break;
+    case llvm::Type::VectorTyID:
+        pod<uint8_t>(TVector);
+        pod<uint32_t>(t->getVectorNumElements());
+        type(t->getVectorElementType());
+        break;
+    case llvm::Type::HalfTyID:
+        pod<uint8_t>(THalf);
+        break;
+    case llvm::Type::FloatTyID:
+        pod<uint8_t>(TFloat);
+        break;
+    case llvm::Type::DoubleTyID:
+        pod<uint8_t>(TDouble);
+        break;
+    default:
+        throw InvalidArgument("Checkpoints cannot hold type " + typestr(t));
+    }
+    _types.emplace(t, _types.size());
+}
+
+void Writer::constant(llvm::Constant* c) {
+    if (c == NULL) {
+        pod<uint8_t>(CNone);
+        return;
+    }
+
+    if (auto ci = llvm::dyn_cast<llvm::ConstantInt>(c)) {
+        pod<uint8_t>(CInt);
+        type(c->getType());
+        apint(ci->getValue());
+    } else if (auto cf = llvm::dyn_cast<llvm::ConstantFP>(c)) {
+        pod<uint8_t>(CFP);
+        type(c->getType());
+        apint(cf->getValueAPF().bitcastToAPInt());
+    } else if (llvm::isa<llvm::ConstantAggregateZero>(c)) {
+        pod<uint8_t>(CZero);
+        type(c->getType());
+    } else if (llvm::isa<llvm::UndefValue>(c)) {
+        pod<uint8_t>(CUndef);
+        type(c->getType());
+    } else if (llvm::isa<llvm::ConstantPointerNull>(c)) {
+        pod<uint8_t>(CPointerNull);
+        type(c->getType());
+    } else if (auto cds = llvm::dyn_cast<llvm::ConstantDataSequential>(c)) {
+        pod<uint8_t>(CAggregate);
+        type(c->getType());
+        pod<uint32_t>(cds->getNumElements());
+        for (unsigned i=0; i<cds->getNumElements(); i++)
+            constant(cds->getElementAsConstant(i));
+    } else if (llvm::isa<llvm::ConstantStruct>(c) ||
+               llvm::isa<llvm::ConstantArray>(c) ||
+               llvm::isa<llvm::ConstantVector>(c)) {
+        pod<uint8_t>(CAggregate);
+        type(c->getType());
+        pod<uint32_t>(c->getNumOperands());
+        for (unsigned i=0; i<c->getNumOperands(); i++)
+            constant(llvm::cast<llvm::Constant>(c->getOperand(i)));
+    } else {
+        throw InvalidArgument("Checkpoints cannot hold constant " +
+                              valuestr(c));
+    }
+}
+
+void Writer::block(Block* b) {
+    Module* m = dynamic_cast<Module*>(b);
+    if (m != NULL) {
+        str("Module");
+        module(m);
+    } else {
+        const Codec* codec = Codecs::get().find(b);
+        if (codec == NULL)
+            throw InvalidArgument("Checkpoints do not support blocks of type " +
+                                  cpp_demangle(typeid(*b).name()));
+        str(codec->tag);
+        codec->save(*this, b);
+    }
+
+    str(b->name());
+    history(b->history());
+    pod<uint32_t>(b->inputs().size());
+    for (auto ip: b->inputs())
+        str(ip->name());
+    pod<uint32_t>(b->outputs().size());
+    for (auto op: b->outputs())
+        str(op->name());
+}
+
+// The block's source and its immediate origins, which is what naming
+// and snapshots of the block look at
+void Writer::history(const BlockHistory& h) {
+    pod<uint8_t>(h.src());
+    str(h.meta());
+    pod<uint32_t>(h.origins().size());
+    for (auto o: h.origins()) {
+        str(*o->type);
+        str(o->base);
+        str(o->suffix);
+        pod<uint8_t>(o->src);
+        str(o->meta);
+    }
+
+    // The instructions aren't saved, so keep what analyses read off them
+    const llvm::MDNode* range = h.range();
+    pod<uint32_t>(range == nullptr ? 0 : range->getNumOperands());
+    if (range != nullptr) {
+        for (const auto& op: range->operands())
+            constant(llvm::mdconst::extract<llvm::ConstantInt>(op));
+    }
+}
+
+void Writer::module(Module* m) {
+    ContainerModule* cm = dynamic_cast<ContainerModule*>(m);
+    if (cm == NULL)
+        throw InvalidArgument("Checkpoints only support ContainerModules, "
+                              "but '" + m->name() + "' is a " +
+                              cpp_demangle(typeid(*m).name()));
+    str(m->name());
+
+    // Declare the ports so that both port lists come out in their
+    // current order. Interface ports are added to both lists at once,
+    // so they line up.
+    map<Port*, Interface*> ifaces;
+    for (auto iface: m->interfaces()) {
+        ifaces[iface->din()] = iface;
+        ifaces[iface->dout()] = iface;
+    }
+    auto findIface = [&](Port* p) -> Interface* {
+        auto f = ifaces.find(p);
+        return f == ifaces.end() ? NULL : f->second;
+    };
+
+    // The module's I/O dummies, in declaration order, followed by
+    // everything else
+    vector<Block*> blocks;
+    const auto& ins = m->inputs();
+    const auto& outs = m->outputs();
+    unsigned i = 0, o = 0;
+    while (i < ins.size() || o < outs.size()) {
+        Interface* ii = i < ins.size() ? findIface(ins[i]) : NULL;
+        Interface* oi = o < outs.size() ? findIface(outs[o]) : NULL;
+        if (i < ins.size() && ii == NULL) {
+            pod<uint8_t>(PInput);
+            type(ins[i]->type());
+            str(ins[i]->name());
+            blocks.push_back(cm->getDriver(ins[i])->owner());
+            i++;
+        } else if (o < outs.size() && oi == NULL) {
+            pod<uint8_t>(POutput);
+            type(outs[o]->type());
+            str(outs[o]->name());
+            blocks.push_back(cm->getSink(outs[o])->owner());
+            o++;
+        } else if (ii != NULL && ii == oi) {
+            pod<uint8_t>(PInterface);
+            pod<uint8_t>(ii->server());
+            type(ii->din()->type());
+            type(ii->dout()->type());
+            str(ii->name());
+            blocks.push_back(cm->getDriver(ii->din())->owner());
+            blocks.push_back(cm->getSink(ii->dout())->owner());
+            i++;
+            o++;
+        } else {
+            throw InternalError("Interface ports of module '" + m->name() +
+                                "' are out of order");
+        }
+    }
+    pod<uint8_t>(PEnd);
+
+    unordered_map<Block*, uint32_t> idx;
+    for (auto b: blocks)
+        idx.emplace(b, idx.size());
+    unsigned numDummies = blocks.size();
+    for (Block* b: cm->conns()->blocks()) {
+        if (idx.emplace(b, idx.size()).second)
+            blocks.push_back(b);
+    }
+
+    pod<uint32_t>(blocks.size() - numDummies);
+    for (unsigned b = numDummies; b < blocks.size(); b++)
+        block(blocks[b]);
+
+    auto blockIdx = [&](Block* b) -> uint32_t {
+        auto f = idx.find(b);
+        if (f == idx.end())
+            throw InternalError("Connection to a block outside of module '" +
+                                m->name() + "'");
+        return f->second;
+    };
+
+    const ConnectionDB* conns = cm->conns();
+    pod<uint64_t>(conns->size());
+    for (const Connection& c: *conns) {
+        Block* src = c.source()->owner();
+        Block* sink = c.sink()->owner();
+        pod<uint32_t>(blockIdx(src));
+        pod<uint32_t>(src->outputNum(c.source()));
+        pod<uint32_t>(blockIdx(sink));
+        pod<uint32_t>(sink->inputNum(c.sink()));
+    }
+
+    // Reconnecting makes blocks live in connection order, which isn't
+    // the order they have now
+    pod<uint32_t>(conns->blocks().size());
+    for (Block* b: conns->blocks())
+        pod<uint32_t>(blockIdx(b));
+
+    software(m);
+}
+
+// The module's software model, if it has one: the LLVM module as
+// bitcode, then which of its functions are tests, S/W versions and
+// interface stubs. Wedges build their simulation libraries from it.
+void Writer::software(Module* m) {
+    llvm::Module* sw = m->swModule();
+    pod<uint8_t>(sw != NULL);
+    if (sw == NULL)
+        return;
+
+    std::string bc;
+    {
+        llvm::raw_string_ostream os(bc);
+        llvm::WriteBitcodeToFile(sw, os);
+    }
+    str(bc);
+
+    auto tests = m->tests();
+    pod<uint32_t>(tests.size());
+    for (auto f: tests)
+        str(f->getName());
+    for (const auto& funcs: {m->swVersions(), m->interfaceStubs()}) {
+        pod<uint32_t>(funcs.size());
+        for (auto p: funcs) {
+            str(p.first);
+            str(p.second->getName());
+        }
+    }
+}
+
+/*********
+ * Reader
+ */
+
+llvm::Type* Reader::type() {
+    uint32_t id = pod<uint32_t>();
+    if (id != NewType) {
+        if (id >= _types.size())
+            throw Exception("Corrupt checkpoint: bad type reference");
+        return _types[id];
+    }
+
+    llvm::LLVMContext& ctxt = context();
+    llvm::Type* t;
+    uint8_t kind = pod<uint8_t>();
+    switch (kind) {
+    case TNamedStruct: {
+        auto sty = llvm::StructType::create(ctxt, str());
+        _types.push_back(sty);
+        bool opaque = pod<uint8_t>();
+        if (!opaque) {
+            bool packed = pod<uint8_t>();
+            sty->setBody(types(), packed);
+        }
+        return sty;
+    }
+    case TVoid:
+        t = llvm::Type::getVoidTy(ctxt);
+        break;
+    case TInt:
+        t = llvm::Type::getIntNTy(ctxt, pod<uint32_t>());
+        break;
+    case TStruct: {
+        bool packed = pod<uint8_t>();
+        t = llvm::StructType::get(ctxt, types(), packed);
+        break;
+    }
+    case TPointer: {
+        uint32_t addrSpace = pod<uint32_t>();
+        t = llvm::PointerType::get(type(), addrSpace);
+        break;
+    }
+    case TArray: {
+        uint64_t num = pod<uint64_t>();
+        t = llvm::ArrayType::get(type(), num);
+        break;
+    }
+    case TVector: {
+        uint32_t num = pod<uint32_t>();
+        t = llvm::VectorType::get(type(), num);
+        break;
+    }
+    case THalf:
+        t = llvm::Type::getHalfTy(ctxt);
+        break;
+    case TFloat:
+        t = llvm::Type::getFloatTy(ctxt);
+        break;
+    case TDouble:
+        t = llvm::Type::getDoubleTy(ctxt);
+        break;
+    default:
+        throw Exception("Corrupt checkpoint: unknown type kind");
+    }
+    _types.push_back(t);
+    return t;
+}
+
+llvm::Constant* Reader::constant() {
+    uint8_t kind = pod<uint8_t>();
+    if (kind == CNone)
+        return NULL;
+
+    llvm::Type* t = type();
+    switch (kind) {
+    case CInt:
+        return llvm::ConstantInt::get(context(), apint());
+    case CFP:
+        return llvm::ConstantFP::get(
+            context(), llvm::APFloat(t->getFltSemantics(), apint()));
+    case CZero:
+        return llvm::ConstantAggregateZero::get(t);
+    case CUndef:
+        return llvm::UndefValue::get(t);
+    case CPointerNull:
+        return llvm::ConstantPointerNull::get(
+            llvm::cast<llvm::PointerType>(t));
+    case CAggregate: {
+        vector<llvm::Constant*> elems;
+        uint32_t num = pod<uint32_t>();
+        for (unsigned i=0; i<num; i++)
+            elems.push_back(constant());
+        if (auto sty = llvm::dyn_cast<llvm::StructType>(t))
+            return llvm::ConstantStruct::get(sty, elems);
+        if (auto aty = llvm::dyn_cast<llvm::ArrayType>(t))
+            return llvm::ConstantArray::get(aty, elems);
+        return llvm::ConstantVector::get(elems);
+    }
+    default:
+        throw Exception("Corrupt checkpoint: unknown constant kind");
+    }
+}
+
+static BlockHistory::Source historySource(uint8_t src) {
+    if (src > BlockHistory::Optimization)
+        throw Exception("Corrupt checkpoint: unknown history source");
+    return (BlockHistory::Source)src;
+}
+
+void Reader::history(BlockHistory& h) {
+    auto src = historySource(pod<uint8_t>());
+    string meta = str();
+    vector<BlockHistory::OriginP> origins;
+    uint32_t num = pod<uint32_t>();
+    for (unsigned i=0; i<num; i++) {
+        string type = str();
+        string base = str();
+        string suffix = str();
+        auto osrc = historySource(pod<uint8_t>());
+        origins.push_back(
+            BlockHistory::Restore(type, base, suffix, osrc, str()));
+    }
+
+    llvm::MDNode* range = nullptr;
+    uint32_t numRange = pod<uint32_t>();
+    if (numRange > 0) {
+        vector<llvm::Metadata*> ops;
+        for (unsigned i=0; i<numRange; i++) {
+            auto c = constant();
+            if (c == nullptr)
+                throw Exception("Corrupt checkpoint: bad range metadata");
+            ops.push_back(llvm::ConstantAsMetadata::get(c));
+        }
+        range = llvm::MDNode::get(context(), ops);
+    }
+    h.restore(src, meta, origins, range);
+}
+
+Block* Reader::block(vector<BlockP>& keep) {
+    string tag = str();
+    Block* b;
+    if (tag == "Module") {
+        b = module();
+    } else {
+        const Codec* codec = Codecs::get().find(tag);
+        if (codec == NULL)
+            throw Exception("Corrupt checkpoint: unknown block type " + tag);
+        b = codec->load(*this);
+    }
+    // Unconnected blocks get freed along with this
+    keep.push_back(b);
+
+    b->name(str());
+    history(b->history());
+
+    uint32_t numInputs = pod<uint32_t>();
+    if (numInputs != b->inputs().size())
+        throw Exception("Corrupt checkpoint: input count of " + tag +
+                        " does not match");
+    for (auto ip: b->inputs())
+        ip->name(str());
+    uint32_t numOutputs = pod<uint32_t>();
+    if (numOutputs != b->outputs().size())
+        throw Exception("Corrupt checkpoint: output count of " + tag +
+                        " does not match");
+    for (auto op: b->outputs())
+        op->name(str());
+    return b;
+}
+
+CheckpointModule* Reader::module() {
+    auto m = new CheckpointModule(_design, str());
+
+    vector<Block*> blocks;
+    uint8_t decl;
+    while ((decl = pod<uint8_t>()) != PEnd) {
+        switch (decl) {
+        case PInput: {
+            auto t = type();
+            auto ip = m->createInputPort(t, str());
+            blocks.push_back(m->getDriver(ip)->owner());
+            break;
+        }
+        case POutput: {
+            auto t = type();
+            auto op = m->createOutputPort(t, str());
+            blocks.push_back(m->getSink(op)->owner());
+            break;
+        }
+        case PInterface: {
+            bool server = pod<uint8_t>();
+            auto inpType = type();
+            auto outType = type();
+            auto iface = m->createInterface(inpType, outType, server, str());
+            blocks.push_back(m->getDriver(iface->din())->owner());
+            blocks.push_back(m->getSink(iface->dout())->owner());
+            break;
+        }
+        default:
+            throw Exception("Corrupt checkpoint: unknown port declaration");
+        }
+    }
+
+    vector<BlockP> keep;
+    uint32_t numBlocks = pod<uint32_t>();
+    blocks.reserve(blocks.size() + numBlocks);
+    for (unsigned i=0; i<numBlocks; i++)
+        blocks.push_back(block(keep));
+
+    uint64_t numConns = pod<uint64_t>();
+    for (uint64_t i=0; i<numConns; i++) {
+        uint32_t src = pod<uint32_t>();
+        uint32_t srcPort = pod<uint32_t>();
+        uint32_t sink = pod<uint32_t>();
+        uint32_t sinkPort = pod<uint32_t>();
+        if (src >= blocks.size() || sink >= blocks.size() ||
+            srcPort >= blocks[src]->outputs().size() ||
+            sinkPort >= blocks[sink]->inputs().size())
+            throw Exception("Corrupt checkpoint: bad connection");
+        m->connect(blocks[src]->outputs()[srcPort],
+                   blocks[sink]->inputs()[sinkPort]);
+    }
+
+    vector<Block*> order;
+    uint32_t numLive = pod<uint32_t>();
+    for (unsigned i=0; i<numLive; i++) {
+        uint32_t b = pod<uint32_t>();
+        if (b >= blocks.size())
+            throw Exception("Corrupt checkpoint: bad block order");
+        order.push_back(blocks[b]);
+    }
+    m->conns()->reorder(order);
+
+    software(m);
+    return m;
+}
+
+llvm::Function* Reader::function(llvm::Module* sw) {
+    string name = str();
+    llvm::Function* f = sw->getFunction(name);
+    if (f == NULL)
+        throw Exception("Corrupt checkpoint: software model has no "
+                        "function '" + name + "'");
+    return f;
+}
+
+void Reader::software(CheckpointModule* m) {
+    if (!pod<uint8_t>())
+        return;
+
+    string bc = str();
+    auto parsed = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(bc, m->name() + "_sw"), context());
+    if (!parsed)
+        throw Exception("Corrupt checkpoint: cannot read the software "
+                        "model of '" + m->name() + "'");
+    llvm::Module* sw = parsed.get().release();
+    _design.assumeOwnership(sw);
+
+    set<llvm::Function*> tests;
+    uint32_t numTests = pod<uint32_t>();
+    for (unsigned i=0; i<numTests; i++)
+        tests.insert(function(sw));
+    map<string, llvm::Function*> funcs[2];
+    for (auto& fm: funcs) {
+        uint32_t num = pod<uint32_t>();
+        for (unsigned i=0; i<num; i++) {
+            string name = str();
+            fm[name] = function(sw);
+        }
+    }
+    m->software(sw, tests, funcs[0], funcs[1]);
+}
+
+/*********
+ * Save/load
+ */
+
+void Checkpoint::Save(Design& d, std::string fn) {
+    Save(d, d.modules(), fn);
+}
+
+void Checkpoint::Save(Design&, const std::vector<Module*>& mods,
+                      std::string fn) {
+    Writer w;
+    w.pod<uint32_t>(mods.size());
+    for (auto m: mods)
+        w.module(m);
+
+    ofstream os(fn, ios::binary | ios::trunc);
+    if (!os)
+        throw SysError("opening " + fn);
+    os.write(Magic, sizeof(Magic));
+    os.write((const char*)&Version, sizeof(Version));
+    os.write(w.buf().data(), w.buf().size());
+    os.close();
+    if (!os)
+        throw SysError("writing " + fn);
+}
+
+/**
+ * Read-only private mapping of a whole file
+ */
+class MappedFile {
+    int _fd;
+    const char* _data;
+    size_t _size;
+
+public:
+    MappedFile(std::string fn) :
+        _fd(-1),
+        _data(NULL),
+        _size(0)
+    {
+        _fd = open(fn.c_str(), O_RDONLY);
+        if (_fd < 0)
+            throw SysError("opening " + fn);
+        struct stat st;
+        if (fstat(_fd, &st) != 0) {
+            close(_fd);
+            throw SysError("reading " + fn);
+        }
+        _size = st.st_size;
+        if (_size > 0) {
+            void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (data == MAP_FAILED) {
+                close(_fd);
+                throw SysError("mapping " + fn);
+            }
+            _data = (const char*)data;
+        }
+    }
+
+    ~MappedFile() {
+        if (_data != NULL)
+            munmap((void*)_data, _size);
+        close(_fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    DEF_GET_NP(data);
+    DEF_GET_NP(size);
+};
+
+std::vector<Module*> Checkpoint::Read(Design& d, std::string fn) {
+    MappedFile f(fn);
+    Reader r(d, f.data(), f.size());
+
+    char magic[sizeof(Magic)];
+    for (auto& c: magic)
+        c = r.pod<char>();
+    if (memcmp(magic, Magic, sizeof(Magic)) != 0)
+        throw InvalidArgument("'" + fn + "' is not an LLPM checkpoint");
+    if (r.pod<uint32_t>() != Version)
+        throw InvalidArgument("'" + fn + "' was written by a different "
+                              "version of LLPM");
+
+    vector<Module*> mods;
+    try {
+        uint32_t numModules = r.pod<uint32_t>();
+        for (unsigned i=0; i<numModules; i++) {
+            CheckpointModule* m = r.module();
+            mods.push_back(m);
+            m->validityCheck();
+        }
+    } catch (...) {
+        for (auto m: mods)
+            delete m;
+        throw;
+    }
+    return mods;
+}
+
+void Checkpoint::Load(Design& d, std::string fn) {
+    for (auto m: Read(d, fn))
+        d.addModule(m);
+    d.elaborated(true);
+}
+
+} // namespace llpm
@@ -0,0 +1,45 @@
+#ifndef __LLPM_CHECKPOINT_HPP__
+#define __LLPM_CHECKPOINT_HPP__
+
+#include <string>
+#include <vector>
+
+namespace llpm {
+
+// Fwd defs
+class Design;
+class Module;
+
+/**
+ * Binary snapshot of a design's modules right after elaboration:
+ * LLVM types, blocks, ports, interfaces and connections. Loading one
+ * skips the frontend and elaboration entirely, so runs which only
+ * differ in optimization options (e.g. clock frequency sweeps) pay
+ * for elaboration once.
+ *
+ * Only the primitives which survive elaboration can be saved; other
+ * blocks are rejected by name. Loaded modules are plain
+ * ContainerModules which keep the software model the frontend gave
+ * them (if any), so wedges build the same simulation libraries from
+ * them as from a fresh elaboration. Blocks keep their place
+ * in the module's block order and as much history as naming needs,
+ * so the output matches that of an uninterrupted run; the chain
+ * behind each block's immediate origin is dropped. LLVM !range
+ * metadata on the instructions the blocks compute themselves is saved
+ * along with them, since the instructions are gone after loading.
+ */
+class Checkpoint {
+public:
+    static void Save(Design& d, std::string fn);
+    static void Save(Design& d, const std::vector<Module*>& mods,
+                     std::string fn);
+
+    // Adds the saved modules to d and marks it elaborated
+    static void Load(Design& d, std::string fn);
+    // Just reads the saved modules. The caller owns them.
+    static std::vector<Module*> Read(Design& d, std::string fn);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_CHECKPOINT_HPP__
@@ -1,24 +1,93 @@
 #include "connection.hpp"
 
 #include <llpm/block.hpp>
+#include <llpm/module.hpp>
 #include <util/llvm_type.hpp>
 #include <libraries/core/interface.hpp>
 #include <analysis/graph_queries.hpp>
 
+#include <unordered_set>
+
 using namespace std;
 
 namespace llpm {
 
+ConnectionDB::ConnectionDB(Module* m) :
+    ConnectionDB(m, m != NULL ? m->design().connStorage() : Storage::Hashed)
+{ }
+
+ConnectionDB::ConnectionDB(Module* m, Storage storage) :
+    _module(m),
+    _changeCounter(0),
+    _storage(storage)
+{
+    if (_storage == Storage::Dense)
+        _dense.reset(new DenseConnectionIndex());
+}
+
 void ConnectionDB::filterBlocks(boost::function<bool(Block*)> ignoreBlock,
                                 std::set<Block*>& blocks)
 {
-    for (auto p: _blockUseCounts) {
-        if (p.second >= 1 &&
-            _blacklist.count(p.first.get()) == 0 &&
-            ignoreBlock(p.first.get())) {
-            blocks.insert(p.first.get());
+    for (auto b: this->blocks()) {
+        if (ignoreBlock(b))
+            blocks.insert(b);
+    }
+}
+
+void ConnectionDB::liveInsert(Block* b) {
+    assert(_livePos.count(b) == 0);
+    _livePos[b] = _live.size();
+    _live.push_back(b);
+}
+
+void ConnectionDB::liveErase(Block* b) {
+    auto f = _livePos.find(b);
+    assert(f != _livePos.end());
+    _live[f->second] = NULL;
+    _livePos.erase(f);
+
+    // Compact once tombstones dominate
+    if (_live.size() > 64 && _live.size() > 2 * _livePos.size()) {
+        size_t pos = 0;
+        for (auto lb: _live) {
+            if (lb == NULL)
+                continue;
+            _live[pos] = lb;
+            _livePos[lb] = pos;
+            pos++;
         }
+        _live.resize(pos);
+    }
+}
+
+void ConnectionDB::reorder(const std::vector<Block*>& order) {
+    unordered_set<Block*> placed;
+    vector<Block*> live;
+    live.reserve(_livePos.size());
+    for (auto b: order) {
+        if (_livePos.count(b) > 0 && placed.insert(b).second)
+            live.push_back(b);
     }
+    for (auto b: _live) {
+        if (b != NULL && placed.count(b) == 0)
+            live.push_back(b);
+    }
+    _live.swap(live);
+    for (size_t i=0; i<_live.size(); i++)
+        _livePos[_live[i]] = i;
+    _changeCounter++;
+}
+
+void ConnectionDB::blacklist(BlockP b) {
+    if (_blacklist.insert(b).second && isUsed(b.get()))
+        liveErase(b.get());
+    _changeCounter++;
+}
+
+void ConnectionDB::deblacklist(BlockP b) {
+    if (_blacklist.erase(b) > 0 && isUsed(b.get()))
+        liveInsert(b.get());
+    _changeCounter++;
 }
 
 void ConnectionDB::registerBlock(BlockP block) {
@@ -42,6 +111,8 @@ void ConnectionDB::registerBlock(BlockP block) {
 
     uint64_t& count = _blockUseCounts[block];
     count += 1;
+    if (count == 1 && _blacklist.count(block) == 0)
+        liveInsert(block.get());
     _changeCounter++;
 }
 
@@ -51,12 +122,21 @@ void ConnectionDB::deregisterBlock(BlockP block) {
     count -= 1;
     if (count == 0) {
         block->module(nullptr);
+        if (_blacklist.count(block) == 0)
+            liveErase(block.get());
     }
 }
 
 void ConnectionDB::findSinks(const OutputPort* op,
                              std::vector<InputPort*>& out) const
 {
+    if (_dense) {
+        auto sinks = _dense->sinks(op);
+        if (sinks != NULL)
+            out.insert(out.end(), sinks->begin(), sinks->end());
+        return;
+    }
+
     const auto& f = _sinkIdx.find((OutputPort*)op);
     if (f != _sinkIdx.end()) {
         for (auto ip: f->second) {
@@ -68,6 +148,13 @@ void ConnectionDB::findSinks(const OutputPort* op,
 void ConnectionDB::findSinks(const OutputPort* op,
                              std::set<InputPort*>& out) const
 {
+    if (_dense) {
+        auto sinks = _dense->sinks(op);
+        if (sinks != NULL)
+            out = std::set<InputPort*>(sinks->begin(), sinks->end());
+        return;
+    }
+
     const auto& f = _sinkIdx.find((OutputPort*)op);
     if (f != _sinkIdx.end()) {
         out = f->second;
@@ -76,6 +163,9 @@ void ConnectionDB::findSinks(const OutputPort* op,
 
 unsigned ConnectionDB::countSinks(const OutputPort* op) const
 {
+    if (_dense)
+        return _dense->countSinks(op);
+
     const auto& f = _sinkIdx.find((OutputPort*)op);
     if (f != _sinkIdx.end()) {
         return f->second.size();
@@ -85,6 +175,9 @@ unsigned ConnectionDB::countSinks(const OutputPort* op) const
 
 OutputPort* ConnectionDB::findSource(const InputPort* ip) const
 {
+    if (_dense)
+        return _dense->source(ip);
+
     auto f = _sourceIdx.find((InputPort*)ip);
     if (f == _sourceIdx.end())
         return NULL;
@@ -92,6 +185,14 @@ OutputPort* ConnectionDB::findSource(const InputPort* ip) const
 }
 
 bool ConnectionDB::find(const InputPort* ip, Connection& cOut) const {
+    if (_dense) {
+        OutputPort* op = _dense->source(ip);
+        if (op == NULL)
+            return false;
+        cOut = Connection(op, (InputPort*)ip);
+        return true;
+    }
+
     auto f = _sourceIdx.find((InputPort*)ip);
     if (f == _sourceIdx.end())
         return false;
@@ -101,6 +202,16 @@ bool ConnectionDB::find(const InputPort* ip, Connection& cOut) const {
 
 void ConnectionDB::find(const OutputPort* op,
                         std::vector<Connection>& out) const {
+    if (_dense) {
+        auto sinks = _dense->sinks(op);
+        if (sinks != NULL) {
+            for (auto ip: *sinks) {
+                out.push_back(Connection((OutputPort*)op, ip));
+            }
+        }
+        return;
+    }
+
     const auto& f = _sinkIdx.find((OutputPort*)op);
     if (f != _sinkIdx.end()) {
         for (auto ip: f->second) {
@@ -154,8 +265,12 @@ void ConnectionDB::connect(OutputPort* o, InputPort* i) {
     }
 #endif
 
-    _sourceIdx.emplace(i, o);
-    _sinkIdx[o].insert(i);
+    if (_dense) {
+        _dense->insert(o, i);
+    } else {
+        _sourceIdx.emplace(i, o);
+        _sinkIdx[o].insert(i);
+    }
     _changeCounter++;
 
 #ifndef LLPM_NO_DEBUG
@@ -181,20 +296,24 @@ void ConnectionDB::connect(Interface* a, Interface* b) {
 void ConnectionDB::disconnect(OutputPort* o, InputPort* i) {
     assert(o != NULL);
     assert(i != NULL);
-    auto sourceF = _sourceIdx.find(i);
-    if (sourceF != _sourceIdx.end() &&
-        sourceF->second == o)
-        _sourceIdx.erase(sourceF);
-
-    auto sinkF = _sinkIdx.find(o);
-    if (sinkF != _sinkIdx.end()) {
-        auto& s = sinkF->second;
-        auto f = s.find(i);
-        if (f != s.end()) {
-            s.erase(f);
+    if (_dense) {
+        _dense->erase(o, i);
+    } else {
+        auto sourceF = _sourceIdx.find(i);
+        if (sourceF != _sourceIdx.end() &&
+            sourceF->second == o)
+            _sourceIdx.erase(sourceF);
+
+        auto sinkF = _sinkIdx.find(o);
+        if (sinkF != _sinkIdx.end()) {
+            auto& s = sinkF->second;
+            auto f = s.find(i);
+            if (f != s.end()) {
+                s.erase(f);
+            }
+            if (s.size() == 0)
+                _sinkIdx.erase(sinkF);
         }
-        if (s.size() == 0)
-            _sinkIdx.erase(sinkF);
     }
 
     _changeCounter++;
@@ -254,19 +373,15 @@ void ConnectionDB::removeBlock(Block* b) {
 
 void ConnectionDB::update(const ConnectionDB& newdb) {
     // First, update the module info for all incoming blocks
-    std::set<Block*> blocks;
-    newdb.findAllBlocks(blocks);
-    for (auto b: blocks) {
-        if (newdb.isblacklisted(b))
-            continue;
+    for (auto b: newdb.blocks()) {
         b->module(_module);
     }
 
-    for (const auto& c: newdb._sourceIdx) {
-        if (newdb.isblacklisted(c.first->ownerP()) ||
-            newdb.isblacklisted(c.second->ownerP()))
+    for (const Connection& c: newdb) {
+        if (newdb.isblacklisted(c.sink()->ownerP()) ||
+            newdb.isblacklisted(c.source()->ownerP()))
             continue;
-        connect(c.first, c.second);
+        connect(c.source(), c.sink());
     }
     _changeCounter++;
 }
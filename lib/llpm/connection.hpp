@@ -4,11 +4,14 @@
 #include <llpm/ports.hpp>
 #include <llpm/block.hpp>
 #include <llpm/exceptions.hpp>
+#include <llpm/dense_connections.hpp>
 #include <util/macros.hpp>
 
 #include <boost/function.hpp>
 #include <set>
 #include <map>
+#include <memory>
+#include <iterator>
 #include <unordered_map>
 
 namespace llpm {
@@ -68,12 +71,27 @@ public:
  * Also, ConnectionDB deals with ownership of the blocks. Internally,
  * the list of blocks are 'intrusive_ptr's to the blocks so the blocks
  * are can be free'd when they are no longer involved in connections.
+ *
+ * Connectivity can be kept in one of two storage engines. 'Hashed'
+ * is a pair of pointer-keyed maps. 'Dense' gives each port a slot
+ * number and keeps adjacency in flat arrays (see
+ * DenseConnectionIndex), which is much friendlier to large designs.
+ * The API is identical either way.
  */
 class ConnectionDB {
+public:
+    enum class Storage {
+        Hashed,
+        Dense
+    };
+
+private:
     Module* _module;
     uint64_t _changeCounter;
+    Storage _storage;
 
-    // Connection data are stored in this bidirectional map
+    // Connection data are stored in this bidirectional map when using
+    // hashed storage
     typedef std::unordered_map<OutputPort*, std::set<InputPort*> > SinkIdx;
     typedef std::unordered_map<InputPort*, OutputPort*> SourceIdx;
     SinkIdx   _sinkIdx;
@@ -83,17 +101,32 @@ class ConnectionDB {
     std::map<BlockP, uint64_t> _blockUseCounts;
     std::set<BlockP> _newBlocks;
 
+    // Blocks which are in use and not blacklisted, in the order in
+    // which they became live. Removals leave a NULL tombstone which
+    // gets compacted away once they outnumber the live entries.
+    std::vector<Block*> _live;
+    std::unordered_map<Block*, size_t> _livePos;
+    void liveInsert(Block* b);
+    void liveErase(Block* b);
+
+    // Dense storage. Must be declared after _blockUseCounts so that it
+    // is torn down while the ports it references are still alive.
+    std::unique_ptr<DenseConnectionIndex> _dense;
+
     void registerBlock(BlockP block);
     void deregisterBlock(BlockP block);
 
 public:
-    ConnectionDB(Module* m) :
-        _module(m),
-        _changeCounter(0)
-    { }
+    /**
+     * Use the storage engine selected for the module's design, or
+     * hashed storage if there is no module.
+     */
+    ConnectionDB(Module* m);
+    ConnectionDB(Module* m, Storage storage);
 
     DEF_GET_NP(module);
     DEF_GET_NP(changeCounter);
+    DEF_GET_NP(storage);
 
     /**
      * Returns a pointer to a counter which increments every time a
@@ -105,46 +138,66 @@ public:
         return &_changeCounter;
     }
 
-    const auto& sinksRaw() const {
-        return _sinkIdx;
-    }
-
-    const auto& sourcesRaw() const {
-        return _sourceIdx;
-    }
-
-    class ConstIterator : public SourceIdx::const_iterator {
+    class ConstIterator :
+        public std::iterator<std::forward_iterator_tag, Connection> {
         friend class ConnectionDB;
-        ConstIterator(SourceIdx::const_iterator iter) 
-            : SourceIdx::const_iterator(iter) { }
+        SourceIdx::const_iterator _iter;
+        const DenseConnectionIndex* _dense;
+        uint32_t _slot;
+
+        ConstIterator(SourceIdx::const_iterator iter) :
+            _iter(iter),
+            _dense(NULL),
+            _slot(0) { }
+        ConstIterator(const DenseConnectionIndex* dense, uint32_t slot) :
+            _dense(dense),
+            _slot(slot) { }
     public:
         Connection operator*() const {
-            return Connection(
-                SourceIdx::const_iterator::operator*());
+            if (_dense)
+                return Connection(_dense->sourceAt(_slot),
+                                  _dense->sinkAt(_slot));
+            return Connection(*_iter);
+        }
+
+        ConstIterator& operator++() {
+            if (_dense)
+                _slot = _dense->nextSlot(_slot + 1);
+            else
+                ++_iter;
+            return *this;
+        }
+
+        bool operator==(const ConstIterator& o) const {
+            if (_dense)
+                return _slot == o._slot;
+            return _iter == o._iter;
+        }
+
+        bool operator!=(const ConstIterator& o) const {
+            return !operator==(o);
         }
     };
     ConstIterator begin() const {
+        if (_dense)
+            return ConstIterator(_dense.get(), _dense->nextSlot(0));
         return ConstIterator(_sourceIdx.begin());
     };
     ConstIterator end() const {
+        if (_dense)
+            return ConstIterator(_dense.get(), _dense->endSlot());
         return ConstIterator(_sourceIdx.end());
     };
 
     /**
      * Make this block invisible to clients
      */
-    void blacklist(BlockP b) {
-        _blacklist.insert(b);
-        _changeCounter++;
-    }
+    void blacklist(BlockP b);
 
     /**
      * Make this block visible to clients
      */
-    void deblacklist(BlockP b) {
-        _blacklist.erase(b);
-        _changeCounter++;
-    }
+    void deblacklist(BlockP b);
 
     /**
      * Is thie block visible to clients?
@@ -177,13 +230,106 @@ public:
         _newBlocks.clear();
     }
 
-    void findAllBlocks(std::set<Block*>& blocks) const {
-        for (auto pr: _blockUseCounts) {
-            if (pr.second >= 1 && _blacklist.count(pr.first) == 0)
-                blocks.insert(pr.first.get());
+    /**
+     * Iterable view of the live (used and not blacklisted) blocks in
+     * this DB. Order is the order in which blocks became live, so it
+     * is deterministic from run to run. The view is invalidated by
+     * any change to the DB -- take a copy with findAllBlocks() if you
+     * intend to modify the DB while walking the blocks.
+     */
+    class BlockIterator :
+        public std::iterator<std::forward_iterator_tag, Block*> {
+        friend class ConnectionDB;
+        std::vector<Block*>::const_iterator _iter;
+        std::vector<Block*>::const_iterator _end;
+
+        BlockIterator(std::vector<Block*>::const_iterator iter,
+                      std::vector<Block*>::const_iterator end) :
+            _iter(iter),
+            _end(end)
+        {
+            skip();
+        }
+
+        void skip() {
+            while (_iter != _end && *_iter == NULL)
+                ++_iter;
+        }
+    public:
+        Block* operator*() const {
+            return *_iter;
         }
+
+        BlockIterator& operator++() {
+            ++_iter;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const BlockIterator& o) const {
+            return _iter == o._iter;
+        }
+
+        bool operator!=(const BlockIterator& o) const {
+            return _iter != o._iter;
+        }
+    };
+
+    class BlockView {
+        friend class ConnectionDB;
+        const ConnectionDB* _db;
+        BlockView(const ConnectionDB* db) :
+            _db(db) { }
+    public:
+        BlockIterator begin() const {
+            return BlockIterator(_db->_live.begin(), _db->_live.end());
+        }
+        BlockIterator end() const {
+            return BlockIterator(_db->_live.end(), _db->_live.end());
+        }
+        size_t size() const {
+            return _db->_livePos.size();
+        }
+        bool count(Block* b) const {
+            return _db->_livePos.count(b);
+        }
+    };
+
+    BlockView blocks() const {
+        return BlockView(this);
+    }
+
+    void findAllBlocks(std::set<Block*>& blocks) const {
+        blocks.insert(_live.begin(), _live.end());
+        blocks.erase(NULL);
+    }
+
+    void findAllBlocks(std::vector<Block*>& blocks) const {
+        blocks.reserve(blocks.size() + _livePos.size());
+        for (auto b: _live)
+            if (b != NULL)
+                blocks.push_back(b);
     }
 
+    /**
+     * Sort key which puts blocks in blocks() order. Lets clients order
+     * a subset of the blocks without walking all of them. Blocks which
+     * aren't live sort last. Keys change as the DB does.
+     */
+    size_t liveOrder(Block* b) const {
+        auto f = _livePos.find(b);
+        if (f == _livePos.end())
+            return (size_t)-1;
+        return f->second;
+    }
+
+    /**
+     * Put the live blocks listed in 'order' first, in that order,
+     * followed by the rest as they were. Lets a module read back from
+     * a checkpoint walk its blocks in the order the saved one did.
+     */
+    void reorder(const std::vector<Block*>& order);
+
     /**
      * Return the set of blocks contained by this DB, filtered by the
      * function passed in.
@@ -245,6 +391,8 @@ public:
     }
 
     size_t numConnections() const {
+        if (_dense)
+            return _dense->size();
         return _sourceIdx.size();
     }
     size_t size() const {
@@ -4,10 +4,14 @@
 #include <analysis/graph_queries.hpp>
 #include <libraries/synthesis/fork.hpp>
 #include <libraries/synthesis/pipeline.hpp>
+#include <libraries/synthesis/arith.hpp>
 #include <analysis/graph.hpp>
 #include <analysis/graph_impl.hpp>
+#include <backends/backend.hpp>
 #include <util/transform.hpp>
 #include <util/llvm_type.hpp>
+#include <util/misc.hpp>
+#include <llpm/design.hpp>
 #include <passes/transforms/simplify.hpp>
 
 #include <boost/format.hpp>
@@ -21,7 +25,7 @@ using namespace std;
 namespace llpm {
 
 void FormControlRegionPass::runInternal(Module* mod) {
-    if (dynamic_cast<ControlRegion*>(mod) != NULL)
+    if (mod->is<ControlRegion>())
         return;
 
     ContainerModule* cm = dynamic_cast<ContainerModule*>(mod);
@@ -89,10 +93,10 @@ void FormControlRegionPass::runInternal(Module* mod) {
 
     unsigned regions = 0;
     unsigned flattened = 0;
-    set<Block*> allBlocks;
+    vector<Block*> allBlocks;
     conns->findAllBlocks(allBlocks);
     for (auto b: allBlocks) {
-        auto cr = dynamic_cast<ControlRegion*>(b);
+        auto cr = b->as<ControlRegion>();
         if (cr != NULL) {
             regions++;
             if (cr->size() <= 1) {
@@ -118,6 +122,10 @@ bool ControlRegion::BlockAllowed(Block* b) {
     if (b->is<Latch>() || b->is<PipelineRegister>())
         // Don't allow Latches and PRegs for now
         return false;
+    if (b->is<SequentialArith>() &&
+        b->as<SequentialArith>()->interval() > 1)
+        // Can't take a new input every cycle like the rest of the CR
+        return false;
     return true;
 }
 
@@ -180,11 +188,11 @@ bool ControlRegion::canGrow(OutputPort* op) {
 }
 
 bool ControlRegion::canGrow(Port* p) {
-    auto op = dynamic_cast<OutputPort*>(p);
+    auto op = p->asOutput();
     if (op)
         return canGrow(op);
 
-    auto ip = dynamic_cast<InputPort*>(p);
+    auto ip = p->asInput();
     if (ip)
         return canGrow(ip);
 
@@ -411,9 +419,7 @@ void ControlRegion::validityCheck() const {
     // NO cycles!
     assert(!hasCycle());
 
-    set<Block*> blocks;
-    _conns.findAllBlocks(blocks);
-    for (auto b: blocks) {
+    for (auto b: _conns.blocks()) {
         assert(b->firing() == DependenceRule::AND_FireOne);
         assert(b->outputsTied());
         assert(!b->outputsSeparate());
@@ -432,7 +438,7 @@ void ControlRegion::finalize() {
     }
 
     // Eliminate Waits and Forks
-    set<Block*> blocks;
+    vector<Block*> blocks;
     _conns.findAllBlocks(blocks);
     for (auto b: blocks) {
         if (b->is<Wait>()) {
@@ -545,8 +551,7 @@ struct PipelineDepthVisitor : public Visitor<OIEdge> {
             stats[op->owner()].visits = op->owner()->inputs().size();
         }
 
-        std::set<Block*> blocks;
-        conns->findAllBlocks(blocks);
+        auto blocks = conns->blocks();
 
         for (auto b: blocks) {
             if (b->inputs().size() == 0) {
@@ -560,18 +565,55 @@ struct PipelineDepthVisitor : public Visitor<OIEdge> {
     }
 };
 
+void ControlRegion::expandMultiCycle() {
+    // Units inside a CR can't run off their own handshakes, so swap
+    // them for registers and the combinational operator, as many
+    // cycles deep. Like the units, the operands are registered first so
+    // that no upstream logic runs into the operator in the same cycle.
+    // The stage controllers drive the registers like any other, and
+    // synthesis retimes those after the operator into the logic.
+    Backend* backend = design().backend();
+    vector<Block*> blocks;
+    _conns.findAllBlocks(blocks);
+    for (auto b: blocks) {
+        unsigned cycles = backend->cycles(b);
+        if (cycles == 0)
+            continue;
+        auto sa = b->as<SequentialArith>();
+        if (sa == nullptr)
+            throw InvalidArgument("Don't know how to schedule a " +
+                                  cpp_demangle(typeid(*b).name()) +
+                                  " in a control region");
+        auto inReg = new PipelineRegister(sa->din());
+        inReg->history().setOptimization(sa);
+        _conns.remap(sa->din(), inReg->din());
+        auto comb = sa->combinational();
+        comb->history().setOptimization(sa);
+        _conns.connect(inReg->dout(), comb->din());
+        OutputPort* op = comb->dout();
+        for (unsigned i=1; i<cycles; i++) {
+            auto preg = new PipelineRegister(op);
+            preg->history().setOptimization(sa);
+            _conns.connect(op, preg->din());
+            op = preg->dout();
+        }
+        _conns.remap(sa->dout(), op);
+    }
+}
+
 void ControlRegion::schedule() {
     _regSchedule.clear();
     _blockSchedule.clear();
 
+    expandMultiCycle();
+
     PipelineDepthVisitor pdv;
     pdv.run(this);
 
     Transformer t(this);
 
-    set<const Port*> constPorts;
-    set<Block*> constBlocks;
-    queries::FindConstants(this, constPorts, constBlocks);
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(this);
+    const set<const Port*>& constPorts = consts->ports;
 
     /* Any connection spanning a depth > 0 needs to be pipelined. */
     // Build a list of blocks to be checked for additional pipelining.
@@ -35,6 +35,7 @@ class ControlRegion : public ContainerModule {
 
 
     std::set<InputPort*> findDependences(OutputPort*) const;
+    void expandMultiCycle();
 
 public:
     ControlRegion(MutableModule* parent,
@@ -44,6 +45,7 @@ public:
         _parent(parent),
         _finalized(false),
         _scheduled(false) {
+        kind<ControlRegion>();
         this->module(parent);
         auto rc = add(seed);
         assert(rc);
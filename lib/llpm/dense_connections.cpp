@@ -0,0 +1,115 @@
+#include "dense_connections.hpp"
+
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+namespace llpm {
+
+static atomic<uint64_t> NextSerial(1);
+
+DenseConnectionIndex::DenseConnectionIndex() :
+    _serial(NextSerial++),
+    _size(0)
+{ }
+
+DenseConnectionIndex::~DenseConnectionIndex() {
+    // Release our stamps so that other indexes can claim these ports
+    for (auto ip: _inPorts)
+        if (ip != NULL && ip->_denseOwner == _serial)
+            ip->_denseOwner = 0;
+    for (auto op: _outPorts)
+        if (op != NULL && op->_denseOwner == _serial)
+            op->_denseOwner = 0;
+}
+
+void DenseConnectionIndex::stamp(Port* p, uint32_t slot) {
+    if (p->_denseOwner == 0) {
+        p->_denseOwner = _serial;
+        p->_denseSlot = slot;
+    } else {
+        assert(p->_denseOwner != _serial);
+        _foreign[p] = slot;
+    }
+}
+
+void DenseConnectionIndex::unstamp(Port* p) {
+    if (p->_denseOwner == _serial)
+        p->_denseOwner = 0;
+    else
+        _foreign.erase(p);
+}
+
+uint32_t DenseConnectionIndex::slot(InputPort* ip) {
+    uint32_t s = lookup(ip);
+    if (s != NoSlot)
+        return s;
+
+    if (_freeIn.size() > 0) {
+        s = _freeIn.back();
+        _freeIn.pop_back();
+        _inPorts[s] = ip;
+    } else {
+        s = _inPorts.size();
+        _inPorts.push_back(ip);
+        _inSource.push_back(NULL);
+    }
+    stamp(ip, s);
+    return s;
+}
+
+uint32_t DenseConnectionIndex::slot(OutputPort* op) {
+    uint32_t s = lookup(op);
+    if (s != NoSlot)
+        return s;
+
+    if (_freeOut.size() > 0) {
+        s = _freeOut.back();
+        _freeOut.pop_back();
+        _outPorts[s] = op;
+    } else {
+        s = _outPorts.size();
+        _outPorts.push_back(op);
+        _outSinks.emplace_back();
+    }
+    stamp(op, s);
+    return s;
+}
+
+void DenseConnectionIndex::insert(OutputPort* op, InputPort* ip) {
+    uint32_t is = slot(ip);
+    assert(_inSource[is] == NULL);
+    uint32_t os = slot(op);
+    _inSource[is] = op;
+    _outSinks[os].push_back(ip);
+    _size++;
+}
+
+bool DenseConnectionIndex::erase(OutputPort* op, InputPort* ip) {
+    uint32_t is = lookup(ip);
+    uint32_t os = lookup(op);
+    if (is == NoSlot || os == NoSlot || _inSource[is] != op)
+        return false;
+
+    _inSource[is] = NULL;
+    _inPorts[is] = NULL;
+    _freeIn.push_back(is);
+    unstamp(ip);
+
+    auto& sinks = _outSinks[os];
+    auto f = std::find(sinks.begin(), sinks.end(), ip);
+    assert(f != sinks.end());
+    *f = sinks.back();
+    sinks.pop_back();
+    if (sinks.size() == 0) {
+        _outPorts[os] = NULL;
+        _freeOut.push_back(os);
+        unstamp(op);
+    }
+
+    _size--;
+    return true;
+}
+
+} // namespace llpm
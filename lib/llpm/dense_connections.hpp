@@ -0,0 +1,123 @@
+#ifndef __LLPM_DENSE_CONNECTIONS_HPP__
+#define __LLPM_DENSE_CONNECTIONS_HPP__
+
+#include <llpm/ports.hpp>
+
+#include <llvm/ADT/SmallVector.h>
+
+#include <vector>
+#include <unordered_map>
+
+namespace llpm {
+
+/**
+ * Compact adjacency storage for ConnectionDB. Each port seen by the
+ * index gets a dense slot number, stamped directly into the port so
+ * that lookups are an array access rather than a hash and a tree
+ * walk. Slots are recycled once a port has no connections left.
+ *
+ * A port may be live in two indexes at once (e.g. during
+ * ConnectionDB::update). The first index to see it owns the stamp;
+ * any others keep the port in a small side table.
+ */
+class DenseConnectionIndex {
+public:
+    static const uint32_t NoSlot = ~0u;
+    typedef llvm::SmallVector<InputPort*, 2> SinkVec;
+
+private:
+    // Unique across all indexes ever created, so a stale stamp left by
+    // a destroyed index can never be mistaken for a live one
+    uint64_t _serial;
+
+    std::vector<InputPort*>  _inPorts;
+    std::vector<OutputPort*> _inSource;
+    std::vector<OutputPort*> _outPorts;
+    std::vector<SinkVec>     _outSinks;
+
+    std::vector<uint32_t> _freeIn;
+    std::vector<uint32_t> _freeOut;
+
+    // Ports stamped by some other index
+    std::unordered_map<const Port*, uint32_t> _foreign;
+
+    size_t _size;
+
+    uint32_t lookup(const Port* p) const {
+        if (p->_denseOwner == _serial)
+            return p->_denseSlot;
+        if (_foreign.size() == 0)
+            return NoSlot;
+        auto f = _foreign.find(p);
+        if (f == _foreign.end())
+            return NoSlot;
+        return f->second;
+    }
+
+    void stamp(Port* p, uint32_t slot);
+    void unstamp(Port* p);
+
+    uint32_t slot(InputPort* ip);
+    uint32_t slot(OutputPort* op);
+
+public:
+    DenseConnectionIndex();
+    ~DenseConnectionIndex();
+
+    DenseConnectionIndex(const DenseConnectionIndex&) = delete;
+    DenseConnectionIndex& operator=(const DenseConnectionIndex&) = delete;
+
+    void insert(OutputPort* op, InputPort* ip);
+    bool erase(OutputPort* op, InputPort* ip);
+
+    OutputPort* source(const InputPort* ip) const {
+        uint32_t s = lookup(ip);
+        if (s == NoSlot)
+            return NULL;
+        return _inSource[s];
+    }
+
+    const SinkVec* sinks(const OutputPort* op) const {
+        uint32_t s = lookup(op);
+        if (s == NoSlot)
+            return NULL;
+        return &_outSinks[s];
+    }
+
+    unsigned countSinks(const OutputPort* op) const {
+        uint32_t s = lookup(op);
+        if (s == NoSlot)
+            return 0;
+        return _outSinks[s].size();
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    /**
+     * Iterate over connections by input slot. Order is stable for a
+     * given sequence of edits.
+     */
+    uint32_t nextSlot(uint32_t slot) const {
+        while (slot < _inSource.size() && _inSource[slot] == NULL)
+            slot++;
+        return slot;
+    }
+
+    uint32_t endSlot() const {
+        return _inSource.size();
+    }
+
+    InputPort* sinkAt(uint32_t slot) const {
+        return _inPorts[slot];
+    }
+
+    OutputPort* sourceAt(uint32_t slot) const {
+        return _inSource[slot];
+    }
+};
+
+} // namespace llpm
+
+#endif // __LLPM_DENSE_CONNECTIONS_HPP__
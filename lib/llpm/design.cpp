@@ -1,9 +1,13 @@
 #include "design.hpp"
 
 #include <llpm/module.hpp>
+#include <llpm/checkpoint.hpp>
+#include <llpm/dse.hpp>
+#include <llpm/elab_cache.hpp>
 #include <backends/graphviz/graphviz.hpp>
 #include <util/misc.hpp>
 #include <util/llvm_type.hpp>
+#include <util/pool_alloc.hpp>
 
 #include <llvm/Pass.h>
 #include <llvm/IR/Module.h>
@@ -11,11 +15,18 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <sstream>
+#include <sys/resource.h>
+
 using namespace std;
 
 namespace llpm {
 
 Design::~Design() {
+    // Finishes any queued dumps
+    DEL_IF(_dumpWriter);
+    DEL_IF(_explorer);
+    DEL_IF(_elabCache);
     for (auto m: _modules) {
         delete m;
     }
@@ -23,28 +34,117 @@ Design::~Design() {
     DEL_IF(_namer);
     DEL_IF(_backend);
     DEL_IF(_gvOutput);
+    DEL_IF(_passPool);
 
     for (auto m: _llvmModules) {
         delete m;
     }
     DEL_IF(_passReg);
+
+    // Blocks and ports all went with the modules, so their slabs can go
+    SlabPool::trim();
+}
+
+void Design::printAllocStats() {
+    auto s = SlabPool::stats();
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("Allocation stats:\n");
+    printf("    Objects allocated: %lu (%lu too large to pool)\n",
+           s.allocs, s.largeAllocs);
+    printf("    Objects freed: %lu, live: %lu, peak live: %lu\n",
+           s.frees, s.live, s.peakLive);
+    printf("    Slab memory: %.1f MB\n", s.slabBytes / (1024.0 * 1024.0));
+    printf("    Peak RSS: %.1f MB\n", ru.ru_maxrss / 1024.0);
+}
+
+void Design::passThreads(unsigned threads) {
+    if (threads == 0)
+        threads = 1;
+    if (threads != _passThreads && _passPool != NULL) {
+        delete _passPool;
+        _passPool = NULL;
+    }
+    _passThreads = threads;
+}
+
+unsigned Design::loopII(const std::string& loop) const {
+    auto f = _loopII.find(loop);
+    if (f == _loopII.end())
+        f = _loopII.find("");
+    if (f == _loopII.end())
+        return 0;
+    return f->second;
+}
+
+AsyncWriter* Design::dumpWriter() {
+    if (_dumpWriter == NULL)
+        _dumpWriter = new AsyncWriter();
+    return _dumpWriter;
+}
+
+void Design::dumpGraph(std::string fn, Module* mod,
+                       bool trans, std::string comment) {
+    std::ostringstream os;
+    gv()->writeModule(os, mod, trans, comment);
+    dumpWriter()->write(workingDir()->create(fn), os.str());
+}
+
+void Design::joinThreads() {
+    // Finishes any queued dumps
+    DEL_IF(_dumpWriter);
+    _dumpWriter = NULL;
+    DEL_IF(_passPool);
+    _passPool = NULL;
+}
+
+ThreadPool* Design::passPool() {
+    if (_passThreads <= 1)
+        return NULL;
+    if (_passPool == NULL)
+        _passPool = new ThreadPool(_passThreads);
+    return _passPool;
 }
 
 int Design::go() {
-    // If wedges require wrapper, wrap away!
-    printf("Wrapping modules...\n");
-    if (_wrapper) {
-        for (unsigned i=0; i<_modules.size(); i++) {
-            _modules[i] = _wrapper->wrapModule(_modules[i]);
+    if (!_elaborated) {
+        // If wedges require wrapper, wrap away!
+        printf("Wrapping modules...\n");
+        if (_wrapper) {
+            for (unsigned i=0; i<_modules.size(); i++) {
+                Module* m = _modules[i];
+                if (_preElaborated.count(m) > 0)
+                    continue;
+                _modules[i] = _wrapper->wrapModule(m);
+                if (_elabCache != NULL)
+                    _elabCache->replaced(m, _modules[i]);
+            }
         }
+
+        printf("Elaborating...\n");
+        this->elaborate(true);
     }
-      
-    printf("Elaborating...\n");
-    this->elaborate(true);
+
+    if (_saveElab != "") {
+        printf("Writing elaborated design to '%s'...\n", _saveElab.c_str());
+        Checkpoint::Save(*this, _saveElab);
+        if (_dumpWriter != NULL)
+            _dumpWriter->flush();
+        return 0;
+    }
+
+    if (_explorer != NULL)
+        return _explorer->run();
+
     printf("Optimizing...\n");
     this->optimize(true);
+    return writeOutput();
+}
 
+int Design::writeOutput() {
     FileSet* fs = workingDir();
+    // Nothing moves between modules any more
+    namer().cacheFullNames();
 
     // printf("Writing graphviz output...\n");
     // for (Module* mod: d.modules()) {
@@ -70,19 +170,20 @@ int Design::go() {
                    op->name().c_str(), typestr(op->type()).c_str());
         }
 
-        printf("Writing graphviz output...\n");
-        auto f =fs->create(mod->name() + ".gv");
-        gv()->writeModule(f, mod, true);
-        f->close();
-        f = fs->create(mod->name() + "_simple.gv");
-        gv()->writeModule(f, mod, false);
-        f->close();
-
-        vector<Module*> submodules;
-        mod->submodules(submodules);
-        for (auto sm: submodules) {
-            gv()->writeModule(fs->create(sm->name() + ".gv"), sm, true);
+        if (_dumps.final()) {
+            printf("Writing graphviz output...\n");
+            dumpGraph(mod->name() + ".gv", mod, true);
+            dumpGraph(mod->name() + "_simple.gv", mod, false);
+
+            vector<Module*> submodules;
+            mod->submodules(submodules);
+            for (auto sm: submodules) {
+                dumpGraph(sm->name() + ".gv", sm, true);
+            }
         }
+        // The dump writer owns the files it's writing until it's done
+        if (_dumpWriter != NULL)
+            _dumpWriter->flush();
         fs->flush();
 
         if (_wedge) {
@@ -91,6 +192,12 @@ int Design::go() {
         }
     }
 
+    if (_dumpWriter != NULL)
+        _dumpWriter->flush();
+
+    if (_allocStats)
+        printAllocStats();
+
     return 0;
 }
 
@@ -103,9 +210,7 @@ protected:
         if (conns == NULL)
             return;
 
-        set<Block*> blocks;
-        conns->findAllBlocks(blocks);
-        for (auto b: blocks) {
+        for (auto b: conns->blocks()) {
             if (b->history().src() == BlockHistory::Unset)
                 b->history().setFrontend();
         }
@@ -117,9 +222,7 @@ public:
 };
 
 void setUnknownElaboration(Module* m) {
-    std::set<Block*> blocks;
-    m->conns()->findAllBlocks(blocks);
-    for (Block* b: blocks) {
+    for (Block* b: m->conns()->blocks()) {
         if (b->history().src() == BlockHistory::Unset) {
             b->history().setUnknown();
             b->history().meta("elaboration");
@@ -141,6 +244,10 @@ void Design::elaborate(bool debug) {
     sfh.run();
 
     for (Module* m: _modules) {
+        if (_preElaborated.count(m) > 0) {
+            printf("Using cached elaboration of '%s'\n", m->name().c_str());
+            continue;
+        }
         m->validityCheck();
 
         bool refined;
@@ -157,6 +264,8 @@ void Design::elaborate(bool debug) {
         m->validityCheck();
 
         if (!refined) {
+            if (_elabCache != NULL)
+                _elabCache->drop(m);
             printf("Error: could not finish refining!\n");
             printf("Remaining blocks to be refined: \n");
             vector<Block*> blocks;
@@ -169,16 +278,19 @@ void Design::elaborate(bool debug) {
             }
         }
     }
+    _elaborations.writeProfile();
+    if (_elabCache != NULL)
+        _elabCache->storePending();
+    _elaborated = true;
 }
 
 void Design::optimize(bool debug) {
     _optimizations.run(debug);
+    _optimizations.writeProfile();
 
     LambdaModulePass p(*this,
         [](Module* m) {
-            std::set<Block*> blocks;
-            m->conns()->findAllBlocks(blocks);
-            for (Block* b: blocks) {
+            for (Block* b: m->conns()->blocks()) {
                 if (b->history().src() == BlockHistory::Unset) {
                     b->history().setOptimization(NULL);
                     b->history().meta("(unknown which optimization)");
@@ -5,13 +5,18 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <refinery/refinery.hpp>
+#include <refinery/implementations.hpp>
 #include <synthesis/object_namer.hpp>
 #include <backends/backend.hpp>
 #include <wedges/wedge.hpp>
 #include <util/macros.hpp>
 #include <util/files.hpp>
+#include <util/thread_pool.hpp>
+#include <util/async_writer.hpp>
 #include <passes/manager.hpp>
+#include <passes/dump_policy.hpp>
 
+#include <map>
 #include <memory>
 #include <vector>
 #include <boost/program_options.hpp>
@@ -25,11 +30,42 @@ namespace llpm {
 // Fwd defs. Are modern compilers really still 1-pass?
 class Module;
 class GraphvizOutput;
+class DesignSpaceExplorer;
+class ElabCache;
+
+/**
+ * Knobs which shape the optimization pipeline
+ */
+struct OptConfig {
+    // Target clock in MHz. Not pipelined for timing if <= 0.
+    float clkMHz;
+    bool controlRegions;
+    // Register untied outputs rather than latching them
+    bool untiedRegs;
+    // Multiply/divide implementation: comb, pipelined[:N], iterative or
+    // auto (picked per operator by slack)
+    std::string arith;
+    // Longest initiation interval 'auto' may pick
+    unsigned arithMaxInterval;
+    // Shrink operators and registers to the value ranges they carry
+    bool narrowWidths;
+
+    OptConfig() :
+        clkMHz(-1.0),
+        controlRegions(true),
+        untiedRegs(false),
+        arith("comb"),
+        arithMaxInterval(1),
+        narrowWidths(false)
+    { }
+};
 
 class Design {
     std::shared_ptr<llvm::LLVMContext> _context;
     llvm::PassRegistry* _passReg;
     Refinery* _refinery;
+    // Alternative implementations of operators, for SelectImplPass
+    ImplRegistry _impls;
     std::vector<Module*> _modules;
     ObjectNamer* _namer;
     Backend* _backend;
@@ -37,6 +73,22 @@ class Design {
     Wrapper* _wrapper;
     GraphvizOutput* _gvOutput;
     FileSet _workingDir;
+    ConnectionDB::Storage _connStorage;
+    unsigned _passThreads;
+    ThreadPool* _passPool;
+    bool _allocStats;
+    DumpPolicy _dumps;
+    AsyncWriter* _dumpWriter;
+    bool _elaborated;
+    std::string _saveElab;
+    OptConfig _optConfig;
+    DesignSpaceExplorer* _explorer;
+    ElabCache* _elabCache;
+    bool _pipelineLoops;
+    // Target initiation interval per loop; "" is the default
+    std::map<std::string, unsigned> _loopII;
+    // Modules which came in already elaborated
+    std::set<Module*> _preElaborated;
 
     PassManager _elaborations;
     PassManager _optimizations;
@@ -50,12 +102,21 @@ public:
     Design(std::shared_ptr<llvm::LLVMContext> ctxt = NULL) :
         _passReg(NULL),
         _refinery(new Refinery()),
-        _namer(NULL),
+        _namer(new ObjectNamer()),
         _backend(NULL),
         _wedge(NULL),
         _wrapper(NULL),
         _gvOutput(NULL),
         _workingDir(),
+        _connStorage(ConnectionDB::Storage::Hashed),
+        _passThreads(1),
+        _passPool(NULL),
+        _allocStats(false),
+        _dumpWriter(NULL),
+        _elaborated(false),
+        _explorer(NULL),
+        _elabCache(NULL),
+        _pipelineLoops(false),
         _elaborations(*this, "elab"),
         _optimizations(*this, "opt"),
         _optDesc("Design global options")
@@ -80,10 +141,20 @@ public:
      */
     int go();
 
+    /// Print the interfaces and write dumps and the wedge's output
+    int writeOutput();
+
+    // Report SlabPool counters and peak RSS
+    void printAllocStats();
+
     Refinery& refinery() {
         return *_refinery;
     }
 
+    ImplRegistry& impls() {
+        return _impls;
+    }
+
     DEF_GET_NP(backend);
     DEF_SET_NONULL(backend);
     DEF_GET_NP(wedge);
@@ -96,6 +167,75 @@ public:
     DEF_GET(workingDir);
     GraphvizOutput* gv();
 
+    /**
+     * Which debug dumps to write. Dumps are rendered by the caller and
+     * written out on a background thread by dumpWriter().
+     */
+    const DumpPolicy& dumps() const {
+        return _dumps;
+    }
+    DEF_SET(dumps);
+    AsyncWriter* dumpWriter();
+
+    /// Queue a Graphviz dump of mod into the working directory
+    void dumpGraph(std::string fn, Module* mod,
+                   bool trans=true, std::string comment="");
+
+    /**
+     * Storage engine used by ConnectionDBs created for modules in
+     * this design. Only affects modules created after it is set.
+     */
+    DEF_GET_NP(connStorage);
+    DEF_SET(connStorage);
+
+    /**
+     * Number of threads used to run module-local passes. The pool
+     * is created on first use; NULL if running single threaded.
+     */
+    DEF_GET_NP(passThreads);
+    void passThreads(unsigned threads);
+    ThreadPool* passPool();
+
+    /**
+     * Finish queued dumps and stop the pass and dump threads, e.g.
+     * before fork()ing. Both start again on demand.
+     */
+    void joinThreads();
+
+    /**
+     * Set once the modules are elaborated, either by elaborate() or
+     * by loading a checkpoint. go() then starts with optimization.
+     */
+    DEF_GET_NP(elaborated);
+    DEF_SET(elaborated);
+
+    /**
+     * If set, go() writes a checkpoint to this file after elaboration
+     * and stops there
+     */
+    DEF_GET_NP(saveElab);
+    DEF_SET(saveElab);
+
+    /**
+     * Cache of elaborated modules shared between runs. NULL unless
+     * enabled with --elab_cache.
+     */
+    DEF_GET_NP(elabCache);
+
+    /**
+     * Should frontends pipeline innermost loops? If so, loopII() is
+     * the initiation interval wanted for a loop, 0 meaning as low as
+     * its recurrences allow.
+     */
+    DEF_GET_NP(pipelineLoops);
+    unsigned loopII(const std::string& loop) const;
+
+    const OptConfig& optConfig() const {
+        return _optConfig;
+    }
+    // Replace the optimization pipeline with one built for this config
+    void buildOptimizations(const OptConfig& cfg);
+
     void elaborate(bool debug = false);
     void optimize(bool debug = false);
 
@@ -105,8 +245,15 @@ public:
         return _modules;
     }
 
-    void addModule(Module* module) {
+    /**
+     * Add a top-level module. If it's already elaborated (e.g. it
+     * came from the elaboration cache) it is not wrapped or
+     * elaborated again.
+     */
+    void addModule(Module* module, bool elaborated = false) {
         _modules.push_back(module);
+        if (elaborated)
+            _preElaborated.insert(module);
     }
 
     llvm::LLVMContext& context() const {
@@ -114,9 +261,6 @@ public:
     }
 
     ObjectNamer& namer() {
-        if (_namer == NULL) {
-            _namer = new ObjectNamer();
-        }
         return *_namer;
     };
 
@@ -1,14 +1,22 @@
 #include "design.hpp"
+#include "dse.hpp"
+#include "elab_cache.hpp"
 
 #include <passes/transforms/synthesize_mem.hpp>
 #include <passes/transforms/synthesize_forks.hpp>
 #include <passes/transforms/pipeline.hpp>
+#include <passes/transforms/retime.hpp>
 #include <passes/print.hpp>
 #include <passes/manager.hpp>
 #include <passes/transforms/simplify.hpp>
 #include <passes/transforms/refine.hpp>
+#include <passes/transforms/share.hpp>
+#include <passes/transforms/arith_impl.hpp>
+#include <passes/transforms/select_impl.hpp>
+#include <passes/transforms/narrow.hpp>
 #include <passes/analysis/checks.hpp>
 #include <libraries/core/tags.hpp>
+#include <libraries/synthesis/arith.hpp>
 
 #include <backends/verilog/synthesize.hpp>
 #include <backends/ipxact/ipxact.hpp>
@@ -17,9 +25,15 @@
 #include <wedges/verilator/verilator.hpp>
 #include <wedges/axi/axi_wedge.hpp>
 
+#include <frontends/llvm/loops.hpp>
+
 #include <boost/program_options.hpp>
 #include <boost/program_options/errors.hpp>
 
+#include <boost/algorithm/string.hpp>
+
+#include <sstream>
+
 using namespace boost::program_options;
 using namespace std;
 
@@ -55,7 +69,15 @@ char const* BackendEnumStrings [] = {
 };
 ENUM_SER(BackendEnum, BackendEnumStrings);
 
+char const* ConnStorageStrings [] = {
+    "hashed",
+    "dense"
+};
+ENUM_SER(ConnectionDB::Storage, ConnStorageStrings);
+
 void Design::buildOpts() {
+    RegisterArithImpls(_impls);
+
     _optDesc.add_options()
         ("wedge", value<WedgeEnum>()->default_value(WedgeEnum::Verilator)
                                     ->required(),
@@ -72,12 +94,79 @@ void Design::buildOpts() {
         ("control_regions", value<bool>()->default_value(true)
                                          ->required(),
             "Controls whether or not control regions are built")
+        ("arith", value<string>()->default_value("comb")
+                                 ->required(),
+            "Multiplier and divider implementation: comb, pipelined "
+            "(stages to meet --clk), pipelined:N (N stages), iterative "
+            "(one bit per cycle) or auto (cheapest which meets --clk, "
+            "per operator)")
+        ("arith_max_interval", value<unsigned>()->default_value(1)
+                                               ->required(),
+            "Longest initiation interval --arith=auto may pick, in cycles")
+        ("narrow_widths", value<bool>()->default_value(false)
+                                        ->required(),
+            "Shrink adders, compares and pipeline registers to the value "
+            "ranges they carry")
+        ("conn_storage", value<ConnectionDB::Storage>()
+                            ->default_value(ConnectionDB::Storage::Hashed)
+                            ->required(),
+            "Connection database storage engine (e.g. hashed, dense)")
+        ("pass_threads", value<unsigned>()->default_value(1)
+                                          ->required(),
+            "Number of threads used to run module-local passes")
+        ("alloc_stats", value<bool>()->default_value(false)
+                                     ->required(),
+            "Print object allocation counts and peak memory use when done")
+        ("history_depth", value<unsigned>()->default_value(0)
+                                           ->required(),
+            "Longest block history chain kept for diagnostics (0: no limit)")
+        ("dumps", value<string>()->default_value("final")
+                                 ->required(),
+            "Debug dumps to write: off, final, every:N (passes) or "
+            "only:<pass or module>,...")
+        ("dse", value<string>()->default_value("")
+                               ->required(),
+            "Explore these clock targets (MHz, comma separated) instead "
+            "of doing a single run")
+        ("dse_vary", value<string>()->default_value("")
+                                    ->required(),
+            "Also try both settings of these knobs when exploring: "
+            "control_regions, untied_regs")
+        ("dse_jobs", value<unsigned>()->default_value(0)
+                                      ->required(),
+            "Configurations explored at once (0: one per core)")
+        ("dse_emit", value<string>()->default_value("pareto")
+                                    ->required(),
+            "Explored configurations to write Verilog for: pareto, all "
+            "or none")
+        ("pipeline_loops", value<bool>()->default_value(false)
+                                        ->required(),
+            "Pipeline innermost (single block) loops")
+        ("loop_ii", value<string>()->default_value("")
+                                   ->required(),
+            "Target initiation interval of pipelined loops: N for all "
+            "loops or function:block=N,... (default: as low as possible)")
+        ("share_ops", value<bool>()->default_value(false)
+                                   ->required(),
+            "Share multipliers and dividers between basic blocks")
+        ("share_latency_weight", value<float>()->default_value(8.0)
+                                              ->required(),
+            "Area an operator share must save per unit of logic it adds "
+            "to each requester's path")
+        ("elab_cache", value<string>()->default_value("")
+                                      ->required(),
+            "Directory in which to cache elaborated modules between runs")
     ;
     _workingDir.addOpts(_optDesc);
 }
 
 void Design::notify(variables_map& vm) {
     _workingDir.notify(vm);
+    _connStorage = vm["conn_storage"].as<ConnectionDB::Storage>();
+    passThreads(vm["pass_threads"].as<unsigned>());
+    _allocStats = vm["alloc_stats"].as<bool>();
+    BlockHistory::maxDepth(vm["history_depth"].as<unsigned>());
+    _dumps = DumpPolicy::Parse(vm["dumps"].as<string>());
 
     switch (vm["backend"].as<BackendEnum>()) {
     case BackendEnum::Verilog:
@@ -111,18 +200,91 @@ void Design::notify(variables_map& vm) {
         break;
     }
 
-    float clkFreq = vm["clk"].as<float>() * 1e6;
+    _pipelineLoops = vm["pipeline_loops"].as<bool>();
+    vector<string> iis;
+    boost::split(iis, vm["loop_ii"].as<string>(), boost::is_any_of(","));
+    for (auto ii: iis) {
+        boost::trim(ii);
+        if (ii == "")
+            continue;
+        string loop;
+        auto eq = ii.rfind('=');
+        if (eq != string::npos) {
+            loop = ii.substr(0, eq);
+            ii = ii.substr(eq + 1);
+        }
+        try {
+            _loopII[loop] = stoul(ii);
+        } catch (std::exception&) {
+            throw InvalidArgument("Bad loop II '" + ii + "'");
+        }
+    }
+
+    string cacheDir = vm["elab_cache"].as<string>();
+    if (cacheDir != "") {
+        // Everything here changes what elaboration produces. --loop_ii
+        // doesn't: it only sets the targets LoopIIReportPass checks.
+        ostringstream os;
+        os << "backend=" << vm["backend"].as<BackendEnum>()
+           << " wedge=" << vm["wedge"].as<WedgeEnum>()
+           << " wrapper=" << vm["wrapper"].as<WrapperEnum>()
+           << " pipeline_loops=" << _pipelineLoops
+           << " share_ops=" << vm["share_ops"].as<bool>()
+           << " share_latency_weight="
+           << vm["share_latency_weight"].as<float>();
+        _elabCache = new ElabCache(*this, cacheDir, os.str());
+    }
 
     elaborations()->append<SynthesizeMemoryPass>();
     elaborations()->append<SynthesizeTagsPass>();
     elaborations()->append<RefinePass>();
+    if (vm["share_ops"].as<bool>())
+        elaborations()->append<ShareOperatorsPass>(
+            vm["share_latency_weight"].as<float>());
+
+    OptConfig cfg;
+    cfg.clkMHz = vm["clk"].as<float>();
+    cfg.controlRegions = vm["control_regions"].as<bool>();
+    cfg.untiedRegs = cfg.clkMHz > 0.0;
+    cfg.arith = vm["arith"].as<string>();
+    cfg.arithMaxInterval = vm["arith_max_interval"].as<unsigned>();
+    cfg.narrowWidths = vm["narrow_widths"].as<bool>();
+    buildOptimizations(cfg);
+
+    string dse = vm["dse"].as<string>();
+    if (dse != "") {
+        _explorer = new DesignSpaceExplorer(*this, dse,
+                                            vm["dse_vary"].as<string>(),
+                                            vm["dse_jobs"].as<unsigned>(),
+                                            vm["dse_emit"].as<string>());
+    }
+}
+
+void Design::buildOptimizations(const OptConfig& cfg) {
+    _optConfig = cfg;
+    _optimizations.clear();
+    float clkFreq = cfg.clkMHz * 1e6;
+
+    // Narrower operators are faster, so do this before choosing their
+    // implementations
+    if (cfg.narrowWidths)
+        optimizations()->append<NarrowWidthsPass>();
+    if (cfg.arith == "auto") {
+        // Without a clock target everything meets timing as is
+        if (clkFreq > 0.0)
+            optimizations()->append<SelectImplPass>(
+                Time::s(1.0 / clkFreq), cfg.arithMaxInterval);
+    } else {
+        optimizations()->append<ArithImplPass>(
+            cfg.arith, clkFreq > 0.0 ? Time::s(1.0 / clkFreq) : Time());
+    }
 
     // optimizations()->append<SimplifyPass>();
     // optimizations()->append<CanonicalizeInputs>();
     // optimizations()->append<SimplifyWaits>();
     // optimizations()->append<SimplifyPass>();
 
-    if (vm["control_regions"].as<bool>()) {
+    if (cfg.controlRegions) {
         optimizations()->append<SimplifyPass>();
         optimizations()->append<FormControlRegionPass>();
     }
@@ -130,19 +292,27 @@ void Design::notify(variables_map& vm) {
     optimizations()->append<PipelineDependentsPass>();
     // optimizations()->append<GVPrinterPass>();
 
-    optimizations()->append<LatchUntiedOutputs>(clkFreq > 0.0);
+    optimizations()->append<LatchUntiedOutputs>(cfg.untiedRegs);
     optimizations()->append<SynthesizeForksPass>(clkFreq > 0.0);
 
+    // Break cycles first so that timing analysis sees an acyclic graph
+    optimizations()->append<PipelineCyclesPass>();
     if (clkFreq > 0.0) {
         Time period = Time::s(1.0 / clkFreq);
         optimizations()->append<PipelineFrequencyPass>(period);
+        optimizations()->append<RetimePass>(period);
     }
-    optimizations()->append<PipelineCyclesPass>();
+    // Once more for the registers pipelining added
+    if (cfg.narrowWidths)
+        optimizations()->append<NarrowWidthsPass>();
 
     optimizations()->append<CheckConnectionsPass>();
     optimizations()->append<CheckOutputsPass>();
     optimizations()->append<CheckCyclesPass>();
-    optimizations()->append<TextPrinterPass>();
+    if (_pipelineLoops)
+        optimizations()->append<LoopIIReportPass>();
+    if (_dumps.final())
+        optimizations()->append<TextPrinterPass>();
     optimizations()->append<StatsPrinterPass>();
 }
 
@@ -0,0 +1,390 @@
+#include "dse.hpp"
+
+#include <llpm/module.hpp>
+#include <llpm/control_region.hpp>
+#include <analysis/timing.hpp>
+#include <analysis/graph_queries.hpp>
+#include <libraries/synthesis/fork.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+#include <util/llvm_type.hpp>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace llpm {
+
+DesignSpaceExplorer::DesignSpaceExplorer(Design& d,
+                                         string clks,
+                                         string vary,
+                                         unsigned jobs,
+                                         string emit) :
+    _design(d),
+    _jobs(jobs)
+{
+    if (_jobs == 0)
+        _jobs = max(1u, thread::hardware_concurrency());
+
+    if (emit == "none")
+        _emit = EmitNone;
+    else if (emit == "pareto")
+        _emit = EmitPareto;
+    else if (emit == "all")
+        _emit = EmitAll;
+    else
+        throw InvalidArgument("Unknown DSE output selection '" + emit + "'");
+
+    vector<string> strs;
+    vector<float> clkList;
+    boost::split(strs, clks, boost::is_any_of(","));
+    for (auto s: strs) {
+        boost::trim(s);
+        if (s == "")
+            continue;
+        try {
+            clkList.push_back(stof(s));
+        } catch (std::exception&) {
+            throw InvalidArgument("Bad DSE clock target '" + s + "'");
+        }
+    }
+    if (clkList.empty())
+        throw InvalidArgument("DSE needs at least one clock target");
+
+    bool varyCR = false;
+    bool varyUntied = false;
+    boost::split(strs, vary, boost::is_any_of(","));
+    for (auto s: strs) {
+        boost::trim(s);
+        if (s == "")
+            continue;
+        if (s == "control_regions")
+            varyCR = true;
+        else if (s == "untied_regs")
+            varyUntied = true;
+        else
+            throw InvalidArgument("Unknown DSE knob '" + s + "'");
+    }
+
+    for (auto clk: clkList) {
+        for (unsigned cr = 0; cr < (varyCR ? 2 : 1); cr++) {
+            for (unsigned ur = 0; ur < (varyUntied ? 2 : 1); ur++) {
+                Point p;
+                p.cfg = d.optConfig();
+                p.cfg.clkMHz = clk;
+                p.cfg.untiedRegs = clk > 0.0;
+                if (varyCR)
+                    p.cfg.controlRegions = (cr == 0);
+                if (varyUntied)
+                    p.cfg.untiedRegs = (ur == 0);
+                p.ok = false;
+                p.metrics = Metrics();
+                p.pareto = false;
+                _points.push_back(p);
+            }
+        }
+    }
+}
+
+std::string DesignSpaceExplorer::Point::label() const {
+    return str(boost::format("clk%1%_%2%_%3%")
+                % cfg.clkMHz
+                % (cfg.controlRegions ? "cr" : "nocr")
+                % (cfg.untiedRegs ? "reg" : "latch"));
+}
+
+std::string DesignSpaceExplorer::dir(const Point& p) const {
+    return _design.workingDir()->dfltDir() + "/dse_" + p.label();
+}
+
+static void MeasureModule(Design& d, Module* mod,
+                          DesignSpaceExplorer::Metrics& m,
+                          map<const OutputPort*, Time>& outDelays,
+                          double& worst) {
+    ConnectionDB* conns = mod->conns();
+    if (conns == NULL)
+        return;
+
+    // Submodules first, so that we know how long their outputs take
+    vector<Module*> subs;
+    mod->submodules(subs);
+    for (auto sub: subs)
+        MeasureModule(d, sub, m, outDelays, worst);
+
+    for (Block* b: conns->blocks()) {
+        if (b->is<PipelineRegister>())
+            m.pipelineRegBits += bitwidth(b->cast<PipelineRegister>()
+                                            ->din()->type());
+        else if (b->is<Fork>())
+            m.forks++;
+        else if (b->is<Latch>())
+            m.latches++;
+        else if (b->is<ControlRegion>())
+            m.crClocks += b->cast<ControlRegion>()->clocks();
+    }
+
+    // Same setup as PipelineFrequencyPass. The period doesn't matter
+    // since we only want the longest path.
+    StaticTiming sta(conns, d.backend(), Time::s(1.0));
+    for (auto sub: subs) {
+        for (auto op: sub->outputs()) {
+            auto f = outDelays.find(op);
+            if (f != outDelays.end())
+                sta.setLatency(op, f->second);
+        }
+    }
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(mod);
+    for (auto p: consts->ports) {
+        auto op = p->asOutput();
+        if (op != NULL)
+            sta.setStart(op, Time());
+    }
+    sta.analyze();
+
+    vector<StaticTiming::TimingPath> paths;
+    sta.worstPaths(1, paths);
+    if (paths.size() > 0 && paths.front().size() > 0)
+        worst = max(worst, paths.front().back().arrival.sec());
+
+    for (auto modOp: mod->outputs()) {
+        InputPort* intIp = mod->getSink(modOp);
+        if (intIp != nullptr)
+            outDelays[modOp] = sta.arrival(intIp);
+    }
+}
+
+DesignSpaceExplorer::Metrics DesignSpaceExplorer::Measure(Design& d) {
+    Metrics m = Metrics();
+    map<const OutputPort*, Time> outDelays;
+    double worst = 0.0;
+    for (auto mod: d.modules())
+        MeasureModule(d, mod, m, outDelays, worst);
+    if (worst > 0.0)
+        m.fmax = 1e-6 / worst;
+    return m;
+}
+
+void DesignSpaceExplorer::forEach(const vector<unsigned>& points,
+                                  string logName,
+                                  function<int (Point&, int fd)> fn,
+                                  vector<string>& out,
+                                  vector<bool>& ok) {
+    out.assign(_points.size(), "");
+    ok.assign(_points.size(), false);
+
+    // Only the forking thread survives in the child
+    _design.joinThreads();
+    fflush(stdout);
+    fflush(stderr);
+
+    struct Child {
+        unsigned point;
+        int fd;
+    };
+    map<pid_t, Child> running;
+
+    auto reap = [&]() {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            throw SysError("waiting for exploration jobs");
+        auto f = running.find(pid);
+        if (f == running.end())
+            return;
+        Child c = f->second;
+        running.erase(f);
+
+        // Children only exit once they've written everything
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(c.fd, buf, sizeof(buf))) > 0)
+            out[c.point].append(buf, n);
+        close(c.fd);
+
+        ok[c.point] = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        Point& p = _points[c.point];
+        if (ok[c.point])
+            printf("    %s: done\n", p.label().c_str());
+        else
+            printf("    %s: failed, see %s/%s\n",
+                   p.label().c_str(), dir(p).c_str(), logName.c_str());
+    };
+
+    for (auto idx: points) {
+        while (running.size() >= _jobs)
+            reap();
+
+        Point& p = _points[idx];
+        int fds[2];
+        if (pipe(fds) != 0)
+            throw SysError("creating a pipe");
+        pid_t pid = fork();
+        if (pid < 0)
+            throw SysError("forking an exploration job");
+
+        if (pid == 0) {
+            close(fds[0]);
+            int rc = 1;
+            try {
+                string dn = dir(p);
+                _design.workingDir()->dfltDir(dn, true);
+                int log = open((dn + "/" + logName).c_str(),
+                               O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                if (log >= 0) {
+                    dup2(log, STDOUT_FILENO);
+                    dup2(log, STDERR_FILENO);
+                    close(log);
+                }
+                rc = fn(p, fds[1]);
+                _design.joinThreads();
+                // _exit() skips the destructors which would otherwise
+                // write out whatever is still buffered
+                _design.workingDir()->flush();
+                _design.workingDir()->close();
+            } catch (Exception& e) {
+                fprintf(stderr, "Caught exception!\n\t%s\n", e.msg.c_str());
+                rc = 1;
+            } catch (std::exception& e) {
+                fprintf(stderr, "Caught exception!\n\t%s\n", e.what());
+                rc = 1;
+            }
+            fflush(stdout);
+            fflush(stderr);
+            close(fds[1]);
+            // The design belongs to the parent; don't tear it down
+            _exit(rc);
+        }
+
+        close(fds[1]);
+        running.emplace(pid, Child {idx, fds[0]});
+    }
+
+    while (!running.empty())
+        reap();
+}
+
+static bool Dominates(const DesignSpaceExplorer::Metrics& a,
+                      const DesignSpaceExplorer::Metrics& b) {
+    if (a.fmax < b.fmax ||
+        a.pipelineRegBits > b.pipelineRegBits ||
+        a.crClocks > b.crClocks ||
+        a.forks > b.forks)
+        return false;
+    return a.fmax > b.fmax ||
+           a.pipelineRegBits < b.pipelineRegBits ||
+           a.crClocks < b.crClocks ||
+           a.forks < b.forks;
+}
+
+void DesignSpaceExplorer::markPareto() {
+    for (auto& p: _points) {
+        p.pareto = p.ok;
+        if (!p.ok)
+            continue;
+        for (const auto& q: _points) {
+            if (q.ok && Dominates(q.metrics, p.metrics)) {
+                p.pareto = false;
+                break;
+            }
+        }
+    }
+}
+
+void DesignSpaceExplorer::report() {
+    auto f = _design.workingDir()->create("dse.csv");
+    auto fd = f->openFile("w");
+    fprintf(fd, "config, clk, control_regions, untied_regs, ok, pareto, "
+                "fmax, pipeline_reg_bits, cr_clocks, forks, latches\n");
+
+    printf("Design space (* marks Pareto-optimal points):\n");
+    printf("    %-26s %10s %10s %8s %8s %8s\n",
+           "config", "Fmax(MHz)", "preg bits", "CR clks", "forks", "latches");
+    for (const auto& p: _points) {
+        const Metrics& m = p.metrics;
+        fprintf(fd, "%s, %g, %d, %d, %d, %d, %.2f, %lu, %lu, %lu, %lu\n",
+                p.label().c_str(), p.cfg.clkMHz,
+                p.cfg.controlRegions, p.cfg.untiedRegs, p.ok, p.pareto,
+                m.fmax, m.pipelineRegBits, m.crClocks, m.forks, m.latches);
+
+        if (!p.ok) {
+            printf("    %-26s %10s\n", p.label().c_str(), "failed");
+            continue;
+        }
+        printf("  %c %-26s %10.1f %10lu %8lu %8lu %8lu\n",
+               p.pareto ? '*' : ' ', p.label().c_str(),
+               m.fmax, m.pipelineRegBits, m.crClocks, m.forks, m.latches);
+    }
+    f->close();
+}
+
+int DesignSpaceExplorer::run() {
+    printf("Exploring %lu configurations, %u at a time...\n",
+           _points.size(), _jobs);
+
+    vector<unsigned> all;
+    for (unsigned i=0; i<_points.size(); i++)
+        all.push_back(i);
+
+    vector<string> out;
+    vector<bool> ok;
+    // Every point gets written out anyway, so do it while the
+    // optimized design is at hand
+    bool emitNow = _emit == EmitAll;
+    forEach(all, "log.txt",
+        [this, emitNow](Point& p, int fd) -> int {
+            _design.buildOptimizations(p.cfg);
+            _design.optimize(true);
+            Metrics m = Measure(_design);
+            if (write(fd, &m, sizeof(m)) != sizeof(m))
+                throw SysError("reporting exploration results");
+            return emitNow ? _design.writeOutput() : 0;
+        }, out, ok);
+
+    int rc = 0;
+    for (unsigned i=0; i<_points.size(); i++) {
+        Point& p = _points[i];
+        p.ok = ok[i] && out[i].size() == sizeof(Metrics);
+        if (p.ok)
+            memcpy(&p.metrics, out[i].data(), sizeof(Metrics));
+        else
+            rc = 1;
+    }
+    markPareto();
+    report();
+
+    // Which points are Pareto-optimal is only known once all of them
+    // are measured. Rather than keep every child around until then,
+    // the chosen ones are optimized again.
+    vector<unsigned> chosen;
+    for (unsigned i=0; i<_points.size(); i++) {
+        const Point& p = _points[i];
+        if (p.ok && _emit == EmitPareto && p.pareto)
+            chosen.push_back(i);
+    }
+    if (chosen.empty())
+        return rc;
+
+    printf("Writing output for %lu configurations...\n", chosen.size());
+    forEach(chosen, "emit_log.txt",
+        [this](Point& p, int) -> int {
+            _design.buildOptimizations(p.cfg);
+            _design.optimize(true);
+            return _design.writeOutput();
+        }, out, ok);
+    for (auto idx: chosen) {
+        if (!ok[idx])
+            rc = 1;
+    }
+    return rc;
+}
+
+} // namespace llpm
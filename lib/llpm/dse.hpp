@@ -0,0 +1,92 @@
+#ifndef __LLPM_DSE_HPP__
+#define __LLPM_DSE_HPP__
+
+#include <llpm/design.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace llpm {
+
+/**
+ * Runs the optimization pipeline on an elaborated design once per
+ * configuration: each clock target crossed with both settings of the
+ * varied knobs. Every configuration runs in a fork()ed child process,
+ * so each starts from a copy-on-write image of the elaborated design
+ * and several run at once.
+ *
+ * Results are reported as a table (also written to dse.csv) with the
+ * Pareto-optimal configurations marked. Verilog is written for the
+ * chosen configurations, each into its own subdirectory of the
+ * working directory: by the measuring child when all of them are
+ * wanted, otherwise by a second round of children for the Pareto
+ * points, which repeats their optimization.
+ */
+class DesignSpaceExplorer {
+public:
+    enum Emit {
+        EmitNone,
+        EmitPareto,
+        EmitAll
+    };
+
+    struct Metrics {
+        // Estimated from static timing, in MHz. Zero if unknown.
+        double fmax;
+        uint64_t pipelineRegBits;
+        uint64_t crClocks;
+        uint64_t forks;
+        uint64_t latches;
+    };
+
+    struct Point {
+        OptConfig cfg;
+        bool ok;
+        Metrics metrics;
+        bool pareto;
+
+        std::string label() const;
+    };
+
+private:
+    Design& _design;
+    std::vector<Point> _points;
+    unsigned _jobs;
+    Emit _emit;
+
+    /**
+     * Run fn(point, fd) for each of the points in a child process, at
+     * most _jobs at once. Whatever fn writes to fd ends up in 'out'.
+     * The child's output goes to logName in its own directory.
+     */
+    void forEach(const std::vector<unsigned>& points,
+                 std::string logName,
+                 std::function<int (Point&, int fd)> fn,
+                 std::vector<std::string>& out,
+                 std::vector<bool>& ok);
+
+    std::string dir(const Point& p) const;
+    void markPareto();
+    void report();
+
+public:
+    DesignSpaceExplorer(Design& d,
+                        std::string clks,
+                        std::string vary,
+                        unsigned jobs,
+                        std::string emit);
+
+    const std::vector<Point>& points() const {
+        return _points;
+    }
+
+    /// Measure what the optimization pipeline produced
+    static Metrics Measure(Design& d);
+
+    int run();
+};
+
+} // namespace llpm
+
+#endif // __LLPM_DSE_HPP__
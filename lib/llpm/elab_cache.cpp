@@ -0,0 +1,104 @@
+#include "elab_cache.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <llpm/checkpoint.hpp>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
+
+#include <cstdio>
+#include <boost/filesystem/operations.hpp>
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace llpm {
+
+ElabCache::ElabCache(Design& d, std::string dir, std::string options) :
+    _design(d),
+    _dir(dir),
+    _options(options)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(_dir, ec);
+    if (ec)
+        throw SysError("creating elaboration cache '" + _dir + "'");
+}
+
+std::string ElabCache::fileName(const std::string& key) const {
+    return _dir + "/" + key + ".ckpt";
+}
+
+std::string ElabCache::key(const std::string& contentHash) const {
+    llvm::MD5 h;
+    h.update(_options);
+    h.update(llvm::ArrayRef<uint8_t>((const uint8_t*)"", 1));
+    h.update(contentHash);
+    llvm::MD5::MD5Result res;
+    h.final(res);
+    llvm::SmallString<32> str;
+    llvm::MD5::stringifyResult(res, str);
+    return string(str.begin(), str.end());
+}
+
+Module* ElabCache::load(const std::string& key) {
+    string fn = fileName(key);
+    if (!boost::filesystem::exists(fn))
+        return NULL;
+
+    try {
+        auto mods = Checkpoint::Read(_design, fn);
+        if (mods.size() == 1)
+            return mods.front();
+        for (auto m: mods)
+            delete m;
+        printf("Warning: ignoring malformed cache entry '%s'\n", fn.c_str());
+    } catch (Exception& e) {
+        printf("Warning: ignoring unreadable cache entry '%s': %s\n",
+               fn.c_str(), e.msg.c_str());
+    }
+    return NULL;
+}
+
+void ElabCache::storeAfterElaboration(Module* m, const std::string& key) {
+    _pending[m] = key;
+}
+
+void ElabCache::replaced(Module* from, Module* to) {
+    auto f = _pending.find(from);
+    if (f == _pending.end())
+        return;
+    string key = f->second;
+    _pending.erase(f);
+    _pending[to] = key;
+}
+
+void ElabCache::drop(Module* m) {
+    _pending.erase(m);
+}
+
+void ElabCache::storePending() {
+    for (auto p: _pending) {
+        Module* m = p.first;
+        string fn = fileName(p.second);
+        // Write to a temporary and rename so that concurrent runs
+        // sharing the cache never see a partial entry
+        string tmp = fn + "." + to_string(getpid()) + ".tmp";
+        try {
+            Checkpoint::Save(_design, {m}, tmp);
+            if (rename(tmp.c_str(), fn.c_str()) != 0)
+                throw SysError("renaming " + tmp);
+            printf("Cached elaborated module '%s' as %s\n",
+                   m->name().c_str(), p.second.c_str());
+        } catch (Exception& e) {
+            unlink(tmp.c_str());
+            printf("Warning: could not cache module '%s': %s\n",
+                   m->name().c_str(), e.msg.c_str());
+        }
+    }
+    _pending.clear();
+}
+
+} // namespace llpm
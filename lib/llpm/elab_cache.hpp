@@ -0,0 +1,63 @@
+#ifndef __LLPM_ELAB_CACHE_HPP__
+#define __LLPM_ELAB_CACHE_HPP__
+
+#include <util/macros.hpp>
+
+#include <map>
+#include <string>
+
+namespace llpm {
+
+// Fwd defs
+class Design;
+class Module;
+
+/**
+ * Persistent cache of elaborated modules, stored as checkpoints in a
+ * directory. Frontends key each module by a hash of whatever it was
+ * built from; the key is combined with the options which influence
+ * elaboration (backend, wedge, wrapper). On a hit the frontend can
+ * skip translation and the design skips wrapping and elaboration for
+ * that module. Entries are checkpoints, so a hit keeps the module's
+ * software model and wedges treat it just like a miss.
+ *
+ * The cache does not know which version of LLPM wrote an entry
+ * beyond the checkpoint format, so clear it when upgrading.
+ */
+class ElabCache {
+    Design& _design;
+    std::string _dir;
+    std::string _options;
+
+    // Modules to be written once elaborated, with their keys
+    std::map<Module*, std::string> _pending;
+
+    std::string fileName(const std::string& key) const;
+
+public:
+    ElabCache(Design& d, std::string dir, std::string options);
+
+    DEF_GET_NP(dir);
+
+    /// Combine a frontend's content hash with the elaboration options
+    std::string key(const std::string& contentHash) const;
+
+    /**
+     * Read the module cached under key. Returns NULL on a miss or if
+     * the entry can't be read.
+     */
+    Module* load(const std::string& key);
+
+    /// Write m under key after the design elaborates it
+    void storeAfterElaboration(Module* m, const std::string& key);
+    /// The wrapper replaced 'from' with 'to'; cache 'to' instead
+    void replaced(Module* from, Module* to);
+    /// Don't write m after all, e.g. because it failed to elaborate
+    void drop(Module* m);
+    /// Write out all the pending modules
+    void storePending();
+};
+
+} // namespace llpm
+
+#endif // __LLPM_ELAB_CACHE_HPP__
@@ -1,43 +1,250 @@
 #include "history.hpp"
 
 #include <llpm/block.hpp>
-#include <llpm/module.hpp>
 #include <util/misc.hpp>
 
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/DebugLoc.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
+#include <unordered_set>
+
 using namespace std;
 
 namespace llpm {
 
+unsigned BlockHistory::MaxDepth = 0;
+
+static atomic<uint64_t> NextOriginID(0);
+
+static mutex InternLock;
+
+static const string* internType(const type_info& ti) {
+    static unordered_map<type_index, string> names;
+    lock_guard<mutex> l(InternLock);
+    auto f = names.find(ti);
+    if (f != names.end())
+        return &f->second;
+    return &(names[ti] = cpp_demangle(ti.name()));
+}
+
+// For type names which come from somewhere other than a live block
+static const string* internType(const string& name) {
+    static unordered_set<string> names;
+    lock_guard<mutex> l(InternLock);
+    return &*names.insert(name).first;
+}
+
 static void printTabs(unsigned tabs) {
     for (unsigned i=0; i<tabs; i++) {
         printf("    ");
     }
 }
 
-void BlockHistory::print(unsigned tabs) const {
-    const char* source;
-    switch(_src) {
-    case Unknown:
-        source = "unknown"; break;
-    case Frontend:
-        source = "frontend"; break;
-    case Refinement:
-        source = "refinement"; break;
-    case Optimization:
-        source = "optimization"; break;
+static const char* sourceStr(BlockHistory::Source src) {
+    switch(src) {
+    case BlockHistory::Unknown:
+        return "unknown";
+    case BlockHistory::Frontend:
+        return "frontend";
+    case BlockHistory::Refinement:
+        return "refinement";
+    case BlockHistory::Optimization:
+        return "optimization";
+    default:
+        return "???";
+    }
+}
+
+static const char* suffixStr(BlockHistory::Source src) {
+    switch(src) {
+    case BlockHistory::Refinement:
+        return "r";
+    case BlockHistory::Optimization:
+        return "o";
     default:
-        source = "???"; break;
-    }
-    printTabs(tabs); printf("Source: %s %s\n",
-                            source, _meta.c_str());
-    for (BlockP b: _srcBlocks) {
-        auto name = b->module()->design().namer().getName(b.get(),
-                                                          b->module());
-        printTabs(tabs); printf("%s (%s)",
-                                name.c_str(),
-                                cpp_demangle(typeid(*b).name()).c_str());
-        b->history().print(tabs+1);
+        return "";
+    }
+}
+
+static void printSource(unsigned tabs, BlockHistory::Source src,
+                        const string& meta, const llvm::Instruction* ins) {
+    printTabs(tabs); printf("Source: %s %s", sourceStr(src), meta.c_str());
+    if (ins != nullptr) {
+        const llvm::Function* f = ins->getParent()->getParent();
+        printf(" [%s", f->getName().str().c_str());
+        const llvm::DebugLoc& dl = ins->getDebugLoc();
+        if (dl)
+            printf(":%u:%u", dl.getLine(), dl.getCol());
+        printf("]");
+    }
+    printf("\n");
+}
+
+// The nearest origin in a chain with an LLVM instruction (or, lacking
+// one, range metadata), breadth first
+static const BlockHistory::Origin* nearestSource(
+        const vector<BlockHistory::OriginP>& origins) {
+    deque<const BlockHistory::Origin*> q;
+    for (auto o: origins)
+        q.push_back(o.get());
+    while (!q.empty()) {
+        auto o = q.front();
+        q.pop_front();
+        if (o->ins != nullptr || o->range != nullptr)
+            return o;
+        for (auto p: o->parents)
+            q.push_back(p.get());
+    }
+    return nullptr;
+}
+
+static const llvm::Instruction* nearestIns(
+        const vector<BlockHistory::OriginP>& origins) {
+    auto o = nearestSource(origins);
+    return o == nullptr ? nullptr : o->ins;
+}
+
+static const llvm::MDNode* rangeOf(const llvm::Instruction* ins,
+                                   const llvm::MDNode* range) {
+    if (ins != nullptr)
+        return ins->getMetadata(llvm::LLVMContext::MD_range);
+    return range;
+}
+
+static const llvm::MDNode* nearestRange(
+        const vector<BlockHistory::OriginP>& origins) {
+    auto o = nearestSource(origins);
+    return o == nullptr ? nullptr : rangeOf(o->ins, o->range);
+}
+
+// Copy an origin chain, dropping everything more than 'depth' deep. An
+// origin which loses parents keeps the nearest instruction they had, so
+// sourceIns() gives the same answer as it did on the whole chain.
+static BlockHistory::OriginP trim(BlockHistory::OriginP o, unsigned depth) {
+    if (depth == 0)
+        return nullptr;
+    if (o->depth <= depth)
+        return o;
+
+    auto c = make_shared<BlockHistory::Origin>(*o);
+    c->parents.clear();
+    c->depth = 1;
+    if (c->ins == nullptr && c->range == nullptr) {
+        c->ins = nearestIns(o->parents);
+        c->range = nearestRange(o->parents);
     }
+    for (auto p: o->parents) {
+        auto tp = trim(p, depth - 1);
+        if (tp == nullptr)
+            continue;
+        c->parents.push_back(tp);
+        c->depth = max(c->depth, tp->depth + 1);
+    }
+    return c;
+}
+
+BlockHistory::OriginP BlockHistory::Snapshot(Block* b) {
+    const BlockHistory& h = b->history();
+    auto o = make_shared<Origin>();
+    o->id = NextOriginID++;
+    o->type = internType(typeid(*b));
+    o->src = h._src;
+    o->meta = h._meta;
+    o->ins = h._ins;
+    o->range = h._range;
+
+    if (b->name() != "") {
+        o->base = b->name();
+    } else if (h._origins.size() == 1 &&
+               (h._src == Refinement || h._src == Optimization)) {
+        const Origin* p = h._origins.front().get();
+        o->base = p->base;
+        o->suffix = p->suffix + suffixStr(h._src);
+    }
+
+    o->depth = 1;
+    for (auto p: h._origins) {
+        if (MaxDepth > 0)
+            p = trim(p, MaxDepth - 1);
+        if (p == nullptr) {
+            // Dropped entirely. Keep its instruction, as trim() does.
+            if (o->ins == nullptr && o->range == nullptr) {
+                o->ins = nearestIns(h._origins);
+                o->range = nearestRange(h._origins);
+            }
+            continue;
+        }
+        o->parents.push_back(p);
+        o->depth = max(o->depth, p->depth + 1);
+    }
+    return o;
+}
+
+BlockHistory::OriginP BlockHistory::Restore(const std::string& type,
+                                            std::string base,
+                                            std::string suffix,
+                                            Source src, std::string meta) {
+    auto o = make_shared<Origin>();
+    o->id = NextOriginID++;
+    o->type = internType(type);
+    o->base = base;
+    o->suffix = suffix;
+    o->src = src;
+    o->meta = meta;
+    o->ins = nullptr;
+    o->range = nullptr;
+    o->depth = 1;
+    return o;
+}
+
+void BlockHistory::setSource(Source s, Block* src) {
+    _src = s;
+    if (src == NULL)
+        _origins = {};
+    else
+        _origins = {Snapshot(src)};
+}
+
+void BlockHistory::Origin::print(unsigned tabs) const {
+    printTabs(tabs);
+    printf("#%lu %s%s (%s)\n",
+           id,
+           base == "" ? "<anon>" : base.c_str(),
+           suffix.c_str(),
+           type->c_str());
+    printSource(tabs+1, src, meta, ins);
+    for (auto p: parents)
+        p->print(tabs+1);
+}
+
+const llvm::Instruction* BlockHistory::sourceIns() const {
+    if (_ins != nullptr)
+        return _ins;
+    return nearestIns(_origins);
+}
+
+const llvm::MDNode* BlockHistory::sourceRange() const {
+    if (_ins != nullptr || _range != nullptr)
+        return rangeOf(_ins, _range);
+    return nearestRange(_origins);
+}
+
+const llvm::MDNode* BlockHistory::range() const {
+    return rangeOf(_ins, _range);
+}
+
+void BlockHistory::print(unsigned tabs) const {
+    printSource(tabs, _src, _meta, _ins);
+    for (auto o: _origins)
+        o->print(tabs);
 }
 
 } // namespace
@@ -1,19 +1,23 @@
 #ifndef __LLPM_HISTORY_HPP__
 #define __LLPM_HISTORY_HPP__
 
-#include <list>
+#include <vector>
 #include <string>
+#include <memory>
 
 #include <util/macros.hpp>
 #include <llpm/exceptions.hpp>
 
-#include <boost/smart_ptr/intrusive_ptr.hpp>
+// fwd defs
+namespace llvm {
+    class Instruction;
+    class MDNode;
+}
 
 namespace llpm {
 
 // Hey, C++: The 60's want their fwd. decl. back!
 class Block;
-typedef boost::intrusive_ptr<Block> BlockP;
 
 class BlockHistory {
 public:
@@ -25,70 +29,139 @@ public:
         Optimization
     };
 
+    class Origin;
+    typedef std::shared_ptr<const Origin> OriginP;
+
+    /**
+     * What is kept of a source block: enough to name its descendants
+     * and print where they came from, but no reference to the block
+     * itself, so refined-away blocks (and their ports) get freed.
+     * Origins are immutable and shared by all of a block's descendants.
+     */
+    class Origin {
+    public:
+        // Process-wide sequence number
+        uint64_t id;
+        // Interned, demangled class name
+        const std::string* type;
+        // Historical name is base + suffix. An empty base means the
+        // chain started with an anonymous block.
+        std::string base;
+        std::string suffix;
+
+        // The source block's own history
+        Source src;
+        std::string meta;
+        const llvm::Instruction* ins;
+        // !range metadata of the source instruction, kept on its own
+        // when there is no instruction (e.g. after loading a checkpoint)
+        const llvm::MDNode* range;
+        std::vector<OriginP> parents;
+        // Length of the longest chain of parents, including this one
+        unsigned depth;
+
+        void print(unsigned tabs=0) const;
+    };
+
 private:
     Source _src;
-    std::list<BlockP> _srcBlocks;
+    std::vector<OriginP> _origins;
     std::string _meta;
+    const llvm::Instruction* _ins;
+    const llvm::MDNode* _range;
 
-    BlockHistory(Source s, BlockP sb) :
-        _src(s)
-    {
-        _srcBlocks.push_back(sb);
-    }
+    // Longest origin chain kept. Zero means no limit.
+    static unsigned MaxDepth;
 
-    BlockHistory(Source s, std::list<BlockP> sb) :
-        _src(s),
-        _srcBlocks(sb)
-    { }
+    void setSource(Source s, Block* src);
 
 public:
     BlockHistory() :
-        _src(Unset)
+        _src(Unset),
+        _ins(nullptr),
+        _range(nullptr)
     { }
 
     DEF_SET(meta);
     DEF_GET_NP(meta);
+    DEF_GET_NP(ins);
+
+    static unsigned maxDepth() {
+        return MaxDepth;
+    }
+    static void maxDepth(unsigned depth) {
+        MaxDepth = depth;
+    }
+
+    /**
+     * Snapshot a block's name, type and history
+     */
+    static OriginP Snapshot(Block* b);
+
+    /**
+     * An origin with no parents, standing in for a chain which was
+     * written to a checkpoint
+     */
+    static OriginP Restore(const std::string& type,
+                           std::string base, std::string suffix,
+                           Source src, std::string meta);
+
+    /// Replace the whole history, e.g. with one read from a checkpoint
+    void restore(Source src, std::string meta,
+                 std::vector<OriginP> origins,
+                 const llvm::MDNode* range = nullptr) {
+        _src = src;
+        _meta = meta;
+        _ins = nullptr;
+        _range = range;
+        _origins = origins;
+    }
 
     bool hasSrcBlock() const {
-        return !_srcBlocks.empty();
+        return !_origins.empty();
     }
 
     void setUnknown() {
         _src = Unknown;
     }
 
-    void setFrontend(std::string meta="") {
+    void setFrontend(std::string meta="",
+                     const llvm::Instruction* ins=nullptr) {
         _src = Frontend;
         _meta = meta;
+        _ins = ins;
     }
 
-    void setRefinement(BlockP src) {
-        _src = Refinement;
-        _srcBlocks = {src};
+    void setRefinement(Block* src) {
+        setSource(Refinement, src);
     }
 
-    void setOptimization(BlockP src) {
-        _src = Optimization;
-        if (src == NULL)
-            _srcBlocks = {};
-        else
-            _srcBlocks = {src};
+    void setOptimization(Block* src) {
+        setSource(Optimization, src);
     }
 
-    const std::list<BlockP>& srcBlocks() const {
-        return _srcBlocks;
+    const std::vector<OriginP>& origins() const {
+        return _origins;
     }
 
-    Block* srcBlock() const {
-        if (_srcBlocks.size() != 1)
-            throw InvalidCall("Can only retrieve single src block when there is only one src block!");
-        return _srcBlocks.front().get();
+    const Origin* origin() const {
+        if (_origins.size() != 1)
+            throw InvalidCall("Can only retrieve single origin when there is only one origin!");
+        return _origins.front().get();
     }
 
     Source src() const {
         return _src;
     }
 
+    /// The nearest LLVM instruction this block descends from, if any
+    const llvm::Instruction* sourceIns() const;
+    /// The !range metadata of that instruction, if any
+    const llvm::MDNode* sourceRange() const;
+    /// The !range metadata of the instruction this block computes
+    /// itself, ignoring the ones it descends from
+    const llvm::MDNode* range() const;
+
     void print(unsigned tabs=0) const;
 };
 
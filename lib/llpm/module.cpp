@@ -119,9 +119,11 @@ void ContainerModule::removeOutputPort(OutputPort* op) {
     delete op;
 }
 
-Interface* ContainerModule::addClientInterface(
-        OutputPort* req, InputPort* resp, std::string name) {
-    auto iface = new Interface(this, resp->type(), req->type(), false, name);
+Interface* ContainerModule::createInterface(llvm::Type* inpType,
+                                            llvm::Type* outType,
+                                            bool server,
+                                            std::string name) {
+    auto iface = new Interface(this, inpType, outType, server, name);
     _ownedInterfaces.insert(iface);
 
     boost::intrusive_ptr<DummyBlock> opdummy ( new DummyBlock(iface->dout()) );
@@ -129,37 +131,29 @@ Interface* ContainerModule::addClientInterface(
     _outputMap.emplace(iface->dout(), opdummy);
     opdummy->name(name + "_opdummy");
     conns()->blacklist(opdummy);
-    conns()->connect(req, opdummy->din());
 
     boost::intrusive_ptr<DummyBlock> ipdummy ( new DummyBlock(iface->din()) );
     ipdummy->module(this);
     _inputMap.emplace(iface->din(), ipdummy);
     ipdummy->name(name + "_ipdummy");
     conns()->blacklist(ipdummy);
-    conns()->connect(resp, ipdummy->dout());
 
     return iface;
 }
 
+Interface* ContainerModule::addClientInterface(
+        OutputPort* req, InputPort* resp, std::string name) {
+    auto iface = createInterface(resp->type(), req->type(), false, name);
+    conns()->connect(req, getSink(iface->dout()));
+    conns()->connect(resp, getDriver(iface->din()));
+    return iface;
+}
+
 Interface* ContainerModule::addServerInterface(
         InputPort* req, OutputPort* resp, std::string name) {
-    auto iface = new Interface(this, req->type(), resp->type(), true, name);
-    _ownedInterfaces.insert(iface);
-
-    boost::intrusive_ptr<DummyBlock> opdummy ( new DummyBlock(iface->dout()) );
-    opdummy->module(this);
-    _outputMap.emplace(iface->dout(), opdummy);
-    opdummy->name(name + "_opdummy");
-    conns()->blacklist(opdummy);
-    conns()->connect(resp, opdummy->din());
-
-    boost::intrusive_ptr<DummyBlock> ipdummy ( new DummyBlock(iface->din()) );
-    ipdummy->module(this);
-    _inputMap.emplace(iface->din(), ipdummy);
-    ipdummy->name(name + "_ipdummy");
-    conns()->blacklist(ipdummy);
-    conns()->connect(req, ipdummy->dout());
-
+    auto iface = createInterface(req->type(), resp->type(), true, name);
+    conns()->connect(resp, getSink(iface->dout()));
+    conns()->connect(req, getDriver(iface->din()));
     return iface;
 }
 
@@ -208,9 +202,7 @@ void ContainerModule::validityCheck() const {
         portNames.insert(op->name());
     }
 
-    set<Block*> blocks;
-    _conns.findAllBlocks(blocks);
-    for (Block* b: blocks) {
+    for (Block* b: _conns.blocks()) {
         assert(b->module() == this);
     }
 
@@ -406,7 +398,7 @@ bool ContainerModule::unifyOutput() {
            name().c_str());
 
     // This is just a stub for now
-    vector<OutputPort*> outs = outputs();
+    vector<OutputPort*> outs(outputs().begin(), outputs().end());
     
     vector<llvm::Type*> types;
     vector<InputPort*> intSinks;
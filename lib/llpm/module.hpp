@@ -8,6 +8,7 @@
 #include <libraries/core/comm_intr.hpp>
 #include <libraries/core/interface.hpp>
 #include <util/cache.hpp>
+#include <analysis/analysis_manager.hpp>
 
 #include <llvm/IR/Module.h>
 #include <llvm/Transforms/Utils/ValueMapper.h>
@@ -47,6 +48,7 @@ public:
         _design(design),
         _swModule(NULL)
     {
+        kind<Module>();
         this->name(name);
     }
     virtual ~Module() { }
@@ -66,6 +68,9 @@ public:
             return f->second;
         return NULL;
     }
+    const std::map<std::string, llvm::Function*>& swVersions() {
+        return _swVersion;
+    }
     std::set<llvm::Function*> tests() {
         return _tests;
     }
@@ -92,6 +97,11 @@ public:
         return NULL;
     }
 
+    // Cached analyses of this module. NULL for opaque modules.
+    virtual AnalysisManager* analyses() {
+        return NULL;
+    }
+
     // Return the current change count -- useful for tracking if
     // changes have been made to a module
     virtual uint64_t changeCounter() = 0;
@@ -140,11 +150,15 @@ class DummyBlock: public Identity {
 public:
     DummyBlock(llvm::Type* t, Port* modPort) :
         Identity(t),
-        _modPort(modPort) { }
+        _modPort(modPort) {
+        kind<DummyBlock>();
+    }
 
     DummyBlock(Port* modPort) :
         Identity(modPort->type()),
-        _modPort(modPort) { }
+        _modPort(modPort) {
+        kind<DummyBlock>();
+    }
     
     DEF_GET_NP(modPort);
 };
@@ -165,9 +179,7 @@ public:
     }
 
     virtual bool hasState() const {
-        std::set<Block*> blocks;
-        conns()->findAllBlocks(blocks);
-        for(Block* b: blocks) {
+        for(Block* b: conns()->blocks()) {
             if (b->hasState())
                 return true;
         }
@@ -176,9 +188,7 @@ public:
     }
 
     virtual void blocks(std::vector<Block*>& vec) const {
-        std::set<Block*> blocks;
-        conns()->findAllBlocks(blocks);
-        vec.insert(vec.end(), blocks.begin(), blocks.end());
+        conns()->findAllBlocks(vec);
     }
 
     virtual void blocks(std::set<Block*>& blocks) const {
@@ -186,26 +196,20 @@ public:
     }
 
     virtual unsigned size() const {
-        std::set<Block*> b;
-        blocks(b);
-        return b.size();
+        return conns()->blocks().size();
     }
 
     virtual void submodules(std::vector<Block*>& vec) const {
-        std::set<Block*> blocks;
-        conns()->findAllBlocks(blocks);
-        for (Block* b: blocks) {
-            Module* m = dynamic_cast<Module*>(b);
+        for (Block* b: conns()->blocks()) {
+            Module* m = b->as<Module>();
             if (m != NULL)
                 vec.push_back(m);
         }
     }
 
     virtual void submodules(std::vector<Module*>& vec) const {
-        std::set<Block*> blocks;
-        conns()->findAllBlocks(blocks);
-        for (Block* b: blocks) {
-            Module* m = dynamic_cast<Module*>(b);
+        for (Block* b: conns()->blocks()) {
+            Module* m = b->as<Module>();
             if (m != NULL)
                 vec.push_back(m);
         }
@@ -236,6 +240,10 @@ protected:
     OutputPort* addOutputPort(OutputPort* op, std::string name = "");
     OutputPort* createOutputPort(llvm::Type* ty, std::string name = "");
     void removeOutputPort(OutputPort* ip);
+    Interface* createInterface(llvm::Type* inpType,
+                               llvm::Type* outType,
+                               bool server,
+                               std::string name = "");
     Interface* addClientInterface(OutputPort* req,
                                   InputPort* resp,
                                   std::string name = "");
@@ -253,6 +261,8 @@ protected:
     CacheMap<const OutputPort*, DependenceRule> _deps;
     DependenceRule _findDeps(const OutputPort*) const;
 
+    AnalysisManager _analyses;
+
 public:
     ContainerModule(Design& design, std::string name) :
         MutableModule(design, name),
@@ -260,7 +270,8 @@ public:
         _hasCycle(_conns.counterPtr(),
                   boost::bind(&ContainerModule::_hasCycleCompute, this)),
         _deps(_conns.counterPtr(),
-              boost::bind(&ContainerModule::_findDeps, this, _1))
+              boost::bind(&ContainerModule::_findDeps, this, _1)),
+        _analyses(_conns.counterPtr())
     { }
 
     virtual ~ContainerModule();
@@ -272,6 +283,10 @@ public:
         return &_conns;
     } 
 
+    AnalysisManager* analyses() {
+        return &_analyses;
+    }
+
     virtual void validityCheck() const;
 
     OutputPort* getDriver(const InputPort* ip) const {
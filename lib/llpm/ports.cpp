@@ -4,12 +4,19 @@
 #include <llpm/connection.hpp>
 #include <llpm/module.hpp>
 #include <libraries/core/comm_intr.hpp>
+#include <util/misc.hpp>
+
+#include <typeinfo>
 
 namespace llpm {
 
 Port::Port(Block* owner,
            llvm::Type* type,
-           std::string name) :
+           std::string name,
+           bool input) :
+    _denseOwner(0),
+    _denseSlot(0),
+    _input(input),
     _owner(owner),
     _type(type),
     _name(name)
@@ -28,8 +35,15 @@ unsigned Port::num() const {
         return owner()->outputNum(asOutput());
 }
 
+std::string Port::describe() const {
+    std::string owner = _owner->name();
+    if (owner == "")
+        owner = cpp_demangle(typeid(*_owner).name());
+    return owner + "." + _name;
+}
+
 InputPort::InputPort(Block* owner, llvm::Type* type, std::string name) :
-    Port(owner, type, name),
+    Port(owner, type, name, true),
     _join(NULL)
 {
     owner->definePort(this);
@@ -52,7 +66,7 @@ InputPort* InputPort::join(ConnectionDB& conns, unsigned idx) {
 OutputPort::OutputPort(
     Block* owner, llvm::Type* type,
     std::string name) :
-    Port(owner, type, name),
+    Port(owner, type, name, false),
     _split(NULL)
 {
     owner->definePort(this);
@@ -2,6 +2,7 @@
 #define __LLPM_PORTS_HPP__
 
 #include <util/macros.hpp>
+#include <util/pool_alloc.hpp>
 #include <llpm/exceptions.hpp>
 
 #include <boost/intrusive_ptr.hpp>
@@ -19,6 +20,7 @@ class InputPort;
 class Join;
 class Split;
 class ConnectionDB;
+class DenseConnectionIndex;
 
 /**
  * Ports define the I/O channels of blocks. Each block contains one or
@@ -26,6 +28,14 @@ class ConnectionDB;
  * can be connected to output ports and vise versa.
  */
 class Port {
+    // Slot stamped into this port by a dense ConnectionDB
+    friend class DenseConnectionIndex;
+    uint64_t _denseOwner;
+    uint32_t _denseSlot;
+    // Direction is fixed at construction, so asInput() and asOutput()
+    // needn't dynamic_cast
+    bool _input;
+
 protected:
     Block* _owner;
     llvm::Type* _type;
@@ -33,10 +43,13 @@ protected:
 
     Port(Block* owner,
          llvm::Type* type,
-         std::string name);
+         std::string name,
+         bool input);
 public:
     virtual ~Port();
 
+    POOL_ALLOCATED
+
     llvm::Type* type() const {
         return _type;
     }
@@ -54,6 +67,13 @@ public:
     DEF_GET_NP(name);
     DEF_SET(name);
 
+    bool isInput() const {
+        return _input;
+    }
+    bool isOutput() const {
+        return !_input;
+    }
+
     InputPort* asInput();
     const InputPort* asInput() const;
 
@@ -61,6 +81,13 @@ public:
     const OutputPort* asOutput() const;
 
     unsigned num() const;
+
+    /**
+     * The owner's name (or class, if it has none) and this port's name.
+     * Unlike the namer, this names nothing, so messages printed while
+     * passes are still changing the design can use it.
+     */
+    std::string describe() const;
 };
 
 /**
@@ -203,19 +230,19 @@ public:
  */
 
 inline InputPort* Port::asInput() {
-    return dynamic_cast<InputPort*>(this);
+    return _input ? static_cast<InputPort*>(this) : NULL;
 }
 
 inline const InputPort* Port::asInput() const {
-    return dynamic_cast<const InputPort*>(this);
+    return _input ? static_cast<const InputPort*>(this) : NULL;
 }
 
 inline OutputPort* Port::asOutput() {
-    return dynamic_cast<OutputPort*>(this);
+    return _input ? NULL : static_cast<OutputPort*>(this);
 }
 
 inline const OutputPort* Port::asOutput() const {
-    return dynamic_cast<const OutputPort*>(this);
+    return _input ? NULL : static_cast<const OutputPort*>(this);
 }
 
 } //llpm
@@ -3,6 +3,7 @@
 #include <llpm/module.hpp>
 #include <util/llvm_type.hpp>
 #include <util/misc.hpp>
+#include <util/thread_pool.hpp>
 #include <llpm/control_region.hpp>
 #include <libraries/synthesis/pipeline.hpp>
 #include <analysis/graph_queries.hpp>
@@ -17,7 +18,7 @@ void CheckConnectionsPass::runInternal(Module* m) {
     if (conns == NULL)
         return;
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     conns->findAllBlocks(blocks);
     auto& namer = m->design().namer();
     // bool allGood = true;
@@ -52,11 +53,8 @@ void CheckOutputsPass::runInternal(Module* m) {
     if (conns == NULL)
         return;
 
-    set<Block*> blocks;
-    conns->findAllBlocks(blocks);
-    auto& namer = m->design().namer();
     bool printedHeader = false;
-    for (auto block: blocks) {
+    for (auto block: conns->blocks()) {
         if (block->outputsSeparate() ||
             block->outputs().size() <= 1)
             continue;
@@ -69,34 +67,28 @@ void CheckOutputsPass::runInternal(Module* m) {
             for (auto sink: sinks) {
                 if (sink->owner()->isnot<PipelineRegister>()) {
                     if (!printedHeader) {
-                        printf("ERROR: found un-pipelined connection from "
+                        tprintf("ERROR: found un-pipelined connection from "
                                "block with dependent outputs:\n");
                         printedHeader = true;
                     }
-                    printf("    %s -> %s\n",
-                           namer.getName(op, m).c_str(),
-                           namer.getName(sink, m).c_str());
+                    tprintf("    %s -> %s\n",
+                           op->describe().c_str(),
+                           sink->describe().c_str());
                 }
             }
         }
     }
 }
 
-static bool isPipelineReg(Block* b) {
-    return b->is<PipelineRegister>();
-}
-
 void CheckCyclesPass::runInternal(Module* m) {
-    std::vector< std::pair<const OutputPort*, const InputPort*> > cycle;
-    auto found = queries::FindCycle(m, &isPipelineReg, cycle);
-    if (found) {
-        auto& namer = m->design().namer();
-        printf("Error: found combinatorial loop in %s!\n",
+    auto cycles = queries::Analyze<queries::CombCycleAnalysis>(m);
+    if (cycles->found) {
+        tprintf("Error: found combinatorial loop in %s!\n",
                m->name().c_str());
-        for (auto c: cycle) {
-            printf("    %s -> %s\n",
-                    namer.getName(c.first, m).c_str(),
-                    namer.getName(c.second, m).c_str());
+        for (auto c: cycles->cycle) {
+            tprintf("    %s -> %s\n",
+                    c.first->describe().c_str(),
+                    c.second->describe().c_str());
         }
     }
 }
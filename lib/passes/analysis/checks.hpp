@@ -21,6 +21,10 @@ public:
     { }
 
     virtual void runInternal(Module*);
+
+    virtual bool moduleLocal() const {
+        return true;
+    }
 };
 
 class CheckCyclesPass: public ModulePass {
@@ -30,6 +34,10 @@ public:
     { }
 
     virtual void runInternal(Module*);
+
+    virtual bool moduleLocal() const {
+        return true;
+    }
 };
 
 };
@@ -0,0 +1,70 @@
+#include "dump_policy.hpp"
+
+#include <llpm/exceptions.hpp>
+
+#include <boost/algorithm/string.hpp>
+
+#include <vector>
+
+using namespace std;
+
+namespace llpm {
+
+DumpPolicy DumpPolicy::Parse(string spec) {
+    DumpPolicy p;
+    string arg;
+    auto colon = spec.find(':');
+    if (colon != string::npos) {
+        arg = spec.substr(colon + 1);
+        spec = spec.substr(0, colon);
+    }
+
+    if (spec == "off") {
+        p._mode = Off;
+    } else if (spec == "final") {
+        p._mode = Final;
+    } else if (spec == "every") {
+        p._mode = Every;
+        try {
+            p._every = stoul(arg);
+        } catch (std::exception&) {
+            p._every = 0;
+        }
+        if (p._every == 0)
+            throw InvalidArgument("every:N dump policy needs N > 0");
+    } else if (spec == "only") {
+        p._mode = Only;
+        vector<string> names;
+        boost::split(names, arg, boost::is_any_of(","));
+        for (auto n: names) {
+            if (n != "")
+                p._names.insert(n);
+        }
+        if (p._names.empty())
+            throw InvalidArgument("only: dump policy needs pass or module names");
+    } else {
+        throw InvalidArgument("Unknown dump policy '" + spec + "'");
+    }
+    return p;
+}
+
+bool DumpPolicy::afterPass(const string& pass,
+                           const string& module,
+                           unsigned num) const {
+    switch (_mode) {
+    case Off:
+    case Final:
+        return false;
+    case Every:
+        return (num + 1) % _every == 0;
+    case Only: {
+        if (_names.count(pass) || _names.count(module))
+            return true;
+        auto ns = pass.rfind("::");
+        return ns != string::npos && _names.count(pass.substr(ns + 2)) > 0;
+    }
+    }
+    return false;
+}
+
+} // namespace llpm
@@ -0,0 +1,60 @@
+#ifndef __LLPM_PASSES_DUMP_POLICY_HPP__
+#define __LLPM_PASSES_DUMP_POLICY_HPP__
+
+#include <string>
+#include <set>
+
+namespace llpm {
+
+/**
+ * Decides which debug dumps (Graphviz and connection listings) get
+ * written. Parsed from a string:
+ *   off          - nothing
+ *   final        - only once the design is finished (the default)
+ *   every:N      - also after every Nth pass which changes a module
+ *   only:A,B,... - also after the named passes, or any pass which
+ *                  changes the named modules
+ */
+class DumpPolicy {
+public:
+    enum Mode {
+        Off,
+        Final,
+        Every,
+        Only
+    };
+
+private:
+    Mode _mode;
+    unsigned _every;
+    std::set<std::string> _names;
+
+public:
+    DumpPolicy() :
+        _mode(Final),
+        _every(1)
+    { }
+
+    static DumpPolicy Parse(std::string spec);
+
+    Mode mode() const {
+        return _mode;
+    }
+
+    bool final() const {
+        return _mode != Off;
+    }
+
+    /**
+     * Should the module be dumped after this pass changed it? 'num'
+     * counts the earlier passes which changed the module. Pass names
+     * match with or without their namespace.
+     */
+    bool afterPass(const std::string& pass,
+                   const std::string& module,
+                   unsigned num) const;
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_DUMP_POLICY_HPP__
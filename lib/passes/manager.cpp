@@ -10,27 +10,33 @@ using namespace std;
 namespace llpm {
 
 void PassManager::debug(Pass* p, Module* mod) {
+    string pass = cpp_demangle(typeid(*p).name());
+    unsigned changes = _changeCounter[mod]++;
+    if (!_design.dumps().afterPass(pass, mod->name(), changes))
+        return;
+
     unsigned ctr = _debugCounter[mod];
     string fn = str(boost::format("%1%_%2%%3$03u.gv")
                         % mod->name()
                         % _name
                         % ctr);
-
-    auto f =_design.workingDir()->create(fn);
-    _design.gv()->writeModule(
-        f,
-        mod,
-        true,
-        "After pass " + cpp_demangle(typeid(*p).name()));
+    _design.dumpGraph(fn, mod, true, "After pass " + pass);
     _debugCounter[mod]++;
-    f->close();
 }
 
 bool PassManager::run(bool debug) {
     bool ret = false;
     for (auto&& p: _passes) {
-        printf("== Pass: %s\n", cpp_demangle(typeid(*p).name()).c_str());
-        if(p->run()) {
+        string name = cpp_demangle(typeid(*p).name());
+        printf("== Pass: %s\n", name.c_str());
+        bool changed;
+        p->profile(&_profile);
+        {
+            PassProfile::Scope s(&_profile, _design, name);
+            changed = p->run();
+        }
+        p->profile(NULL);
+        if(changed) {
             ret = true;
             if (debug)
                 for (Module* mod: _design.modules())
@@ -43,17 +49,20 @@ bool PassManager::run(bool debug) {
 bool PassManager::run(Module* mod, bool debug) {
     bool ret = false;
     for (auto&& p: _passes) {
-        printf("== Pass: %s\n", cpp_demangle(typeid(*p).name()).c_str());
+        string name = cpp_demangle(typeid(*p).name());
+        printf("== Pass: %s\n", name.c_str());
         ModulePass* mp = dynamic_cast<ModulePass*>(p.get());
-        if (mp)
+        if (mp) {
+            mp->profile(&_profile);
+            PassProfile::Scope s(&_profile, _design, name);
             if (mp->run(mod))
                 ret = true;
+            mp->profile(NULL);
+        }
 
         LambdaModulePass historypass(_design,
             [p](Module* m) {
-                std::set<Block*> blocks;
-                m->conns()->findAllBlocks(blocks);
-                for (Block* b: blocks) {
+                for (Block* b: m->conns()->blocks()) {
                     if (b->history().src() == BlockHistory::Unset) {
                         b->history().setUnknown();
                         b->history().meta(
@@ -70,4 +79,17 @@ bool PassManager::run(Module* mod, bool debug) {
     return ret;
 }
 
+void PassManager::writeProfile() {
+    if (_profile.size() == 0)
+        return;
+
+    auto trace = _design.workingDir()->create(_name + "_profile.json");
+    _profile.writeTrace(trace->openStream());
+    trace->close();
+
+    auto csv = _design.workingDir()->create(_name + "_profile.csv");
+    _profile.writeCSV(csv->openStream());
+    csv->close();
+}
+
 };
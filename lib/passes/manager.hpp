@@ -2,6 +2,7 @@
 #define __LLPM_PASSES_MANAGER_HPP__
 
 #include <passes/pass.hpp>
+#include <passes/profile.hpp>
 
 #include <deque>
 #include <map>
@@ -15,6 +16,8 @@ protected:
     std::string _name;
     std::deque<std::shared_ptr<Pass>> _passes;
     std::map<Module*, unsigned> _debugCounter;
+    std::map<Module*, unsigned> _changeCounter;
+    PassProfile _profile;
     void debug(Pass* p, Module* mod);
 
 public:
@@ -41,8 +44,19 @@ public:
         _passes.push_front(p);
     }
 
+    void clear() {
+        _passes.clear();
+    }
+
     bool run(bool debug = false);
     bool run(Module* mod, bool debug = false);
+
+    /**
+     * Write the profile of every pass run so far to
+     * <name>_profile.json (Chrome trace) and <name>_profile.csv in the
+     * working directory.
+     */
+    void writeProfile();
 };
 
 };
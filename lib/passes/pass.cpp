@@ -2,31 +2,75 @@
 
 #include <llpm/module.hpp>
 #include <llpm/design.hpp>
+#include <util/thread_pool.hpp>
+#include <util/misc.hpp>
+#include <passes/profile.hpp>
 
 #include <vector>
+#include <functional>
+#include <algorithm>
 
 using namespace std;
 
 namespace llpm {
 
 bool ModulePass::run() {
-    bool ret = false;
     auto mods = _design.modules();
-    for (Module* m: mods) {
-        if (run(m))
-            ret = true;
-        m->validityCheck();
+    ThreadPool* pool = moduleLocal() ? _design.passPool() : NULL;
+    if (pool == NULL || mods.size() < 2) {
+        bool ret = false;
+        for (Module* m: mods) {
+            if (run(m))
+                ret = true;
+            m->validityCheck();
+        }
+        return ret;
     }
-    return ret;
+
+    vector<char> changed(mods.size(), false);
+    vector< function<void()> > tasks;
+    for (unsigned i=0; i<mods.size(); i++) {
+        tasks.push_back([this, &mods, &changed, i]() {
+            changed[i] = this->run(mods[i]);
+            mods[i]->validityCheck();
+        });
+    }
+    pool->run(tasks);
+    return std::find(changed.begin(), changed.end(), true) != changed.end();
 }
 
 bool ModulePass::run(Module* mod) {
     uint64_t ctr = mod->changeCounter();
-    runInternal(mod);
+    if (_profile != NULL) {
+        PassProfile::Scope s(_profile, mod,
+                             cpp_demangle(typeid(*this).name()));
+        runInternal(mod);
+    } else {
+        runInternal(mod);
+    }
+
+    AnalysisManager* am = mod->analyses();
+    if (am != NULL && mod->changeCounter() != ctr) {
+        PreservedAnalyses pa;
+        preserved(pa);
+        if (!pa.empty())
+            am->update(ctr, pa);
+    }
     vector<Module*> submodules;
     mod->submodules(submodules);
-    for (auto sm: submodules) {
-        this->run(sm);
+
+    // Submodules (e.g. control regions) share nothing, so module-local
+    // passes can visit them concurrently
+    ThreadPool* pool = moduleLocal() ? _design.passPool() : NULL;
+    if (pool != NULL && submodules.size() > 1) {
+        vector< function<void()> > tasks;
+        for (auto sm: submodules)
+            tasks.push_back([this, sm]() { this->run(sm); });
+        pool->run(tasks);
+    } else {
+        for (auto sm: submodules) {
+            this->run(sm);
+        }
     }
     finalize();
     return mod->changeCounter() > ctr;
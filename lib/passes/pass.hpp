@@ -2,21 +2,30 @@
 #define __LLPM_PASSES_PASS_HPP__
 
 #include <boost/function.hpp>
+#include <analysis/analysis_manager.hpp>
 
 namespace llpm {
     class Design;
     class Module;
+    class PassProfile;
 
 class Pass {
 protected:
     Design& _design;
+    PassProfile* _profile;
 
 public:
     Pass(Design& design) :
-        _design(design)
+        _design(design),
+        _profile(NULL)
     { }
 
     virtual bool run() = 0;
+
+    /// Record per-module samples here while running. May be NULL.
+    void profile(PassProfile* p) {
+        _profile = p;
+    }
 };
 
 class ModulePass : public Pass {
@@ -27,6 +36,22 @@ public:
         Pass(design)
     { }
 
+    /**
+     * Module-local passes touch nothing outside of the module they are
+     * given (and the design's namer), keep no state across modules and
+     * print only with tprintf. They may be run on many modules at once.
+     * Note that finalize() may then be called from worker threads.
+     */
+    virtual bool moduleLocal() const {
+        return false;
+    }
+
+    /**
+     * Cached analyses this pass keeps valid when it changes a module.
+     * By default, any change invalidates everything.
+     */
+    virtual void preserved(PreservedAnalyses&) const { }
+
     virtual bool run();
     bool run(Module* mod);
     virtual void finalize() { }
@@ -5,6 +5,7 @@
 #include <backends/graphviz/graphviz.hpp>
 
 #include <boost/format.hpp>
+#include <sstream>
 
 using namespace std;
 
@@ -17,14 +18,8 @@ void GVPrinterPass::runInternal(Module* mod) {
                             % _name
                             % ctr);
 
-    auto f =_design.workingDir()->create(fn);
-    _design.gv()->writeModule(
-        f,
-        mod,
-        false,
-        _name);
+    _design.dumpGraph(fn, mod, false, _name);
     _counter[mod]++;
-    f->close();
 }
 
 void TextPrinterPass::runInternal(Module* mod) {
@@ -37,18 +32,15 @@ void TextPrinterPass::runInternal(Module* mod) {
     ConnectionDB* conns = mod->conns();
     if (conns == NULL)
         return;
-    auto f =_design.workingDir()->create(fn);
-    auto fd = f->openFile("w");
-    for (auto p: conns->sourcesRaw()) {
-        fprintf(fd, "%s (%u:%s) -> %s (%u:%s)\n",
-                p.second->owner()->globalName().c_str(),
-                p.second->num(),
-                p.second->name().c_str(),
-                p.first->owner()->globalName().c_str(),
-                p.first->num(),
-                p.first->name().c_str());
+    std::ostringstream os;
+    for (const Connection& c: *conns) {
+        os << c.source()->owner()->globalName()
+           << " (" << c.source()->num() << ":" << c.source()->name() << ")"
+           << " -> "
+           << c.sink()->owner()->globalName()
+           << " (" << c.sink()->num() << ":" << c.sink()->name() << ")\n";
     }
-    f->close();
+    _design.dumpWriter()->write(_design.workingDir()->create(fn), os.str());
 }
 
 void StatsPrinterPass::runInternal(Module* mod) {
@@ -56,9 +48,7 @@ void StatsPrinterPass::runInternal(Module* mod) {
     if (conns == NULL)
         return;
 
-    set<Block*> blocks;
-    conns->findAllBlocks(blocks);
-    for (auto b: blocks) {
+    for (auto b: conns->blocks()) {
         _typeCounters[typeid(*b).name()] += 1;
     }
 }
@@ -0,0 +1,177 @@
+#include "profile.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <analysis/graph.hpp>
+
+#include <ctime>
+#include <sys/resource.h>
+#include <boost/format.hpp>
+
+using namespace std;
+
+namespace llpm {
+
+static double cpuMicros(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static long peakRSS() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static void moduleCounts(Module* mod,
+                         size_t& blocks, size_t& conns, uint64_t& changes) {
+    const ConnectionDB* db = mod->conns();
+    if (db != NULL) {
+        blocks += db->blocks().size();
+        conns += db->numConnections();
+    }
+    changes += mod->changeCounter();
+}
+
+static void allCounts(Module* mod,
+                      size_t& blocks, size_t& conns, uint64_t& changes) {
+    moduleCounts(mod, blocks, conns, changes);
+    vector<Module*> submodules;
+    mod->submodules(submodules);
+    for (auto sm: submodules)
+        allCounts(sm, blocks, conns, changes);
+}
+
+PassProfile::Scope::Scope(PassProfile* profile, Design& design, string pass) :
+    _profile(profile),
+    _design(&design),
+    _mod(NULL)
+{
+    _sample.pass = pass;
+    _sample.tid = _profile->tid();
+    counts(_sample.blocksBefore, _sample.connsBefore, _changeStart);
+    _visitStart = SearchStats::total();
+    _rssStart = peakRSS();
+    _cpuStart = cpuMicros(CLOCK_PROCESS_CPUTIME_ID);
+    _start = chrono::steady_clock::now();
+}
+
+PassProfile::Scope::Scope(PassProfile* profile, Module* mod, string pass) :
+    _profile(profile),
+    _design(NULL),
+    _mod(mod)
+{
+    _sample.pass = pass;
+    _sample.module = mod->name();
+    _sample.tid = _profile->tid();
+    counts(_sample.blocksBefore, _sample.connsBefore, _changeStart);
+    _visitStart = SearchStats::thread();
+    _rssStart = peakRSS();
+    _cpuStart = cpuMicros(CLOCK_THREAD_CPUTIME_ID);
+    _start = chrono::steady_clock::now();
+}
+
+void PassProfile::Scope::counts(size_t& blocks, size_t& conns,
+                                uint64_t& changes) {
+    blocks = conns = 0;
+    changes = 0;
+    if (_mod != NULL) {
+        moduleCounts(_mod, blocks, conns, changes);
+    } else {
+        for (auto m: _design->modules())
+            allCounts(m, blocks, conns, changes);
+    }
+}
+
+PassProfile::Scope::~Scope() {
+    auto end = chrono::steady_clock::now();
+    if (_mod != NULL) {
+        _sample.cpu = cpuMicros(CLOCK_THREAD_CPUTIME_ID) - _cpuStart;
+        _sample.visits = SearchStats::thread() - _visitStart;
+    } else {
+        _sample.cpu = cpuMicros(CLOCK_PROCESS_CPUTIME_ID) - _cpuStart;
+        _sample.visits = SearchStats::total() - _visitStart;
+    }
+    _sample.rssDelta = peakRSS() - _rssStart;
+    _sample.start =
+        chrono::duration<double, micro>(_start - _profile->_epoch).count();
+    _sample.wall = chrono::duration<double, micro>(end - _start).count();
+
+    uint64_t changeEnd;
+    counts(_sample.blocksAfter, _sample.connsAfter, changeEnd);
+    _sample.changes = changeEnd - _changeStart;
+    _profile->record(_sample);
+}
+
+PassProfile::PassProfile() :
+    _epoch(chrono::steady_clock::now())
+{ }
+
+unsigned PassProfile::tid() {
+    lock_guard<mutex> l(_lock);
+    auto id = this_thread::get_id();
+    auto f = _tids.find(id);
+    if (f != _tids.end())
+        return f->second;
+    unsigned n = _tids.size();
+    _tids[id] = n;
+    return n;
+}
+
+void PassProfile::record(const Sample& s) {
+    lock_guard<mutex> l(_lock);
+    _samples.push_back(s);
+}
+
+static string jsonEscape(const string& s) {
+    string ret;
+    for (char c: s) {
+        if (c == '"' || c == '\\')
+            ret += '\\';
+        ret += c;
+    }
+    return ret;
+}
+
+void PassProfile::writeTrace(ostream& os) const {
+    os << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (const auto& s: _samples) {
+        if (!first)
+            os << ",\n";
+        first = false;
+        string name = s.module.empty() ? s.pass : s.module;
+        os << boost::format(
+                "  {\"name\": \"%1%\", \"cat\": \"%2%\", \"ph\": \"X\", "
+                "\"pid\": 0, \"tid\": %3%, \"ts\": %4$.3f, \"dur\": %5$.3f, "
+                "\"args\": {\"pass\": \"%6%\", \"cpu_us\": %7$.3f, "
+                "\"rss_delta_kb\": %8%, "
+                "\"blocks\": [%9%, %10%], \"connections\": [%11%, %12%], "
+                "\"changes\": %13%, \"visits\": %14%}}")
+            % jsonEscape(name)
+            % (s.module.empty() ? "pass" : "module")
+            % s.tid % s.start % s.wall
+            % jsonEscape(s.pass) % s.cpu % s.rssDelta
+            % s.blocksBefore % s.blocksAfter
+            % s.connsBefore % s.connsAfter
+            % s.changes % s.visits;
+    }
+    os << "\n]}\n";
+}
+
+void PassProfile::writeCSV(ostream& os) const {
+    os << "pass,module,thread,start_us,wall_us,cpu_us,rss_delta_kb,"
+          "blocks_before,blocks_after,conns_before,conns_after,"
+          "changes,visits\n";
+    for (const auto& s: _samples) {
+        os << boost::format(
+                "\"%1%\",\"%2%\",%3%,%4$.3f,%5$.3f,%6$.3f,%7%,"
+                "%8%,%9%,%10%,%11%,%12%,%13%\n")
+            % s.pass % s.module % s.tid % s.start % s.wall % s.cpu
+            % s.rssDelta % s.blocksBefore % s.blocksAfter
+            % s.connsBefore % s.connsAfter % s.changes % s.visits;
+    }
+}
+
+} // namespace llpm
@@ -0,0 +1,91 @@
+#ifndef __LLPM_PASSES_PROFILE_HPP__
+#define __LLPM_PASSES_PROFILE_HPP__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <ostream>
+
+namespace llpm {
+
+// fwd defs
+class Design;
+class Module;
+
+/**
+ * Records where a PassManager spends its time. Every pass gets a sample
+ * covering its whole run and each module it visits (if it is a
+ * ModulePass) gets another for just that module. Output is a Chrome
+ * trace (load it in chrome://tracing or Perfetto) and a CSV summary.
+ */
+class PassProfile {
+public:
+    struct Sample {
+        std::string pass;
+        // Empty for the pass-wide sample
+        std::string module;
+        unsigned tid;
+
+        // Microseconds. 'start' is relative to profile creation.
+        double start;
+        double wall;
+        double cpu;
+        // Growth of the process's peak RSS, in KB
+        long rssDelta;
+
+        size_t blocksBefore, blocksAfter;
+        size_t connsBefore, connsAfter;
+        uint64_t changes;
+        uint64_t visits;
+    };
+
+    /**
+     * Measures from construction to destruction. Module scopes count
+     * only the calling thread's CPU time and searches; pass scopes count
+     * the whole process's, so they include any pool workers.
+     */
+    class Scope {
+        PassProfile* _profile;
+        Design* _design;
+        Module* _mod;
+        Sample _sample;
+        std::chrono::steady_clock::time_point _start;
+        double _cpuStart;
+        long _rssStart;
+        uint64_t _changeStart;
+        uint64_t _visitStart;
+
+        void counts(size_t& blocks, size_t& conns, uint64_t& changes);
+
+    public:
+        Scope(PassProfile* profile, Design& design, std::string pass);
+        Scope(PassProfile* profile, Module* mod, std::string pass);
+        ~Scope();
+    };
+
+private:
+    std::chrono::steady_clock::time_point _epoch;
+    std::mutex _lock;
+    std::vector<Sample> _samples;
+    std::map<std::thread::id, unsigned> _tids;
+
+    unsigned tid();
+    void record(const Sample&);
+
+public:
+    PassProfile();
+
+    size_t size() const {
+        return _samples.size();
+    }
+
+    void writeTrace(std::ostream&) const;
+    void writeCSV(std::ostream&) const;
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_PROFILE_HPP__
@@ -0,0 +1,61 @@
+#include "arith_impl.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <llpm/control_region.hpp>
+#include <libraries/synthesis/arith.hpp>
+#include <refinery/implementations.hpp>
+#include <util/transform.hpp>
+
+using namespace std;
+
+namespace llpm {
+
+ArithImplPass::ArithImplPass(Design& d, string impl, Time period) :
+    ModulePass(d),
+    _impl(nullptr),
+    _period(period)
+{
+    auto colon = impl.find(':');
+    string name = impl.substr(0, colon);
+    const Implementation* base = d.impls().find(name);
+    if (base == nullptr)
+        throw InvalidArgument("Unknown arithmetic implementation '" +
+                              impl + "'");
+    if (colon == string::npos) {
+        _impl = base;
+    } else {
+        _configured = base->configure(impl.substr(colon + 1));
+        _impl = _configured.get();
+    }
+}
+
+void ArithImplPass::runInternal(Module* mod) {
+    if (_impl->name() == "comb" || mod->is<ControlRegion>())
+        return;
+
+    Transformer t(mod);
+    if (!t.canMutate())
+        return;
+
+    ConnectionDB* conns = t.conns();
+    vector<Block*> blocks;
+    vector<Block*> ops;
+    conns->findAllBlocks(blocks);
+    for (auto b: blocks) {
+        if (SequentialArith::Handles(b) && _impl->handles(b))
+            ops.push_back(b);
+    }
+    if (ops.empty())
+        return;
+
+    Refinery r;
+    r.refiners().appendEntry(
+        make_shared<ImplRefiner>(_impl, _design.backend(), _period));
+    r.refine(ops, *conns, 1);
+
+    printf("    Replaced %lu operators in %s with %s units\n",
+           ops.size(), mod->name().c_str(), _impl->name().c_str());
+}
+
+} // namespace llpm
@@ -0,0 +1,35 @@
+#ifndef __LLPM_PASSES_TRANSFORMS_ARITH_IMPL_HPP__
+#define __LLPM_PASSES_TRANSFORMS_ARITH_IMPL_HPP__
+
+#include <passes/pass.hpp>
+#include <util/time.hpp>
+
+#include <memory>
+#include <string>
+
+namespace llpm {
+
+// Fwd defs
+class Implementation;
+
+/**
+ * Swaps multiplies, divides and remainders for one of the arithmetic
+ * implementations in the design's registry, as SelectImplPass would
+ * but for all of them at once. The implementation is one of "comb"
+ * (leave them alone), "pipelined" (as many stages as the clock period
+ * needs), "pipelined:N" (N stages) or "iterative" (one bit per cycle).
+ */
+class ArithImplPass: public ModulePass {
+    std::shared_ptr<Implementation> _configured;
+    const Implementation* _impl;
+    Time _period;
+
+public:
+    ArithImplPass(Design& d, std::string impl, Time period = Time());
+
+    virtual void runInternal(Module*);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_TRANSFORMS_ARITH_IMPL_HPP__
@@ -0,0 +1,248 @@
+#include "narrow.hpp"
+
+#include <llpm/module.hpp>
+#include <libraries/core/std_library.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+#include <util/transform.hpp>
+#include <util/llvm_type.hpp>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace llpm {
+
+// The type needed to carry values in 'v'
+static llvm::Type* NarrowType(llvm::Type* t, const ValueRange& v) {
+    if (t->isStructTy()) {
+        if (v.fields.size() != t->getStructNumElements())
+            return t;
+        bool changed = false;
+        vector<llvm::Type*> elems;
+        for (unsigned i=0; i<v.fields.size(); i++) {
+            llvm::Type* et = t->getStructElementType(i);
+            elems.push_back(NarrowType(et, v.fields[i]));
+            changed |= elems.back() != et;
+        }
+        if (!changed)
+            return t;
+        return llvm::StructType::get(t->getContext(), elems);
+    }
+    if (!v.narrowable())
+        return t;
+    return llvm::Type::getIntNTy(t->getContext(), max(v.bits(), 1u));
+}
+
+// Truncate or zero extend ints from one type to another, field by
+// field for structs. Returns the ports to wire in.
+static pair<InputPort*, OutputPort*> Convert(ConnectionDB* conns,
+                                             llvm::Type* from,
+                                             llvm::Type* to) {
+    assert(from != to);
+    if (from->isIntegerTy()) {
+        unsigned fw = bitwidth(from);
+        unsigned tw = bitwidth(to);
+        Function* f;
+        if (tw < fw)
+            f = new IntTruncate(from, to);
+        else
+            f = new IntExtend(tw - fw, false, from);
+        return make_pair(f->din(), f->dout());
+    }
+
+    assert(from->isStructTy());
+    auto split = new Split(from);
+    auto join = new Join(to);
+    for (unsigned i=0; i<split->dout_size(); i++) {
+        llvm::Type* ft = from->getStructElementType(i);
+        llvm::Type* tt = to->getStructElementType(i);
+        if (ft == tt) {
+            conns->connect(split->dout(i), join->din(i));
+            continue;
+        }
+        auto c = Convert(conns, ft, tt);
+        conns->connect(split->dout(i), c.first);
+        conns->connect(c.second, join->din(i));
+    }
+    return make_pair(split->din(), join->dout());
+}
+
+// Move the driver of 'orig' over to 'ip', converted
+static void ShrinkInput(ConnectionDB* conns, InputPort* orig,
+                        InputPort* ip) {
+    if (orig->type() == ip->type()) {
+        conns->remap(orig, ip);
+        return;
+    }
+    auto c = Convert(conns, orig->type(), ip->type());
+    conns->remap(orig, c.first);
+    conns->connect(c.second, ip);
+}
+
+// Send 'op' (of a narrower type) to the sinks of 'orig', converted
+static void WidenOutput(ConnectionDB* conns, OutputPort* orig,
+                        OutputPort* op) {
+    if (orig->type() == op->type()) {
+        conns->remap(orig, op);
+        return;
+    }
+    auto c = Convert(conns, op->type(), orig->type());
+    conns->connect(op, c.first);
+    conns->remap(orig, c.second);
+}
+
+static llvm::Type* IntTy(llvm::Type* t, unsigned width) {
+    return llvm::Type::getIntNTy(t->getContext(), width);
+}
+
+static bool NarrowAddition(ConnectionDB* conns, IntAddition* add,
+                           const ValueRange& in, const ValueRange& out) {
+    if (!out.narrowable())
+        return false;
+    unsigned k = max(out.bits(), 1u);
+    vector<llvm::Type*> args;
+    bool changed = false;
+    for (unsigned i=0; i<in.fields.size(); i++) {
+        const ValueRange& f = in.fields[i];
+        if (!f.tracked() || f.empty)
+            return false;
+        unsigned w = min(f.width, max(f.bits(), 1u));
+        args.push_back(IntTy(add->dout()->type(), w));
+        changed |= w < f.width;
+    }
+    if (!changed || args.size() != numContainedTypes(add->din()->type()))
+        return false;
+
+    auto na = new IntAddition(args);
+    na->history().setOptimization(add);
+    ShrinkInput(conns, add->din(), na->din());
+    OutputPort* sum = na->dout();
+    // Nothing above bit k is ever set
+    if (bitwidth(sum->type()) > k) {
+        auto trunc = new IntTruncate(sum->type(), IntTy(sum->type(), k));
+        conns->connect(sum, trunc->din());
+        sum = trunc->dout();
+    }
+    WidenOutput(conns, add->dout(), sum);
+    return true;
+}
+
+static bool NarrowCompare(ConnectionDB* conns, IntCompare* cmp,
+                          const ValueRange& in) {
+    if (in.fields.size() != 2)
+        return false;
+    const ValueRange& a = in.fields[0];
+    const ValueRange& b = in.fields[1];
+    if (!a.tracked() || !b.tracked() || a.empty || b.empty)
+        return false;
+    // Signed compares need both sides non-negative to become unsigned
+    if (cmp->isSigned() && (a.bits() >= a.width || b.bits() >= b.width))
+        return false;
+    unsigned k = max(max(a.bits(), b.bits()), 1u);
+    if (k >= a.width && k >= b.width)
+        return false;
+
+    llvm::Type* t = IntTy(cmp->dout()->type(), k);
+    auto nc = new IntCompare(t, t, cmp->op(), false);
+    nc->history().setOptimization(cmp);
+    ShrinkInput(conns, cmp->din(), nc->din());
+    conns->remap(cmp->dout(), nc->dout());
+    return true;
+}
+
+static unsigned NarrowRegister(ConnectionDB* conns, PipelineRegister* reg,
+                               const ValueRange& v) {
+    llvm::Type* t = reg->din()->type();
+    llvm::Type* nt = NarrowType(t, v);
+    if (nt == t)
+        return 0;
+
+    auto c = Convert(conns, t, nt);
+    conns->remap(reg->din(), c.first);
+    auto nreg = new PipelineRegister(c.second);
+    nreg->name(reg->name());
+    nreg->history().setOptimization(reg);
+    conns->connect(c.second, nreg->din());
+
+    // Registers in control regions keep their stage controller
+    if (reg->enable() != nullptr) {
+        OutputPort* ce = conns->findSource(reg->enable());
+        if (ce != nullptr && ce->owner()->is<PipelineStageController>()) {
+            auto psc = ce->owner()->as<PipelineStageController>();
+            nreg->controller(conns, psc);
+            conns->disconnect(ce, reg->enable());
+        }
+    }
+
+    WidenOutput(conns, reg->dout(), nreg->dout());
+    return bitwidth(t) - bitwidth(nt);
+}
+
+static void ClearOrigins(ValueRange& v) {
+    v.origin = nullptr;
+    for (auto& f: v.fields)
+        ClearOrigins(f);
+}
+
+void NarrowWidthsPass::runInternal(Module* mod) {
+    Transformer t(mod);
+    if (!t.canMutate())
+        return;
+
+    ConnectionDB* conns = t.conns();
+    auto ranges = AnalyzeRanges(mod, _seeds);
+    auto input = [&](InputPort* ip) {
+        OutputPort* src = conns->findSource(ip);
+        if (src == nullptr)
+            return ValueRange::Full(ip->type(), nullptr);
+        return ranges->range(src);
+    };
+
+    // Submodules are visited next. Give them what we know about their
+    // inputs. Origins don't mean anything across the boundary.
+    vector<Module*> subs;
+    mod->submodules(subs);
+    for (auto sub: subs) {
+        for (auto ip: sub->inputs()) {
+            OutputPort* inner = sub->getDriver(ip);
+            if (inner == nullptr)
+                continue;
+            ValueRange v = input(ip);
+            ClearOrigins(v);
+            v.origin = inner;
+            _seeds[inner] = v;
+        }
+    }
+
+    vector<Block*> blocks;
+    conns->findAllBlocks(blocks);
+    unsigned ops = 0;
+    unsigned regs = 0;
+    unsigned regBits = 0;
+    for (auto b: blocks) {
+        if (b->is<IntAddition>()) {
+            auto add = b->as<IntAddition>();
+            if (NarrowAddition(conns, add, input(add->din()),
+                               ranges->range(add->dout())))
+                ops++;
+        } else if (b->is<IntCompare>()) {
+            auto cmp = b->as<IntCompare>();
+            if (NarrowCompare(conns, cmp, input(cmp->din())))
+                ops++;
+        } else if (b->is<PipelineRegister>()) {
+            auto reg = b->as<PipelineRegister>();
+            unsigned saved = NarrowRegister(conns, reg, input(reg->din()));
+            if (saved > 0) {
+                regs++;
+                regBits += saved;
+            }
+        }
+    }
+
+    if (ops > 0 || regs > 0)
+        printf("    Narrowed %u operators and %u registers (%u bits) "
+               "in %s\n",
+               ops, regs, regBits, mod->name().c_str());
+}
+
+} // namespace llpm
@@ -0,0 +1,34 @@
+#ifndef __LLPM_PASSES_TRANSFORMS_NARROW_HPP__
+#define __LLPM_PASSES_TRANSFORMS_NARROW_HPP__
+
+#include <passes/pass.hpp>
+#include <analysis/value_range.hpp>
+
+#include <map>
+
+namespace llpm {
+
+/**
+ * Shrinks datapaths to the bits their values actually need, according
+ * to RangeAnalysis. IntAdditions and IntCompares get narrower operands
+ * and PipelineRegisters only hold the bits in use, field by field for
+ * structs (which is what Joins feed them). IntTruncate and zero
+ * IntExtend blocks at the boundaries are just wiring.
+ *
+ * Modules are visited before their submodules, so control regions
+ * start from the ranges their inputs' drivers have in the parent.
+ */
+class NarrowWidthsPass: public ModulePass {
+    std::map<const OutputPort*, ValueRange> _seeds;
+
+public:
+    NarrowWidthsPass(Design& d) :
+        ModulePass(d)
+    { }
+
+    virtual void runInternal(Module*);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_TRANSFORMS_NARROW_HPP__
@@ -7,8 +7,12 @@
 #include <libraries/synthesis/fork.hpp>
 #include <util/transform.hpp>
 #include <util/llvm_type.hpp>
-#include <analysis/graph.hpp>
+#include <util/thread_pool.hpp>
 #include <analysis/graph_queries.hpp>
+#include <analysis/scc.hpp>
+#include <analysis/timing.hpp>
+
+#include <cmath>
 
 using namespace std;
 
@@ -23,7 +27,7 @@ void PipelineDependentsPass::runInternal(Module* mod) {
     if (!t.canMutate())
         return;
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     t.conns()->findAllBlocks(blocks);
     for (auto block: blocks) {
         unsigned numNormalOutputs = block->outputs().size();
@@ -78,88 +82,6 @@ static bool isPipelineReg(Block* b) {
     return b->is<PipelineRegister>();
 }
 
-struct FlowVisitor : public Visitor<OIEdge> {
-    struct BlockStats {
-        float flow;
-        unsigned visits;
-        unsigned outputEdges;
-        unsigned inputEdges;
-
-        BlockStats() :
-            flow(0.0),
-            visits(0),
-            outputEdges(0),
-            inputEdges(0)
-        { }
-    };
-
-    map<Block*, BlockStats> flowAmt;
-
-    float edgeFlow(const OutputPort* op) {
-        Block* srcBlock = op->owner();
-        BlockStats& bs = flowAmt[srcBlock];
-        if (bs.outputEdges == 0)
-            return -1.0;
-        // printf("flow: %f\n", bs.flow);
-        return bs.flow / bs.outputEdges;
-    }
-
-    Terminate visit(const ConnectionDB*, const OIEdge& edge) {
-        Block* dstBlock = edge.endPort()->owner();
-        if (dstBlock->is<PipelineRegister>())
-            return TerminatePath;
-
-        float ef = edgeFlow(edge.end().first);
-        BlockStats& bs = flowAmt[dstBlock];
-#if 0
-        printf("  %p <- %p %u/%u\n",
-               dstBlock, edge.end().first->owner(),
-               bs.visits, bs.inputEdges);
-#endif
-        bs.flow += ef;
-        bs.visits += 1;
-        // if (bs.visits < bs.inputEdges)
-            // return TerminatePath;
-        return Continue;
-    }
-
-    void run(Module* mod) {
-        ConnectionDB* conns = mod->conns();
-        if (conns == NULL)
-            return;
-
-        vector<OutputPort*> initVec;
-        mod->internalDrivers(initVec);
-
-        set<OutputPort*> init(initVec.begin(), initVec.end());
-
-        for (const Connection& c: *conns) {
-            if (!c.sink()->owner()->is<PipelineRegister>()) {
-                flowAmt[c.source()->owner()].outputEdges += 1;
-                flowAmt[c.sink()->owner()].inputEdges += 1;
-            }
-            if (c.source()->owner()->is<PipelineRegister>() ||
-                c.source()->owner()->inputs().size() == 0) {
-                init.insert(c.source());
-            }
-        }
-
-        for (auto op: init) {
-            if (op->owner()->is<PipelineRegister>() ||
-                op->owner()->inputs().size() == 0) {
-                flowAmt[op->owner()].flow = 0.0;
-            } else {
-                flowAmt[op->owner()].flow = 1.0;
-            }
-        }
-
-        GraphSearch<FlowVisitor, BFS> search(conns, *this);
-        for (unsigned i=0; i<2; i++) {
-            search.go(init);
-        }
-    }
-};
-
 void PipelineCyclesPass::runInternal(Module* mod) {
     if (mod->is<ControlRegion>())
         // Never insert registers within a CR
@@ -174,36 +96,21 @@ void PipelineCyclesPass::runInternal(Module* mod) {
 
     // Strictly speaking, pipeline registers are only necessary for
     // _correctness_ when there exists a cycle in the graph. Therefore,
-    // the _minimum_ pipelining is found by locating graph cycles and breaking
-    // them with pipeline regs. We can further reduce pipeline regs by
-    // breaking them starting with the most common edges in cycles --
-    // breaking those edges simultaneously breaks the most cycles!
-    //
-    std::vector< std::pair<const OutputPort*, const InputPort*> > cycle;
-    while (queries::FindCycle(mod, &isPipelineReg, cycle)) {
-        FlowVisitor fvisitor;
-        fvisitor.run(mod);
-
-        auto toBreak = cycle[rand() % cycle.size()];
-        float maxFlow = 0;
-        for (auto c: cycle) {
-            float flow = fvisitor.edgeFlow(c.first);
-            if (flow > maxFlow) {
-                maxFlow = flow;
-                toBreak = c;
-            }
-        }
-
-        auto preg = new PipelineRegister(toBreak.first);
-        t.insertAfter((OutputPort*)toBreak.first, preg);
-        // printf("    preg at: %s -> %s\n",
-               // toBreak.source()->owner()->globalName().c_str(),
-               // toBreak.sink()->owner()->globalName().c_str());
+    // the _minimum_ pipelining is found by locating the strongly connected
+    // components and cutting each of them with as few register bits as we
+    // can manage.
+    std::vector<const OutputPort*> cut;
+    queries::FindFeedbackPorts(mod, &isPipelineReg, cut);
+    for (auto op: cut) {
+        auto preg = new PipelineRegister(op);
+        t.insertAfter((OutputPort*)op, preg);
         count++;
         bits += bitwidth(preg->dout()->type());
     }
+    // No cycle should be left. CheckCyclesPass makes sure of that once,
+    // at the end of optimization, rather than after every module.
 
-    printf("    Inserted %u pipeline registers (%u bits)\n", count, bits);
+    tprintf("    Inserted %u pipeline registers (%u bits)\n", count, bits);
 }
 
 void LatchUntiedOutputs::runInternal(Module* mod) {
@@ -216,7 +123,7 @@ void LatchUntiedOutputs::runInternal(Module* mod) {
         return;
 
     unsigned count = 0;
-    set<Block*> blocks;
+    vector<Block*> blocks;
     t.conns()->findAllBlocks(blocks);
     for (auto b: blocks) {
         if (b->outputsTied())
@@ -234,149 +141,163 @@ void LatchUntiedOutputs::runInternal(Module* mod) {
             count++;
         }
     }
-    printf("    Inserted %u latches\n", count);
+    tprintf("    Inserted %u latches\n", count);
 }
 
-struct DelayVisitor : public Visitor<OIEdge> {
-    struct Stats {
-        Time inputPathDelay;
-        unsigned visits;
-
-        Stats() :
-            inputPathDelay(),
-            visits(0)
-        { }
-    };
-
-    PipelineFrequencyPass* pipePass;
-    Backend* backend;
-    Time period;
-    map<const OutputPort*, Stats> delays;
-    set<const OutputPort*> pipeline;
-    set<const Port*> constPorts;
-    set<Block*> constBlocks;
-
-    DelayVisitor(PipelineFrequencyPass* pass, Backend* b, Time period) :
-        pipePass(pass),
-        backend(b),
-        period(period)
-    { }
-
-    Time edgeDelay(const OutputPort* op) {
-        if (pipeline.count(op) > 0 || constPorts.count(op) > 0)
-            return Time();
-        Stats& s = delays[op];
-        if (op->owner()->is<MutableModule>()) {
-            auto f = pipePass->_modOutDelays.find(op);
-            if (f == pipePass->_modOutDelays.end()) {
-                pipePass->runOnModule(op->owner()->as<Module>(), s.inputPathDelay);
-            }
-            return pipePass->_modOutDelays[op];
-        } else {
-            return s.inputPathDelay + backend->maxLatency(op);
-        }
-    }
-
-    Terminate visit(const ConnectionDB*, const OIEdge& edge) {
-        // Get the delay to the output port of our origin
-        Time delay = edgeDelay(edge.end().first);
-
-        // Add the routing delay
-        delay += backend->latency(edge.end().second, edge.end().first);
+/**
+ * Pick a port on a failing path to register. Ideally, one register
+ * fixes the path: both halves meet the period. Among such ports, take
+ * the narrowest, then the one which balances the halves best. If no
+ * single register will do, cut as late as we can and let the next
+ * round deal with the rest.
+ */
+static const OutputPort* ChooseCut(const StaticTiming& sta,
+                                   const StaticTiming::TimingPath& path,
+                                   const set<const Port*>& constPorts) {
+    double period = sta.period().sec();
+    double total = path.back().arrival.sec();
+
+    const OutputPort* best = NULL;
+    bool bestFixes = false;
+    unsigned bestBits = 0;
+    double bestScore = 0.0;
+    for (const auto& pp: path) {
+        const OutputPort* op = pp.port->asOutput();
+        double a = pp.arrival.sec();
+        if (op == NULL ||
+            a <= 0.0 || a > period ||
+            sta.isCut(op) ||
+            constPorts.count(op) > 0 ||
+            op->owner()->is<PipelineRegister>())
+            continue;
 
-        if (delay >= period) {
-            pipeline.insert(edge.end().first);
-            delay = Time();
+        bool fixes = (total - a) <= period;
+        unsigned bits = bitwidth(op->type());
+        double score = fixes ? -fabs(total / 2 - a) : a;
+        bool better;
+        if (best == NULL || fixes != bestFixes)
+            better = best == NULL || fixes;
+        else if (fixes && bits != bestBits)
+            better = bits < bestBits;
+        else
+            better = score > bestScore;
+
+        if (better) {
+            best = op;
+            bestFixes = fixes;
+            bestBits = bits;
+            bestScore = score;
         }
+    }
+    return best;
+}
 
-        set<const OutputPort*> deps;
-        edge.endPort()->owner()->deps(edge.endPort(), deps);
+bool PipelineFrequencyPass::runOnModule(Module* mod) {
+    ConnectionDB* conns = mod->conns();
+    if (conns == NULL || _done.count(mod) > 0)
+        return false;
+    _done.insert(mod);
 
-        for (auto op: deps) {
-            Stats& s = delays[op];
-            if (s.inputPathDelay < delay)
-                s.inputPathDelay = delay;
-            s.visits += 1;
+    // Submodules first, so that we know how long their outputs take
+    bool ret = false;
+    vector<Module*> subs;
+    mod->submodules(subs);
+    for (auto sub: subs)
+        ret |= runOnModule(sub);
+
+    StaticTiming sta(conns, _design.backend(), _maxDelay);
+    for (auto sub: subs) {
+        for (auto op: sub->outputs()) {
+            auto f = _modOutDelays.find(op);
+            if (f != _modOutDelays.end())
+                sta.setLatency(op, f->second);
         }
-        return Continue;
     }
 
-    void run(Module* mod, Time initTime) {
-        ConnectionDB* conns = mod->conns();
-        if (conns == NULL)
-            return;
-
-        queries::FindConstants(mod, constPorts, constBlocks);
-
-        vector<OutputPort*> init;
-        mod->internalDrivers(init);
-
-        for (auto op: init) {
-            delays[op].inputPathDelay = initTime;
-        }
+    // Constants get synthesized away, so they take no time
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(mod);
+    for (auto p: consts->ports) {
+        auto op = p->asOutput();
+        if (op != NULL)
+            sta.setStart(op, Time());
+    }
 
-        set<Block*> blocks;
-        for (auto block: blocks) {
-            if (block->is<PipelineRegister>()) {
-                pipeline.insert(block->as<PipelineRegister>()->dout());
-            }
+    sta.analyze();
+    Time wns = sta.wns();
+    Time tns = sta.tns();
+
+    vector<const OutputPort*> regs;
+    set<const Port*> unfixable;
+    StaticTiming::TimingPath path;
+    while (const Port* endpoint = sta.worstViolation(unfixable)) {
+        sta.criticalPath(endpoint, path);
+        auto op = ChooseCut(sta, path, consts->ports);
+        if (op == NULL) {
+            // Some single block on this path is slower than the period
+            unfixable.insert(endpoint);
+            continue;
         }
-
-        GraphSearch<DelayVisitor, BFS> search(conns, *this);
-        search.go(init);
+        sta.cut(op);
+        regs.push_back(op);
     }
-};
+    sta.analyze();
 
-bool PipelineFrequencyPass::runOnModule(Module* mod, Time initTime) {
-    // TODO: We assume a delay of 0.0 at the start of the module. That is
-    // wrong. Get a delay from a previous execution of this function. Better
-    // yet, run this function recursively with that number.
-
-    DelayVisitor dv(this, _design.backend(), _maxDelay);
-    dv.run(mod, initTime);
     unsigned bits = 0;
-    for (auto p: dv.pipeline) {
-        bits += bitwidth(p->type());
+    for (auto op: regs) {
+        bits += bitwidth(op->type());
     }
-    if (dv.pipeline.size() > 0) {
+    if (regs.size() > 0) {
         printf("Inserting %lu pipeline registers (%u bits) "
                "into %s to meet timing...\n",
-               dv.pipeline.size(),
+               regs.size(),
                bits,
                mod->name().c_str());
+        printf("    WNS %.3f ns -> %.3f ns, TNS %.3f ns -> %.3f ns\n",
+               wns.sec() * 1e9, sta.wns().sec() * 1e9,
+               tns.sec() * 1e9, sta.tns().sec() * 1e9);
+    }
+    if (unfixable.size() > 0) {
+        printf("Warning: %lu paths in %s cannot meet timing by "
+               "pipelining. Worst:\n",
+               unfixable.size(), mod->name().c_str());
+        vector<StaticTiming::TimingPath> worst;
+        sta.worstPaths(1, worst);
+        for (const auto& pp: worst.front()) {
+            printf("    %8.3f ns  %s\n",
+                   pp.arrival.sec() * 1e9, pp.port->describe().c_str());
+        }
+    }
+
+    for (auto modOp: mod->outputs()) {
+        InputPort* intIp = mod->getSink(modOp);
+        assert(intIp != nullptr);
+        _modOutDelays[modOp] = sta.arrival(intIp);
     }
 
     Transformer t(mod);
-    for (auto op: dv.pipeline) {
-        if (op->owner()->is<PipelineRegister>())
-            continue;
+    for (auto op: regs) {
         if (t.conns()->countSinks(op) == 0)
             // Don't pipeline things with no consumer
             continue;
-        auto preg = new PipelineRegister(op);
+        auto preg = new PipelineRegister((OutputPort*)op);
         t.insertAfter((OutputPort*)op, preg);
     }
 
-    if (mod->is<ControlRegion>() && dv.pipeline.size() > 0) {
+    if (mod->is<ControlRegion>() && regs.size() > 0) {
         mod->as<ControlRegion>()->schedule();
         printf("    CR cycle latency: %u\n",
                mod->as<ControlRegion>()->clocks());
     }
 
-    for (auto modOp: mod->outputs()) {
-        OutputPort* intOp = t.conns()->findSource(mod->getSink(modOp));
-        assert(intOp != nullptr);
-        _modOutDelays[modOp] = dv.edgeDelay(intOp);
-    }
-
-    return dv.pipeline.size() > 0;
+    return ret || regs.size() > 0;
 }
 
 bool PipelineFrequencyPass::run() {
     bool ret = false;
+    _done.clear();
     auto mods = _design.modules();
     for (Module* m: mods) {
-        if (runOnModule(m, Time::s(0)))
+        if (runOnModule(m))
             ret = true;
         m->validityCheck();
     }
@@ -2,9 +2,11 @@
 #define __LLPM_PASSES_TRANSFORMS_PIPELINE_HPP__
 
 #include <passes/pass.hpp>
+#include <analysis/graph_queries.hpp>
 #include <util/time.hpp>
 
 #include <map>
+#include <set>
 
 namespace llpm {
 
@@ -27,14 +29,29 @@ public:
     { }
 
     virtual void runInternal(Module*);
+
+    virtual bool moduleLocal() const {
+        return true;
+    }
+
+    // Nothing on a cycle can be constant, so cutting cycles never
+    // changes which ports are
+    virtual void preserved(PreservedAnalyses& pa) const {
+        pa.preserve<queries::ConstantsAnalysis>();
+    }
 };
 
+/**
+ * Inserts pipeline registers wherever static timing analysis says a
+ * path cannot meet the clock period. Submodules are analyzed first;
+ * their output delays become block latencies in the parent.
+ */
 class PipelineFrequencyPass: public Pass {
     Time _maxDelay;
     std::map<const OutputPort*, Time> _modOutDelays;
+    std::set<Module*> _done;
 
-    friend struct DelayVisitor;
-    bool runOnModule(Module* mod, Time initTime);
+    bool runOnModule(Module* mod);
 
 public:
     PipelineFrequencyPass(Design& d, Time maxDelay) :
@@ -55,6 +72,10 @@ public:
     { }
 
     virtual void runInternal(Module*);
+
+    virtual bool moduleLocal() const {
+        return true;
+    }
 };
 
 
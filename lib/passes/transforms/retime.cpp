@@ -0,0 +1,375 @@
+#include "retime.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <llpm/control_region.hpp>
+#include <libraries/synthesis/pipeline.hpp>
+#include <analysis/graph_queries.hpp>
+#include <analysis/timing.hpp>
+#include <util/transform.hpp>
+#include <util/llvm_type.hpp>
+
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace llpm {
+
+static bool isFreeReg(Block* b) {
+    // Registers driven by a stage controller belong to a CR schedule
+    return b->is<PipelineRegister>() &&
+           b->as<PipelineRegister>()->enable() == nullptr;
+}
+
+static bool isMovable(Block* b) {
+    return !b->is<PipelineRegister>() &&
+           !b->is<PipelineStageController>() &&
+           !b->is<Module>() &&
+           !b->hasState() &&
+           b->inputs().size() > 0 &&
+           b->outputs().size() > 0;
+}
+
+bool RetimePass::canMoveForward(Transformer& t, Block* b) {
+    if (!isMovable(b) || _boundary.count(b) > 0)
+        return false;
+    for (auto ip: b->inputs()) {
+        OutputPort* src = t.conns()->findSource(ip);
+        if (src == nullptr ||
+            !isFreeReg(src->owner()) ||
+            t.conns()->countSinks(src) != 1)
+            return false;
+    }
+    for (auto op: b->outputs()) {
+        if (t.conns()->countSinks(op) == 0)
+            return false;
+    }
+    return true;
+}
+
+bool RetimePass::canMoveBackward(Transformer& t, Block* b) {
+    if (!isMovable(b) || _boundary.count(b) > 0)
+        return false;
+    for (auto ip: b->inputs()) {
+        if (t.conns()->findSource(ip) == nullptr)
+            return false;
+    }
+    vector<InputPort*> sinks;
+    for (auto op: b->outputs()) {
+        sinks.clear();
+        t.conns()->findSinks(op, sinks);
+        if (sinks.size() != 1 || !isFreeReg(sinks.front()->owner()))
+            return false;
+    }
+    return true;
+}
+
+int RetimePass::moveForward(Transformer& t, Block* b) {
+    int bits = 0;
+    for (auto ip: b->inputs()) {
+        OutputPort* src = t.conns()->findSource(ip);
+        bits -= bitwidth(src->type());
+        t.remove(src->owner());
+    }
+    for (auto op: b->outputs()) {
+        auto preg = new PipelineRegister(op);
+        t.insertAfter(op, preg);
+        bits += bitwidth(op->type());
+    }
+    return bits;
+}
+
+int RetimePass::moveBackward(Transformer& t, Block* b) {
+    int bits = 0;
+    vector<InputPort*> sinks;
+    for (auto op: b->outputs()) {
+        sinks.clear();
+        t.conns()->findSinks(op, sinks);
+        bits -= bitwidth(op->type());
+        t.remove(sinks.front()->owner());
+    }
+    for (auto ip: b->inputs()) {
+        OutputPort* src = t.conns()->findSource(ip);
+        auto preg = new PipelineRegister(src);
+        t.insertBetween(Connection(src, ip), preg);
+        bits += bitwidth(ip->type());
+    }
+    return bits;
+}
+
+void RetimePass::analyze(StaticTiming& sta) {
+    for (auto p: _constPorts) {
+        auto op = p->asOutput();
+        if (op != NULL)
+            sta.setStart(op, Time());
+    }
+    sta.analyze();
+}
+
+// Worst endpoint arrival on the paths a move across 'b' creates,
+// estimated from 'sta'. Connection delays are assumed to stay the same.
+Time RetimePass::predict(Transformer& t, StaticTiming& sta,
+                         Block* b, bool forward) {
+    Backend* backend = _design.backend();
+    ConnectionDB* conns = t.conns();
+    Time worst;
+    set<const InputPort*> deps;
+    vector<InputPort*> sinks;
+    for (auto op: b->outputs()) {
+        deps.clear();
+        b->deps(op, deps);
+        Time through;
+        for (auto ip: deps) {
+            OutputPort* src = conns->findSource(ip);
+            Time d = backend->latency(ip, op);
+            if (forward) {
+                // Paths into the register on 'ip' now continue through b
+                auto reg = src->owner()->as<PipelineRegister>();
+                d = d + sta.arrival(reg->din()) + sta.arrival(ip);
+            } else {
+                d = d + sta.arrival(ip) - sta.arrival(src);
+            }
+            if (d > through)
+                through = d;
+        }
+
+        if (!forward) {
+            // Paths out of the register on 'op' now start before b
+            sinks.clear();
+            conns->findSinks(op, sinks);
+            auto reg = sinks.front()->owner()->as<PipelineRegister>();
+            through = through + sta.arrival(reg->din()) - sta.arrival(op);
+            through = through + sta.period() - sta.required(reg->dout());
+        }
+        if (through > worst)
+            worst = through;
+    }
+    return worst;
+}
+
+// Blocks whose paths a move across 'b' changed, which are those up to
+// one register away
+static void Neighborhood(ConnectionDB* conns, Block* b, set<Block*>& out) {
+    vector<InputPort*> sinks;
+    vector<InputPort*> regSinks;
+    for (auto ip: b->inputs()) {
+        OutputPort* src = conns->findSource(ip);
+        if (src == nullptr)
+            continue;
+        out.insert(src->owner());
+        if (!src->owner()->is<PipelineRegister>())
+            continue;
+        for (auto rip: src->owner()->inputs()) {
+            OutputPort* rsrc = conns->findSource(rip);
+            if (rsrc != nullptr)
+                out.insert(rsrc->owner());
+        }
+    }
+    for (auto op: b->outputs()) {
+        sinks.clear();
+        conns->findSinks(op, sinks);
+        for (auto sink: sinks) {
+            out.insert(sink->owner());
+            if (!sink->owner()->is<PipelineRegister>())
+                continue;
+            for (auto rop: sink->owner()->outputs()) {
+                regSinks.clear();
+                conns->findSinks(rop, regSinks);
+                for (auto rs: regSinks)
+                    out.insert(rs->owner());
+            }
+        }
+    }
+}
+
+static unsigned sumBits(const Block::InputList& ports) {
+    unsigned bits = 0;
+    for (auto p: ports)
+        bits += bitwidth(p->type());
+    return bits;
+}
+
+static unsigned sumBits(const Block::OutputList& ports) {
+    unsigned bits = 0;
+    for (auto p: ports)
+        bits += bitwidth(p->type());
+    return bits;
+}
+
+void RetimePass::runInternal(Module* mod) {
+    if (mod->is<ControlRegion>())
+        // CR registers are bound to stage controllers by schedule(),
+        // which also balances them. Leave them be.
+        return;
+
+    Transformer t(mod);
+    if (!t.canMutate())
+        return;
+
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(mod);
+    _constPorts = consts->ports;
+
+    // Never move registers across module I/O or constants
+    _boundary = consts->blocks;
+    vector<OutputPort*> drivers;
+    mod->internalDrivers(drivers);
+    for (auto op: drivers)
+        _boundary.insert(op->owner());
+    for (auto op: mod->outputs())
+        _boundary.insert(mod->getSink(op)->owner());
+
+    Backend* backend = _design.backend();
+    unique_ptr<StaticTiming> sta(
+        new StaticTiming(t.conns(), backend, _period));
+    analyze(*sta);
+    Time wns = sta->wns();
+    Time startWns = wns;
+
+    unsigned moves = 0;
+    int bits = 0;
+
+    // Phase 1: chip away at the critical path by pulling the register
+    // at its start forward or pushing the one at its end backward.
+    // Stop once neither helps.
+    while (wns < Time()) {
+        set<const Port*> none;
+        const Port* endpoint = sta->worstViolation(none);
+        if (endpoint == NULL)
+            break;
+        StaticTiming::TimingPath path;
+        sta->criticalPath(endpoint, path);
+        if (path.size() < 3)
+            break;
+
+        vector< pair<Block*, bool> > moveCands;
+        Block* first = path[1].port->owner();
+        if (path.front().port->owner()->is<PipelineRegister>() &&
+            canMoveForward(t, first))
+            moveCands.push_back(make_pair(first, true));
+        Block* last = path[path.size() - 2].port->owner();
+        if (endpoint->owner()->is<PipelineRegister>() &&
+            canMoveBackward(t, last))
+            moveCands.push_back(make_pair(last, false));
+
+        // Only moves which don't just make a path as long elsewhere,
+        // most promising first
+        Time worstArrival = _period - wns;
+        vector< pair<Time, pair<Block*, bool> > > cands;
+        for (auto cand: moveCands) {
+            Time p = predict(t, *sta, cand.first, cand.second);
+            if (p < worstArrival)
+                cands.push_back(make_pair(p, cand));
+        }
+        sort(cands.begin(), cands.end(),
+             [](const pair<Time, pair<Block*, bool> >& a,
+                const pair<Time, pair<Block*, bool> >& b) {
+                 return a.first < b.first;
+             });
+
+        bool accepted = false;
+        for (auto cand: cands) {
+            Block* b = cand.second.first;
+            bool forward = cand.second.second;
+            int delta = forward ? moveForward(t, b) : moveBackward(t, b);
+
+            unique_ptr<StaticTiming> trial(
+                new StaticTiming(t.conns(), backend, _period));
+            analyze(*trial);
+            if (trial->wns() > wns) {
+                wns = trial->wns();
+                sta = move(trial);
+                bits += delta;
+                moves++;
+                accepted = true;
+                break;
+            }
+
+            // Put it back. The registers are new, so the analysis is
+            // out of date.
+            if (forward)
+                moveBackward(t, b);
+            else
+                moveForward(t, b);
+            sta.reset();
+        }
+
+        if (!accepted)
+            break;
+    }
+
+    // Phase 2: registers are cheaper on the narrow side of a block.
+    // Move them there if timing doesn't suffer. Moves in one round
+    // mustn't touch each other's paths so that they can all be judged
+    // from the same analysis. Each move strictly reduces bits, so this
+    // terminates.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        if (sta == nullptr) {
+            sta.reset(new StaticTiming(t.conns(), backend, _period));
+            analyze(*sta);
+        }
+        Time limit = _period - wns;
+
+        vector<Block*> blocks;
+        t.conns()->findAllBlocks(blocks);
+        vector<Block*> movable;
+        for (auto b: blocks)
+            if (isMovable(b) && _boundary.count(b) == 0)
+                movable.push_back(b);
+
+        set<Block*> touched;
+        vector< pair<Block*, bool> > done;
+        int roundBits = 0;
+        for (auto b: movable) {
+            if (touched.count(b) > 0)
+                continue;
+            unsigned inBits = sumBits(b->inputs());
+            unsigned outBits = sumBits(b->outputs());
+            bool forward;
+            if (inBits > outBits && canMoveForward(t, b))
+                forward = true;
+            else if (outBits > inBits && canMoveBackward(t, b))
+                forward = false;
+            else
+                continue;
+
+            if (predict(t, *sta, b, forward) > limit)
+                continue;
+            roundBits += forward ? moveForward(t, b) : moveBackward(t, b);
+            done.push_back(make_pair(b, forward));
+            touched.insert(b);
+            Neighborhood(t.conns(), b, touched);
+        }
+        if (done.empty())
+            break;
+
+        // The estimates ignore changes in routing delay. If the round
+        // lost timing after all, take it back and stop.
+        sta.reset(new StaticTiming(t.conns(), backend, _period));
+        analyze(*sta);
+        if (sta->wns() < wns) {
+            for (auto iter = done.rbegin(); iter != done.rend(); iter++) {
+                if (iter->second)
+                    moveBackward(t, iter->first);
+                else
+                    moveForward(t, iter->first);
+            }
+            break;
+        }
+        wns = sta->wns();
+        bits += roundBits;
+        moves += done.size();
+        changed = true;
+    }
+
+    if (moves > 0) {
+        printf("    Retimed %s: %u moves, %+d register bits, "
+               "WNS %.3f ns -> %.3f ns\n",
+               mod->name().c_str(), moves, bits,
+               startWns.sec() * 1e9, wns.sec() * 1e9);
+    }
+}
+
+} // namespace llpm
@@ -0,0 +1,54 @@
+#ifndef __LLPM_PASSES_TRANSFORMS_RETIME_HPP__
+#define __LLPM_PASSES_TRANSFORMS_RETIME_HPP__
+
+#include <passes/pass.hpp>
+#include <util/time.hpp>
+
+#include <set>
+
+namespace llpm {
+
+// fwd defs
+class Block;
+class Port;
+class Transformer;
+class StaticTiming;
+
+/**
+ * Moves existing pipeline registers across combinational blocks
+ * (Leiserson-Saxe style) to meet the clock period, then to reduce the
+ * number of register bits without breaking timing. A move takes a
+ * register off every input of a block and puts one on every output
+ * (or vice versa), so every path keeps its token latency.
+ *
+ * Timing is analyzed once per round. Candidate moves are judged by an
+ * estimate of the paths they change, taken from that analysis, and
+ * checked with a full analysis only once they look worthwhile.
+ */
+class RetimePass: public ModulePass {
+    Time _period;
+
+    // Per-module state
+    std::set<const Port*> _constPorts;
+    std::set<Block*> _boundary;
+
+    bool canMoveForward(Transformer&, Block*);
+    bool canMoveBackward(Transformer&, Block*);
+    int moveForward(Transformer&, Block*);
+    int moveBackward(Transformer&, Block*);
+
+    void analyze(StaticTiming&);
+    Time predict(Transformer&, StaticTiming&, Block*, bool forward);
+
+public:
+    RetimePass(Design& d, Time period) :
+        ModulePass(d),
+        _period(period)
+    { }
+
+    virtual void runInternal(Module*);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_TRANSFORMS_RETIME_HPP__
@@ -0,0 +1,175 @@
+#include "select_impl.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <llpm/control_region.hpp>
+#include <refinery/implementations.hpp>
+#include <analysis/graph_queries.hpp>
+#include <util/transform.hpp>
+#include <util/misc.hpp>
+
+#include <llvm/IR/Instruction.h>
+
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+namespace llpm {
+
+SelectImplPass::SelectImplPass(Design& d, Time period,
+                               unsigned maxInterval) :
+    ModulePass(d),
+    _period(period),
+    _maxInterval(maxInterval)
+{
+    if (period <= Time())
+        throw InvalidArgument("Selecting implementations needs a clock "
+                              "period");
+    if (maxInterval == 0)
+        throw InvalidArgument("Initiation interval must be at least 1");
+}
+
+// 'op' by its own name, or else by the LLVM instruction it came from.
+// Asking the namer would hand out names to blocks which later passes
+// may still replace.
+static string Describe(Block* op) {
+    if (op->name() != "")
+        return op->name();
+    const llvm::Instruction* ins = op->history().sourceIns();
+    if (ins != nullptr) {
+        if (ins->hasName())
+            return "%" + ins->getName().str();
+        return ins->getOpcodeName();
+    }
+    return cpp_demangle(typeid(*op).name());
+}
+
+void SelectImplPass::runInternal(Module* mod) {
+    if (mod->is<ControlRegion>())
+        return;
+
+    Transformer t(mod);
+    if (!t.canMutate())
+        return;
+
+    ConnectionDB* conns = t.conns();
+    Backend* backend = _design.backend();
+    const ImplRegistry& reg = _design.impls();
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(mod);
+
+    vector<Block*> blocks;
+    vector<Block*> ops;
+    conns->findAllBlocks(blocks);
+    for (auto b: blocks) {
+        // Constant operators get synthesized away
+        if (b->outputs().size() != 1 || consts->blocks.count(b) > 0)
+            continue;
+        vector<Implementation*> impls;
+        reg.candidates(b, impls);
+        if (impls.size() > 1)
+            ops.push_back(b);
+    }
+    if (ops.empty())
+        return;
+
+    struct Option {
+        Implementation* impl;
+        BlockP block;
+        float area;
+        Time stage;
+        unsigned cycles;
+        unsigned interval;
+        // Of the operator's own stage, between the registers which
+        // pipelining may place around it
+        Time slack;
+        bool meets;
+    };
+
+    unsigned swapped = 0;
+    for (auto op: ops) {
+        // The wires into and out of the operator stay in its stage
+        // unless it registers its own inputs and outputs
+        Time wires;
+        for (auto ip: op->inputs()) {
+            OutputPort* src = conns->findSource(ip);
+            if (src != NULL)
+                wires = max(wires, backend->latency(Connection(src, ip)));
+        }
+        vector<InputPort*> sinks;
+        conns->findSinks(op->outputs()[0], sinks);
+        Time outWire;
+        for (auto sink: sinks)
+            outWire = max(outWire, backend->latency(
+                                       Connection(op->outputs()[0], sink)));
+        wires += outWire;
+
+        vector<Implementation*> impls;
+        reg.candidates(op, impls);
+        vector<Option> options;
+        for (auto impl: impls) {
+            Option o;
+            o.impl = impl;
+            o.block = impl->build(op, backend, _period);
+            o.area = impl->area(o.block.get());
+            o.stage = backend->maxLatency(o.block->outputs()[0]);
+            o.cycles = backend->cycles(o.block.get());
+            o.interval = backend->interval(o.block.get());
+            if (o.cycles == 0)
+                o.slack = _period - wires - o.stage;
+            else
+                o.slack = _period - o.stage;
+            o.meets = o.slack >= Time() && o.interval <= _maxInterval;
+            options.push_back(o);
+        }
+
+        Option* best = NULL;
+        for (auto& o: options) {
+            if (!o.meets)
+                continue;
+            if (best == NULL || o.area < best->area ||
+                (o.area == best->area && o.cycles < best->cycles))
+                best = &o;
+        }
+        bool met = best != NULL;
+        if (!met) {
+            for (auto& o: options) {
+                if (o.interval > _maxInterval)
+                    continue;
+                if (best == NULL || o.slack > best->slack)
+                    best = &o;
+            }
+        }
+        assert(best != NULL);
+
+        printf("    %s in %s%s:\n",
+               Describe(op).c_str(),
+               mod->name().c_str(),
+               met ? "" : " (nothing meets timing)");
+        for (const auto& o: options) {
+            printf("      %c %-10s area %8.1f  latency %3u  interval %3u  "
+                   "stage %8.3f ns  slack %8.3f ns\n",
+                   &o == best ? '*' : ' ',
+                   o.impl->name().c_str(),
+                   o.area, o.cycles, o.interval,
+                   o.stage.sec() * 1e9,
+                   o.slack.sec() * 1e9);
+        }
+
+        if (best->block.get() == op)
+            continue;
+        auto refiner = make_shared<ImplRefiner>(best->impl, backend, _period);
+        refiner->built(op, best->block);
+        Refinery r;
+        r.refiners().appendEntry(refiner);
+        r.refine({op}, *conns, 1);
+        swapped++;
+    }
+
+    if (swapped > 0)
+        printf("    Swapped %u of %lu operators in %s for other "
+               "implementations\n",
+               swapped, ops.size(), mod->name().c_str());
+}
+
+} // namespace llpm
@@ -0,0 +1,36 @@
+#ifndef __LLPM_PASSES_TRANSFORMS_SELECT_IMPL_HPP__
+#define __LLPM_PASSES_TRANSFORMS_SELECT_IMPL_HPP__
+
+#include <passes/pass.hpp>
+#include <util/time.hpp>
+
+namespace llpm {
+
+/**
+ * Picks an implementation for every operator with more than one in
+ * the design's ImplRegistry. It runs before pipelining, so the paths
+ * through an operator are not what they will be; each candidate is
+ * judged only by its own stage instead. A combinational one has to fit
+ * the clock period along with the wires into and out of it, since
+ * pipelining can at best register both ends. A sequential one
+ * registers its own inputs and outputs, so its longest stage has to
+ * fit. The smallest one which fits and accepts inputs at least every
+ * maxInterval cycles wins; if nothing fits, the one leaving the most
+ * slack does.
+ *
+ * The swap goes through a Refinery. Every candidate's area, latency,
+ * interval and slack is reported.
+ */
+class SelectImplPass: public ModulePass {
+    Time _period;
+    unsigned _maxInterval;
+
+public:
+    SelectImplPass(Design& d, Time period, unsigned maxInterval);
+
+    virtual void runInternal(Module*);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_TRANSFORMS_SELECT_IMPL_HPP__
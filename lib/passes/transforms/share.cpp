@@ -0,0 +1,231 @@
+#include "share.hpp"
+
+#include <llpm/design.hpp>
+#include <llpm/module.hpp>
+#include <llpm/control_region.hpp>
+#include <libraries/core/comm_intr.hpp>
+#include <libraries/core/logic_intr.hpp>
+#include <libraries/core/std_library.hpp>
+#include <util/transform.hpp>
+#include <util/llvm_type.hpp>
+#include <util/misc.hpp>
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <tuple>
+
+using namespace std;
+
+namespace llpm {
+
+static bool LoopsToItself(const llvm::BasicBlock* bb) {
+    auto term = bb->getTerminator();
+    if (term == nullptr)
+        return false;
+    for (unsigned i=0; i<term->getNumSuccessors(); i++) {
+        if (term->getSuccessor(i) == bb)
+            return true;
+    }
+    return false;
+}
+
+// Basic blocks reachable from bb over one or more CFG edges
+static void Reachable(const llvm::BasicBlock* bb,
+                      set<const llvm::BasicBlock*>& reach) {
+    vector<const llvm::BasicBlock*> work({bb});
+    while (!work.empty()) {
+        auto b = work.back();
+        work.pop_back();
+        auto term = b->getTerminator();
+        if (term == nullptr)
+            continue;
+        for (unsigned i=0; i<term->getNumSuccessors(); i++) {
+            auto succ = term->getSuccessor(i);
+            if (reach.insert(succ).second)
+                work.push_back(succ);
+        }
+    }
+}
+
+// Area of one operator: logical effort times output bits
+static float UnitArea(Block* b) {
+    Function* f = b->as<Function>();
+    return f->logicalEffort(f->din(), f->dout()) *
+           bitwidth(f->dout()->type());
+}
+
+bool ShareOperatorsPass::worthSharing(const vector<Block*>& ops) const {
+    Function* f = ops.front()->as<Function>();
+    float k = ops.size();
+    float mux = 1.0 + log2(k);
+    float inBits = bitwidth(f->din()->type()) + idxwidth(ops.size());
+    float outBits = bitwidth(f->dout()->type());
+
+    float saved = (k - 1) * UnitArea(f);
+    // The request Select and the response Router
+    float added = mux * (inBits + outBits);
+    // Every requester now goes through both of them
+    float latency = k * 2 * mux;
+    return saved > added + _latencyWeight * latency;
+}
+
+void ShareOperatorsPass::share(Transformer& t, const vector<Block*>& ops) {
+    ConnectionDB* conns = t.conns();
+    Function* unit = ops.front()->as<Function>();
+    llvm::Type* dinTy = unit->din()->type();
+    llvm::Type* doutTy = unit->dout()->type();
+    llvm::Type* tagTy = llvm::Type::getIntNTy(dinTy->getContext(),
+                                              idxwidth(ops.size()));
+    llvm::Type* reqTy = llvm::StructType::get(dinTy->getContext(),
+                                              vector<llvm::Type*>(
+                                                {tagTy, dinTy}));
+
+    auto sel = new Select(ops.size(), reqTy);
+    auto router = new Router(ops.size(), doutTy);
+    for (unsigned i=0; i<ops.size(); i++) {
+        Function* op = ops[i]->as<Function>();
+        auto req = new Join(vector<llvm::Type*>({tagTy, dinTy}));
+        auto tag = new Constant(llvm::ConstantInt::get(tagTy, i));
+        conns->connect(tag->dout(), req->din(0));
+        conns->remap(op->din(), req->din(1));
+        conns->connect(req->dout(), sel->din(i));
+        // All but the first are now unconnected, so they drop out
+        conns->remap(op->dout(), router->dout(i));
+    }
+
+    auto tag = new Extract(reqTy, {0});
+    auto data = new Extract(reqTy, {1});
+    conns->connect(sel->dout(), tag->din());
+    conns->connect(sel->dout(), data->din());
+    conns->connect(data->dout(), unit->din());
+    auto resp = Join::get(*conns, {tag->dout(), unit->dout()});
+    conns->connect(resp->dout(), router->din());
+}
+
+void ShareOperatorsPass::runInternal(Module* mod) {
+    if (mod->is<ControlRegion>())
+        return;
+
+    Transformer t(mod);
+    if (!t.canMutate())
+        return;
+    // Wait until the instructions have all been refined into
+    // operators. Elaboration stops once they are, so this runs once.
+    if (!mod->refined(_design.backend()->primitiveStops()))
+        return;
+
+    struct Candidate {
+        Block* op;
+        const llvm::BasicBlock* bb;
+        unsigned order;
+    };
+    typedef tuple<string, llvm::Type*, llvm::Type*, bool> Kind;
+    map<Kind, vector<Candidate>> kinds;
+    map<const llvm::Instruction*, unsigned> order;
+    set<const llvm::Function*> numbered;
+
+    vector<Block*> blocks;
+    t.conns()->findAllBlocks(blocks);
+    for (Block* b: blocks) {
+        string name;
+        bool isSigned = false;
+        if (b->is<IntMultiply>()) {
+            name = "multiplier";
+        } else if (b->is<IntDivide>()) {
+            name = "divider";
+            isSigned = b->as<IntDivide>()->isSigned();
+        } else if (b->is<IntRemainder>()) {
+            name = "remainder unit";
+            isSigned = b->as<IntRemainder>()->isSigned();
+        } else {
+            continue;
+        }
+
+        const llvm::Instruction* ins = b->history().sourceIns();
+        if (ins == nullptr)
+            continue;
+        const llvm::BasicBlock* bb = ins->getParent();
+        // Iterations of a pipelined loop overlap, so its operators are
+        // busy all the time
+        if (_design.pipelineLoops() && LoopsToItself(bb))
+            continue;
+
+        const llvm::Function* func = bb->getParent();
+        if (numbered.insert(func).second) {
+            for (const auto& fbb: *func)
+                for (const auto& fins: fbb)
+                    order.emplace(&fins, order.size());
+        }
+
+        Function* f = b->as<Function>();
+        Kind k(name, f->din()->type(), f->dout()->type(), isSigned);
+        kinds[k].push_back(Candidate {b, bb, order[ins]});
+    }
+
+    // Most expensive first, so they get first pick of the basic blocks
+    typedef pair<string, vector<Candidate>*> Group;
+    vector<Group> groups;
+    for (auto& p: kinds) {
+        auto& cands = p.second;
+        sort(cands.begin(), cands.end(),
+             [](const Candidate& a, const Candidate& b) {
+                return a.order < b.order;
+             });
+        groups.push_back(Group(get<0>(p.first), &cands));
+    }
+    sort(groups.begin(), groups.end(),
+         [](const Group& a, const Group& b) {
+            float aa = UnitArea(a.second->front().op);
+            float ba = UnitArea(b.second->front().op);
+            if (aa != ba)
+                return aa > ba;
+            return a.second->front().order < b.second->front().order;
+         });
+
+    map<const llvm::BasicBlock*, set<const llvm::BasicBlock*>> reach;
+    for (const auto& p: kinds) {
+        for (const auto& c: p.second) {
+            if (reach.count(c.bb) == 0)
+                Reachable(c.bb, reach[c.bb]);
+        }
+    }
+    // Neither block can run after the other in the same call
+    auto exclusive = [&](const llvm::BasicBlock* a,
+                         const llvm::BasicBlock* b) {
+        return a != b && reach[a].count(b) == 0 && reach[b].count(a) == 0;
+    };
+
+    set<const llvm::BasicBlock*> claimed;
+    for (const auto& g: groups) {
+        vector<Block*> ops;
+        set<const llvm::BasicBlock*> bbs;
+        for (const auto& c: *g.second) {
+            if (claimed.count(c.bb) > 0)
+                continue;
+            bool ok = all_of(bbs.begin(), bbs.end(),
+                             [&](const llvm::BasicBlock* bb) {
+                                 return exclusive(bb, c.bb);
+                             });
+            if (ok) {
+                bbs.insert(c.bb);
+                ops.push_back(c.op);
+            }
+        }
+        if (ops.size() < 2 || !worthSharing(ops))
+            continue;
+
+        printf("    Sharing one %s between %lu basic blocks in %s\n",
+               g.first.c_str(), ops.size(), mod->name().c_str());
+        share(t, ops);
+        claimed.insert(bbs.begin(), bbs.end());
+    }
+}
+
+} // namespace llpm
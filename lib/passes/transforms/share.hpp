@@ -0,0 +1,50 @@
+#ifndef __LLPM_PASSES_TRANSFORMS_SHARE_HPP__
+#define __LLPM_PASSES_TRANSFORMS_SHARE_HPP__
+
+#include <passes/pass.hpp>
+
+#include <vector>
+
+namespace llpm {
+
+// fwd defs
+class Block;
+class Transformer;
+
+/**
+ * Binds expensive arithmetic (multiplies, divides and remainders)
+ * which came from different basic blocks of the same function onto
+ * one shared unit. Requests are merged by a Select with a tag naming
+ * the requester, and a Router sends each result back by its tag.
+ *
+ * Calls in flight in different basic blocks use a unit at the same
+ * time, and a result stuck at the Router holds up the ones behind it.
+ * If one block could reach the other, a call waiting in the later
+ * block could be stuck behind a result for an earlier call which is
+ * still waiting on that later block. So operators are only shared
+ * between blocks on different branches, with no path through the CFG
+ * from either one to the other, and every basic block takes part in
+ * at most one shared unit.
+ *
+ * A group is shared if the area it saves (logical effort times output
+ * bits) beats the multiplexing it adds plus latencyWeight times the
+ * logic the requests now pass through.
+ */
+class ShareOperatorsPass: public ModulePass {
+    float _latencyWeight;
+
+    bool worthSharing(const std::vector<Block*>& ops) const;
+    void share(Transformer&, const std::vector<Block*>& ops);
+
+public:
+    ShareOperatorsPass(Design& d, float latencyWeight) :
+        ModulePass(d),
+        _latencyWeight(latencyWeight)
+    { }
+
+    virtual void runInternal(Module*);
+};
+
+} // namespace llpm
+
+#endif // __LLPM_PASSES_TRANSFORMS_SHARE_HPP__
@@ -17,13 +17,13 @@ void SimplifyPass::eliminateNoops(Module* m) {
     ConnectionDB* conns = m->conns();
     assert(conns != NULL);
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     conns->findAllBlocks(blocks);
 
     // Eliminate identities and other no-ops
     for (Block* b: blocks) {
         // Identify does nothing by definition
-        Identity* ib = dynamic_cast<Identity*>(b);
+        Identity* ib = b->as<Identity>();
         if (ib)
             t.remove(ib);
 
@@ -43,7 +43,7 @@ void SimplifyPass::eliminateNoops(Module* m) {
             t.remove(rb);
 
         // Extracts with no selection path are probably invalid anyway
-        Extract* eb = dynamic_cast<Extract*>(b);
+        Extract* eb = b->as<Extract>();
         if (eb && eb->path().size() == 0) {
             t.remove(eb);
         }
@@ -61,7 +61,7 @@ void SimplifyPass::eliminateNoops(Module* m) {
         }
 
         // Find splits driven by joins and replace with wait
-        Split* s = dynamic_cast<Split*>(b);
+        Split* s = b->as<Split>();
         if (s) {
             auto driver = t.conns()->findSource(s->din());
             if (driver) {
@@ -87,7 +87,7 @@ void SimplifyPass::eliminateNoops(Module* m) {
         }
 
         // Find extracts driven by joins and replace with wait
-        Extract* e = dynamic_cast<Extract*>(b);
+        Extract* e = b->as<Extract>();
         if (e) {
             auto driver = t.conns()->findSource(e->din());
             auto join = driver->owner()->as<Join>();
@@ -162,7 +162,7 @@ void SimplifyPass::simplifyNullSinks(Module* m) {
     ConnectionDB* conns = m->conns();
     assert(conns != NULL);
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     conns->findAllBlocks(blocks);
 
     // Eliminate NullSinks on inputs with other connections
@@ -222,13 +222,10 @@ void SimplifyPass::simplifyExtracts(Module* m) {
     ConnectionDB* conns = m->conns();
     assert(conns != NULL);
 
-    set<Block*> blocks;
-    conns->findAllBlocks(blocks);
-
     // Find all field extracts
     map<OutputPort*, set<unsigned>> fieldsUsed;
-    for (Block* b: blocks) {
-        Extract* eb = dynamic_cast<Extract*>(b);
+    for (Block* b: conns->blocks()) {
+        Extract* eb = b->as<Extract>();
         if (eb) {
             assert(eb->path().size() > 0);
             OutputPort* op = conns->findSource(eb->din());
@@ -247,7 +244,7 @@ void SimplifyPass::simplifyExtracts(Module* m) {
             vector<InputPort*> opSinks;
             conns->findSinks(op, opSinks);
             for (auto sink: opSinks) {
-                Extract* eb = dynamic_cast<Extract*>(sink->owner());
+                Extract* eb = sink->owner()->as<Extract>();
                 if (eb) {
                     auto path = eb->path();
                     assert(path.size() > 0);
@@ -280,9 +277,9 @@ void SimplifyPass::simplifyConstants(Module* m) {
     ConnectionDB* conns = m->conns();
     assert(conns != NULL);
 
-    std::set<const Port*> constPorts;
-    std::set<Block*> constBlocks;
-    queries::FindConstants(m, constPorts, constBlocks);
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(m);
+    const std::set<const Port*>& constPorts = consts->ports;
+    const std::set<Block*>& constBlocks = consts->blocks;
 
     set<Block*> blocks;
     conns->findAllBlocks(blocks);
@@ -345,7 +342,7 @@ void CanonicalizeInputs::runInternal(Module* mod) {
     if (!t.canMutate())
         return;
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     t.conns()->findAllBlocks(blocks);
     for (auto b: blocks) {
         if (b->is<Extract>() ||
@@ -479,7 +476,7 @@ void SimplifyWaits::runInternal(Module* mod) {
     if (!t.canMutate())
         return;
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     t.conns()->findAllBlocks(blocks);
     unsigned ctr = 0;
     for (auto b: blocks) {
@@ -5,16 +5,13 @@
 #include <llpm/control_region.hpp>
 #include <libraries/synthesis/pipeline.hpp>
 #include <analysis/graph_queries.hpp>
+#include <util/thread_pool.hpp>
 
 
 using namespace std;
 
 namespace llpm {
 
-static bool isPipelineReg(Block* b) {
-    return b->is<PipelineRegister>();
-}
-
 template<typename T>
 unsigned intersection_size(const set<T>& a, const set<T>& b) {
     unsigned count;
@@ -42,14 +39,14 @@ void SynthesizeForksPass::runInternal(Module* mod) {
         // Don't add forks to CRs
         return;
 
-    set<const Port*> constPorts;
-    set<Block*> constBlocks;
-    queries::FindConstants(mod, constPorts, constBlocks);
+    auto consts = queries::Analyze<queries::ConstantsAnalysis>(mod);
 
     deque<OutputPort*> forkingSources;
-    for (const auto& p: conns->sinksRaw()) {
-        if (p.second.size() > 1)
-            forkingSources.push_back(p.first);
+    set<OutputPort*> seenSources;
+    for (const Connection& c: *conns) {
+        if (conns->countSinks(c.source()) > 1 &&
+            seenSources.insert(c.source()).second)
+            forkingSources.push_back(c.source());
     }
 
     set<Fork*> realForks;
@@ -60,7 +57,7 @@ void SynthesizeForksPass::runInternal(Module* mod) {
         
         bool virt = false;
 
-        if (constPorts.count(op) > 0)
+        if (consts->ports.count(op) > 0)
             // Don't need to actually fork const values
             virt = true;
 
@@ -86,18 +83,18 @@ void SynthesizeForksPass::runInternal(Module* mod) {
     }
 
     if (realForks.size() > 0)
-        printf("Created forks for %lu forking sources\n", realForks.size());
+        tprintf("Created forks for %lu forking sources\n", realForks.size());
 
     // We now need to check if the fork outputs ever re-combine without
     // touching a pipelineregister. If they do, than those outputs need
     // pipeline regsiters or deadlock could occur.
     unsigned recombinedForks = 0;
     for (auto fork: realForks) {
+        // Consumer sets are only good until we add registers below
+        auto analysis = queries::Analyze<queries::ConsumersAnalysis>(mod);
         vector<set<const InputPort*>> consumers;
-        for (auto op: fork->outputs()) {
-            consumers.push_back({});
-            queries::FindConsumers(mod, op, consumers.back(), &isPipelineReg);
-        }
+        for (auto op: fork->outputs())
+            consumers.push_back(analysis->consumers(op));
 
         set<unsigned> pipelineTheseOutputs;
         for (unsigned i=0; i<fork->outputs().size(); i++) {
@@ -127,7 +124,7 @@ void SynthesizeForksPass::runInternal(Module* mod) {
             recombinedForks++;
         }
     }
-    printf("Found and pipelined %u recombining forks!\n", recombinedForks);
+    tprintf("Found and pipelined %u recombining forks!\n", recombinedForks);
 }
 
 } // namespace llpm
@@ -18,6 +18,10 @@ public:
         ModulePass(d),
         _pipeline(pipeline)
     { }
+
+    virtual bool moduleLocal() const {
+        return true;
+    }
 };
 
 } // namespace llpm
@@ -106,7 +106,7 @@ void SynthesizeMemoryPass::runInternal(Module* mod) {
     if (conns == NULL)
         return;
 
-    set<Block*> blocks;
+    vector<Block*> blocks;
     conns->findAllBlocks(blocks);
     for (auto&& block: blocks) {
         Register* reg = dynamic_cast<Register*>(block);
@@ -0,0 +1,56 @@
+#include "implementations.hpp"
+
+#include <llpm/exceptions.hpp>
+
+using namespace std;
+
+namespace llpm {
+
+shared_ptr<Implementation>
+Implementation::configure(const string& arg) const {
+    throw InvalidArgument("Implementation '" + name() +
+                          "' takes no argument, but got '" + arg + "'");
+}
+
+void ImplRegistry::candidates(Block* b,
+                              vector<Implementation*>& impls) const {
+    for (auto impl: _impls) {
+        if (impl->handles(b))
+            impls.push_back(impl.get());
+    }
+}
+
+Implementation* ImplRegistry::find(string name) const {
+    for (auto impl: _impls) {
+        if (impl->name() == name)
+            return impl.get();
+    }
+    return nullptr;
+}
+
+bool ImplRefiner::handles(Block* b) const {
+    return _impl->handles(b);
+}
+
+bool ImplRefiner::refine(const Block* block,
+                         ConnectionDB& conns) const {
+    Block* b = const_cast<Block*>(block);
+    auto f = _built.find(block);
+    Block* nb = f != _built.end() ? f->second.get() :
+                                    _impl->build(b, _backend, _period);
+    if (nb == b)
+        return false;
+
+    if (nb->inputs().size() != b->inputs().size() ||
+        nb->outputs().size() != b->outputs().size())
+        throw InternalError("Implementation '" + _impl->name() +
+                            "' does not match its block's ports");
+
+    for (unsigned i=0; i<b->inputs().size(); i++)
+        conns.remap(b->inputs()[i], nb->inputs()[i]);
+    for (unsigned i=0; i<b->outputs().size(); i++)
+        conns.remap(b->outputs()[i], nb->outputs()[i]);
+    return true;
+}
+
+} // namespace llpm
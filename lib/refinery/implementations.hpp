@@ -0,0 +1,96 @@
+#ifndef __LLPM_REFINERY_IMPLEMENTATIONS_HPP__
+#define __LLPM_REFINERY_IMPLEMENTATIONS_HPP__
+
+#include <refinery/refinery.hpp>
+#include <util/time.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llpm {
+
+// fwd defs
+class Backend;
+
+/**
+ * One way of building an operator. Several implementations of the
+ * same operator trade area against latency and clock speed; the
+ * ImplRegistry lists them so a pass can pick one per block.
+ */
+class Implementation {
+public:
+    virtual ~Implementation() { }
+
+    virtual std::string name() const = 0;
+    virtual bool handles(Block*) const = 0;
+
+    /**
+     * Build an unconnected block which computes what 'b' does, sized
+     * for a clock 'period' long. Returns 'b' itself if it already is
+     * this implementation.
+     */
+    virtual Block* build(Block* b, Backend*, Time period) const = 0;
+
+    /// Estimated area of a block from build(), in logical effort times
+    /// bits (the same unit ShareOperatorsPass uses)
+    virtual float area(Block* impl) const = 0;
+
+    /**
+     * This implementation with an argument applied, as in the
+     * "name:arg" a user may ask for. Throws InvalidArgument unless the
+     * implementation takes one.
+     */
+    virtual std::shared_ptr<Implementation>
+        configure(const std::string& arg) const;
+};
+
+/**
+ * Lists the implementations available for each operator
+ */
+class ImplRegistry {
+    std::vector<std::shared_ptr<Implementation>> _impls;
+
+public:
+    void add(std::shared_ptr<Implementation> impl) {
+        _impls.push_back(impl);
+    }
+
+    /// Implementations which can stand in for 'b', in registry order
+    void candidates(Block* b, std::vector<Implementation*>& impls) const;
+
+    Implementation* find(std::string name) const;
+};
+
+/**
+ * Swaps each block it handles for a given implementation. The new
+ * block's ports line up with the old one's by index.
+ */
+class ImplRefiner: public BlockRefiner {
+    const Implementation* _impl;
+    Backend* _backend;
+    Time _period;
+    std::map<const Block*, BlockP> _built;
+
+public:
+    ImplRefiner(const Implementation* impl, Backend* backend, Time period) :
+        _impl(impl),
+        _backend(backend),
+        _period(period)
+    { }
+
+    /// Swap 'b' for 'impl', already built from it, instead of building
+    /// it again
+    void built(const Block* b, BlockP impl) {
+        _built[b] = impl;
+    }
+
+    virtual bool handles(Block*) const;
+    virtual bool refine(const Block* block,
+                        ConnectionDB& conns) const;
+};
+
+} // namespace llpm
+
+#endif // __LLPM_REFINERY_IMPLEMENTATIONS_HPP__
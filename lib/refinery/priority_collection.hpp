@@ -6,6 +6,7 @@
 #include <typeindex>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
 #include <boost/foreach.hpp>
 #include <util/macros.hpp>
 
@@ -51,7 +52,9 @@ public:
 
 private:
     std::vector<std::shared_ptr<V>> _entries;
+    // Filled lazily. Lookups may come from several threads at once.
     std::unordered_map<std::type_index, std::vector<V*> > _cache;
+    std::mutex _cacheLock;
     std::vector< std::shared_ptr<Library<V>> > _libraries;
 
 public:
@@ -100,6 +103,7 @@ public:
 
     const std::vector<V*>& lookup(K* k) {
         std::type_index ti = typeid(*k);
+        std::lock_guard<std::mutex> l(_cacheLock);
         auto f = _cache.find(ti);
         if (f == _cache.end()) {
             // std::cout << "Non cache for: " << typeid(*k).name() << std::endl;
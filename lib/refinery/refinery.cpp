@@ -2,6 +2,9 @@
 
 #include <llpm/module.hpp>
 
+#include <algorithm>
+#include <unordered_map>
+
 using namespace std;
 
 namespace llpm {
@@ -24,23 +27,45 @@ unsigned Refinery::refine(std::vector<Block*> crude,
                           ConnectionDB& conns,
                           int depth,
                           StopCondition* sc) {
+    // Primitive types are the bulk of most designs. Ask about each type
+    // once when the stop condition allows it.
+    unordered_map<type_index, bool> stopCache;
+    auto stop = [&](Block* c) {
+        if (sc == NULL)
+            return false;
+        if (!sc->typeOnly())
+            return sc->stopRefine(c);
+        type_index idx = typeid(*c);
+        auto f = stopCache.find(idx);
+        if (f != stopCache.end())
+            return f->second;
+        return stopCache[idx] = sc->stopRefine(c);
+    };
+
     long passes = 0;
     bool foundRefinement;
     do {
-        set<Block*> refinedBlocks;
+        set<BlockP> refinedBlocks;
+        // Next pass' work: blocks created by this pass plus the ones
+        // nobody could refine (which might be refinable later). Holding
+        // references keeps them valid if some other refinement drops
+        // them from conns.
+        vector<BlockP> next;
         for(Block*& c: crude) {
             BlockP cShared = c->getptr();
-            if (sc && sc->stopRefine(c))
+            if (stop(c))
                 continue;
 
             // List of possible refiners
             const vector<Refiner*>& possible_refiners = _refiners(c);
+            bool refined = false;
             for(auto& r: possible_refiners) {
                 conns.clearNewBlocks();
                 auto changeCounter = conns.changeCounter();
                 if(r->refine(c, conns)) {
                     // This refiner did the job!
-                    refinedBlocks.insert(c);
+                    refined = true;
+                    refinedBlocks.insert(cShared);
                     if (conns.isUsed(c)) {
                         for (InputPort* ip: c->inputs()) {
                             OutputPort* op = conns.findSource(ip);
@@ -67,7 +92,8 @@ unsigned Refinery::refine(std::vector<Block*> crude,
                         assert(nb.get() != c);
                         assert(conns.isUsed(nb.get()));
                         if (nb->history().src() == BlockHistory::Unset)
-                            nb->history().setRefinement(cShared);
+                            nb->history().setRefinement(c);
+                        next.push_back(nb);
                     }
                     break;
                 } else {
@@ -79,6 +105,8 @@ unsigned Refinery::refine(std::vector<Block*> crude,
                     assert(newBlocks.size() == 0); // Should be redundant
                 }
             }
+            if (!refined)
+                next.push_back(cShared);
         }
 
         if (refinedBlocks.size() > 0) {
@@ -88,13 +116,26 @@ unsigned Refinery::refine(std::vector<Block*> crude,
             foundRefinement = false;
         }
 
-        set<Block*> newCrude;
-        conns.findAllBlocks(newCrude);
-        crude = vector<Block*>(newCrude.begin(), newCrude.end());
-        for (Block* b: newCrude) {
-            if (refinedBlocks.count(b) > 0)
+        for (const BlockP& b: refinedBlocks) {
+            if (conns.blocks().count(b.get()) > 0)
                 throw ImplementationError("Refined block still present in connection DB!");
         }
+
+        // Visit them in the same order a full walk of conns would.
+        // Anything which has since been refined away or removed drops
+        // out here.
+        std::sort(next.begin(), next.end(),
+                  [&conns](const BlockP& a, const BlockP& b) {
+                      return conns.liveOrder(a.get()) <
+                             conns.liveOrder(b.get());
+                  });
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+        crude.clear();
+        for (auto& b: next) {
+            if (conns.blocks().count(b.get()) == 0)
+                continue;
+            crude.push_back(b.get());
+        }
     } while (foundRefinement && (depth == -1 || passes < depth));
 
     return passes;
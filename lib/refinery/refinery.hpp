@@ -42,6 +42,11 @@ public:
     class StopCondition {
     public:
         virtual bool stopRefine(Block*) = 0;
+        // Does stopRefine() depend only on the block's concrete type?
+        // If so, refine() asks once per type.
+        virtual bool typeOnly() const {
+            return false;
+        }
         virtual void unrefined(std::vector<Block*>& crude) {
             std::vector<Block*> unref;
             for(Block* c: crude) {
@@ -78,6 +83,12 @@ public:
         refiners().prependLibrary(lib);
     }
 
+    /**
+     * Refine blocks until a fixed point (or 'depth' passes). The first
+     * pass looks at 'crude'. After that, only blocks created by the
+     * previous pass and those which no refiner could handle are
+     * revisited, in conns' block order.
+     */
     unsigned refine(std::vector<Block*> crude,
                     ConnectionDB& conns,
                     int depth = -1,
@@ -99,6 +110,10 @@ public:
     BaseLibraryStopCondition() { }
     virtual ~BaseLibraryStopCondition() { }
 
+    virtual bool typeOnly() const {
+        return true;
+    }
+
     virtual bool stopRefine(Block* c) {
         std::type_index idx = typeid(*c);
         auto f = _classes.find(idx);
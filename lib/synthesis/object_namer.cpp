@@ -6,6 +6,7 @@
 
 #include <boost/format.hpp>
 #include <cctype>
+#include <algorithm>
 
 using namespace std;
 
@@ -27,9 +28,18 @@ static std::string addContext(std::string base, Block* b, Module* ctxt) {
     return name;
 }
 
+ObjectNamer::Shard& ObjectNamer::shard(Module* ctxt) {
+    std::lock_guard<std::mutex> l(_shardsLock);
+    // std::map never moves its nodes, so the reference stays good
+    return _shards[ctxt];
+}
+
 void ObjectNamer::assignName(const Port* p, Module* ctxt, std::string name) {
-    _portNames[make_pair(ctxt, p)] = name;
-    _existingNames.insert(make_pair(ctxt, name));
+    Shard& s = shard(ctxt);
+    std::lock_guard<std::mutex> l(s.lock);
+    s.portNames[p] = name;
+    s.fullPortNames.erase(p);
+    s.existingNames.insert(name);
 }
 
 static std::string sanitize(std::string s) {
@@ -44,92 +54,120 @@ static std::string sanitize(std::string s) {
 std::string ObjectNamer::historicalName(Block* b) {
     if (b->name() != "")
         return b->name();
-    if (b->history().src() == BlockHistory::Refinement &&
-        b->history().hasSrcBlock()) {
-        return historicalName(b->history().srcBlock()) + "r";
-    } else if (b->history().src() == BlockHistory::Optimization &&
-               b->history().hasSrcBlock()) {
-        return historicalName(b->history().srcBlock()) + "o";
+    const BlockHistory& h = b->history();
+    const char* suffix = NULL;
+    if (h.src() == BlockHistory::Refinement && h.hasSrcBlock())
+        suffix = "r";
+    else if (h.src() == BlockHistory::Optimization && h.hasSrcBlock())
+        suffix = "o";
+
+    if (suffix != NULL) {
+        const BlockHistory::Origin* o = h.origin();
+        std::string base = o->base;
+        if (base == "")
+            base = str(boost::format("anonBlock%1%") % ++_anonBlockCounter);
+        return base + o->suffix + suffix;
     }
 
-    return str(boost::format("anonBlock%1%") % ++anonBlockCounter);
+    return str(boost::format("anonBlock%1%") % ++_anonBlockCounter);
 }
 
-std::string ObjectNamer::primBlockName(Block* b, Module* ctxt) {
-    std::string& base = _blockNames[make_pair(ctxt, b)];
-    if (base == "") {
-        base = b->name();
-        if (base == "") {
-            base = historicalName(b);
-        }
-        base = sanitize(base);
+const std::string& ObjectNamer::primBlockName(Shard& s, Block* b,
+                                              Module* ctxt) {
+    auto f = s.blockNames.find(b);
+    if (f != s.blockNames.end())
+        return *f->second;
 
-        size_t ctr = 0;
-        string orig_base = base;
-        while (_existingNames.count(std::make_pair(ctxt, base)) > 0 ||
-               _existingNames.count(std::make_pair(nullptr, base)) > 0) {
-            base = str(boost::format("%1%_%2%") % orig_base % ++ctr);
-        }
-        _existingNames.insert(make_pair(ctxt, base));
+    std::string base = b->name();
+    if (base == "") {
+        base = historicalName(b);
+    }
+    base = sanitize(base);
+
+    // Global names live in the NULL context's shard
+    Shard* global = ctxt == nullptr ? nullptr : &shard(nullptr);
+    std::unique_lock<std::mutex> gl;
+    if (global != nullptr)
+        gl = std::unique_lock<std::mutex>(global->lock);
+
+    size_t ctr = 0;
+    string orig_base = base;
+    while (s.existingNames.count(base) > 0 ||
+           (global != nullptr && global->existingNames.count(base) > 0)) {
+        base = str(boost::format("%1%_%2%") % orig_base % ++ctr);
     }
-    return base;
+    const std::string* interned = &*s.existingNames.insert(base).first;
+    s.blockNames[b] = interned;
+    return *interned;
+}
+
+std::string ObjectNamer::primBlockName(Block* b, Module* ctxt) {
+    Shard& s = shard(ctxt);
+    std::lock_guard<std::mutex> l(s.lock);
+    return primBlockName(s, b, ctxt);
 }
 
 std::string ObjectNamer::getName(Block* b, Module* ctxt, bool) {
-    std::string base = primBlockName(b, ctxt);
-    return addContext(base, b, ctxt);
+    Shard& s = shard(ctxt);
+    std::lock_guard<std::mutex> l(s.lock);
+    auto f = s.fullBlockNames.find(b);
+    if (f != s.fullBlockNames.end() && f->second.module == b->module())
+        return f->second.name;
+    std::string name = addContext(primBlockName(s, b, ctxt), b, ctxt);
+    if (_cacheFullNames)
+        s.fullBlockNames[b] = FullName{b->module(), name};
+    return name;
 }
 
-std::string ObjectNamer::getName(const InputPort* p, Module* ctxt, bool io) {
-    if (io)
-        return p->name();
+static const Block::InputList& siblings(const InputPort* p) {
+    return p->owner()->inputs();
+}
 
-    std::string& base = _portNames[make_pair(ctxt, p)];
+static const Block::OutputList& siblings(const OutputPort* p) {
+    return p->owner()->outputs();
+}
+
+template<typename P>
+std::string ObjectNamer::portName(const P* p, Module* ctxt, const char* dir) {
+    Shard& s = shard(ctxt);
+    std::lock_guard<std::mutex> l(s.lock);
+    auto f = s.fullPortNames.find(p);
+    if (f != s.fullPortNames.end() &&
+        f->second.module == p->owner()->module())
+        return f->second.name;
+
+    std::string& base = s.portNames[p];
     if (base == "") {
         base = p->name();
         if (base == "") {
-            unsigned count = 0;
-            for (auto&& ip: p->owner()->inputs()) {
-                if (ip == p)
-                    break;
-                count++;
-            }
-            assert(count < p->owner()->inputs().size());
+            const auto& ports = siblings(p);
+            unsigned count = std::find(ports.begin(), ports.end(), p)
+                                - ports.begin();
+            assert(count < ports.size());
             base = str(boost::format("%1%") % count);
         }
 
-        if (!io)
-            base = str(boost::format("%1%_input%2%") 
-                        % primBlockName(p->owner(), ctxt)
-                        % base);
+        base = str(boost::format("%1%_%2%%3%")
+                    % primBlockName(s, p->owner(), ctxt)
+                    % dir
+                    % base);
     }
-    return addContext(base, p->owner(), ctxt);
+    std::string name = addContext(base, p->owner(), ctxt);
+    if (_cacheFullNames)
+        s.fullPortNames[p] = FullName{p->owner()->module(), name};
+    return name;
 }
 
-std::string ObjectNamer::getName(const OutputPort* p, Module* ctxt, bool io) {
+std::string ObjectNamer::getName(const InputPort* p, Module* ctxt, bool io) {
     if (io)
         return p->name();
+    return portName(p, ctxt, "input");
+}
 
-    std::string& base = _portNames[make_pair(ctxt, p)];
-    if (base == "") {
-        base = p->name();
-        if (base == "") {
-            unsigned count = 0;
-            for (auto&& op: p->owner()->outputs()) {
-                if (op == p)
-                    break;
-                count++;
-            }
-            assert(count < p->owner()->outputs().size());
-            base = str(boost::format("%1%") % count);
-        }
-
-        if (!io)
-            base = str(boost::format("%1%_output%2%")
-                       % primBlockName(p->owner(), ctxt)
-                       % base);
-    }
-    return addContext(base, p->owner(), ctxt);
+std::string ObjectNamer::getName(const OutputPort* p, Module* ctxt, bool io) {
+    if (io)
+        return p->name();
+    return portName(p, ctxt, "output");
 }
 
 }
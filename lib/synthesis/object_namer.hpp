@@ -3,7 +3,10 @@
 
 #include <string>
 #include <map>
-#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
 
 #include <boost/noncopyable.hpp>
 
@@ -16,17 +19,55 @@ class Port;
 class InputPort;
 class OutputPort;
 
+/**
+ * Assigns unique names to blocks and ports within a module context.
+ * Names are kept in a separate shard per context, each with its own
+ * lock, so passes running on different modules in parallel don't
+ * contend. Anonymous blocks are numbered from one counter in the order
+ * they're first named, so parallel callers must name blocks up front
+ * (as the Verilog backend does) to get the same names every run.
+ *
+ * Each name is sanitized once. A block name is interned in its shard's
+ * set of taken names rather than stored a second time. Once
+ * cacheFullNames() is called, names qualified with their context are
+ * kept too, for as long as the block stays in the same module.
+ */
 class ObjectNamer : boost::noncopyable {
-    uint64_t anonBlockCounter;
-    std::set< std::pair<Module*, std::string> > _existingNames;
-    std::map< std::pair<Module*, Block*>, std::string> _blockNames;
-    std::map< std::pair<Module*, const Port*>, std::string> _portNames;
+    struct FullName {
+        Module* module;
+        std::string name;
+    };
 
+    struct Shard {
+        std::mutex lock;
+        std::unordered_set<std::string> existingNames;
+        // Point into existingNames
+        std::unordered_map<Block*, const std::string*> blockNames;
+        std::unordered_map<const Port*, std::string> portNames;
+        // Names with context prepended, as handed out by getName, along
+        // with the module the block was in at the time
+        std::unordered_map<Block*, FullName> fullBlockNames;
+        std::unordered_map<const Port*, FullName> fullPortNames;
+    };
+
+    std::mutex _shardsLock;
+    std::map<Module*, Shard> _shards;
+    // One count for all contexts, so anonBlockN names are the same as
+    // when there was a single table
+    std::atomic<uint64_t> _anonBlockCounter;
+    // Blocks still move between modules until optimization is done
+    std::atomic<bool> _cacheFullNames;
+
+    Shard& shard(Module* ctxt);
     std::string historicalName(Block* b);
+    const std::string& primBlockName(Shard& s, Block* b, Module* ctxt);
+    template<typename P>
+    std::string portName(const P* p, Module* ctxt, const char* dir);
 
 public:
     ObjectNamer() :
-        anonBlockCounter(0)
+        _anonBlockCounter(0),
+        _cacheFullNames(false)
     { }
 
     virtual ~ObjectNamer() { }
@@ -38,8 +79,16 @@ public:
 
     virtual void assignName(const Port* p, Module* ctxt, std::string name);
 
+    /// Remember qualified names from now on. Call once the module
+    /// hierarchy won't change any more.
+    void cacheFullNames() {
+        _cacheFullNames = true;
+    }
+
     virtual void reserveName(std::string name, Module* ctxt) {
-        _existingNames.insert(make_pair(ctxt, name));
+        Shard& s = shard(ctxt);
+        std::lock_guard<std::mutex> l(s.lock);
+        s.existingNames.insert(name);
     }
 };
 
@@ -0,0 +1,74 @@
+#include "async_writer.hpp"
+
+#include <cstdio>
+
+namespace llpm {
+
+AsyncWriter::AsyncWriter(size_t maxQueuedBytes) :
+    _queuedBytes(0),
+    _maxQueuedBytes(maxQueuedBytes),
+    _busy(false),
+    _stop(false)
+{
+    _thread = std::thread([this]() { work(); });
+}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::lock_guard<std::mutex> l(_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+    _thread.join();
+}
+
+void AsyncWriter::write(FileSet::File* f, std::string text) {
+    std::unique_lock<std::mutex> l(_lock);
+    _drained.wait(l, [this]() {
+        return _queuedBytes < _maxQueuedBytes;
+    });
+    _queuedBytes += text.size();
+    _queue.push_back(Job{f, std::move(text)});
+    l.unlock();
+    _wake.notify_one();
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> l(_lock);
+    _drained.wait(l, [this]() {
+        return _queue.empty() && !_busy;
+    });
+}
+
+void AsyncWriter::work() {
+    std::unique_lock<std::mutex> l(_lock);
+    while (true) {
+        _wake.wait(l, [this]() {
+            return _stop || !_queue.empty();
+        });
+        // Finish everything queued before stopping
+        if (_queue.empty())
+            return;
+
+        Job job = std::move(_queue.front());
+        _queue.pop_front();
+        _busy = true;
+        l.unlock();
+
+        try {
+            std::ostream& os = job.file->openStream();
+            os.write(job.text.data(), job.text.size());
+            job.file->close();
+        } catch (std::exception& e) {
+            fprintf(stderr, "Warning: could not write '%s': %s\n",
+                    job.file->name().c_str(), e.what());
+        }
+
+        l.lock();
+        _busy = false;
+        _queuedBytes -= job.text.size();
+        _drained.notify_all();
+    }
+}
+
+} // namespace llpm
@@ -0,0 +1,54 @@
+#ifndef __LLPM_UTIL_ASYNC_WRITER_HPP__
+#define __LLPM_UTIL_ASYNC_WRITER_HPP__
+
+#include <util/files.hpp>
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace llpm {
+
+/**
+ * Writes files on a background thread, so that dumping debug output
+ * doesn't hold up the compiler. Callers render the contents into a
+ * string and hand over the file; it is opened, written and closed on
+ * the writer thread. If too much is queued, write() blocks until the
+ * writer catches up.
+ */
+class AsyncWriter {
+    struct Job {
+        FileSet::File* file;
+        std::string text;
+    };
+
+    std::thread _thread;
+    std::deque<Job> _queue;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _drained;
+    size_t _queuedBytes;
+    size_t _maxQueuedBytes;
+    bool _busy;
+    bool _stop;
+
+    void work();
+
+public:
+    AsyncWriter(size_t maxQueuedBytes = 256 * 1024 * 1024);
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void write(FileSet::File* f, std::string text);
+
+    /// Wait until everything queued so far is on disk
+    void flush();
+};
+
+} // namespace llpm
+
+#endif // __LLPM_UTIL_ASYNC_WRITER_HPP__
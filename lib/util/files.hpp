@@ -186,6 +186,12 @@ public:
             f->flush();
     }
 
+    /// Close every file, e.g. before exiting without running destructors
+    void close() {
+        for (auto f: _files)
+            f->close();
+    }
+
     std::string tmpdir() {
         assert(_valid);
         char name[_dfltDir.size() + 16];
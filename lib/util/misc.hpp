@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include <llvm/ADT/SmallVector.h>
+
 namespace llpm {
 
 std::string cpp_demangle(const char* name);
@@ -12,7 +14,12 @@ inline std::string cpp_demangle(const std::string& name) {
 }
 
 template<typename T>
-std::vector<const T*> constCopy(std::vector<T*> vec) {
+std::vector<const T*> constCopy(const std::vector<T*>& vec) {
+    return std::vector<const T*>(vec.begin(), vec.end());
+}
+
+template<typename T>
+std::vector<const T*> constCopy(const llvm::SmallVectorImpl<T*>& vec) {
     return std::vector<const T*>(vec.begin(), vec.end());
 }
 /**
@@ -0,0 +1,133 @@
+#include "pool_alloc.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <new>
+
+namespace llpm {
+
+static const size_t Granule = 16;
+static const size_t MaxSize = 1024;
+static const size_t NumClasses = MaxSize / Granule;
+static const size_t SlabSize = 64 * 1024;
+
+namespace {
+
+struct FreeNode {
+    FreeNode* next;
+};
+
+struct SizeClass {
+    std::mutex lock;
+    FreeNode* freeList = nullptr;
+    char* bump = nullptr;
+    char* bumpEnd = nullptr;
+    std::vector<char*> slabs;
+    uint64_t live = 0;
+};
+
+}
+
+static std::atomic<uint64_t> Allocs(0);
+static std::atomic<uint64_t> Frees(0);
+static std::atomic<uint64_t> Live(0);
+static std::atomic<uint64_t> PeakLive(0);
+static std::atomic<uint64_t> SlabBytes(0);
+static std::atomic<uint64_t> LargeAllocs(0);
+
+static SizeClass* classes() {
+    // Never destroyed. Objects may outlive static destruction.
+    static SizeClass* c = new SizeClass[NumClasses];
+    return c;
+}
+
+static void countAlloc() {
+    Allocs++;
+    uint64_t live = ++Live;
+    uint64_t peak = PeakLive;
+    while (live > peak && !PeakLive.compare_exchange_weak(peak, live))
+        ;
+}
+
+void* SlabPool::alloc(size_t sz) {
+    countAlloc();
+    if (sz == 0)
+        sz = 1;
+    if (sz > MaxSize) {
+        LargeAllocs++;
+        return ::operator new(sz);
+    }
+
+    size_t rounded = (sz + Granule - 1) & ~(Granule - 1);
+    SizeClass& sc = classes()[rounded / Granule - 1];
+    std::lock_guard<std::mutex> l(sc.lock);
+    sc.live++;
+    if (sc.freeList != nullptr) {
+        FreeNode* n = sc.freeList;
+        sc.freeList = n->next;
+        return n;
+    }
+
+    if (sc.bump == nullptr || sc.bump + rounded > sc.bumpEnd) {
+        char* slab = (char*)::operator new(SlabSize);
+        sc.slabs.push_back(slab);
+        sc.bump = slab;
+        sc.bumpEnd = slab + SlabSize;
+        SlabBytes += SlabSize;
+    }
+    void* p = sc.bump;
+    sc.bump += rounded;
+    return p;
+}
+
+void SlabPool::free(void* p, size_t sz) {
+    if (p == nullptr)
+        return;
+    Frees++;
+    Live--;
+    if (sz == 0)
+        sz = 1;
+    if (sz > MaxSize) {
+        ::operator delete(p);
+        return;
+    }
+
+    size_t rounded = (sz + Granule - 1) & ~(Granule - 1);
+    SizeClass& sc = classes()[rounded / Granule - 1];
+    std::lock_guard<std::mutex> l(sc.lock);
+    FreeNode* n = (FreeNode*)p;
+    n->next = sc.freeList;
+    sc.freeList = n;
+    sc.live--;
+}
+
+SlabPool::Stats SlabPool::stats() {
+    Stats s;
+    s.allocs = Allocs;
+    s.frees = Frees;
+    s.live = Live;
+    s.peakLive = PeakLive;
+    s.slabBytes = SlabBytes;
+    s.largeAllocs = LargeAllocs;
+    return s;
+}
+
+void SlabPool::trim() {
+    SizeClass* cs = classes();
+    for (size_t i=0; i<NumClasses; i++) {
+        SizeClass& sc = cs[i];
+        std::lock_guard<std::mutex> l(sc.lock);
+        if (sc.live > 0)
+            continue;
+        for (char* slab: sc.slabs) {
+            ::operator delete(slab);
+            SlabBytes -= SlabSize;
+        }
+        sc.slabs.clear();
+        sc.freeList = nullptr;
+        sc.bump = sc.bumpEnd = nullptr;
+    }
+}
+
+} // namespace llpm
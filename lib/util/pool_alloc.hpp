@@ -0,0 +1,60 @@
+#ifndef __LLPM_UTIL_POOL_ALLOC_HPP__
+#define __LLPM_UTIL_POOL_ALLOC_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace llpm {
+
+/**
+ * Slab allocator for the swarms of small objects a design is built
+ * from: blocks, heap-allocated ports and interfaces. Objects are binned
+ * by size class and carved out of large slabs, so objects created
+ * together (as refinement does) sit together in memory and freeing one
+ * is a push onto a free list. Big objects go straight to the heap.
+ *
+ * Classes opt in with POOL_ALLOCATED. Pooled classes must be deleted
+ * through a virtual destructor (or as their real type) so that the
+ * right size comes back to free().
+ */
+class SlabPool {
+public:
+    struct Stats {
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t live;
+        uint64_t peakLive;
+        uint64_t slabBytes;
+        // Too large for a size class
+        uint64_t largeAllocs;
+    };
+
+    static void* alloc(size_t sz);
+    static void free(void* p, size_t sz);
+
+    static Stats stats();
+
+    /**
+     * Return slabs belonging to size classes with no live objects.
+     * Call once a whole design has been torn down.
+     */
+    static void trim();
+};
+
+// Define LLPM_NO_POOL_ALLOC to use the plain heap, e.g. so that
+// valgrind can see use-after-free errors
+#ifdef LLPM_NO_POOL_ALLOC
+#define POOL_ALLOCATED
+#else
+#define POOL_ALLOCATED \
+    static void* operator new(size_t sz) { \
+        return ::llpm::SlabPool::alloc(sz); \
+    } \
+    static void operator delete(void* p, size_t sz) { \
+        ::llpm::SlabPool::free(p, sz); \
+    }
+#endif
+
+} // namespace llpm
+
+#endif // __LLPM_UTIL_POOL_ALLOC_HPP__
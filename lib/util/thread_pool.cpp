@@ -0,0 +1,141 @@
+#include "thread_pool.hpp"
+
+#include <cstdarg>
+#include <string>
+#include <exception>
+
+using namespace std;
+
+namespace llpm {
+
+typedef vector< pair<FILE*, string> > OutputBuffer;
+
+static thread_local bool TLWorker = false;
+static thread_local OutputBuffer* TLOutput = nullptr;
+
+ThreadPool::ThreadPool(unsigned threads) :
+    _stop(false)
+{
+    for (unsigned i=0; i<threads; i++)
+        _workers.emplace_back([this]() { this->work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> l(_lock);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& t: _workers)
+        t.join();
+}
+
+bool ThreadPool::inWorker() {
+    return TLWorker;
+}
+
+void ThreadPool::work() {
+    TLWorker = true;
+    while (true) {
+        function<void()> job;
+        {
+            unique_lock<mutex> l(_lock);
+            _wake.wait(l, [this]() { return _stop || !_queue.empty(); });
+            if (_queue.empty())
+                return;
+            job = std::move(_queue.front());
+            _queue.pop_front();
+        }
+        job();
+    }
+}
+
+void ThreadPool::run(const vector< function<void()> >& tasks) {
+    if (inWorker() || _workers.size() == 0) {
+        for (auto& t: tasks)
+            t();
+        return;
+    }
+
+    struct Result {
+        OutputBuffer output;
+        exception_ptr error;
+    };
+    vector<Result> results(tasks.size());
+    size_t remaining = tasks.size();
+    mutex doneLock;
+    condition_variable done;
+
+    {
+        unique_lock<mutex> l(_lock);
+        for (size_t i=0; i<tasks.size(); i++) {
+            _queue.push_back([&, i]() {
+                TLOutput = &results[i].output;
+                try {
+                    tasks[i]();
+                } catch (...) {
+                    results[i].error = current_exception();
+                }
+                TLOutput = nullptr;
+
+                unique_lock<mutex> dl(doneLock);
+                if (--remaining == 0)
+                    done.notify_one();
+            });
+        }
+    }
+    _wake.notify_all();
+
+    {
+        unique_lock<mutex> dl(doneLock);
+        done.wait(dl, [&]() { return remaining == 0; });
+    }
+
+    for (auto& r: results) {
+        for (auto& o: r.output)
+            fputs(o.second.c_str(), o.first);
+    }
+    for (auto& r: results) {
+        if (r.error)
+            rethrow_exception(r.error);
+    }
+}
+
+static int vtfprintf(FILE* f, const char* fmt, va_list args) {
+    if (TLOutput == nullptr)
+        return vfprintf(f, fmt, args);
+
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (len <= 0)
+        return len;
+
+    string s(len + 1, '\0');
+    vsnprintf(&s[0], len + 1, fmt, args);
+    s.resize(len);
+    if (!TLOutput->empty() && TLOutput->back().first == f)
+        TLOutput->back().second += s;
+    else
+        TLOutput->push_back(make_pair(f, s));
+    return len;
+}
+
+int tprintf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vtfprintf(stdout, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+int tfprintf(FILE* f, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vtfprintf(f, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+} // namespace llpm
@@ -0,0 +1,61 @@
+#ifndef __LLPM_UTIL_THREAD_POOL_HPP__
+#define __LLPM_UTIL_THREAD_POOL_HPP__
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace llpm {
+
+/**
+ * A fixed set of worker threads which run batches of tasks. Anything a
+ * task prints with tprintf/tfprintf is buffered and replayed in task
+ * order once the batch completes, so output doesn't depend on
+ * scheduling. Batches submitted from within a task run inline, on the
+ * calling worker.
+ */
+class ThreadPool {
+    std::vector<std::thread> _workers;
+    std::deque< std::function<void()> > _queue;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    bool _stop;
+
+    void work();
+
+public:
+    ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const {
+        return _workers.size();
+    }
+
+    /// Is the calling thread one of some pool's workers?
+    static bool inWorker();
+
+    /**
+     * Run all of the tasks and wait for them. If any throw, the
+     * exception from the earliest task is rethrown here after all of
+     * them have finished.
+     */
+    void run(const std::vector< std::function<void()> >& tasks);
+};
+
+/// printf which is buffered when called from a pool task
+int tprintf(const char* fmt, ...)
+    __attribute__ ((format (printf, 1, 2)));
+/// fprintf which is buffered when called from a pool task
+int tfprintf(FILE* f, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+} // namespace llpm
+
+#endif // __LLPM_UTIL_THREAD_POOL_HPP__
@@ -170,8 +170,11 @@ void VerilatorWedge::writeModule(FileSet& fileset, Module* mod) {
 
     if (mod->swModule() != nullptr) {
         auto bcFile = fileset.create(mod->name() + "_preverilator.bc");
-        llvm::raw_os_ostream llvmStream(bcFile->openStream());
-        llvm::WriteBitcodeToFile(mod->swModule(), llvmStream);
+        {
+            llvm::raw_os_ostream llvmStream(bcFile->openStream());
+            llvm::WriteBitcodeToFile(mod->swModule(), llvmStream);
+        }
+        bcFile->close();
     }
 
     // Load all the output objs and merge them into swModule
@@ -212,8 +215,11 @@ void VerilatorWedge::writeModule(FileSet& fileset, Module* mod) {
     llvm::Module* swModule = mod->swModule();
     if (swModule != NULL) {
         auto bcFile = fileset.create(mod->name() + "_sw.bc");
-        llvm::raw_os_ostream llvmStream(bcFile->openStream());
-        llvm::WriteBitcodeToFile(swModule, llvmStream);
+        {
+            llvm::raw_os_ostream llvmStream(bcFile->openStream());
+            llvm::WriteBitcodeToFile(swModule, llvmStream);
+        }
+        bcFile->close();
     }
 
     // Delete unnecessary files
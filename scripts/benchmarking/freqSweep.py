@@ -12,8 +12,8 @@ def run(cmd):
 
 args = " ".join(sys.argv[1:])
 
+# Elaborates once, then tries every clock target in parallel. Results
+# land in freq/dse.csv and the Verilog for each target in freq/dse_*/
 clkRange = range(0, 250, 10)
-for clk in clkRange:
-    run("%s/cpphdl %s --clk %s --workdir freq%s" %
-            (bindir, args, clk, clk))
-
+run("%s/llvm2verilog %s --dse %s --dse_emit all --workdir freq" %
+        (bindir, args, ",".join([str(c) for c in clkRange])))
@@ -0,0 +1,229 @@
+/* LLPM Project library file
+ *
+ * This file contains multi-cycle implementations of integer multiply,
+ * divide and remainder. Operands are registered as they are accepted
+ * and results come straight out of registers, so timing paths do not
+ * run through the operators.
+ *
+ * Op selects the operation: 0 multiply, 1 divide, 2 remainder. The
+ * input x holds operand a in its low AWidth bits and operand b above
+ * it.
+ */
+`default_nettype none
+
+// Accepts an input every cycle and presents its result Stages + 1
+// cycles later. The operands go into a register, then through the
+// operator written combinationally and Stages more registers;
+// synthesis tools are expected to retime those into the operator.
+module LLPM_PipelinedArith(clk, resetn,
+    x, x_valid, x_bp,
+    a, a_valid, a_bp);
+
+parameter Name = "";
+parameter Op = 0;
+parameter Signed = 0;
+parameter AWidth = 8;
+parameter BWidth = 8;
+parameter Width = 8;
+parameter Stages = 2;
+
+input wire clk;
+input wire resetn;
+
+input wire [AWidth+BWidth-1:0] x;
+input wire                     x_valid;
+output wire                    x_bp;
+
+output wire [Width-1:0] a;
+output wire             a_valid;
+input  wire             a_bp;
+
+reg [AWidth+BWidth-1:0] xr;
+reg                     xr_valid;
+
+wire [AWidth-1:0] opA = xr[AWidth-1:0];
+wire [BWidth-1:0] opB = xr[AWidth+BWidth-1:AWidth];
+wire signed [AWidth-1:0] sOpA = opA;
+wire signed [BWidth-1:0] sOpB = opB;
+
+wire [Width-1:0] result;
+generate
+    if (Op == 0) begin: g_mul
+        assign result = opA * opB;
+    end else if (Op == 1 && Signed) begin: g_sdiv
+        assign result = sOpA / sOpB;
+    end else if (Op == 1) begin: g_udiv
+        assign result = opA / opB;
+    end else if (Signed) begin: g_srem
+        assign result = sOpA % sOpB;
+    end else begin: g_urem
+        assign result = opA % opB;
+    end
+endgenerate
+
+reg [Width-1:0] data  [Stages-1:0];
+reg             valid [Stages-1:0];
+
+// The whole pipeline stalls when its result isn't taken
+wire advance = !valid[Stages-1] || !a_bp;
+assign x_bp = !advance;
+
+assign a = data[Stages-1];
+assign a_valid = valid[Stages-1];
+
+integer i;
+always@(posedge clk)
+begin
+    if (~resetn)
+    begin
+        xr_valid <= 1'b0;
+        for (i=0; i<Stages; i=i+1)
+            valid[i] <= 1'b0;
+    end else if (advance) begin
+        xr       <= x;
+        xr_valid <= x_valid;
+        valid[0] <= xr_valid;
+        data[0]  <= result;
+        for (i=1; i<Stages; i=i+1)
+        begin
+            valid[i] <= valid[i-1];
+            data[i]  <= data[i-1];
+        end
+    end
+    `ifdef verilator
+    $c("debug_reg(", Name, ", ", valid[Stages-1], ", ", data[Stages-1], ");");
+    `endif
+end
+
+endmodule
+
+// Computes one bit per cycle: shift-and-add for multiplies, restoring
+// division for divides and remainders. Signed divides work on
+// magnitudes and fix the signs up at the end, rounding toward zero.
+// Dividing by zero gives zero, as the combinational operators do in
+// Verilator. The operands are registered as they are accepted and
+// made positive in the next cycle; the result gets its sign in a
+// cycle of its own. That is AWidth (or BWidth) + 3 cycles in all. The
+// next input is accepted as the previous result is taken.
+module LLPM_IterativeArith(clk, resetn,
+    x, x_valid, x_bp,
+    a, a_valid, a_bp);
+
+parameter Name = "";
+parameter Op = 0;
+parameter Signed = 0;
+parameter AWidth = 8;
+parameter BWidth = 8;
+parameter Width = 8;
+
+localparam Steps = (Op == 0) ? BWidth : AWidth;
+
+input wire clk;
+input wire resetn;
+
+input wire [AWidth+BWidth-1:0] x;
+input wire                     x_valid;
+output wire                    x_bp;
+
+output reg  [Width-1:0] a;
+output wire             a_valid;
+input  wire             a_bp;
+
+reg [AWidth+BWidth-1:0] xr;
+wire [AWidth-1:0] opA = xr[AWidth-1:0];
+wire [BWidth-1:0] opB = xr[AWidth+BWidth-1:AWidth];
+wire negA = Signed && opA[AWidth-1];
+wire negB = Signed && opB[BWidth-1];
+
+reg busy;
+reg loaded;
+reg fixup;
+reg done;
+reg [31:0] count;
+
+// Multiply state
+reg [Width-1:0]  acc;
+reg [Width-1:0]  mcand;
+reg [BWidth-1:0] mplier;
+
+// Divide state
+reg [AWidth-1:0] quo;
+reg [BWidth:0]   rem;
+reg [BWidth-1:0] divisor;
+reg              negQ;
+reg              negR;
+reg              divZero;
+
+wire [BWidth:0] shifted = {rem[BWidth-1:0], quo[AWidth-1]};
+wire [BWidth:0] diff = shifted - {1'b0, divisor};
+wire fits = !diff[BWidth];
+
+assign x_bp = busy || (done && a_bp);
+assign a_valid = done;
+wire take = x_valid && !x_bp;
+
+always@(posedge clk)
+begin
+    if (~resetn)
+    begin
+        busy   <= 1'b0;
+        loaded <= 1'b0;
+        fixup  <= 1'b0;
+        done   <= 1'b0;
+    end else begin
+        if (done && !a_bp)
+            done <= 1'b0;
+
+        if (take)
+        begin
+            xr     <= x;
+            busy   <= 1'b1;
+            loaded <= 1'b1;
+        end else if (loaded) begin
+            loaded  <= 1'b0;
+            count   <= 0;
+            acc     <= {Width{1'b0}};
+            mcand   <= opA;
+            mplier  <= opB;
+            quo     <= negA ? -opA : opA;
+            rem     <= {(BWidth+1){1'b0}};
+            divisor <= negB ? -opB : opB;
+            negQ    <= negA ^ negB;
+            negR    <= negA;
+            divZero <= opB == {BWidth{1'b0}};
+        end else if (fixup) begin
+            fixup <= 1'b0;
+            busy  <= 1'b0;
+            done  <= 1'b1;
+            if (Op == 0)
+                a <= acc;
+            else if (divZero)
+                a <= {Width{1'b0}};
+            else if (Op == 1)
+                a <= negQ ? -quo : quo;
+            else
+                a <= negR ? -rem[BWidth-1:0] : rem[BWidth-1:0];
+        end else if (busy) begin
+            if (Op == 0)
+            begin
+                if (mplier[0])
+                    acc <= acc + mcand;
+                mcand  <= mcand << 1;
+                mplier <= mplier >> 1;
+            end else begin
+                rem <= fits ? diff : shifted;
+                quo <= (quo << 1) | fits;
+            end
+            count <= count + 1;
+            if (count == Steps - 1)
+                fixup <= 1'b1;
+        end
+    end
+    `ifdef verilator
+    $c("debug_reg(", Name, ", ", done, ", ", a, ");");
+    `endif
+end
+
+endmodule
+
+`default_nettype wire
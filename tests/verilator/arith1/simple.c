@@ -0,0 +1,13 @@
+int simple(int a, int b) {
+    unsigned ua = a;
+    unsigned ub = b;
+    int sdiv = a / b;
+    int srem = a % b;
+    unsigned udiv = ua / ub;
+    unsigned urem = ua % ub;
+    unsigned mul = ua * ub;
+    long long smul = (long long)a * b;
+    unsigned long long umul = (unsigned long long)ua * ub;
+    int prod = mul ^ (int)(smul >> 32) ^ (int)(umul >> 32);
+    return sdiv ^ (srem << 8) ^ (udiv << 16) ^ (urem << 24) ^ prod;
+}
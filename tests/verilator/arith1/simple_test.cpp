@@ -0,0 +1,58 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+#include <limits.h>
+
+// What the hardware does where C leaves it undefined: dividing by zero
+// gives zero, and INT_MIN / -1 wraps around
+static int sdiv(int a, int b) {
+    if (b == 0)
+        return 0;
+    if (a == INT_MIN && b == -1)
+        return INT_MIN;
+    return a / b;
+}
+
+static int srem(int a, int b) {
+    if (b == 0 || (a == INT_MIN && b == -1))
+        return 0;
+    return a % b;
+}
+
+static unsigned udiv(unsigned a, unsigned b) {
+    return b == 0 ? 0 : a / b;
+}
+
+static unsigned urem(unsigned a, unsigned b) {
+    return b == 0 ? 0 : a % b;
+}
+
+// The high halves of the widening products differ between signed and
+// unsigned multiplies when an operand is negative
+static int prod(int a, int b) {
+    unsigned mul = (unsigned)a * (unsigned)b;
+    long long smul = (long long)a * b;
+    unsigned long long umul = (unsigned long long)(unsigned)a * (unsigned)b;
+    return mul ^ (int)(smul >> 32) ^ (int)(umul >> 32);
+}
+
+int simple_sw(int a, int b) {
+    return sdiv(a, b) ^ (srem(a, b) << 8) ^
+           (udiv(a, b) << 16) ^ (urem(a, b) << 24) ^ prod(a, b);
+}
+
+int main(void) {
+    static const int cases[][2] = {
+        {100, 7}, {-100, 7}, {100, -7}, {-100, -7},
+        {7, 0}, {-7, 0}, {0, 0},
+        {INT_MIN, -1}, {INT_MIN, 1}, {INT_MIN, INT_MIN},
+        {INT_MAX, -1}, {INT_MAX, INT_MIN}, {-1, 3}, {3, -1},
+        {123456, -98765}, {-65536, 65537}, {-40000, -50000},
+        {INT_MAX, INT_MAX}, {46341, 46341},
+    };
+
+    Harness<simple> h;
+    for (auto c: cases)
+        h.check(simple_sw, c[0], c[1]);
+    return h.rc();
+}
@@ -0,0 +1,10 @@
+long simple(long a, long b) {
+    long i;
+    for (i=0; i<b; i++) {
+        if (i & 1)
+            a += i;
+        else
+            a ^= i;
+    }
+    return a;
+}
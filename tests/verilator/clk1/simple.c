@@ -0,0 +1,5 @@
+int simple(int a, int b, int c) {
+    int x = a * b + c;
+    int y = (x ^ (a - c)) * (b + 3);
+    return (y + x * c) ^ (y >> 3);
+}
@@ -0,0 +1,15 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+int simple_sw(int a, int b, int c) {
+    int x = a * b + c;
+    int y = (x ^ (a - c)) * (b + 3);
+    return (y + x * c) ^ (y >> 3);
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (int a=-300; a<=300; a+=77)
+        h.check(simple_sw, a, a + 5, 1000 - a);
+    return h.rc();
+}
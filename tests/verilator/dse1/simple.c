@@ -0,0 +1,7 @@
+long simple(long a, long b) {
+    long i;
+    for (i=0; i<b; i++) {
+        a = a * 3 + (i ^ b);
+    }
+    return a;
+}
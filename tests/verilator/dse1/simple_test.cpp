@@ -0,0 +1,16 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+long simple_sw(long a, long b) {
+    long i;
+    for (i=0; i<b; i++)
+        a = a * 3 + (i ^ b);
+    return a;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (long b=0; b<20; b+=3)
+        h.check(simple_sw, 4L, b);
+    return h.rc();
+}
@@ -0,0 +1,20 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+long simple_sw(long a, long b) {
+    long i;
+    for (i=0; i<b; i++) {
+        if (i & 1)
+            a += i;
+        else
+            a ^= i;
+    }
+    return a;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (long a=-100; a<=100; a+=37)
+        h.check(simple_sw, a, 13L);
+    return h.rc();
+}
@@ -0,0 +1,60 @@
+#ifndef __LLPM_TESTS_VERILATOR_HARNESS_HPP__
+#define __LLPM_TESTS_VERILATOR_HARNESS_HPP__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <iostream>
+
+/**
+ * Runs a simulated design against its software model. Results go to
+ * stdout and cycle counts to stderr, so that the results of designs
+ * with different timing can be diffed.
+ */
+template<typename Sim>
+class Harness {
+    Sim* _sim;
+    int _rc;
+
+public:
+    Harness() :
+        _sim(new Sim()),
+        _rc(0)
+    {
+        _sim->trace("debug.vcd");
+        _sim->reset();
+    }
+
+    ~Harness() {
+        _sim->run(5);
+        delete _sim;
+    }
+
+    /// Calls the design and 'sw' with 'args' and compares the results
+    template<typename R, typename... P, typename... A>
+    void check(R (*sw)(P...), A... args) {
+        uint64_t start = _sim->cycles();
+        R hw = _sim->call(args...);
+        fprintf(stderr, "Cycle count: %lu\n",
+                (unsigned long)(_sim->cycles() - start));
+
+        std::cout << "simple(";
+        const char* sep = "";
+        int order[] = {0, ((std::cout << sep << args), sep = ", ", 0)...};
+        (void)order;
+        std::cout << ") = " << hw << std::endl;
+
+        R expect = sw(args...);
+        if (hw != expect) {
+            std::cout << "    S/W Result: " << expect << std::endl;
+            _rc = 1;
+        }
+    }
+
+    /// Nonzero if any check failed
+    int rc() const {
+        return _rc;
+    }
+};
+
+#endif // __LLPM_TESTS_VERILATOR_HARNESS_HPP__
@@ -0,0 +1,9 @@
+int simple(int a, int b) {
+    int i;
+    int acc = 0;
+    for (i=1; i<=b; i++) {
+        acc += (a * i) / (i + 2);
+        acc ^= a % i;
+    }
+    return acc;
+}
@@ -0,0 +1,19 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+int simple_sw(int a, int b) {
+    int i;
+    int acc = 0;
+    for (i=1; i<=b; i++) {
+        acc += (a * i) / (i + 2);
+        acc ^= a % i;
+    }
+    return acc;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (int a=-20; a<=20; a+=7)
+        h.check(simple_sw, a, 9);
+    return h.rc();
+}
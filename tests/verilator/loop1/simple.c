@@ -0,0 +1,19 @@
+int simple(int a) {
+    int i = 0;
+    unsigned j;
+    unsigned acc = 0;
+    unsigned x = a;
+    unsigned n = (a & 31) + 1;
+    // A plain for loop. LLVMTranslator::optimize rotates it, so its
+    // body branches back to itself. The trip count isn't a constant, so
+    // it isn't unrolled away either.
+    for (j = 0; j < n; j++)
+        x = x * 3 + (j ^ a);
+    // A do/while body branches back to itself without rotation
+    do {
+        x = x * 5 + i;
+        acc += x ^ (a * i);
+        i++;
+    } while (i < 100);
+    return acc;
+}
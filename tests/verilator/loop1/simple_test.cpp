@@ -0,0 +1,24 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+int simple_sw(int a) {
+    int i = 0;
+    unsigned acc = 0;
+    unsigned x = a;
+    unsigned n = (a & 31) + 1;
+    for (unsigned j = 0; j < n; j++)
+        x = x * 3 + (j ^ a);
+    do {
+        x = x * 5 + i;
+        acc += x ^ (a * i);
+        i++;
+    } while (i < 100);
+    return acc;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (int a=-300; a<=300; a+=77)
+        h.check(simple_sw, a);
+    return h.rc();
+}
@@ -0,0 +1,7 @@
+int simple(int a) {
+    int i;
+    int acc = 0;
+    for (i=0; i<100; i++)
+        acc += a ^ i;
+    return acc;
+}
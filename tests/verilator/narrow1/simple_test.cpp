@@ -0,0 +1,17 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+int simple_sw(int a) {
+    int i;
+    int acc = 0;
+    for (i=0; i<100; i++)
+        acc += a ^ i;
+    return acc;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (int a=-300; a<=300; a+=77)
+        h.check(simple_sw, a);
+    return h.rc();
+}
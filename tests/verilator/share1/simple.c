@@ -0,0 +1,8 @@
+long simple(long a, long b) {
+    long r;
+    if (a & 1)
+        r = a * b;
+    else
+        r = (a + 3) * (b - 1);
+    return r / 5;
+}
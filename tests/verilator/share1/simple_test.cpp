@@ -0,0 +1,18 @@
+#include "simple.hpp"
+#include "harness.hpp"
+
+long simple_sw(long a, long b) {
+    long r;
+    if (a & 1)
+        r = a * b;
+    else
+        r = (a + 3) * (b - 1);
+    return r / 5;
+}
+
+int main(void) {
+    Harness<simple> h;
+    for (long a=-4; a<12; a++)
+        h.check(simple_sw, a, 11 - a);
+    return h.rc();
+}
@@ -0,0 +1,55 @@
+# Rules shared by the tests which build simple.c again with extra
+# llvm2verilog options and check that the result still computes what
+# the default flow does. Before including this file, a test sets
+# VARIANTS to the variant names and FLAGS_<name> to each one's options.
+# Variant <name> is built in obj_<name>, with its output in <name>.log.
+# "make variants" diffs every variant's simulation against the default.
+
+CFLAGS=-O0
+CXXFLAGS=${CFLAGS} -std=c++11 -I..
+CXX=../../../bin/llvm/bin/clang++
+OPTS=-mem2reg -dce -constprop -die -mergereturn -simplifycfg -loop-simplify
+LLVM2VERILOG=../../../bin/llvm2verilog
+
+# Logs are written through tee, which mustn't hide a failed llvm2verilog
+SHELL=/bin/bash
+.SHELLFLAGS=-o pipefail -c
+
+default: check
+
+obj/simple.hpp: simple.bc ${LLVM2VERILOG}
+	${LLVM2VERILOG} simple.bc simple
+
+obj_%/simple.hpp: simple.bc ${LLVM2VERILOG}
+	${LLVM2VERILOG} simple.bc simple --workdir obj_$* ${FLAGS_$*} \
+		| tee $*.log
+
+# The harness against the simple.hpp and software model in directory %
+%/simple_test: %/simple.hpp simple_test.cpp
+	${CXX} -c -emit-llvm ${CXXFLAGS} -I$* simple_test.cpp \
+		-o $*/simple_test.cpp.bc
+	${CXX} -o $@ $*/simple_test.cpp.bc $*/simple_sw.bc
+
+# Results go to stdout and cycle counts to stderr, so only the results
+# get compared
+default.out: obj/simple_test
+	obj/simple_test > $@
+
+%.out: obj_%/simple_test
+	obj_$*/simple_test > $@
+
+variants: default.out $(patsubst %,%.out,${VARIANTS})
+	for v in ${VARIANTS}; do \
+		diff -u default.out $$v.out || exit 1; \
+	done
+
+%.bc: %.c
+	clang -c -emit-llvm ${CFLAGS} $< -o $@.tmp
+	opt ${OPTS} $@.tmp -o $@
+	llvm-dis-3.4 $@
+
+clean:
+	rm -rf *.bc *.ll *.tmp *.out *.log obj obj_* ${CLEAN}
+
+.PHONY: default check variants clean
+.SECONDARY:
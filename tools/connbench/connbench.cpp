@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include <llpm/connection.hpp>
+#include <libraries/core/comm_intr.hpp>
+#include <util/files.hpp>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/DerivedTypes.h>
+
+/**
+ * Microbenchmark for the ConnectionDB storage engines. Builds the same
+ * synthetic graph with each engine and times construction, lookups,
+ * refinement-style edge churn and teardown.
+ */
+
+using namespace llpm;
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+struct Results {
+    double build;
+    double query;
+    double churn;
+    double teardown;
+    uint64_t checksum;
+};
+
+static Results run(ConnectionDB::Storage storage,
+                   llvm::Type* ty,
+                   const vector<unsigned>& drivers,
+                   unsigned rounds,
+                   unsigned churn) {
+    Results r;
+    r.checksum = 0;
+    vector<BlockP> blocks;
+    blocks.reserve(drivers.size());
+    for (unsigned i=0; i<drivers.size(); i++)
+        blocks.push_back(new Identity(ty));
+
+    ConnectionDB conns(NULL, storage);
+
+    // Build: each block is driven by some earlier block, giving a
+    // random tree with a realistic fanout distribution
+    auto start = Clock::now();
+    for (unsigned i=1; i<drivers.size(); i++) {
+        Identity* src = blocks[drivers[i]]->as<Identity>();
+        Identity* dst = blocks[i]->as<Identity>();
+        conns.connect(src->dout(), dst->din());
+    }
+    r.build = msSince(start);
+
+    // Query: what every pass does over and over
+    start = Clock::now();
+    vector<InputPort*> sinks;
+    for (unsigned round=0; round<rounds; round++) {
+        for (auto& b: blocks) {
+            Identity* id = b->as<Identity>();
+            if (conns.findSource(id->din()) != NULL)
+                r.checksum++;
+            sinks.clear();
+            conns.findSinks(id->dout(), sinks);
+            r.checksum += sinks.size();
+            r.checksum += conns.countSinks(id->dout());
+        }
+    }
+    r.query = msSince(start);
+
+    // Churn: insert a new block in front of some inputs, the way
+    // refinement and pipelining do
+    start = Clock::now();
+    for (unsigned i=0; i<churn; i++) {
+        unsigned idx = 1 + (i * 7919) % (drivers.size() - 1);
+        Identity* dst = blocks[idx]->as<Identity>();
+        OutputPort* src = conns.findSource(dst->din());
+        Identity* mid = new Identity(ty);
+        blocks.push_back(mid);
+        conns.disconnect(src, dst->din());
+        conns.connect(src, mid->din());
+        conns.connect(mid->dout(), dst->din());
+    }
+    r.checksum += conns.numConnections();
+    r.churn = msSince(start);
+
+    start = Clock::now();
+    for (auto& b: blocks)
+        conns.removeBlock(b.get());
+    r.teardown = msSince(start);
+    r.checksum += conns.numConnections();
+    return r;
+}
+
+int main(int argc, const char** argv) {
+    unsigned numBlocks, rounds, churn, seed;
+
+    po::options_description desc("ConnectionDB benchmark options");
+    desc.add_options()
+        ("help", "Show this output")
+        ("blocks,n", po::value<unsigned>(&numBlocks)->default_value(100000),
+            "Number of blocks in the synthetic graph")
+        ("rounds,r", po::value<unsigned>(&rounds)->default_value(10),
+            "Number of full-graph lookup rounds")
+        ("churn,c", po::value<unsigned>(&churn)->default_value(20000),
+            "Number of edge splits to perform")
+        ("seed,s", po::value<unsigned>(&seed)->default_value(1),
+            "Random seed for the graph shape")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help")) {
+        cout << desc << "\n";
+        return 1;
+    }
+    if (numBlocks < 2) {
+        fprintf(stderr, "Need at least two blocks\n");
+        return 1;
+    }
+
+    srand(seed);
+    vector<unsigned> drivers(numBlocks, 0);
+    for (unsigned i=1; i<numBlocks; i++)
+        drivers[i] = rand() % i;
+
+    llvm::LLVMContext ctxt;
+    llvm::Type* ty = llvm::Type::getInt32Ty(ctxt);
+
+    printf("%u blocks, %u lookup rounds, %u edge splits\n",
+           numBlocks, rounds, churn);
+    printf("%-8s %10s %10s %10s %10s\n",
+           "storage", "build ms", "query ms", "churn ms", "teardown ms");
+
+    const char* names[] = {"hashed", "dense"};
+    ConnectionDB::Storage engines[] = {ConnectionDB::Storage::Hashed,
+                                       ConnectionDB::Storage::Dense};
+    uint64_t checksum = 0;
+    for (unsigned e=0; e<2; e++) {
+        Results r = run(engines[e], ty, drivers, rounds, churn);
+        printf("%-8s %10.2f %10.2f %10.2f %10.2f\n",
+               names[e], r.build, r.query, r.churn, r.teardown);
+        if (e > 0 && r.checksum != checksum) {
+            fprintf(stderr, "ERROR: storage engines disagree!\n");
+            return 1;
+        }
+        checksum = r.checksum;
+    }
+    return 0;
+}
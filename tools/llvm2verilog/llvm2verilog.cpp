@@ -5,6 +5,7 @@
 #include <llpm/design.hpp>
 #include <llpm/module.hpp>
 #include <llpm/control_region.hpp>
+#include <llpm/checkpoint.hpp>
 #include <libraries/core/std_library.hpp>
 #include <frontends/llvm/translate.hpp>
 #include <refinery/refinery.hpp>
@@ -28,15 +29,20 @@ int main(int argc, const char** argv) {
         Design d;
         LLVMTranslator trans(d);
 
-        string inputFN, modName;
+        string inputFN, modName, saveElab, loadElab;
 
         po::options_description desc("CPPHDL Options");
         desc.add_options()
             ("help", "Show this output")
-            ("input,i", po::value<string>(&inputFN)->required(),
+            ("input,i", po::value<string>(&inputFN),
                   "Filename of input bitcode")
-            ("module,m", po::value<string>(&modName)->required(),
+            ("module,m", po::value<string>(&modName),
                   "Name of top module")
+            ("save-elab", po::value<string>(&saveElab),
+                  "Save the elaborated design to this file and stop")
+            ("load-elab", po::value<string>(&loadElab),
+                  "Start from a design saved with --save-elab instead "
+                  "of bitcode")
         ;
         po::positional_options_description pd;
         pd.add("input", 1)
@@ -57,11 +63,24 @@ int main(int argc, const char** argv) {
         po::notify(vm);
         d.notify(vm);
 
-        trans.readBitcode(inputFN);
-        trans.prepare(modName);
-        trans.translate();
-        auto m = trans.get(modName);
-        d.addModule(m);
+        if (loadElab != "") {
+            if (saveElab != "")
+                throw InvalidArgument(
+                    "--save-elab and --load-elab cannot be used together");
+            Checkpoint::Load(d, loadElab);
+        } else {
+            if (inputFN == "" || modName == "") {
+                fprintf(stderr, "Input bitcode and top module name are "
+                                "required unless using --load-elab\n");
+                cout << desc << "\n";
+                return 1;
+            }
+            trans.readBitcode(inputFN);
+            trans.prepare(modName);
+            trans.translate();
+            trans.addModule(modName);
+            d.saveElab(saveElab);
+        }
 
         return d.go();
     } catch (Exception& e) {